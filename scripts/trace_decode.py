@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+
+# This script decodes a dump of the kernel's trace buffers and prints the events as a timeline.
+#
+# The kernel dumps its trace buffers on COM2 when it stops, if events have been enabled with the
+# `-trace` command line argument (for example `-trace all` or `-trace sched_switch,page_fault`).
+# With QEMU, the dump can be retrieved with:
+#   qemu-system-i386 -cdrom maestro.iso -serial stdio -serial file:trace.bin
+#
+# Usage: trace_decode.py <dump>
+
+import struct
+import sys
+
+MAGIC = b'MTRC'
+VERSION = 1
+RECORD_FORMAT = '<QHBB5I'
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.off = 0
+
+    def read(self, fmt):
+        values = struct.unpack_from('<' + fmt, self.data, self.off)
+        self.off += struct.calcsize('<' + fmt)
+        return values if len(values) > 1 else values[0]
+
+    def read_str(self, length):
+        s = self.data[self.off:self.off + length].decode('ascii')
+        self.off += length
+        return s
+
+
+def decode(data):
+    # The dump may be preceded by other data written on the port
+    off = data.find(MAGIC)
+    if off < 0:
+        sys.exit('No trace dump found')
+    r = Reader(data[off + len(MAGIC):])
+
+    version = r.read('I')
+    if version != VERSION:
+        sys.exit('Unsupported dump version: {}'.format(version))
+    frequency = r.read('Q')
+
+    events = {}
+    for _ in range(r.read('H')):
+        event_id = r.read('H')
+        name = r.read_str(r.read('B'))
+        fields = []
+        for _ in range(r.read('B')):
+            kind, length = r.read('BB')
+            fields.append((kind, r.read_str(length)))
+        events[event_id] = (name, fields)
+
+    records = []
+    for _ in range(r.read('H')):
+        for _ in range(r.read('I')):
+            records.append(struct.unpack_from(RECORD_FORMAT, r.data, r.off))
+            r.off += RECORD_SIZE
+
+    return frequency, events, records
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('usage: {} <dump>'.format(sys.argv[0]))
+    with open(sys.argv[1], 'rb') as f:
+        frequency, events, records = decode(f.read())
+
+    records.sort(key=lambda r: r[0])
+    if not records:
+        return
+    begin = records[0][0]
+
+    for tsc, event_id, core, args_count, *args in records:
+        if frequency != 0:
+            time = '{:>14.3f}us'.format((tsc - begin) * 1000000 / frequency)
+        else:
+            time = '{:>16}'.format(tsc - begin)
+        name, fields = events.get(event_id, ('event_{}'.format(event_id), []))
+
+        values = []
+        for i, value in enumerate(args[:args_count]):
+            kind, field = fields[i] if i < len(fields) else (0, 'arg{}'.format(i))
+            values.append('{}={}'.format(field, hex(value) if kind == 1 else value))
+
+        print('{} [{}] {:<16} {}'.format(time, core, name, ' '.join(values)))
+
+
+if __name__ == '__main__':
+    main()
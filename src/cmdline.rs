@@ -21,6 +21,9 @@ pub struct ArgsParser {
 
 	/// Whether the kernel boots silently.
 	silent: bool,
+
+	/// The comma-separated list of events to trace, if specified.
+	trace: Option<String>,
 }
 
 /// Structure representing a token in the command line.
@@ -171,6 +174,8 @@ impl ArgsParser {
 			init: None,
 
 			silent: false,
+
+			trace: None,
 		};
 
 		let mut root_specified = false;
@@ -213,6 +218,23 @@ impl ArgsParser {
 					i += 2;
 				},
 
+				"-trace" => {
+					if tokens.len() < i + 2 {
+						let begin = tokens[i].begin;
+						let size = tokens[i].len();
+						return Err(ParseError::new(cmdline, "Not enough arguments for `-trace`",
+							Some((begin, size))));
+					}
+
+					if let Ok(trace) = tokens[i + 1].s.failable_clone() {
+						s.trace = Some(trace);
+					} else {
+						return Err(ParseError::new(cmdline, "Out of memory", None));
+					}
+
+					i += 2;
+				},
+
 				"-silent" => {
 					s.silent = true;
 
@@ -248,6 +270,11 @@ impl ArgsParser {
 	pub fn is_silent(&self) -> bool {
 		self.silent
 	}
+
+	/// Returns the comma-separated list of events to trace if specified.
+	pub fn get_trace_events(&self) -> &Option<String> {
+		&self.trace
+	}
 }
 
 #[cfg(test)]
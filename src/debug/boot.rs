@@ -0,0 +1,76 @@
+//! This module measures the duration of each phase of the kernel's boot.
+//!
+//! The beginning of each phase is timestamped with the TSC. Since the TSC is calibrated during the
+//! boot, timestamps are kept in cycles and converted only when the breakdown is printed.
+
+use crate::time::tsc;
+use crate::time;
+
+/// The maximum number of phases.
+const MAX_PHASES: usize = 16;
+
+/// Structure representing a phase of the boot.
+#[derive(Clone, Copy)]
+struct Phase {
+	/// The name of the phase.
+	name: &'static str,
+	/// The value of the TSC at the beginning of the phase.
+	begin: u64,
+}
+
+/// The phases recorded so far. Since phases are recorded only by the boot core, they don't
+/// require a lock.
+static mut PHASES: [Phase; MAX_PHASES] = [Phase {
+	name: "",
+	begin: 0,
+}; MAX_PHASES];
+/// The number of phases recorded so far.
+static mut PHASES_COUNT: usize = 0;
+
+/// Marks the beginning of the phase with name `name`, which is also the end of the previous one.
+/// If the CPU has no TSC or if too many phases have been recorded, the function does nothing.
+pub fn phase(name: &'static str) {
+	if !tsc::is_present() {
+		return;
+	}
+
+	unsafe { // Safe because only the boot core records phases
+		if PHASES_COUNT < MAX_PHASES {
+			PHASES[PHASES_COUNT] = Phase {
+				name,
+				begin: tsc::read(),
+			};
+			PHASES_COUNT += 1;
+		}
+	}
+}
+
+/// Prints the name and the duration `cycles` of a phase. If the frequency of the TSC is unknown,
+/// the duration is printed in cycles.
+fn print_duration(name: &str, cycles: u64, frequency: Option<u64>) {
+	match frequency {
+		Some(frequency) if frequency > 0 => {
+			crate::println!("{:<16} {:>10} us", name, cycles * 1000000 / frequency);
+		},
+		_ => crate::println!("{:<16} {:>10} cycles", name, cycles),
+	}
+}
+
+/// Ends the last phase and prints the duration of every phases.
+pub fn report() {
+	let phases = unsafe { // Safe because only the boot core records phases
+		&PHASES[..PHASES_COUNT]
+	};
+	if phases.is_empty() {
+		return;
+	}
+	let end = tsc::read();
+	let frequency = time::get_tsc_frequency();
+
+	crate::println!("--- Boot time ---");
+	for (i, p) in phases.iter().enumerate() {
+		let next = phases.get(i + 1).map_or(end, | p | p.begin);
+		print_duration(p.name, next - p.begin, frequency);
+	}
+	print_duration("total", end - phases[0].begin, frequency);
+}
@@ -1,11 +1,30 @@
 //! This module implements debugging tools.
 
+pub mod boot;
+#[cfg(config_debug_profiler)]
+pub mod profiler;
+pub mod trace;
+
 use core::ffi::c_void;
 use core::mem::size_of;
 use crate::elf;
 use crate::memory;
 use crate::multiboot;
 
+/// Returns the name of the kernel function containing the instruction at address `inst`. If no
+/// function is found, the function returns None.
+pub fn get_function_name(inst: *const c_void) -> Option<&'static str> {
+	if elf::symbols::is_ready() {
+		return elf::symbols::get_function_name(inst);
+	}
+
+	// Slow path used before the index is built
+	let boot_info = multiboot::get_boot_info();
+	elf::get_function_name(memory::kern_to_virt(boot_info.elf_sections),
+		boot_info.elf_num as usize, boot_info.elf_shndx as usize,
+		boot_info.elf_entsize as usize, inst)
+}
+
 /// Prints, in hexadecimal, the content of the memory at the given location `ptr`, with the given
 /// size `n` in bytes.
 pub unsafe fn print_memory(ptr: *const c_void, n: usize) {
@@ -48,8 +67,6 @@ pub unsafe fn print_memory(ptr: *const c_void, n: usize) {
 /// function shall print `...` at the end. If the callstack is empty, the function just prints
 /// `Empty`.
 pub fn print_callstack(ebp: *const u32, max_depth: usize) {
-	let boot_info = multiboot::get_boot_info();
-
 	crate::println!("--- Callstack ---");
 
 	let mut i: usize = 0;
@@ -67,9 +84,7 @@ pub fn print_callstack(ebp: *const u32, max_depth: usize) {
 			break;
 		}
 
-		if let Some(name) = elf::get_function_name(memory::kern_to_virt(boot_info.elf_sections),
-			boot_info.elf_num as usize, boot_info.elf_shndx as usize,
-			boot_info.elf_entsize as usize, eip) {
+		if let Some(name) = get_function_name(eip) {
 			crate::println!("{}: {:p} -> {}", i, eip, name);
 		} else {
 			crate::println!("{}: {:p} -> ???", i, eip);
@@ -0,0 +1,327 @@
+//! This module implements a sampling profiler for the kernel.
+//!
+//! At each tick of the timer, the state of the interrupted context is recorded into a ring buffer
+//! belonging to the current CPU core: the instruction pointer, the ring, the PID of the current
+//! process and, for kernel code, the callstack obtained by following the frame pointers.
+//!
+//! Samples are read through the device `/dev/profile`, which returns one line per sample in the
+//! folded stacks format (`frame0;frame1;...;frameN 1`), starting from the root of the callstack.
+//! This output can be fed directly to flame graph tools.
+
+use core::ffi::c_void;
+use core::fmt::Write;
+use core::fmt;
+use core::mem::ManuallyDrop;
+use core::mem::size_of;
+use crate::device::Device;
+use crate::device::DeviceHandle;
+use crate::device::DeviceType;
+use crate::device;
+use crate::errno::Errno;
+use crate::event::InterruptResult;
+use crate::event::InterruptResultAction;
+use crate::event;
+use crate::file::path::Path;
+use crate::memory;
+use crate::process::Process;
+use crate::process::pid::Pid;
+use crate::util::lock::mutex::*;
+use crate::util;
+
+/// The maximum number of CPU cores.
+const CORES_COUNT: usize = 1;
+/// The number of samples each ring buffer can hold.
+const BUFFER_SIZE: usize = 1024;
+/// The maximum depth of a recorded callstack.
+const MAX_DEPTH: usize = 8;
+/// The maximum length of a line returned by the device. Longer lines are truncated.
+const LINE_MAX: usize = 512;
+
+/// The priority of the sampling callback. It must be higher than the scheduler's, which never
+/// returns.
+const CALLBACK_PRIORITY: u32 = 1;
+
+/// The major number of the profiler's device.
+const DEVICE_MAJOR: u32 = 1;
+/// The minor number of the profiler's device.
+const DEVICE_MINOR: u32 = 13;
+
+/// Structure representing a sample.
+#[derive(Clone, Copy)]
+struct Sample {
+	/// The interrupted instruction.
+	eip: u32,
+	/// The ring of the interrupted context.
+	ring: u8,
+	/// The PID of the current process. If zero, no process was running.
+	pid: Pid,
+
+	/// The number of elements in `callstack`.
+	depth: u8,
+	/// The return addresses of the callstack, starting from the innermost frame.
+	callstack: [u32; MAX_DEPTH],
+}
+
+/// Empty sample, used for initialization.
+const EMPTY_SAMPLE: Sample = Sample {
+	eip: 0,
+	ring: 0,
+	pid: 0,
+
+	depth: 0,
+	callstack: [0; MAX_DEPTH],
+};
+
+/// A ring buffer of samples. When full, the oldest samples are overwritten.
+struct SampleBuffer {
+	/// The samples.
+	samples: [Sample; BUFFER_SIZE],
+	/// The index of the oldest sample.
+	read_head: usize,
+	/// The number of samples in the buffer.
+	len: usize,
+	/// The number of samples that have been overwritten before being read.
+	lost: usize,
+}
+
+impl SampleBuffer {
+	/// Creates a new empty buffer.
+	const fn new() -> Self {
+		Self {
+			samples: [EMPTY_SAMPLE; BUFFER_SIZE],
+			read_head: 0,
+			len: 0,
+			lost: 0,
+		}
+	}
+
+	/// Pushes the sample `sample`, overwriting the oldest one if the buffer is full.
+	fn push(&mut self, sample: Sample) {
+		if self.len == BUFFER_SIZE {
+			self.read_head = (self.read_head + 1) % BUFFER_SIZE;
+			self.len -= 1;
+			self.lost += 1;
+		}
+
+		self.samples[(self.read_head + self.len) % BUFFER_SIZE] = sample;
+		self.len += 1;
+	}
+
+	/// Removes the oldest sample and returns it.
+	fn pop(&mut self) -> Option<Sample> {
+		if self.len > 0 {
+			let sample = self.samples[self.read_head];
+			self.read_head = (self.read_head + 1) % BUFFER_SIZE;
+			self.len -= 1;
+
+			Some(sample)
+		} else {
+			None
+		}
+	}
+}
+
+/// An empty buffer, used for initialization.
+const EMPTY_BUFFER: InterruptMutex<SampleBuffer> = InterruptMutex::new(SampleBuffer::new());
+/// The samples buffers, one for each CPU core.
+static mut BUFFERS: [InterruptMutex<SampleBuffer>; CORES_COUNT] = [EMPTY_BUFFER; CORES_COUNT];
+
+/// Returns the buffer of the core with ID `core_id`.
+fn get_buffer(core_id: usize) -> &'static mut InterruptMutex<SampleBuffer> {
+	unsafe { // Safe because using Mutex
+		&mut BUFFERS[core_id]
+	}
+}
+
+/// Fills the callstack of the sample `sample` by following the frame pointers from `ebp`. The
+/// walk stops at the first frame pointer that doesn't point to the kernel's stack.
+fn walk_callstack(sample: &mut Sample, ebp: u32) {
+	let mut ebp = ebp as usize;
+	let mut depth = 0;
+
+	while depth < MAX_DEPTH {
+		if ebp < memory::PROCESS_END as usize || !util::is_aligned(ebp as _, size_of::<u32>())
+			|| ebp.checked_add(2 * size_of::<u32>()).is_none() {
+			break;
+		}
+
+		let (next, eip) = unsafe {
+			let frame = ebp as *const u32;
+			(*frame as usize, *frame.add(1))
+		};
+		if eip == 0 {
+			break;
+		}
+		sample.callstack[depth] = eip;
+		depth += 1;
+
+		// The stack grows downwards, a caller's frame is always above
+		if next <= ebp {
+			break;
+		}
+		ebp = next;
+	}
+
+	sample.depth = depth as _;
+}
+
+/// Records a sample of the context interrupted with registers `regs` in ring `ring`.
+fn sample(regs: &util::Regs, ring: u32) {
+	let mut sample = Sample {
+		eip: regs.eip,
+		ring: ring as _,
+		..EMPTY_SAMPLE
+	};
+
+	if let Some(mut proc) = Process::get_current() {
+		sample.pid = proc.lock().get().get_pid();
+	}
+	if ring < 3 {
+		walk_callstack(&mut sample, regs.ebp);
+	}
+
+	let core_id = 0; // TODO
+	get_buffer(core_id).lock().get_mut().push(sample);
+}
+
+/// Structure allowing to format a line into a fixed-size buffer. Contrary to the logger's, the
+/// writer fails if the buffer is too small.
+struct LineWriter<'a> {
+	/// The buffer.
+	buff: &'a mut [u8],
+	/// The length of the line.
+	len: usize,
+}
+
+impl<'a> fmt::Write for LineWriter<'a> {
+	fn write_str(&mut self, s: &str) -> Result<(), fmt::Error> {
+		if self.len + s.len() > self.buff.len() {
+			return Err(fmt::Error);
+		}
+
+		self.buff[self.len..(self.len + s.len())].copy_from_slice(s.as_bytes());
+		self.len += s.len();
+		Ok(())
+	}
+}
+
+/// Writes the symbol corresponding to the address `addr` with the writer `w`.
+fn write_symbol(w: &mut LineWriter, addr: u32) -> fmt::Result {
+	match super::get_function_name(addr as *const c_void) {
+		Some(name) => write!(w, "{}", name),
+		None => write!(w, "{:#x}", addr),
+	}
+}
+
+/// Formats the sample `sample` as a line in the folded stacks format into the buffer `buff`.
+/// The function returns the length of the line.
+fn format_sample(sample: &Sample, buff: &mut [u8]) -> Result<usize, fmt::Error> {
+	let mut w = LineWriter {
+		buff,
+		len: 0,
+	};
+
+	if sample.pid != 0 {
+		write!(w, "[pid {}]", sample.pid)?;
+	} else {
+		write!(w, "[idle]")?;
+	}
+
+	if sample.ring < 3 {
+		for addr in sample.callstack[..(sample.depth as usize)].iter().rev() {
+			write!(w, ";")?;
+			write_symbol(&mut w, *addr)?;
+		}
+		write!(w, ";")?;
+		write_symbol(&mut w, sample.eip)?;
+	} else {
+		write!(w, ";[user]")?;
+	}
+
+	write!(w, " 1\n")?;
+	Ok(w.len)
+}
+
+/// The device allowing to read the samples. Reading consumes them.
+struct ProfileDeviceHandle {
+	/// A sample removed from its buffer that didn't fit in the reader's buffer. It is returned
+	/// first by the next read.
+	pending: Option<Sample>,
+}
+
+impl DeviceHandle for ProfileDeviceHandle {
+	fn get_size(&self) -> u64 {
+		0
+	}
+
+	fn read(&mut self, _offset: u64, buff: &mut [u8]) -> Result<usize, Errno> {
+		let mut off = 0;
+		let mut line = [0; LINE_MAX];
+
+		for core_id in 0..CORES_COUNT {
+			loop {
+				// The buffer is locked only to remove the sample, since symbolization is slow
+				let sample = match self.pending.take() {
+					Some(sample) => sample,
+					None => match get_buffer(core_id).lock().get_mut().pop() {
+						Some(sample) => sample,
+						None => break,
+					},
+				};
+
+				let len = match format_sample(&sample, &mut line) {
+					Ok(len) => len,
+					// The line is too long, truncating it
+					Err(_) => {
+						line[LINE_MAX - 3..].copy_from_slice(b" 1\n");
+						LINE_MAX
+					},
+				};
+				if off + len > buff.len() {
+					self.pending = Some(sample);
+					return Ok(off);
+				}
+				buff[off..(off + len)].copy_from_slice(&line[..len]);
+				off += len;
+			}
+		}
+
+		Ok(off)
+	}
+
+	fn write(&mut self, _offset: u64, buff: &[u8]) -> Result<usize, Errno> {
+		// Writing discards the samples recorded so far
+		self.pending = None;
+		for core_id in 0..CORES_COUNT {
+			let mut guard = get_buffer(core_id).lock();
+			let buffer = guard.get_mut();
+			buffer.len = 0;
+			buffer.lost = 0;
+		}
+
+		Ok(buff.len())
+	}
+}
+
+/// Returns the number of samples that have been overwritten before being read.
+pub fn get_lost_count() -> usize {
+	(0..CORES_COUNT).map(| i | get_buffer(i).lock().get().lost).sum()
+}
+
+/// Starts the profiler and creates its device.
+pub fn init() -> Result<(), Errno> {
+	let path = Path::from_string("/dev/profile")?;
+	let handle = ProfileDeviceHandle {
+		pending: None,
+	};
+	device::register_device(Device::new(DEVICE_MAJOR, DEVICE_MINOR, path, 0o600,
+		DeviceType::Char, handle)?)?;
+
+	let callback = | _id: u32, _code: u32, regs: &util::Regs, ring: u32 | {
+		sample(regs, ring);
+		InterruptResult::new(false, InterruptResultAction::Resume)
+	};
+	let _ = ManuallyDrop::new(event::register_callback(0x20, CALLBACK_PRIORITY, callback)?);
+
+	Ok(())
+}
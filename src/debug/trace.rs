@@ -0,0 +1,284 @@
+//! This module implements static tracepoints.
+//!
+//! Events are declared at compile time with the names of their fields. A tracepoint is placed in
+//! the code with the `trace` macro. While the event is disabled, the tracepoint costs a single
+//! load and branch.
+//!
+//! Enabled events write fixed-size binary records, timestamped with the TSC, into a ring buffer
+//! belonging to the current CPU core. Since each core only writes to its own buffer with
+//! interrupts disabled, recording doesn't require any lock.
+//!
+//! Events are enabled with the `-trace` command line argument. The buffers are dumped in binary on
+//! the serial port COM2 when the kernel stops. The dump can be decoded with the script
+//! `scripts/trace_decode.py`.
+
+use core::sync::atomic::AtomicBool;
+use core::sync::atomic::AtomicUsize;
+use core::sync::atomic::Ordering;
+use crate::device::serial;
+use crate::idt;
+use crate::time::tsc;
+use crate::time;
+use crate::util::lock::mutex::TMutex;
+
+/// The maximum number of CPU cores.
+const CORES_COUNT: usize = 1;
+/// The number of records each buffer can hold.
+const BUFFER_SIZE: usize = 2048;
+/// The maximum number of fields of an event.
+pub const MAX_FIELDS: usize = 5;
+
+/// The magic number at the beginning of a dump.
+const DUMP_MAGIC: &[u8; 4] = b"MTRC";
+/// The version of the dump format.
+const DUMP_VERSION: u32 = 1;
+/// The serial port on which buffers are dumped.
+const DUMP_PORT: u16 = serial::COM2;
+
+/// A field of an event.
+pub enum Field {
+	/// A field to be displayed in decimal.
+	Dec(&'static str),
+	/// A field to be displayed in hexadecimal.
+	Hex(&'static str),
+}
+
+/// Structure representing an event.
+pub struct Event {
+	/// The identifier of the event, used in records.
+	id: u16,
+	/// The name of the event.
+	name: &'static str,
+	/// The fields of the event.
+	fields: &'static [Field],
+
+	/// Tells whether the event is enabled.
+	enabled: AtomicBool,
+}
+
+impl Event {
+	/// Creates a new event.
+	const fn new(id: u16, name: &'static str, fields: &'static [Field]) -> Self {
+		Self {
+			id,
+			name,
+			fields,
+
+			enabled: AtomicBool::new(false),
+		}
+	}
+
+	/// Tells whether the event is enabled.
+	#[inline(always)]
+	pub fn is_enabled(&self) -> bool {
+		self.enabled.load(Ordering::Relaxed)
+	}
+
+	/// Writes a record of the event with the values of the fields `args`.
+	/// This function should be called only through the `trace` macro.
+	#[cold]
+	#[inline(never)]
+	pub fn record(&self, args: &[u32]) {
+		debug_assert_eq!(args.len(), self.fields.len());
+
+		let mut record = Record {
+			tsc: tsc::read(),
+			event: self.id,
+			core: 0,
+			args_count: args.len() as _,
+			args: [0; MAX_FIELDS],
+		};
+		record.args[..args.len()].copy_from_slice(args);
+
+		let core_id = 0; // TODO
+		record.core = core_id as _;
+		let buffer = unsafe { // Safe because each core only writes to its own buffer
+			&mut BUFFERS[core_id]
+		};
+		buffer.push(record);
+	}
+}
+
+/// Declares the events. Each event is given an identifier, a name and its fields.
+macro_rules! events {
+	($($ident:ident = $id:expr, $name:expr, [$($field:expr),*];)*) => {
+		$(
+			pub static $ident: Event = Event::new($id, $name, &[$($field),*]);
+		)*
+
+		/// The list of all events.
+		static EVENTS: &[&Event] = &[$(&$ident),*];
+	};
+}
+
+events! {
+	SCHED_SWITCH = 0, "sched_switch", [Field::Dec("prev_pid"), Field::Dec("next_pid")];
+	PAGE_FAULT = 1, "page_fault", [Field::Hex("addr"), Field::Hex("code")];
+	BUDDY_ALLOC = 2, "buddy_alloc", [Field::Dec("order"), Field::Hex("ptr")];
+	BUDDY_FREE = 3, "buddy_free", [Field::Dec("order"), Field::Hex("ptr")];
+	SYSCALL_ENTER = 4, "syscall_enter", [Field::Dec("pid"), Field::Dec("id")];
+	SYSCALL_EXIT = 5, "syscall_exit", [Field::Dec("pid"), Field::Dec("id"), Field::Hex("ret")];
+	PATA_SUBMIT = 6, "pata_submit", [Field::Dec("write"), Field::Dec("lba"), Field::Dec("count")];
+	PATA_COMPLETE = 7, "pata_complete", [Field::Dec("write"), Field::Dec("errno")];
+}
+
+/// Places a tracepoint for the given event with the given values of fields. Values are converted
+/// to `u32`.
+#[macro_export]
+macro_rules! trace {
+	($event:expr $(, $arg:expr)* $(,)?) => {{
+		let event = &$event;
+		if event.is_enabled() {
+			event.record(&[$($arg as u32),*]);
+		}
+	}};
+}
+
+/// A record of an event, as stored in buffers and dumped.
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Record {
+	/// The value of the TSC when the event happened.
+	tsc: u64,
+	/// The identifier of the event.
+	event: u16,
+	/// The ID of the CPU core on which the event happened.
+	core: u8,
+	/// The number of fields.
+	args_count: u8,
+	/// The values of the fields.
+	args: [u32; MAX_FIELDS],
+}
+
+/// Empty record, used for initialization.
+const EMPTY_RECORD: Record = Record {
+	tsc: 0,
+	event: 0,
+	core: 0,
+	args_count: 0,
+	args: [0; MAX_FIELDS],
+};
+
+/// A ring buffer of records. When full, the oldest records are overwritten.
+struct TraceBuffer {
+	/// The records.
+	records: [Record; BUFFER_SIZE],
+	/// The total number of records written since boot.
+	head: AtomicUsize,
+}
+
+impl TraceBuffer {
+	/// Creates a new empty buffer.
+	const fn new() -> Self {
+		Self {
+			records: [EMPTY_RECORD; BUFFER_SIZE],
+			head: AtomicUsize::new(0),
+		}
+	}
+
+	/// Pushes the record `record`. The buffer must belong to the current core.
+	fn push(&mut self, record: Record) {
+		idt::wrap_disable_interrupts(|| {
+			let head = self.head.load(Ordering::Relaxed);
+			self.records[head % BUFFER_SIZE] = record;
+			self.head.store(head.wrapping_add(1), Ordering::Release);
+		});
+	}
+}
+
+/// An empty buffer, used for initialization.
+const EMPTY_BUFFER: TraceBuffer = TraceBuffer::new();
+/// The trace buffers, one for each CPU core.
+static mut BUFFERS: [TraceBuffer; CORES_COUNT] = [EMPTY_BUFFER; CORES_COUNT];
+
+/// Tells whether at least one event has been enabled.
+static ENABLED: AtomicBool = AtomicBool::new(false);
+
+/// Enables the events whose names are in the comma-separated list `list`. If the list is `all`,
+/// every events are enabled. Since records are timestamped with the TSC, events are not enabled
+/// if the TSC is not available.
+/// If an event doesn't exist, the function returns its name.
+pub fn enable(list: &str) -> Result<(), &str> {
+	if time::get_tsc_frequency().is_none() {
+		return Ok(());
+	}
+
+	for name in list.split(',') {
+		if name == "all" {
+			EVENTS.iter().for_each(| e | e.enabled.store(true, Ordering::Relaxed));
+		} else {
+			let event = EVENTS.iter().find(| e | e.name == name).ok_or(name)?;
+			event.enabled.store(true, Ordering::Relaxed);
+		}
+	}
+
+	ENABLED.store(true, Ordering::Relaxed);
+	Ok(())
+}
+
+/// Dumps the content of the trace buffers on the serial port. If no event has been enabled, or if
+/// the port doesn't exist or is already locked, the function does nothing.
+///
+/// The dump is made of, in little endian:
+/// - the magic number and the version of the format
+/// - the frequency of the TSC (`u64`)
+/// - the number of events (`u16`), then for each: its identifier (`u16`), the length of its name
+/// (`u8`), its name, its number of fields (`u8`) then for each field: its kind (`u8`, `0` for
+/// decimal and `1` for hexadecimal), the length of its name (`u8`) and its name
+/// - the number of buffers (`u16`), then for each: the number of records (`u32`) followed by the
+/// records, from the oldest to the newest
+pub fn dump() {
+	if !ENABLED.load(Ordering::Relaxed) {
+		return;
+	}
+	// The port may have been locked by the code interrupted by the panic
+	let mut guard = match serial::get(DUMP_PORT).and_then(| s | s.try_lock()) {
+		Some(g) => g,
+		None => return,
+	};
+	let serial = guard.get_mut();
+
+	serial.write(DUMP_MAGIC);
+	serial.write(&DUMP_VERSION.to_le_bytes());
+	serial.write(&time::get_tsc_frequency().unwrap_or(0).to_le_bytes());
+
+	serial.write(&(EVENTS.len() as u16).to_le_bytes());
+	for e in EVENTS {
+		serial.write(&e.id.to_le_bytes());
+		serial.write(&[e.name.len() as u8]);
+		serial.write(e.name.as_bytes());
+		serial.write(&[e.fields.len() as u8]);
+
+		for f in e.fields {
+			let (kind, name) = match f {
+				Field::Dec(name) => (0, name),
+				Field::Hex(name) => (1, name),
+			};
+			serial.write(&[kind, name.len() as u8]);
+			serial.write(name.as_bytes());
+		}
+	}
+
+	serial.write(&(CORES_COUNT as u16).to_le_bytes());
+	for core_id in 0..CORES_COUNT {
+		let buffer = unsafe { // Safe because interrupts are disabled when the kernel stops
+			&BUFFERS[core_id]
+		};
+
+		let head = buffer.head.load(Ordering::Acquire);
+		let count = head.min(BUFFER_SIZE);
+		serial.write(&(count as u32).to_le_bytes());
+
+		for i in (head - count)..head {
+			let r = &buffer.records[i % BUFFER_SIZE];
+			serial.write(&r.tsc.to_le_bytes());
+			serial.write(&r.event.to_le_bytes());
+			serial.write(&[r.core, r.args_count]);
+			for a in r.args.iter() {
+				serial.write(&a.to_le_bytes());
+			}
+		}
+	}
+
+	serial.flush();
+}
@@ -28,7 +28,7 @@ pub trait Bus {
 
 /// Detects internal buses and registers them.
 pub fn detect() -> Result<(), Errno> {
-	let mut pci_manager = pci::PCIManager {};
+	let mut pci_manager = pci::PCIManager::new();
 	let devices = pci_manager.scan();
 
 	// TODO Move into PCI scan itself?
@@ -12,12 +12,30 @@ const CONFIG_ADDRESS_PORT: u16 = 0xcf8;
 /// The port used to retrieve the devices informations.
 const CONFIG_DATA_PORT: u16 = 0xcfc;
 
+/// The number of buses.
+const BUSES_COUNT: usize = 256;
+/// The number of devices on a bus.
+const DEVICES_PER_BUS: u8 = 32;
+/// The number of functions of a device.
+const FUNCTIONS_PER_DEVICE: u8 = 8;
+/// The bit of the header type telling that the device has several functions.
+const HEADER_TYPE_MULTIFUNCTION: u8 = 0x80;
+/// The class code of bridges.
+const CLASS_BRIDGE: u8 = 0x06;
+/// The subclass code of PCI-to-PCI bridges.
+const SUBCLASS_PCI_BRIDGE: u8 = 0x04;
+/// The offset in the configuration space of a PCI-to-PCI bridge of the word containing the
+/// number of its secondary bus.
+const SECONDARY_BUS_OFFSET: u8 = 0x18;
+
 /// Structure representing a device attached to the PCI bus.
 pub struct PCIDevice {
 	/// The PCI bus of the device.
 	bus: u8,
 	/// The offset of the device on the bus.
 	device: u8,
+	/// The function of the device.
+	func: u8,
 
 	/// The device's ID.
 	device_id: u16,
@@ -47,23 +65,24 @@ pub struct PCIDevice {
 }
 
 impl PCIDevice {
-	/// Checks if a device exists on the given bus `bus` and device id `device` and returns an
-	/// instance for it if so.
+	/// Checks if a device exists on the given bus `bus`, device id `device` and function `func`
+	/// and returns an instance for it if so.
 	/// If no device is present at this location, the function returns None.
-	fn new(manager: &mut PCIManager, bus: u8, device: u8) -> Option<Self> {
-		let first_word = manager.read_word(bus, device, 0, 0);
+	fn new(manager: &PCIManager, bus: u8, device: u8, func: u8) -> Option<Self> {
+		let first_word = manager.read_word(bus, device, func, 0);
 		let vendor_id = (first_word & 0xffff) as u16;
 		if vendor_id != 0xffff {
 			let device_id = ((first_word >> 16) & 0xffff) as u16;
 			let mut data: [u32; 16] = [0; 16];
 			data[0] = first_word;
 			for (i, d) in data.iter_mut().enumerate().skip(1) {
-				*d = manager.read_word(bus, device, 0, (i * 4) as _);
+				*d = manager.read_word(bus, device, func, (i * 4) as _);
 			}
 
 			Some(Self {
 				bus,
 				device,
+				func,
 
 				vendor_id,
 				device_id,
@@ -106,6 +125,17 @@ impl PCIDevice {
 		self.subclass
 	}
 
+	/// Tells whether the device has several functions. This is only meaningful for function 0.
+	pub fn is_multifunction(&self) -> bool {
+		self.header_type & HEADER_TYPE_MULTIFUNCTION != 0
+	}
+
+	/// Tells whether the device is a bridge to another PCI bus.
+	pub fn is_pci_bridge(&self) -> bool {
+		self.class == CLASS_BRIDGE && self.subclass == SUBCLASS_PCI_BRIDGE
+			&& self.header_type & 0x7f == 0x01
+	}
+
 	// TODO
 }
 
@@ -132,7 +162,10 @@ impl PhysicalDevice for PCIDevice {
 }
 
 /// Structure representing the PCI manager.
-pub struct PCIManager {}
+pub struct PCIManager {
+	/// The devices found by the scan. If None, the bus hasn't been scanned yet.
+	devices: Option<Vec<PCIDevice>>,
+}
 
 /// Trait representing a bus.
 impl Bus for PCIManager {
@@ -146,6 +179,15 @@ impl Bus for PCIManager {
 }
 
 impl PCIManager {
+	/// Creates a new instance.
+	pub fn new() -> Self {
+		Self {
+			devices: None,
+		}
+	}
+
+	/// Reads the word at offset `off` in the configuration space of the function `func` of the
+	/// device `device` on the bus `bus`.
 	fn read_word(&self, bus: u8, device: u8, func: u8, off: u8) -> u32 {
 		let addr = ((bus as u32) << 16) | ((device as u32) << 11) | ((func as u32) << 8)
 			| ((off as u32) & 0xfc) | 0x80000000;
@@ -155,23 +197,80 @@ impl PCIManager {
 		}
 	}
 
-	// TODO Cache devices?
-	/// Scans for PCI devices and returns the list.
-	pub fn scan(&mut self) -> Vec<PCIDevice> {
-		let mut devices = Vec::new();
+	/// Pushes the device `dev` into `devices`. If the device is a PCI-to-PCI bridge, the bus
+	/// behind it is scanned.
+	/// `scanned` tells which buses have already been scanned.
+	fn add_device(&self, dev: PCIDevice, devices: &mut Vec<PCIDevice>,
+		scanned: &mut [bool; BUSES_COUNT]) {
+		let secondary_bus = if dev.is_pci_bridge() {
+			let word = self.read_word(dev.bus, dev.device, dev.func, SECONDARY_BUS_OFFSET);
+			Some(((word >> 8) & 0xff) as u8)
+		} else {
+			None
+		};
+
+		if devices.push(dev).is_err() {
+			crate::kernel_panic!("No enough memory to scan PCI devices!");
+		}
+
+		if let Some(secondary_bus) = secondary_bus {
+			self.scan_bus(secondary_bus, devices, scanned);
+		}
+	}
+
+	/// Scans the bus `bus` and pushes the devices found on it into `devices`. Buses behind
+	/// PCI-to-PCI bridges are scanned recursively, so that only the buses that exist are probed.
+	/// `scanned` tells which buses have already been scanned, which prevents loops on broken
+	/// configurations.
+	fn scan_bus(&self, bus: u8, devices: &mut Vec<PCIDevice>, scanned: &mut [bool; BUSES_COUNT]) {
+		if scanned[bus as usize] {
+			return;
+		}
+		scanned[bus as usize] = true;
+
+		for device in 0..DEVICES_PER_BUS {
+			let dev = match PCIDevice::new(self, bus, device, 0) {
+				Some(dev) => dev,
+				None => continue,
+			};
+			let multifunction = dev.is_multifunction();
+			self.add_device(dev, devices, scanned);
+
+			// Functions other than 0 may exist only on multi-function devices
+			if multifunction {
+				for func in 1..FUNCTIONS_PER_DEVICE {
+					if let Some(dev) = PCIDevice::new(self, bus, device, func) {
+						self.add_device(dev, devices, scanned);
+					}
+				}
+			}
+		}
+	}
 
-		for bus in 0..=255 {
-			for device in 0..32 {
-				if let Some(dev) = PCIDevice::new(self, bus, device) {
-					if devices.push(dev).is_err() {
-						crate::kernel_panic!("No enough memory to scan PCI devices!");
+	/// Scans for PCI devices and returns the list. Since the PCI bus isn't hotplug, the scan is
+	/// performed only on the first call and the devices are kept for subsequent calls.
+	pub fn scan(&mut self) -> &[PCIDevice] {
+		if self.devices.is_none() {
+			let mut devices = Vec::new();
+			let mut scanned = [false; BUSES_COUNT];
+
+			// If the host controller is a multi-function device, each of its functions is the
+			// host controller of the root bus with the same number
+			let multifunction = PCIDevice::new(self, 0, 0, 0)
+				.map_or(false, | dev | dev.is_multifunction());
+			if multifunction {
+				for func in 0..FUNCTIONS_PER_DEVICE {
+					if PCIDevice::new(self, 0, 0, func).is_some() {
+						self.scan_bus(func, &mut devices, &mut scanned);
 					}
-				} else {
-					break;
 				}
+			} else {
+				self.scan_bus(0, &mut devices, &mut scanned);
 			}
+
+			self.devices = Some(devices);
 		}
 
-		devices
+		self.devices.as_ref().unwrap().as_slice()
 	}
 }
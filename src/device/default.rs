@@ -1,14 +1,19 @@
 //! This module implements default devices.
 
 use core::cmp::min;
+use core::fmt;
 use core::mem::ManuallyDrop;
 use crate::device::Device;
 use crate::device::DeviceHandle;
 use crate::device;
 use crate::errno::Errno;
+use crate::errno;
 use crate::file::path::Path;
 use crate::logger;
+use crate::memory::stats;
 use crate::tty;
+#[cfg(config_debug_lock_profiler)]
+use crate::util::lock::profiler;
 use crate::util::lock::mutex::MutexGuard;
 use crate::util::lock::mutex::TMutex;
 use super::DeviceType;
@@ -81,6 +86,90 @@ impl DeviceHandle for KMsgDeviceHandle {
 	}
 }
 
+/// Structure allowing to write formatted text into a buffer, skipping the text before the offset
+/// `offset`. This allows to read text generated on the fly from any offset.
+struct OffsetWriter<'a> {
+	/// The buffer.
+	buff: &'a mut [u8],
+	/// The offset in the text of the beginning of the buffer.
+	offset: usize,
+	/// The length of the text written so far, including the skipped part.
+	pos: usize,
+}
+
+impl<'a> fmt::Write for OffsetWriter<'a> {
+	fn write_str(&mut self, s: &str) -> fmt::Result {
+		let begin = self.pos;
+		let end = self.pos + s.len();
+		self.pos = end;
+
+		// Copying the part of the string that is inside of the buffer
+		let buff_end = self.offset + self.buff.len();
+		if end > self.offset && begin < buff_end {
+			let copy_begin = begin.max(self.offset);
+			let copy_end = end.min(buff_end);
+			self.buff[(copy_begin - self.offset)..(copy_end - self.offset)]
+				.copy_from_slice(&s.as_bytes()[(copy_begin - begin)..(copy_end - begin)]);
+		}
+
+		Ok(())
+	}
+}
+
+/// Structure representing the statistics on memory.
+pub struct MemInfoDeviceHandle {}
+
+impl DeviceHandle for MemInfoDeviceHandle {
+	fn get_size(&self) -> u64 {
+		0
+	}
+
+	fn read(&mut self, offset: u64, buff: &mut [u8]) -> Result<usize, Errno> {
+		let mut w = OffsetWriter {
+			buff,
+			offset: offset as _,
+			pos: 0,
+		};
+		// Cannot fail since the writer doesn't fail
+		let _ = stats::write(&mut w);
+
+		Ok(w.pos.saturating_sub(w.offset).min(w.buff.len()))
+	}
+
+	fn write(&mut self, _offset: u64, _buff: &[u8]) -> Result<usize, Errno> {
+		Err(errno::EINVAL)
+	}
+}
+
+/// Structure representing the statistics on the contention of mutexes. Writing to the device
+/// resets the statistics.
+#[cfg(config_debug_lock_profiler)]
+pub struct LockStatDeviceHandle {}
+
+#[cfg(config_debug_lock_profiler)]
+impl DeviceHandle for LockStatDeviceHandle {
+	fn get_size(&self) -> u64 {
+		0
+	}
+
+	fn read(&mut self, offset: u64, buff: &mut [u8]) -> Result<usize, Errno> {
+		let mut w = OffsetWriter {
+			buff,
+			offset: offset as _,
+			pos: 0,
+		};
+		// Cannot fail since the writer doesn't fail
+		let _ = profiler::write(&mut w);
+
+		Ok(w.pos.saturating_sub(w.offset).min(w.buff.len()))
+	}
+
+	fn write(&mut self, _offset: u64, buff: &[u8]) -> Result<usize, Errno> {
+		profiler::reset();
+		Ok(buff.len())
+	}
+}
+
 /// Structure representing the current TTY.
 pub struct CurrentTTYDeviceHandle {}
 
@@ -116,6 +205,17 @@ pub fn create() -> Result<(), Errno> {
 	device::register_device(Device::new(1, 11, kmsg_path, 0o600, DeviceType::Char,
 		KMsgDeviceHandle {})?)?;
 
+	let meminfo_path = Path::from_string("/dev/meminfo")?;
+	device::register_device(Device::new(1, 14, meminfo_path, 0o444, DeviceType::Char,
+		MemInfoDeviceHandle {})?)?;
+
+	#[cfg(config_debug_lock_profiler)]
+	{
+		let lockstat_path = Path::from_string("/dev/lockstat")?;
+		device::register_device(Device::new(1, 15, lockstat_path, 0o600, DeviceType::Char,
+			LockStatDeviceHandle {})?)?;
+	}
+
 	let _fifth_major = ManuallyDrop::new(id::alloc_major(DeviceType::Char, Some(5))?);
 
 	let current_tty_path = Path::from_string("/dev/tty")?;
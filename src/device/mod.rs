@@ -263,5 +263,7 @@ pub fn init() -> Result<(), Errno> {
 
 	bus::detect()?;
 
+	serial::init()?;
+
 	Ok(())
 }
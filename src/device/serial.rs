@@ -1,7 +1,21 @@
 //! This module implements Serial port communications.
+//!
+//! Data written to a port is queued into a transmit buffer, which is drained into the UART's FIFO
+//! each time the transmitter holding register becomes empty. Ports are only used for output,
+//! thus received data is discarded.
+//!
+//! Until interrupts are enabled for a port (see `init`), writing is synchronous.
 
+use crate::errno::Errno;
+use crate::event::CallbackHook;
+use crate::event::InterruptResult;
+use crate::event::InterruptResultAction;
+use crate::event;
+use crate::idt::pic;
 use crate::io;
-use crate::util::lock::mutex::Mutex;
+use crate::util::lock::mutex::InterruptMutex;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
 
 /// The offset of COM1 registers.
 pub const COM1: u16 = 0x3f8;
@@ -35,13 +49,38 @@ const SCRATCH_REG_OFF: u16 = 7;
 
 /// Bit of the Interrupt Enable Register telling whether data is available.
 const INTERRUPT_DATA_AVAILABLE: u8 = 0b1;
-/// TODO doc
+/// Bit of the Interrupt Enable Register telling whether the transmitter holding register is
+/// empty.
 const INTERRUPT_TRANSMITTER_EMPTY: u8 = 0b10;
-/// TODO doc
+/// Bit of the Interrupt Enable Register telling whether an error occured on the line.
 const INTERRUPT_ERROR: u8 = 0b100;
-/// TODO doc
+/// Bit of the Interrupt Enable Register telling whether the modem status changed.
 const INTERRUPT_STATUS_CHANGE: u8 = 0b1000;
 
+/// Bit of the Interrupt Identification Register telling that no interrupt is pending.
+const II_NO_INTERRUPT: u8 = 0b1;
+/// Mask of the identifier of the pending interrupt in the Interrupt Identification Register.
+const II_ID_MASK: u8 = 0b1110;
+/// Interrupt identifier: the modem status changed.
+const II_MODEM_STATUS: u8 = 0b0000;
+/// Interrupt identifier: the transmitter holding register is empty.
+const II_TRANSMITTER_EMPTY: u8 = 0b0010;
+/// Interrupt identifier: received data is available.
+const II_DATA_AVAILABLE: u8 = 0b0100;
+/// Interrupt identifier: an error occured on the line.
+const II_LINE_STATUS: u8 = 0b0110;
+/// Interrupt identifier: received data has been waiting in the FIFO for some time.
+const II_TIMEOUT: u8 = 0b1100;
+
+/// Value of the FIFO Control Register: enables and clears the FIFOs, with a receive interrupt
+/// trigger level of 14 bytes.
+const FIFO_CTRL: u8 = 0xc7;
+/// The size of the UART's transmit FIFO in bytes.
+const FIFO_SIZE: usize = 16;
+
+/// The size of the transmit buffer in bytes.
+const TX_BUFFER_SIZE: usize = 4096;
+
 /// The offset of the DLAB bit in the line control register.
 const DLAB: u8 = 1 << 7;
 
@@ -68,10 +107,67 @@ const UART_FREQUENCY: u32 = 115200; // TODO Replace by a rational number?
 
 // TODO Add feature to avoid multiple instances on one port
 
+/// A fixed-size circular buffer of bytes.
+struct RingBuffer<const N: usize> {
+	/// The buffer's data.
+	buff: [u8; N],
+	/// The offset of the next byte to be read.
+	read_head: usize,
+	/// The number of bytes in the buffer.
+	len: usize,
+}
+
+impl<const N: usize> RingBuffer<N> {
+	/// Creates a new empty buffer.
+	const fn new() -> Self {
+		Self {
+			buff: [0; N],
+			read_head: 0,
+			len: 0,
+		}
+	}
+
+	/// Tells whether the buffer is empty.
+	fn is_empty(&self) -> bool {
+		self.len == 0
+	}
+
+	/// Pushes the byte `b` at the end of the buffer. If the buffer is full, the function returns
+	/// `false`.
+	fn push(&mut self, b: u8) -> bool {
+		if self.len >= N {
+			return false;
+		}
+
+		self.buff[(self.read_head + self.len) % N] = b;
+		self.len += 1;
+		true
+	}
+
+	/// Pops the byte at the beginning of the buffer. If the buffer is empty, the function returns
+	/// None.
+	fn pop(&mut self) -> Option<u8> {
+		if self.is_empty() {
+			return None;
+		}
+
+		let b = self.buff[self.read_head];
+		self.read_head = (self.read_head + 1) % N;
+		self.len -= 1;
+		Some(b)
+	}
+}
+
 /// Structure representing a serial communication port.
 pub struct Serial {
 	/// The offset of the port's I/O registers.
 	regs_off: u16,
+
+	/// The data waiting to be transmitted.
+	tx: RingBuffer<TX_BUFFER_SIZE>,
+
+	/// The hook of the port's interrupt callback. If None, the port works in polling mode.
+	interrupt_callback_hook: Option<CallbackHook>,
 }
 
 impl Serial {
@@ -81,7 +177,7 @@ impl Serial {
 			io::outb(self.regs_off + INTERRUPT_REG_OFF, 0x00);
 			self.set_baud_rate(38400);
 			io::outb(self.regs_off + LINE_CTRL_REG_OFF, 0x03);
-			io::outb(self.regs_off + II_FIFO_REG_OFF, 0xc7);
+			io::outb(self.regs_off + II_FIFO_REG_OFF, FIFO_CTRL);
 			io::outb(self.regs_off + MODEM_CTRL_REG_OFF, 0x0b);
 			io::outb(self.regs_off + MODEM_CTRL_REG_OFF, 0x1e);
 			io::outb(self.regs_off + DATA_REG_OFF, 0xae);
@@ -101,6 +197,10 @@ impl Serial {
 	fn from_port(port: u16) -> Option<Serial> {
 		let mut s = Self {
 			regs_off: port,
+
+			tx: RingBuffer::new(),
+
+			interrupt_callback_hook: None,
 		};
 
 		if s.probe() {
@@ -133,22 +233,116 @@ impl Serial {
 		} & LINE_STATUS_THRE) != 0
 	}
 
-	// TODO read
+	/// Sets or clears the bits `bits` of the Interrupt Enable Register according to `enable`.
+	fn set_interrupts(&mut self, bits: u8, enable: bool) {
+		unsafe {
+			let ier = io::inb(self.regs_off + INTERRUPT_REG_OFF);
+			let new = if enable {
+				ier | bits
+			} else {
+				ier & !bits
+			};
+
+			if new != ier {
+				io::outb(self.regs_off + INTERRUPT_REG_OFF, new);
+			}
+		}
+	}
+
+	/// Moves data from the transmit buffer to the UART's FIFO. If the FIFO is not empty, the
+	/// function does nothing.
+	fn fill_fifo(&mut self) {
+		if !self.is_transmit_empty() {
+			return;
+		}
+
+		for _ in 0..FIFO_SIZE {
+			if let Some(b) = self.tx.pop() {
+				unsafe {
+					io::outb(self.regs_off + DATA_REG_OFF, b);
+				}
+			} else {
+				break;
+			}
+		}
+	}
+
+	/// Discards the data received by the UART, which acknowledges the associated interrupt.
+	fn discard_received(&mut self) {
+		while unsafe {
+			io::inb(self.regs_off + LINE_STATUS_REG_OFF)
+		} & LINE_STATUS_DR != 0 {
+			unsafe {
+				io::inb(self.regs_off + DATA_REG_OFF);
+			}
+		}
+	}
 
 	/// Writes the given buffer to the port's output.
+	/// The data is queued and transmitted in background. If the transmit buffer is full, the
+	/// function waits until enough space is available.
 	pub fn write(&mut self, buff: &[u8]) {
 		for b in buff {
+			while !self.tx.push(*b) {
+				while !self.is_transmit_empty() {}
+				self.fill_fifo();
+			}
+		}
+		self.fill_fifo();
+
+		if self.interrupt_callback_hook.is_some() {
+			let pending = !self.tx.is_empty();
+			self.set_interrupts(INTERRUPT_TRANSMITTER_EMPTY, pending);
+		} else {
+			self.flush();
+		}
+	}
+
+	/// Waits until every queued bytes have been handed to the UART.
+	/// This function is useful when interrupts cannot be handled, such as on kernel panic.
+	pub fn flush(&mut self) {
+		while !self.tx.is_empty() {
 			while !self.is_transmit_empty() {}
+			self.fill_fifo();
+		}
+	}
 
-			unsafe {
-				io::outb(self.regs_off + DATA_REG_OFF, *b);
+	/// Handles the interrupts pending on the port.
+	fn handle_interrupt(&mut self) {
+		loop {
+			let ii = unsafe {
+				io::inb(self.regs_off + II_FIFO_REG_OFF)
+			};
+			if ii & II_NO_INTERRUPT != 0 {
+				break;
+			}
+
+			match ii & II_ID_MASK {
+				II_DATA_AVAILABLE | II_TIMEOUT => self.discard_received(),
+
+				II_TRANSMITTER_EMPTY => {
+					self.fill_fifo();
+					if self.tx.is_empty() {
+						self.set_interrupts(INTERRUPT_TRANSMITTER_EMPTY, false);
+					}
+				},
+
+				II_LINE_STATUS => unsafe {
+					io::inb(self.regs_off + LINE_STATUS_REG_OFF);
+				},
+
+				II_MODEM_STATUS => unsafe {
+					io::inb(self.regs_off + MODEM_STATUS_REG_OFF);
+				},
+
+				_ => {},
 			}
 		}
 	}
 }
 
 /// The list of serial ports.
-static mut PORTS: [Option<Mutex<Serial>>; 4] = [
+static mut PORTS: [Option<InterruptMutex<Serial>>; 4] = [
 	None,
 	None,
 	None,
@@ -158,7 +352,7 @@ static mut PORTS: [Option<Mutex<Serial>>; 4] = [
 /// Returns an instance to an object allowing to use the given serial communication port. If the
 /// port is not initialized, the function tries to do it. If the port doesn't exist, the function
 /// returns None.
-pub fn get(port: u16) -> Option<&'static mut Mutex<Serial>> {
+pub fn get(port: u16) -> Option<&'static mut InterruptMutex<Serial>> {
 	let ports = unsafe { // Safe because using Mutex
 		&mut PORTS
 	};
@@ -173,9 +367,64 @@ pub fn get(port: u16) -> Option<&'static mut Mutex<Serial>> {
 	};
 	if ports[i].is_none() {
 		if let Some(s) = Serial::from_port(port) {
-			ports[i] = Some(Mutex::new(s));
+			ports[i] = Some(InterruptMutex::new(s));
 		}
 	}
 
 	ports[i].as_mut()
 }
+
+/// Returns the IRQ line of the given port.
+fn get_irq(port: u16) -> u8 {
+	match port {
+		COM1 | COM3 => 4,
+		_ => 3,
+	}
+}
+
+/// Enables interrupt-driven communications on every existing serial ports.
+/// This function must be called once the events handler has been initialized.
+pub fn init() -> Result<(), Errno> {
+	for port in &[COM1, COM2, COM3, COM4] {
+		let port = *port;
+		let serial = match get(port) {
+			Some(s) => s,
+			None => continue,
+		};
+
+		let irq = get_irq(port);
+		// Ports sharing the same line each have their own callback on the same interrupt
+		let callback = move | _id: u32, _code: u32, _regs: &util::Regs, _ring: u32 | {
+			if let Some(s) = get(port) {
+				s.lock().get_mut().handle_interrupt();
+			}
+
+			InterruptResult::new(false, InterruptResultAction::Resume)
+		};
+
+		let mut guard = serial.lock();
+		let s = guard.get_mut();
+		if s.interrupt_callback_hook.is_none() {
+			let hook = event::register_callback(0x20 + irq as usize, 0, callback)?;
+			s.interrupt_callback_hook = Some(hook);
+		}
+		s.set_interrupts(INTERRUPT_ERROR, true);
+		drop(guard);
+
+		pic::enable_irq(irq);
+	}
+
+	Ok(())
+}
+
+/// Writes the pending data of every serial ports synchronously.
+/// This function is meant to be called on kernel panic. Since the code holding a port's lock may
+/// have been interrupted by the panic, ports that are already locked are skipped instead of
+/// waiting for a lock that would never be released.
+pub fn flush_all() {
+	for port in &[COM1, COM2, COM3, COM4] {
+		if let Some(mut guard) = get(*port).and_then(| s | s.try_lock()) {
+			guard.get_mut().flush();
+		}
+	}
+}
@@ -12,6 +12,7 @@
 //!
 //! TODO
 
+use crate::debug::trace;
 use crate::errno::Errno;
 use crate::errno;
 use crate::io;
@@ -298,8 +299,10 @@ impl PATAInterface {
 		self.send_command(COMMAND_IDENTIFY);
 		self.wait(false);
 
+		// If no controller is connected, the bus is floating and every bits are set, which would
+		// make waiting for the busy flag loop forever
 		let status = self.get_status();
-		if status == 0 {
+		if status == 0 || status == 0xff {
 			return Err("Drive doesn't exist");
 		}
 		self.wait_busy();
@@ -498,11 +501,15 @@ impl StorageInterface for PATAInterface {
 			return Err(errno::EINVAL);
 		}
 
-		if offset < (1 << 29) - 1 {
+		crate::trace!(trace::PATA_SUBMIT, 0, offset, size);
+		let result = if offset < (1 << 29) - 1 {
 			self.read28(buf, offset, size)
 		} else {
 			self.read48(buf, offset, size)
-		}
+		};
+		crate::trace!(trace::PATA_COMPLETE, 0, result.err().unwrap_or(0));
+
+		result
 	}
 
 	fn write(&mut self, buf: &[u8], offset: u64, size: u64) -> Result<(), Errno> {
@@ -510,10 +517,14 @@ impl StorageInterface for PATAInterface {
 			return Err(errno::EINVAL);
 		}
 
-		if offset < (1 << 29) - 1 {
+		crate::trace!(trace::PATA_SUBMIT, 1, offset, size);
+		let result = if offset < (1 << 29) - 1 {
 			self.write28(buf, offset, size)
 		} else {
 			self.write48(buf, offset, size)
-		}
+		};
+		crate::trace!(trace::PATA_COMPLETE, 1, result.err().unwrap_or(0));
+
+		result
 	}
 }
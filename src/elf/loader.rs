@@ -0,0 +1,133 @@
+//! The ELF loader maps the segments of an executable file into a memory space.
+//!
+//! Segments are not read when loading the program. Instead, they are mapped as file-backed
+//! mappings, which are filled from the page cache when a page is accessed for the first time.
+//! Thus, read-only segments of a program are shared between every processes executing it.
+
+use core::ffi::c_void;
+use core::mem::MaybeUninit;
+use core::mem::size_of;
+use core::slice;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::File;
+use crate::memory;
+use crate::process::mem_space::FileBacking;
+use crate::process::mem_space::MAPPING_FLAG_EXEC;
+use crate::process::mem_space::MAPPING_FLAG_USER;
+use crate::process::mem_space::MAPPING_FLAG_WRITE;
+use crate::process::mem_space::MemSpace;
+use crate::util::lock::mutex::TMutex;
+use crate::util::math;
+use crate::util::ptr::SharedPtr;
+use crate::util;
+use super::*;
+
+/// The maximum number of program headers in a file.
+const MAX_PROGRAM_HEADERS: u16 = 256;
+
+/// Reads a structure of type `T` at offset `off` in the file `file`.
+/// If the file is too small to contain the structure, the function returns `ENOEXEC`.
+fn read_struct<T: Copy>(file: &SharedPtr<File>, off: usize) -> Result<T, Errno> {
+	let mut val = MaybeUninit::<T>::uninit();
+	let buff = unsafe { // Safe because the slice covers exactly the structure
+		slice::from_raw_parts_mut(val.as_mut_ptr() as *mut u8, size_of::<T>())
+	};
+
+	let len = file.get_mut().lock().get().read(off, buff)?;
+	if len < size_of::<T>() {
+		return Err(errno::ENOEXEC);
+	}
+
+	Ok(unsafe { // Safe because the structure has been entirely read
+		val.assume_init()
+	})
+}
+
+/// Reads and checks the ELF header of the file `file`. If the file is not an executable for the
+/// current architecture, the function returns `ENOEXEC`.
+fn read_header(file: &SharedPtr<File>) -> Result<ELF32ELFHeader, Errno> {
+	let hdr: ELF32ELFHeader = read_struct(file, 0)?;
+
+	let valid = hdr.e_ident[..ELF_MAGIC.len()] == ELF_MAGIC
+		&& hdr.e_ident[EI_CLASS] == ELFCLASS32
+		&& hdr.e_ident[EI_DATA] == ELFDATA2LSB
+		&& hdr.e_ident[EI_VERSION] == EV_CURRENT
+		&& hdr.e_type == ET_EXEC
+		&& hdr.e_machine == EM_386
+		&& hdr.e_phentsize as usize == size_of::<ELF32ProgramHeader>()
+		&& hdr.e_phnum <= MAX_PROGRAM_HEADERS;
+	if valid {
+		Ok(hdr)
+	} else {
+		Err(errno::ENOEXEC)
+	}
+}
+
+/// Maps the segment described by the program header `phdr` of the file `file` into the memory
+/// space `mem_space`.
+fn map_segment(file: &SharedPtr<File>, phdr: &ELF32ProgramHeader, mem_space: &mut MemSpace)
+	-> Result<(), Errno> {
+	// The segment's data must be located at the same offset in a page in the file and in memory
+	let page_off = phdr.p_vaddr as usize % memory::PAGE_SIZE;
+	if phdr.p_filesz > phdr.p_memsz || phdr.p_offset as usize % memory::PAGE_SIZE != page_off {
+		return Err(errno::ENOEXEC);
+	}
+
+	let end = (phdr.p_vaddr as usize).checked_add(phdr.p_memsz as usize)
+		.ok_or(errno::ENOEXEC)?;
+	if end > memory::PROCESS_END as usize {
+		return Err(errno::ENOEXEC);
+	}
+
+	let begin = util::down_align(phdr.p_vaddr as _, memory::PAGE_SIZE);
+	let pages = math::ceil_division(page_off + phdr.p_memsz as usize, memory::PAGE_SIZE);
+
+	let mut flags = MAPPING_FLAG_USER;
+	if phdr.p_flags & PF_W != 0 {
+		flags |= MAPPING_FLAG_WRITE;
+	}
+	if phdr.p_flags & PF_X != 0 {
+		flags |= MAPPING_FLAG_EXEC;
+	}
+
+	// The part of the segment beyond the file's data (.bss) is filled with zeros
+	let backing = FileBacking {
+		file: file.clone(),
+		off: (phdr.p_offset as usize - page_off) as _,
+		size: page_off + phdr.p_filesz as usize,
+	};
+	mem_space.map_file(begin, pages, flags, backing)?;
+
+	Ok(())
+}
+
+/// Loads the executable file `file` into the memory space `mem_space`, which should be empty.
+/// The function returns the program's entry point.
+/// If the file is not a valid executable, the function returns `ENOEXEC`.
+pub fn load(file: &SharedPtr<File>, mem_space: &mut MemSpace) -> Result<*const c_void, Errno> {
+	let hdr = read_header(file)?;
+
+	let mut loaded = false;
+	for i in 0..(hdr.e_phnum as usize) {
+		let off = hdr.e_phoff as usize + i * size_of::<ELF32ProgramHeader>();
+		let phdr: ELF32ProgramHeader = read_struct(file, off)?;
+
+		match phdr.p_type {
+			PT_LOAD if phdr.p_memsz > 0 => {
+				map_segment(file, &phdr, mem_space)?;
+				loaded = true;
+			},
+
+			// Dynamic linking is not supported
+			PT_INTERP | PT_DYNAMIC => return Err(errno::ENOEXEC),
+
+			_ => {},
+		}
+	}
+
+	if !loaded {
+		return Err(errno::ENOEXEC);
+	}
+	Ok(hdr.e_entry as _)
+}
@@ -2,11 +2,55 @@
 //! systems. This module implements an interface to manipulate this format, including the kernel's
 //! executable itself.
 
+pub mod loader;
+pub mod symbols;
+
 use core::ffi::c_void;
 use core::mem::size_of;
 use crate::memory;
 use crate::util;
 
+/// The magic number at the beginning of every ELF file.
+pub const ELF_MAGIC: [u8; 4] = [0x7f, b'E', b'L', b'F'];
+
+/// Index of the class in the identification array.
+pub const EI_CLASS: usize = 4;
+/// Index of the data encoding in the identification array.
+pub const EI_DATA: usize = 5;
+/// Index of the file version in the identification array.
+pub const EI_VERSION: usize = 6;
+
+/// The file contains 32 bits objects.
+pub const ELFCLASS32: u8 = 1;
+/// The file's data is encoded in little endian.
+pub const ELFDATA2LSB: u8 = 1;
+/// The current version of the ELF format.
+pub const EV_CURRENT: u8 = 1;
+
+/// The file is an executable.
+pub const ET_EXEC: u16 = 2;
+/// The file is a shared object.
+pub const ET_DYN: u16 = 3;
+
+/// The file targets the Intel 80386 architecture.
+pub const EM_386: u16 = 3;
+
+/// The program header entry is unused.
+pub const PT_NULL: u32 = 0;
+/// The segment is loadable.
+pub const PT_LOAD: u32 = 1;
+/// The segment contains informations for dynamic linking.
+pub const PT_DYNAMIC: u32 = 2;
+/// The segment contains the path to the program interpreter.
+pub const PT_INTERP: u32 = 3;
+
+/// The segment is executable.
+pub const PF_X: u32 = 0x1;
+/// The segment is writable.
+pub const PF_W: u32 = 0x2;
+/// The segment is readable.
+pub const PF_R: u32 = 0x4;
+
 /// The section header is inactive.
 pub const SHT_NULL: u32 = 0x00000000;
 /// The section holds information defined by the program.
@@ -93,6 +137,64 @@ pub const STT_HIPROC: u8 = 15;
 /// TODO doc
 type ELF32Addr = u32;
 
+/// Structure representing the header at the beginning of an ELF file.
+#[derive(Clone, Copy, Debug)]
+#[repr(C)]
+pub struct ELF32ELFHeader {
+	/// Identification informations: the magic number, the class, the data encoding and the
+	/// version.
+	pub e_ident: [u8; 16],
+	/// The type of the file.
+	pub e_type: u16,
+	/// The architecture targeted by the file.
+	pub e_machine: u16,
+	/// The version of the file.
+	pub e_version: u32,
+	/// The virtual address of the program's entry point.
+	pub e_entry: ELF32Addr,
+	/// The offset of the program header table in the file.
+	pub e_phoff: u32,
+	/// The offset of the section header table in the file.
+	pub e_shoff: u32,
+	/// Processor-specific flags.
+	pub e_flags: u32,
+	/// The size of the ELF header in bytes.
+	pub e_ehsize: u16,
+	/// The size of an entry of the program header table.
+	pub e_phentsize: u16,
+	/// The number of entries in the program header table.
+	pub e_phnum: u16,
+	/// The size of an entry of the section header table.
+	pub e_shentsize: u16,
+	/// The number of entries in the section header table.
+	pub e_shnum: u16,
+	/// The index of the section containing section names.
+	pub e_shstrndx: u16,
+}
+
+/// Structure representing an ELF program header, describing a segment.
+#[derive(Clone, Copy, Debug)]
+#[repr(C)]
+pub struct ELF32ProgramHeader {
+	/// The type of the segment.
+	pub p_type: u32,
+	/// The offset of the segment's data in the file.
+	pub p_offset: u32,
+	/// The virtual address of the segment in memory.
+	pub p_vaddr: ELF32Addr,
+	/// The physical address of the segment, unused.
+	pub p_paddr: ELF32Addr,
+	/// The size of the segment's data in the file.
+	pub p_filesz: u32,
+	/// The size of the segment in memory. The part that is not in the file is filled with
+	/// zeros.
+	pub p_memsz: u32,
+	/// The segment's flags.
+	pub p_flags: u32,
+	/// Alignment constraints of the segment.
+	pub p_align: u32,
+}
+
 /// Structure representing an ELF section header in memory.
 #[derive(Clone, Copy, Debug)]
 #[repr(C)]
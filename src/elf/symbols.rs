@@ -0,0 +1,179 @@
+//! This module implements an index of the kernel's function symbols, allowing to find the
+//! function containing a given address quickly.
+//!
+//! The index is built once at boot from the ELF sections given by Multiboot. It is an array of
+//! symbols sorted by address, which is searched by dichotomy.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::memory;
+use crate::multiboot;
+use crate::util::container::vec::Vec;
+use crate::util;
+use super::ELF32SectionHeader;
+use super::ELF32Sym;
+use super::SHT_SYMTAB;
+use super::STT_FUNC;
+
+/// A function symbol in the index.
+#[derive(Clone, Copy, Debug)]
+struct Symbol {
+	/// The address of the beginning of the function.
+	begin: u32,
+	/// The size of the function in bytes.
+	size: u32,
+	/// The offset of the function's name in the string table.
+	name: u32,
+}
+
+/// The index of the kernel's function symbols.
+struct SymbolIndex {
+	/// The symbols, sorted by address.
+	symbols: Vec<Symbol>,
+	/// The beginning of the string table containing the symbols' names.
+	strtab: *const u8,
+}
+
+impl SymbolIndex {
+	/// Returns the symbol containing the address `addr`.
+	fn get(&self, addr: u32) -> Option<&Symbol> {
+		// Finding the last symbol beginning before the address
+		let i = match self.symbols.binary_search_by(| s | s.begin.cmp(&addr)) {
+			Ok(i) => i,
+			Err(0) => return None,
+			Err(i) => i - 1,
+		};
+
+		let sym = &self.symbols[i];
+		if addr - sym.begin < sym.size {
+			Some(sym)
+		} else {
+			None
+		}
+	}
+
+	/// Returns the name of the symbol `sym`.
+	fn get_name(&self, sym: &Symbol) -> &'static str {
+		unsafe { // Safe because the offset comes from the symbol table
+			util::ptr_to_str(self.strtab.add(sym.name as _) as _)
+		}
+	}
+}
+
+/// The index. Since it is written only once at boot, it doesn't require a lock.
+static mut INDEX: Option<SymbolIndex> = None;
+
+/// Tells whether the ELF symbol `sym` has to be in the index.
+fn is_indexed(sym: &ELF32Sym) -> bool {
+	sym.st_info & 0xf == STT_FUNC && sym.st_size != 0 && sym.st_name != 0
+}
+
+/// Calls the function `f` for each symbol of the kernel's symbol tables.
+fn foreach_symbol<F: FnMut(&ELF32Sym)>(mut f: F) {
+	let boot_info = multiboot::get_boot_info();
+
+	super::foreach_sections(memory::kern_to_virt(boot_info.elf_sections),
+		boot_info.elf_num as usize, boot_info.elf_shndx as usize,
+		boot_info.elf_entsize as usize, | hdr: &ELF32SectionHeader, _name: &str | {
+			if hdr.sh_type != SHT_SYMTAB {
+				return;
+			}
+			debug_assert!(hdr.sh_entsize > 0);
+
+			let ptr = memory::kern_to_virt(hdr.sh_addr as _) as *const u8;
+			for off in (0..(hdr.sh_size as usize)).step_by(hdr.sh_entsize as usize) {
+				f(unsafe {
+					&*(ptr.add(off) as *const ELF32Sym)
+				});
+			}
+		});
+}
+
+/// Builds the index from the kernel's ELF sections. If the kernel has no string table, the index
+/// is not built.
+/// This function must be called only once, at boot.
+pub fn init() -> Result<(), Errno> {
+	let boot_info = multiboot::get_boot_info();
+	let strtab = match super::get_section(memory::kern_to_virt(boot_info.elf_sections),
+		boot_info.elf_num as usize, boot_info.elf_shndx as usize,
+		boot_info.elf_entsize as usize, ".strtab") {
+		Some(hdr) => memory::kern_to_virt(hdr.sh_addr as _) as *const u8,
+		None => return Ok(()),
+	};
+
+	let mut count = 0;
+	foreach_symbol(| sym | {
+		if is_indexed(sym) {
+			count += 1;
+		}
+	});
+
+	let mut symbols = Vec::with_capacity(count)?;
+	foreach_symbol(| sym | {
+		if is_indexed(sym) {
+			// Cannot fail since the capacity is sufficient
+			symbols.push(Symbol {
+				begin: sym.st_value,
+				size: sym.st_size,
+				name: sym.st_name,
+			}).unwrap();
+		}
+	});
+	symbols.as_mut_slice().sort_unstable_by_key(| s | s.begin);
+
+	unsafe { // Safe because called only once at boot
+		INDEX = Some(SymbolIndex {
+			symbols,
+			strtab,
+		});
+	}
+	Ok(())
+}
+
+/// Returns the name of the kernel function containing the address `addr`.
+/// If the index isn't built or if no function contains the address, the function returns None.
+pub fn get_function_name(addr: *const c_void) -> Option<&'static str> {
+	let index = unsafe { // Safe because the index is written only at boot
+		INDEX.as_ref()
+	}?;
+
+	index.get(addr as _).map(| sym | index.get_name(sym))
+}
+
+/// Tells whether the index has been built.
+pub fn is_ready() -> bool {
+	unsafe { // Safe because the index is written only at boot
+		INDEX.is_some()
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn symbol_index0() {
+		let mut symbols = Vec::new();
+		for (begin, size) in [(0x1000, 0x10), (0x1010, 0x20), (0x2000, 0x100)].iter() {
+			symbols.push(Symbol {
+				begin: *begin,
+				size: *size,
+				name: 0,
+			}).unwrap();
+		}
+		let index = SymbolIndex {
+			symbols,
+			strtab: core::ptr::null(),
+		};
+
+		assert!(index.get(0).is_none());
+		assert!(index.get(0xfff).is_none());
+		assert_eq!(index.get(0x1000).unwrap().begin, 0x1000);
+		assert_eq!(index.get(0x100f).unwrap().begin, 0x1000);
+		assert_eq!(index.get(0x1010).unwrap().begin, 0x1010);
+		assert_eq!(index.get(0x102f).unwrap().begin, 0x1010);
+		assert!(index.get(0x1030).is_none());
+		assert_eq!(index.get(0x20ff).unwrap().begin, 0x2000);
+		assert!(index.get(0x2100).is_none());
+	}
+}
@@ -218,8 +218,9 @@ pub extern "C" fn event_handler(id: u32, code: u32, ring: u32, regs: &util::Regs
 			}
 		};
 
-		for i in 0..callbacks.len() {
-			let result = (callbacks[i].callback)(id, code, regs, ring);
+		// Callbacks are sorted by increasing priority
+		for c in callbacks.iter().rev() {
+			let result = (c.callback)(id, code, regs, ring);
 			last_action = result.action;
 			if result.skip_next {
 				break;
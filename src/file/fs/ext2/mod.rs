@@ -1377,6 +1377,7 @@ impl Filesystem for Ext2Fs {
 		let mut file = File::new(name, file_type, inode_.uid, inode_.gid,
 			inode_.get_permissions())?;
 		file.set_inode(Some(inode));
+		file.set_size(inode_.get_size(&self.superblock));
 		file.set_ctime(inode_.ctime);
 		file.set_mtime(inode_.mtime);
 		file.set_atime(inode_.atime);
@@ -1458,13 +1459,19 @@ impl Filesystem for Ext2Fs {
 		//Err(errno::ENOMEM)
 	}
 
-	fn read_node(&mut self, _io: &mut dyn DeviceHandle, inode: INode, _buf: &mut [u8])
-		-> Result<(), Errno> {
+	fn read_node(&mut self, io: &mut dyn DeviceHandle, inode: INode, off: u64, buf: &mut [u8])
+		-> Result<usize, Errno> {
 		debug_assert!(inode >= 1);
-		// TODO
-		todo!();
 
-		//Err(errno::ENOMEM)
+		let inode_ = Ext2INode::read(inode, &self.superblock, io)?;
+		let size = inode_.get_size(&self.superblock);
+		if off >= size {
+			return Ok(0);
+		}
+
+		let len = min(buf.len() as u64, size - off) as usize;
+		inode_.read_content(off, &mut buf[..len], &self.superblock, io)?;
+		Ok(len)
 	}
 
 	fn write_node(&mut self, _io: &mut dyn DeviceHandle, inode: INode, _buf: &[u8])
@@ -53,9 +53,11 @@ pub trait Filesystem {
 	fn remove_file(&mut self, io: &mut dyn DeviceHandle, parent_inode: INode, name: &String)
 		-> Result<(), Errno>;
 
-	/// Reads from the given inode `inode` into the buffer `buf`.
-	fn read_node(&mut self, io: &mut dyn DeviceHandle, inode: INode, buf: &mut [u8])
-		-> Result<(), Errno>;
+	/// Reads from the given inode `inode` at offset `off` into the buffer `buf`.
+	/// The function returns the number of bytes read, which is zero if `off` is at or beyond the
+	/// end of the file.
+	fn read_node(&mut self, io: &mut dyn DeviceHandle, inode: INode, off: u64, buf: &mut [u8])
+		-> Result<usize, Errno>;
 
 	/// Writes to the given inode `inode` from the buffer `buf`.
 	fn write_node(&mut self, io: &mut dyn DeviceHandle, inode: INode, buf: &[u8])
@@ -5,6 +5,7 @@
 pub mod file_descriptor;
 pub mod fs;
 pub mod mountpoint;
+pub mod page_cache;
 pub mod path;
 
 use core::mem::MaybeUninit;
@@ -66,9 +67,6 @@ pub const S_ISGID: Mode = 0o2000;
 /// Sticky bit.
 pub const S_ISVTX: Mode = 0o1000;
 
-/// The number of buckets in the hash map storing a directory's subfiles.
-pub const SUBFILES_HASHMAP_BUCKETS: usize = 16;
-
 /// The size of the files pool.
 pub const FILES_POOL_SIZE: usize = 1024;
 /// The upper bount for the file accesses counter.
@@ -153,7 +151,7 @@ impl File {
 
 		let subfiles_hash_map = {
 			if file_type == FileType::Directory {
-				Some(HashMap::<String, WeakPtr<File>>::new(SUBFILES_HASHMAP_BUCKETS)?)
+				Some(HashMap::<String, WeakPtr<File>>::new())
 			} else {
 				None
 			}
@@ -220,6 +218,16 @@ impl File {
 		self.size
 	}
 
+	/// Sets the size of the file in bytes.
+	pub fn set_size(&mut self, size: u64) {
+		// Cached pages beyond the new end of the file are stale
+		if size < self.size {
+			page_cache::invalidate(self);
+		}
+
+		self.size = size;
+	}
+
 	/// Returns the type of the file.
 	pub fn get_file_type(&self) -> FileType {
 		self.file_type
@@ -335,7 +343,7 @@ impl File {
 	/// directory, the behaviour is undefined.
 	pub fn remove_subfile(&mut self, name: String) {
 		debug_assert_eq!(self.file_type, FileType::Directory);
-		self.subfiles.as_mut().unwrap().remove(name);
+		self.subfiles.as_mut().unwrap().remove(&name);
 	}
 
 	/// Returns the symbolic link's target. If the file isn't a symbolic link, the behaviour is
@@ -389,8 +397,23 @@ impl File {
 	pub fn read(&self, off: usize, buff: &mut [u8]) -> Result<usize, Errno> {
 		match self.file_type {
 			FileType::Regular => {
-				// TODO
-				todo!();
+				// A file which isn't stored on any filesystem has no content
+				let inode = match self.inode {
+					Some(inode) => inode,
+					None => return Ok(0),
+				};
+
+				let path = self.get_path()?;
+				let mut ptr = mountpoint::get_deepest(&path).ok_or(errno::ENOENT)?;
+				let mut guard = ptr.lock();
+				let deepest_mountpoint = guard.get_mut();
+
+				let mut dev_ptr = deepest_mountpoint.get_device();
+				let mut dev_guard = dev_ptr.lock();
+				let dev = dev_guard.get_mut();
+
+				deepest_mountpoint.get_filesystem().read_node(dev.get_handle(), inode, off as _,
+					buff)
 			},
 
 			FileType::Directory => {
@@ -434,6 +457,9 @@ impl File {
 	pub fn write(&self, off: usize, buff: &[u8]) -> Result<usize, Errno> {
 		match self.file_type {
 			FileType::Regular => {
+				// The cached content of the file is about to be stale
+				page_cache::invalidate(self);
+
 				// TODO
 				todo!();
 			},
@@ -484,6 +510,8 @@ impl File {
 
 	/// Unlinks the current file.
 	pub fn unlink(&mut self) {
+		page_cache::invalidate(self);
+
 		// TODO
 		todo!();
 	}
@@ -593,8 +621,16 @@ impl FCache {
 
 			let parent_inode = deepest_mountpoint.get_filesystem().get_inode(dev.get_handle(),
 				parent_inner_path)?;
+			let inner_path = path.range_from(mountpoint_path_len..)?;
+			let inode = deepest_mountpoint.get_filesystem().get_inode(dev.get_handle(),
+				inner_path)?;
 			deepest_mountpoint.get_filesystem().remove_file(dev.get_handle(), parent_inode,
 				entry_name)?;
+
+			// The inode may be reused by another file
+			drop(dev_guard);
+			drop(guard);
+			page_cache::invalidate_inode(&ptr, inode);
 		}
 		Ok(())
 	}
@@ -0,0 +1,235 @@
+//! The page cache keeps the content of files in physical memory pages. This allows several
+//! memory mappings of the same file to share their physical memory instead of reading the file
+//! each time a page is accessed.
+//!
+//! Each page of the cache holds a reference on the physical pages reference counter. Thus, a
+//! page mapped in a private mapping is considered shared and is subject to Copy-On-Write.
+//!
+//! Pages are identified by the location of the file on disk, which is its mountpoint and its
+//! inode, so that every instance of the same file share the same pages. Each page keeps a
+//! reference to its mountpoint to prevent its address from being reused.
+//!
+//! The pages of a file are invalidated when its content changes or when it is removed. Pages that
+//! aren't mapped anymore can be evicted when memory is running low (see `shrink`).
+//!
+//! The cache's lock is never held while accessing a file, since files invalidate the cache while
+//! locked.
+
+use core::ffi::c_void;
+use core::slice;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::mountpoint::MountPoint;
+use crate::file::mountpoint;
+use crate::memory::buddy;
+use crate::memory;
+use crate::process::mem_space::PHYSICAL_REF_COUNTER;
+use crate::util::container::binary_tree::BinaryTree;
+use crate::util::container::binary_tree::TraversalType;
+use crate::util::lock::mutex::*;
+use crate::util::ptr::SharedPtr;
+use crate::util;
+use super::File;
+use super::INode;
+
+/// The maximum number of pages released for each traversal of the cache.
+const RELEASE_BATCH: usize = 32;
+
+/// The key identifying a page in the cache: the address of the file's mountpoint, the file's
+/// inode and the offset of the page in the file.
+type PageKey = (usize, INode, u64);
+
+/// A page of the cache.
+struct CachedPage {
+	/// The mountpoint of the file, kept alive as long as the page is cached.
+	_mountpoint: SharedPtr<MountPoint>,
+	/// The physical page.
+	page: *const c_void,
+}
+
+/// The cached pages.
+static mut PAGES: Mutex<BinaryTree<PageKey, CachedPage>> = Mutex::new(BinaryTree::new());
+
+/// Returns the mountpoint and the inode locating the file `file` on disk. If the file isn't
+/// stored on any filesystem, the function returns None.
+fn get_location(file: &File) -> Result<Option<(SharedPtr<MountPoint>, INode)>, Errno> {
+	let inode = match file.get_inode() {
+		Some(inode) => inode,
+		None => return Ok(None),
+	};
+
+	let mountpoint = mountpoint::get_deepest(&file.get_path()?).ok_or(errno::ENOENT)?;
+	Ok(Some((mountpoint, inode)))
+}
+
+/// Returns the address identifying the mountpoint `mountpoint` in the keys of the cache.
+fn get_mountpoint_id(mountpoint: &SharedPtr<MountPoint>) -> usize {
+	mountpoint.get() as *const Mutex<MountPoint> as usize
+}
+
+/// Fills the physical page `page` with the content of the file `file` at offset `off`. The part
+/// of the page beyond the end of the file is left untouched.
+/// `len` is the number of bytes to read.
+pub fn read_page(file: &SharedPtr<File>, off: u64, page: *const c_void, len: usize)
+	-> Result<(), Errno> {
+	debug_assert!(len <= memory::PAGE_SIZE);
+
+	let buff = unsafe { // Safe because the page is located in the kernel zone
+		slice::from_raw_parts_mut(memory::kern_to_virt(page) as *mut u8, len)
+	};
+
+	let guard = file.get_mut().lock();
+	let mut i = 0;
+	while i < len {
+		let n = guard.get().read(off as usize + i, &mut buff[i..])?;
+		if n == 0 {
+			break;
+		}
+
+		i += n;
+	}
+
+	Ok(())
+}
+
+/// Returns the physical page containing the data of the file `file` at offset `off`. If the page
+/// is not in the cache, it is read from the file.
+/// `off` must be a multiple of the size of a page.
+/// The page stays in the cache, thus the caller must increment its reference counter to keep
+/// using it.
+pub fn get_page(file: &SharedPtr<File>, off: u64) -> Result<*const c_void, Errno> {
+	debug_assert!(off % memory::PAGE_SIZE as u64 == 0);
+
+	let (mountpoint, inode) = get_location(file.get_mut().lock().get())?.ok_or(errno::ENOENT)?;
+	let key = (get_mountpoint_id(&mountpoint), inode, off);
+
+	{
+		let guard = unsafe { // Safe because using Mutex
+			PAGES.lock()
+		};
+		if let Some(cached) = guard.get().get(key) {
+			return Ok(cached.page);
+		}
+	}
+
+	// The kernel zone is used so that the page can be filled from the kernel
+	let page = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_KERNEL | buddy::FLAG_USAGE_PAGE_CACHE)?;
+	unsafe {
+		util::bzero(memory::kern_to_virt(page) as _, memory::PAGE_SIZE);
+	}
+	if let Err(errno) = read_page(file, off, page, memory::PAGE_SIZE) {
+		buddy::free(page, 0);
+		return Err(errno);
+	}
+
+	let mut guard = unsafe { // Safe because using Mutex
+		PAGES.lock()
+	};
+	let pages = guard.get_mut();
+
+	// The page may have been cached while reading it
+	if let Some(cached) = pages.get(key) {
+		buddy::free(page, 0);
+		return Ok(cached.page);
+	}
+
+	{
+		let mut ref_counter = unsafe { // Safe because using Mutex
+			PHYSICAL_REF_COUNTER.lock()
+		};
+		if let Err(errno) = ref_counter.get_mut().increment(page) {
+			buddy::free(page, 0);
+			return Err(errno);
+		}
+	}
+
+	let cached = CachedPage {
+		_mountpoint: mountpoint,
+		page,
+	};
+	if pages.insert(key, cached).is_err() {
+		unsafe { // Safe because using Mutex
+			PHYSICAL_REF_COUNTER.lock()
+		}.get_mut().decrement(page);
+		buddy::free(page, 0);
+		return Err(errno::ENOMEM);
+	}
+
+	Ok(page)
+}
+
+/// Removes from the cache the pages for which `f` returns `true`, at most `max` of them.
+/// The cache's reference on each page is released. Pages that are still mapped stay owned by
+/// their mappings, the others are freed.
+/// The function returns the number of removed pages.
+fn release<F: Fn(&PageKey, &CachedPage) -> bool>(f: F, max: usize) -> usize {
+	let mut guard = unsafe { // Safe because using Mutex
+		PAGES.lock()
+	};
+	let pages = guard.get_mut();
+	let mut removed = 0;
+
+	while removed < max {
+		// The tree cannot be modified while traversing it, thus keys are collected first
+		let mut keys = [(0, 0, 0); RELEASE_BATCH];
+		let mut count = 0;
+		pages.foreach(| key, page | {
+			if count < RELEASE_BATCH && removed + count < max && f(key, page) {
+				keys[count] = *key;
+				count += 1;
+			}
+		}, TraversalType::InOrder);
+
+		let mut ref_counter = unsafe { // Safe because using Mutex
+			PHYSICAL_REF_COUNTER.lock()
+		};
+		let ref_counter = ref_counter.get_mut();
+		for key in &keys[..count] {
+			if let Some(cached) = pages.remove(*key) {
+				let last = ref_counter.get_ref_count(cached.page) == 1;
+				ref_counter.decrement(cached.page);
+				if last {
+					buddy::free(cached.page, 0);
+				}
+			}
+		}
+
+		removed += count;
+		if count < RELEASE_BATCH {
+			break;
+		}
+	}
+
+	removed
+}
+
+/// Removes the pages of the file with inode `inode` on the mountpoint `mountpoint` from the
+/// cache. This function must be called when the file is modified or removed so that new mappings
+/// don't use stale data. Existing mappings keep their pages.
+pub fn invalidate_inode(mountpoint: &SharedPtr<MountPoint>, inode: INode) {
+	let id = get_mountpoint_id(mountpoint);
+	release(| key, _ | key.0 == id && key.1 == inode, usize::MAX);
+}
+
+/// Same as `invalidate_inode`, for the file `file`. If the file isn't stored on any filesystem,
+/// the function does nothing.
+pub fn invalidate(file: &File) {
+	// If the file cannot be located, it has no page in the cache
+	if let Ok(Some((mountpoint, inode))) = get_location(file) {
+		invalidate_inode(&mountpoint, inode);
+	}
+}
+
+/// Evicts at most `count` pages that are not mapped anywhere from the cache, freeing their memory.
+/// This function is meant to be called by the memory allocator when running out of memory. It
+/// must not be called with the cache or the physical pages reference counter locked.
+/// The function returns the number of freed pages.
+pub fn shrink(count: usize) -> usize {
+	release(| _, cached | {
+		// Only the cache holds a reference on the page
+		let ref_counter = unsafe { // Safe because using Mutex
+			PHYSICAL_REF_COUNTER.lock()
+		};
+		ref_counter.get().get_ref_count(cached.page) == 1
+	}, count)
+}
@@ -12,8 +12,10 @@
  * This macro stores the values of every registers after an interruption was triggered.
  * It is required that the caller allocate some memory (the size of the registers storing structure) before calling.
  * The stack frame is used as a reference to place the register values.
+ * The direction flag is cleared since the interrupted code may have set it, while the handlers expect string instructions to go forward. `iret` restores it.
  */
 .macro GET_REGS n
+	cld
 	mov %edi, -0x4(%ebp)
 	mov %esi, -0x8(%ebp)
 	mov %edx, -0xc(%ebp)
@@ -65,6 +65,20 @@ pub fn init(offset1: u8, offset2: u8) {
 	}
 }
 
+/// Unmasks the interrupt `irq`, allowing the PIC to raise it.
+pub fn enable_irq(irq: u8) {
+	let port = if irq < 0x8 {
+		MASTER_DATA
+	} else {
+		SLAVE_DATA
+	};
+
+	unsafe {
+		let mask = io::inb(port);
+		io::outb(port, mask & !(1 << (irq % 0x8)));
+	}
+}
+
 /// Sends an End-Of-Interrupt message to the PIC for the given interrupt `irq`.
 #[no_mangle]
 pub extern "C" fn end_of_interrupt(irq: u8) {
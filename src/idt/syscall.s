@@ -4,6 +4,8 @@
 
 syscall:
 	cli
+	# Userspace may have set the direction flag, which is restored by `iret`
+	cld
 	push %ebp
 	mov %esp, %ebp
 
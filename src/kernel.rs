@@ -142,6 +142,7 @@ extern "C" {
 #[no_mangle]
 pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	crate::cli!();
+	debug::boot::phase("early");
 	tty::init();
 
 	if magic != multiboot::BOOTLOADER_MAGIC || !util::is_aligned(multiboot_ptr, 8) {
@@ -152,7 +153,9 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	pit::init();
 	event::init();
 
-	// TODO CPUID
+	unsafe {
+		util::libc_init();
+	}
 	multiboot::read_tags(multiboot_ptr);
 
 	memory::memmap::init(multiboot_ptr);
@@ -165,6 +168,9 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	if kernel_vmem.is_err() {
 		crate::kernel_panic!("Cannot initialize kernel virtual memory!", 0);
 	}
+	if elf::symbols::init().is_err() {
+		crate::kernel_panic!("Cannot build the kernel symbols index!", 0);
+	}
 
 	#[cfg(test)]
 	#[cfg(config_debug_test)]
@@ -180,13 +186,27 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 
 	println!("Booting Maestro kernel version {}", KERNEL_VERSION);
 
+	debug::boot::phase("acpi");
 	println!("Initializing ACPI...");
 	acpi::init();
 
+	debug::boot::phase("time");
+	println!("Initializing time management...");
+	if time::init().is_err() {
+		kernel_panic!("Failed to initialize time management!");
+	}
+	if let Some(events) = args_parser.get_trace_events() {
+		if let Err(name) = debug::trace::enable(events.as_str()) {
+			println!("Unknown trace event `{}`", name);
+		}
+	}
+
+	debug::boot::phase("ramdisks");
 	println!("Initializing ramdisks...");
 	if device::storage::ramdisk::create().is_err() {
 		kernel_panic!("Failed to create ramdisks!");
 	}
+	debug::boot::phase("devices");
 	println!("Initializing devices management...");
 	if device::init().is_err() {
 		crate::kernel_panic!("Failed to initialize devices management!", 0);
@@ -194,6 +214,7 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 
 	let (root_major, root_minor) = args_parser.get_root_dev();
 	println!("Root device is {} {}", root_major, root_minor);
+	debug::boot::phase("files");
 	println!("Initializing files management...");
 	if file::init(device::DeviceType::Block, root_major, root_minor).is_err() {
 		kernel_panic!("Failed to initialize files management!");
@@ -201,7 +222,12 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 	if device::default::create().is_err() {
 		kernel_panic!("Failed to create default devices!");
 	}
+	#[cfg(config_debug_profiler)]
+	if debug::profiler::init().is_err() {
+		kernel_panic!("Failed to start the profiler!");
+	}
 
+	debug::boot::phase("processes");
 	println!("Initializing processes...");
 	if process::init().is_err() {
 		kernel_panic!("Failed to init processes!", 0);
@@ -215,6 +241,7 @@ pub extern "C" fn kernel_main(magic: u32, multiboot_ptr: *const c_void) -> ! {
 		kernel_panic!("Failed to create init process!", 0);
 	}
 
+	debug::boot::report();
 	enter_loop();
 }
 
@@ -225,6 +252,10 @@ fn panic(panic_info: &PanicInfo) -> ! {
 	if selftest::is_running() {
 		println!("FAILED\n");
 		println!("Error: {}\n", panic_info);
+
+		#[cfg(config_debug_qemu)]
+		selftest::qemu::exit(selftest::qemu::FAILURE);
+		#[cfg(not(config_debug_qemu))]
 		halt();
 	}
 
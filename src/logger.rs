@@ -1,20 +1,53 @@
 //! This modules handles kernel logging.
 //! If the logger is silent, it will not print the logs on the screen but it will keep it in memory
 //! anyways.
+//!
+//! Printing a message only copies it into a per-core buffer, as a record tagged with a global
+//! sequence number. Buffers are written without locking: each core only writes to its own buffer,
+//! with interrupts disabled for the duration of the copy.
+//!
+//! Records are drained in sequence order by `flush`, which writes them to the current TTY, to the
+//! serial port and to the logs archive. Once deferred flushing is enabled, `flush` is called
+//! periodically by the scheduler instead of on each message, so that printing from an interrupt
+//! handler does not perform any device I/O.
 
+use core::cell::UnsafeCell;
 use core::cmp::min;
+use core::fmt;
+use core::ptr;
+use core::sync::atomic::AtomicBool;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::AtomicUsize;
+use core::sync::atomic::Ordering;
 use crate::device::serial;
+use crate::idt;
 use crate::tty;
 use crate::util::lock::mutex::Mutex;
 use crate::util::lock::mutex::MutexGuard;
 use crate::util::lock::mutex::TMutex;
 
-/// The size of the kernel logs buffer in bytes.
+/// The size of the kernel logs archive in bytes.
 const LOGS_SIZE: usize = 1048576;
 
+/// The maximum number of CPU cores.
+const CORES_COUNT: usize = 1; // TODO
+/// The size of each per-core buffer in bytes. Must be a power of two.
+const BUFFER_SIZE: usize = 65536;
+/// The size of a record's header in bytes. Records are aligned on this size.
+const HEADER_SIZE: usize = 8;
+
 /// The kernel's logger.
 static mut LOGGER: Mutex<Logger> = Mutex::new(Logger::new());
 
+/// The per-core records buffers.
+static BUFFERS: [LogBuffer; CORES_COUNT] = [LogBuffer::new()];
+/// The sequence number of the next record.
+static SEQUENCE: AtomicU32 = AtomicU32::new(0);
+/// Tells whether a flush is in progress.
+static FLUSHING: AtomicBool = AtomicBool::new(false);
+/// Tells whether flushing is deferred to the scheduler.
+static DEFERRED: AtomicBool = AtomicBool::new(false);
+
 /// Initializes logging.
 /// `silent` tells whether the logger is silent.
 pub fn init(silent: bool) {
@@ -32,7 +65,259 @@ pub fn get() -> &'static mut Mutex<Logger> {
 	}
 }
 
-/// Kernel logger, used to print/store kernel logs.
+/// Sets whether flushing is deferred. If not deferred, records are flushed as soon as they are
+/// written.
+pub fn set_deferred(deferred: bool) {
+	DEFERRED.store(deferred, Ordering::Release);
+}
+
+/// Header of a record in a per-core buffer. The record's data directly follows it.
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct RecordHeader {
+	/// The sequence number of the record.
+	seq: u32,
+	/// The length of the record's data in bytes.
+	len: u32,
+}
+
+/// Rounds the position `pos` up to the alignment of records.
+fn record_align(pos: usize) -> usize {
+	pos.wrapping_add(HEADER_SIZE - 1) & !(HEADER_SIZE - 1)
+}
+
+/// A circular buffer of records with a single producer and a single consumer.
+/// Positions increase indefinitely (wrapping on overflow) and are reduced modulo the size of the
+/// buffer on access.
+struct LogBuffer {
+	/// The buffer's data.
+	buff: UnsafeCell<[u8; BUFFER_SIZE]>,
+	/// The end of the last committed record. Written by the producer only.
+	head: AtomicUsize,
+	/// The beginning of the oldest record that is not flushed yet. Written by the consumer only.
+	tail: AtomicUsize,
+	/// The number of records dropped because the buffer was full.
+	dropped: AtomicUsize,
+}
+
+impl LogBuffer {
+	/// Creates a new instance.
+	const fn new() -> Self {
+		Self {
+			buff: UnsafeCell::new([0; BUFFER_SIZE]),
+			head: AtomicUsize::new(0),
+			tail: AtomicUsize::new(0),
+			dropped: AtomicUsize::new(0),
+		}
+	}
+
+	/// Copies `data` at position `pos`, wrapping around the end of the buffer.
+	/// The function is unsafe because the range must not be accessed by the consumer.
+	unsafe fn write_at(&self, pos: usize, data: &[u8]) {
+		let buff = &mut *self.buff.get();
+		let off = pos % BUFFER_SIZE;
+		let first = min(data.len(), BUFFER_SIZE - off);
+
+		buff[off..(off + first)].copy_from_slice(&data[..first]);
+		buff[..(data.len() - first)].copy_from_slice(&data[first..]);
+	}
+
+	/// Returns the data at position `pos` with length `len`, as up to two slices since it may
+	/// wrap around the end of the buffer.
+	/// The function is unsafe because the range must not be accessed by the producer.
+	unsafe fn read_at(&self, pos: usize, len: usize) -> (&[u8], &[u8]) {
+		let buff = &*self.buff.get();
+		let off = pos % BUFFER_SIZE;
+		let first = min(len, BUFFER_SIZE - off);
+
+		(&buff[off..(off + first)], &buff[..(len - first)])
+	}
+
+	/// Returns the header of the record at position `pos`. Records being aligned, a header never
+	/// wraps around the end of the buffer.
+	unsafe fn read_header(&self, pos: usize) -> RecordHeader {
+		let buff = &*self.buff.get();
+		ptr::read_unaligned(&buff[pos % BUFFER_SIZE] as *const _ as *const RecordHeader)
+	}
+
+	/// Writes the message `args` as a new record. If the buffer is full, the message is truncated
+	/// or dropped.
+	/// Interrupts must be disabled on the current core while calling this function.
+	fn write(&self, args: fmt::Arguments) {
+		let begin = self.head.load(Ordering::Relaxed);
+		let tail = self.tail.load(Ordering::Acquire);
+		let available = BUFFER_SIZE - begin.wrapping_sub(tail);
+		if available < HEADER_SIZE {
+			self.dropped.fetch_add(1, Ordering::Relaxed);
+			return;
+		}
+
+		let mut writer = RecordWriter {
+			buffer: self,
+			pos: begin.wrapping_add(HEADER_SIZE),
+			remaining: available - HEADER_SIZE,
+		};
+		fmt::write(&mut writer, args).ok();
+
+		let hdr = RecordHeader {
+			seq: SEQUENCE.fetch_add(1, Ordering::Relaxed),
+			len: (available - HEADER_SIZE - writer.remaining) as _,
+		};
+		let hdr_bytes = unsafe { // Safe because the header is a plain structure
+			core::slice::from_raw_parts(&hdr as *const _ as *const u8, HEADER_SIZE)
+		};
+		unsafe { // Safe because the range is beyond the head
+			self.write_at(begin, hdr_bytes);
+		}
+
+		// Publishing the record after its content has been written
+		self.head.store(record_align(writer.pos), Ordering::Release);
+	}
+}
+
+unsafe impl Sync for LogBuffer {}
+
+/// Structure writing the data of a record being created into a buffer.
+struct RecordWriter<'a> {
+	/// The buffer.
+	buffer: &'a LogBuffer,
+	/// The current writing position.
+	pos: usize,
+	/// The number of bytes that can still be written before the buffer is full.
+	remaining: usize,
+}
+
+impl<'a> fmt::Write for RecordWriter<'a> {
+	fn write_str(&mut self, s: &str) -> Result<(), fmt::Error> {
+		let len = min(s.len(), self.remaining);
+		unsafe { // Safe because the range is beyond the head and before the tail
+			self.buffer.write_at(self.pos, &s.as_bytes()[..len]);
+		}
+		self.pos = self.pos.wrapping_add(len);
+		self.remaining -= len;
+
+		Ok(())
+	}
+}
+
+/// Writes the message `args` to the current core's buffer. If flushing is not deferred, the
+/// buffers are flushed.
+pub fn log(args: fmt::Arguments) {
+	idt::wrap_disable_interrupts(|| {
+		let core_id = 0; // TODO
+		BUFFERS[core_id].write(args);
+	});
+
+	if !DEFERRED.load(Ordering::Acquire) {
+		flush();
+	}
+}
+
+/// Writes the given data to every outputs of the logger.
+fn output(data: &[u8]) {
+	let mut guard = get().lock();
+	let logger = guard.get_mut();
+
+	if !logger.is_silent() {
+		MutexGuard::new(tty::current()).get_mut().write(data);
+	}
+	logger.push(data);
+
+	if let Some(serial) = serial::get(serial::COM1) {
+		serial.lock().get_mut().write(data)
+	}
+}
+
+/// Drains the records of every per-core buffers, in sequence order, to the logger's outputs.
+/// If a flush is already in progress, the function does nothing since the records will be
+/// drained by it.
+pub fn flush() {
+	if FLUSHING.swap(true, Ordering::Acquire) {
+		return;
+	}
+
+	loop {
+		// Looking for the oldest record
+		let mut next: Option<(&LogBuffer, RecordHeader)> = None;
+		for buffer in BUFFERS.iter() {
+			let tail = buffer.tail.load(Ordering::Relaxed);
+			if tail == buffer.head.load(Ordering::Acquire) {
+				continue;
+			}
+
+			let hdr = unsafe { // Safe because the record is committed
+				buffer.read_header(tail)
+			};
+			let older = match next {
+				Some((_, n)) => (hdr.seq.wrapping_sub(n.seq) as i32) < 0,
+				None => true,
+			};
+			if older {
+				next = Some((buffer, hdr));
+			}
+		}
+
+		let (buffer, hdr) = match next {
+			Some(n) => n,
+			None => break,
+		};
+
+		let tail = buffer.tail.load(Ordering::Relaxed);
+		let (first, second) = unsafe { // Safe because the record is committed
+			buffer.read_at(tail.wrapping_add(HEADER_SIZE), hdr.len as _)
+		};
+		output(first);
+		output(second);
+
+		// Releasing the record's space once its content has been read
+		let end = record_align(tail.wrapping_add(HEADER_SIZE + hdr.len as usize));
+		buffer.tail.store(end, Ordering::Release);
+	}
+
+	for buffer in BUFFERS.iter() {
+		let dropped = buffer.dropped.swap(0, Ordering::Relaxed);
+		if dropped > 0 {
+			let mut msg = [0u8; 64];
+			let mut w = BytesWriter {
+				buff: &mut msg,
+				len: 0,
+			};
+			fmt::write(&mut w, format_args!("[{} log records lost]\n", dropped)).ok();
+			let len = w.len;
+			output(&msg[..len]);
+		}
+	}
+
+	FLUSHING.store(false, Ordering::Release);
+}
+
+/// Flushes the buffers, even if another flush was interrupted.
+/// This function is meant to be used on kernel panic only, since it may interleave records.
+pub fn force_flush() {
+	FLUSHING.store(false, Ordering::Release);
+	flush();
+}
+
+/// Structure allowing to format a message into a fixed-size buffer. The message is truncated if
+/// the buffer is too small.
+struct BytesWriter<'a> {
+	/// The buffer.
+	buff: &'a mut [u8],
+	/// The length of the message.
+	len: usize,
+}
+
+impl<'a> fmt::Write for BytesWriter<'a> {
+	fn write_str(&mut self, s: &str) -> Result<(), fmt::Error> {
+		let len = min(s.len(), self.buff.len() - self.len);
+		self.buff[self.len..(self.len + len)].copy_from_slice(&s.as_bytes()[..len]);
+		self.len += len;
+
+		Ok(())
+	}
+}
+
+/// Kernel logger, used to store kernel logs.
 pub struct Logger {
 	/// Tells whether the logger is silent.
 	silent: bool,
@@ -110,37 +395,28 @@ impl Logger {
 	/// Pops at least `n` characters from the buffer. If the popping `n` characters result in
 	/// cutting a line, the function shall pop the full line.
 	fn pop(&mut self, n: usize) {
-		let read_new = (self.read_head + n) % self.buff.len();
-		if read_new >= self.write_head && read_new < self.read_head {
+		if n >= self.get_size() {
 			self.read_head = self.write_head;
 			return;
 		}
 
-		let mut i = 0;
-		while i < self.buff.len() {
-			let off = (read_new + i) % self.buff.len();
-			if off >= self.write_head || self.buff[off] == b'\n' {
-				break;
-			}
-
-			i += 1;
-		}
-
-		self.read_head = (read_new + i) % self.buff.len();
-	}
-}
-
-impl core::fmt::Write for Logger {
-	fn write_str(&mut self, s: &str) -> Result<(), core::fmt::Error> {
-		if !self.is_silent() {
-			MutexGuard::new(tty::current()).get_mut().write(s.as_bytes());
-		}
-		self.push(s.as_bytes());
+		// Looking for the end of the cut line in the used part of the buffer, which is split in
+		// at most two slices
+		let read_new = (self.read_head + n) % self.buff.len();
+		let (first, second) = if read_new <= self.write_head {
+			(&self.buff[read_new..self.write_head], &self.buff[..0])
+		} else {
+			(&self.buff[read_new..], &self.buff[..self.write_head])
+		};
 
-		if let Some(serial) = serial::get(serial::COM1) {
-			serial.lock().get_mut().write(s.as_bytes())
-		}
+		let skip = if let Some(i) = first.iter().position(| b | *b == b'\n') {
+			i
+		} else if let Some(i) = second.iter().position(| b | *b == b'\n') {
+			first.len() + i
+		} else {
+			first.len() + second.len()
+		};
 
-		Ok(())
+		self.read_head = (read_new + skip) % self.buff.len();
 	}
 }
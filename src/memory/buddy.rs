@@ -11,8 +11,10 @@ use core::cmp::min;
 use core::ffi::c_void;
 use core::mem::MaybeUninit;
 use core::mem::size_of;
+use crate::debug::trace;
 use crate::errno::Errno;
 use crate::errno;
+use crate::file::page_cache;
 use crate::memory;
 use crate::util::lock::mutex::*;
 use crate::util::math;
@@ -44,18 +46,106 @@ pub const FLAG_ZONE_TYPE_DMA: Flags = 0b010;
 /// order is higher than 0. The allocator shall use the OOM killer to recover memory.
 pub const FLAG_NOFAIL: Flags = 0b100; // TODO Move OOM killer outside?
 
+/// The offset of the usage of the frame in buddy allocator flags.
+const USAGE_SHIFT: Flags = 3;
+/// The mask for the usage of the frame in buddy allocator flags.
+const USAGE_MASK: Flags = 0b111 << USAGE_SHIFT;
+/// Buddy allocator flag. Tells that the frame is used by the kernel for a purpose that isn't
+/// covered by other usages. This is the default.
+pub const FLAG_USAGE_KERNEL: Flags = (Usage::Kernel as Flags) << USAGE_SHIFT;
+/// Buddy allocator flag. Tells that the frame is used for userspace memory.
+pub const FLAG_USAGE_USER: Flags = (Usage::User as Flags) << USAGE_SHIFT;
+/// Buddy allocator flag. Tells that the frame is used as a DMA buffer.
+pub const FLAG_USAGE_DMA: Flags = (Usage::DMA as Flags) << USAGE_SHIFT;
+/// Buddy allocator flag. Tells that the frame is used for paging objects.
+pub const FLAG_USAGE_PAGE_TABLE: Flags = (Usage::PageTable as Flags) << USAGE_SHIFT;
+/// Buddy allocator flag. Tells that the frame is used by the kernel's memory allocator.
+pub const FLAG_USAGE_SLAB: Flags = (Usage::Slab as Flags) << USAGE_SHIFT;
+/// Buddy allocator flag. Tells that the frame is used by the page cache.
+pub const FLAG_USAGE_PAGE_CACHE: Flags = (Usage::PageCache as Flags) << USAGE_SHIFT;
+
+/// The number of pages evicted from the page cache each time an allocation fails.
+const RECLAIM_PAGES: usize = 32;
+
 /// Pointer to the end of the kernel zone of memory with the maximum possible size.
 pub const KERNEL_ZONE_LIMIT: *const c_void = 0x40000000 as _;
 
 /// Value indicating that the frame is used.
 pub const FRAME_STATE_USED: FrameID = !0_u32;
 
+/// The number of frame usages.
+pub const USAGES_COUNT: usize = 6;
+
+/// Enumeration of the usages of allocated frames, used for memory accounting.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum Usage {
+	/// Memory used by the kernel for a purpose that isn't covered by other usages.
+	Kernel = 0,
+	/// Userspace memory.
+	User = 1,
+	/// DMA buffers.
+	DMA = 2,
+	/// Paging objects.
+	PageTable = 3,
+	/// Memory used by the kernel's memory allocator.
+	Slab = 4,
+	/// Memory used by the page cache.
+	PageCache = 5,
+}
+
+/// The list of usages, ordered by value.
+pub const USAGES: [Usage; USAGES_COUNT] = [
+	Usage::Kernel,
+	Usage::User,
+	Usage::DMA,
+	Usage::PageTable,
+	Usage::Slab,
+	Usage::PageCache,
+];
+
+impl Usage {
+	/// Returns the usage given in the buddy allocator flags `flags`.
+	fn from_flags(flags: Flags) -> Self {
+		let i = ((flags & USAGE_MASK) >> USAGE_SHIFT) as usize;
+		USAGES.get(i).copied().unwrap_or(Usage::Kernel)
+	}
+
+	/// Returns the name of the usage.
+	pub fn get_name(&self) -> &'static str {
+		match self {
+			Self::Kernel => "kernel",
+			Self::User => "user",
+			Self::DMA => "dma",
+			Self::PageTable => "page_table",
+			Self::Slab => "slab",
+			Self::PageCache => "page_cache",
+		}
+	}
+}
+
+/// Statistics on the allocations in a zone.
+#[derive(Clone, Copy, Default)]
+pub struct ZoneStats {
+	/// The number of pages in the zone.
+	pub pages_count: usize,
+	/// The number of allocated pages in the zone.
+	pub allocated_pages: usize,
+	/// The number of allocated frames in the zone, for each order.
+	pub allocated_frames: [usize; (MAX_ORDER + 1) as usize],
+	/// The number of allocated pages in the zone, for each usage.
+	pub usage_pages: [usize; USAGES_COUNT],
+}
+
 /// Structure representing an allocatable zone of memory.
 pub struct Zone {
 	/// The type of the zone, defining the priority
 	type_: Flags,
 	/// The number of allocated pages in the zone
 	allocated_pages: usize,
+	/// The number of allocated frames for each order
+	allocated_frames: [usize; (MAX_ORDER + 1) as usize],
+	/// The number of allocated pages for each usage
+	usage_pages: [usize; USAGES_COUNT],
 
 	/// A pointer to the beginning of the metadata of the zone
 	metadata_begin: *mut c_void,
@@ -81,10 +171,14 @@ struct Frame {
 	next: FrameID,
 	/// Order of the current frame
 	order: FrameOrder,
+	/// The usage of the frame, if used.
+	usage: u8,
 }
 
 /// The array of buddy allocator zones.
-static mut ZONES: MaybeUninit<[Mutex<Zone>; ZONES_COUNT]> = MaybeUninit::uninit();
+/// Frames may be allocated or freed from interrupt handlers, thus interrupts are disabled while a
+/// zone is locked so that a handler cannot spin on a lock held by the code it interrupted.
+static mut ZONES: MaybeUninit<[InterruptMutex<Zone>; ZONES_COUNT]> = MaybeUninit::uninit();
 
 /// Prepares the buddy allocator. Calling this function is required before setting the zone slots.
 pub fn prepare() {
@@ -103,7 +197,7 @@ pub fn set_zone_slot(slot: usize, zone: Zone) {
 	};
 
 	debug_assert!(slot < z.len());
-	z[slot] = Mutex::new(zone);
+	z[slot] = InterruptMutex::new(zone);
 }
 
 /// The size in bytes of a frame allocated by the buddy allocator with the given `order`.
@@ -129,7 +223,7 @@ pub fn get_order(pages: usize) -> FrameOrder {
 }
 
 /// Returns a mutable reference to a zone suitable for an allocation with the given type `type_`.
-fn get_suitable_zone(type_: usize) -> Option<&'static mut Mutex<Zone>> {
+fn get_suitable_zone(type_: usize) -> Option<&'static mut InterruptMutex<Zone>> {
 	let zones = unsafe {
 		ZONES.assume_init_mut()
 	};
@@ -137,7 +231,7 @@ fn get_suitable_zone(type_: usize) -> Option<&'static mut Mutex<Zone>> {
 	#[allow(clippy::needless_range_loop)]
 	for i in 0..zones.len() {
 		let is_valid = {
-			let guard = MutexGuard::new(&mut zones[i]);
+			let guard = zones[i].lock();
 			let zone = guard.get();
 			zone.type_ == type_ as _
 		};
@@ -149,7 +243,7 @@ fn get_suitable_zone(type_: usize) -> Option<&'static mut Mutex<Zone>> {
 }
 
 /// Returns a mutable reference to the zone that contains the given pointer.
-fn get_zone_for_pointer(ptr: *const c_void) -> Option<&'static mut Mutex<Zone>> {
+fn get_zone_for_pointer(ptr: *const c_void) -> Option<&'static mut InterruptMutex<Zone>> {
 	let zones = unsafe {
 		ZONES.assume_init_mut()
 	};
@@ -157,7 +251,7 @@ fn get_zone_for_pointer(ptr: *const c_void) -> Option<&'static mut Mutex<Zone>>
 	#[allow(clippy::needless_range_loop)]
 	for i in 0..zones.len() {
 		let is_valid = {
-			let guard = MutexGuard::new(&mut zones[i]);
+			let guard = zones[i].lock();
 			let zone = guard.get();
 			ptr >= zone.begin && (ptr as usize) < (zone.begin as usize) + zone.get_size()
 		};
@@ -171,26 +265,47 @@ fn get_zone_for_pointer(ptr: *const c_void) -> Option<&'static mut Mutex<Zone>>
 /// Allocates a frame of memory using the buddy allocator. `order` is the order of the frame to be
 /// allocated. The given frame shall fit the flags `flags`. If no suitable frame is found, the
 /// function returns an Err.
+///
+/// If memory is running low, single pages for userspace or for the page cache are reclaimed by
+/// evicting unused pages from the page cache. Other allocations may be made while the page cache
+/// is locked, such as by the kernel's memory allocator, thus they cannot reclaim.
 pub fn alloc(order: FrameOrder, flags: Flags) -> Result<*mut c_void, Errno> {
 	debug_assert!(order <= MAX_ORDER);
 
+	let usage = Usage::from_flags(flags);
+	let reclaimable = order == 0 && (usage == Usage::User || usage == Usage::PageCache);
+	loop {
+		let result = alloc_from_zones(order, flags);
+		if result.is_ok() || !reclaimable || page_cache::shrink(RECLAIM_PAGES) == 0 {
+			return result;
+		}
+	}
+}
+
+/// Allocates a frame of order `order` fitting the flags `flags` from the zones.
+fn alloc_from_zones(order: FrameOrder, flags: Flags) -> Result<*mut c_void, Errno> {
 	let begin_zone = (flags & ZONE_TYPE_MASK) as usize;
 	for i in begin_zone..ZONES_COUNT {
 		let z = get_suitable_zone(i);
 
 		if let Some(z) = z {
-			let mut guard = MutexGuard::new(z);
+			let mut guard = z.lock();
 			let zone = guard.get_mut();
 
 			let frame = zone.get_available_frame(order);
 			if let Some(f) = frame {
 				f.split(zone, order);
 				f.mark_used();
+				let usage = Usage::from_flags(flags);
+				f.usage = usage as _;
 				zone.allocated_pages += math::pow2(order as usize);
+				zone.allocated_frames[order as usize] += 1;
+				zone.usage_pages[usage as usize] += math::pow2(order as usize);
 
 				let ptr = f.get_ptr(zone);
 				debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
 				debug_assert!(ptr >= zone.begin && ptr < (zone.begin as usize + zone.get_size()) as _);
+				crate::trace!(trace::BUDDY_ALLOC, order, ptr as usize);
 				return Ok(ptr);
 			}
 		}
@@ -209,19 +324,24 @@ pub fn alloc_kernel(order: FrameOrder) -> Result<*mut c_void, Errno> {
 pub fn free(ptr: *const c_void, order: FrameOrder) {
 	debug_assert!(util::is_aligned(ptr, memory::PAGE_SIZE));
 	debug_assert!(order <= MAX_ORDER);
+	crate::trace!(trace::BUDDY_FREE, order, ptr as usize);
 
 	let z = get_zone_for_pointer(ptr).unwrap();
-	let mut guard = MutexGuard::new(z);
+	let mut guard = z.lock();
 	let zone = guard.get_mut();
 
 	let frame_id = zone.get_frame_id_from_ptr(ptr);
 	debug_assert!(frame_id < zone.get_pages_count());
 	let frame = zone.get_frame(frame_id);
-	unsafe {
+	let usage = unsafe {
+		let usage = (*frame).usage;
 		(*frame).mark_free(zone);
 		(*frame).coalesce(zone);
-	}
+		usage
+	};
 	zone.allocated_pages -= math::pow2(order as usize);
+	zone.allocated_frames[order as usize] -= 1;
+	zone.usage_pages[usage as usize] -= math::pow2(order as usize);
 }
 
 /// Frees the given memory frame. `ptr` is the *virtual* address to the beginning of the frame and
@@ -239,12 +359,28 @@ pub fn allocated_pages_count() -> usize {
 	};
 	#[allow(clippy::needless_range_loop)]
 	for i in 0..z.len() {
-		let guard = MutexGuard::new(&mut z[i]);
+		let guard = z[i].lock();
 		n += guard.get().get_allocated_pages();
 	}
 	n
 }
 
+/// Returns the type of the zone in slot `slot` along with statistics on its allocations.
+pub fn get_zone_stats(slot: usize) -> (Flags, ZoneStats) {
+	let z = unsafe {
+		ZONES.assume_init_mut()
+	};
+	let guard = z[slot].lock();
+	let zone = guard.get();
+
+	(zone.type_, ZoneStats {
+		pages_count: zone.get_pages_count() as _,
+		allocated_pages: zone.allocated_pages,
+		allocated_frames: zone.allocated_frames,
+		usage_pages: zone.usage_pages,
+	})
+}
+
 impl Zone {
 	/// Fills the free list during initialization according to the number of available pages.
 	fn fill_free_list(&mut self) {
@@ -285,6 +421,8 @@ impl Zone {
 		let mut z = Zone {
 			type_,
 			allocated_pages: 0,
+			allocated_frames: [0; (MAX_ORDER + 1) as usize],
+			usage_pages: [0; USAGES_COUNT],
 			metadata_begin,
 			begin,
 			pages_count,
@@ -604,6 +742,9 @@ impl Frame {
 mod test {
 	use super::*;
 	use core::ptr::null;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
+	use crate::selftest;
 
 	#[test_case]
 	fn buddy0() {
@@ -752,6 +893,35 @@ mod test {
 
 		debug_assert_eq!(allocated_pages_count(), alloc_pages);
 	}
+	#[test_case]
+	fn buddy_stats0() {
+		let slot = FLAG_ZONE_TYPE_KERNEL as usize;
+		let (_, before) = get_zone_stats(slot);
+
+		let p = alloc(2, FLAG_ZONE_TYPE_KERNEL | FLAG_USAGE_PAGE_CACHE).unwrap();
+		let (_, stats) = get_zone_stats(slot);
+		assert_eq!(stats.allocated_pages, before.allocated_pages + 4);
+		assert_eq!(stats.allocated_frames[2], before.allocated_frames[2] + 1);
+		let usage = Usage::PageCache as usize;
+		assert_eq!(stats.usage_pages[usage], before.usage_pages[usage] + 4);
+
+		free(p, 2);
+		let (_, after) = get_zone_stats(slot);
+		assert_eq!(after.allocated_frames[2], before.allocated_frames[2]);
+		assert_eq!(after.usage_pages[usage], before.usage_pages[usage]);
+	}
+
+	fn alloc_free_bench(b: &mut Bencher) {
+		for order in [0, 4].iter() {
+			b.iter_param(format_args!("{}", order), || {
+				let ptr = alloc_kernel(selftest::black_box(*order)).unwrap();
+				free_kernel(selftest::black_box(ptr), *order);
+			});
+		}
+	}
+
+	#[test_case]
+	static ALLOC_FREE_BENCH: Bench = Bench::new("buddy::alloc_free", alloc_free_bench);
 
 	// TODO Add more tests
 }
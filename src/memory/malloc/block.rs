@@ -36,7 +36,8 @@ impl Block {
 		let first_chunk_size = buddy::get_frame_size(order) - size_of::<Block>();
 		debug_assert!(first_chunk_size >= min_size);
 
-		let ptr = buddy::alloc_kernel(order)?;
+		let flags = buddy::FLAG_ZONE_TYPE_KERNEL | buddy::FLAG_USAGE_SLAB;
+		let ptr = memory::kern_to_virt(buddy::alloc(order, flags)?);
 		debug_assert!(ptr as *const _ >= memory::PROCESS_END);
 		let block = unsafe { // Safe since `ptr` is valid
 			ptr::write_volatile(ptr as *mut Block, Self {
@@ -57,6 +57,9 @@ pub struct Chunk {
 	flags: u8,
 	/// The size of the chunk's memory in bytes
 	size: usize,
+	/// The address of the code that allocated the chunk, if used.
+	#[cfg(config_debug_malloc_sites)]
+	pub site: u32,
 }
 
 /// A free chunk, wrapping the Chunk structure.
@@ -77,6 +80,8 @@ impl Chunk {
 			list: ListNode::new_single(),
 			flags: 0,
 			size: 0,
+			#[cfg(config_debug_malloc_sites)]
+			site: 0,
 		}
 	}
 
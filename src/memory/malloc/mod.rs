@@ -4,6 +4,8 @@
 
 mod block;
 mod chunk;
+#[cfg(config_debug_malloc_sites)]
+pub mod sites;
 
 use block::Block;
 use chunk::Chunk;
@@ -34,6 +36,7 @@ pub fn init() {
 
 /// Allocates `n` bytes of kernel memory and returns a pointer to the beginning of the allocated
 /// chunk. If the allocation fails, the function shall return an error.
+#[cfg_attr(config_debug_malloc_sites, inline(never))]
 pub unsafe fn alloc(n: usize) -> Result<*mut c_void, Errno> {
 	let _ = MutexGuard::new(&mut MUTEX);
 
@@ -50,6 +53,10 @@ pub unsafe fn alloc(n: usize) -> Result<*mut c_void, Errno> {
 	assert!(!chunk.is_used());
 	chunk.set_used(true);
 
+	// The function is never inlined, thus the return address in its frame is in the caller
+	#[cfg(config_debug_malloc_sites)]
+	sites::track(chunk, *(crate::register_get!("ebp") as *const u32).add(1));
+
 	let ptr = chunk.get_ptr();
 	debug_assert!(util::is_aligned(ptr, chunk::ALIGNEMENT));
 	debug_assert!(ptr as usize >= memory::PROCESS_END as usize);
@@ -89,6 +96,8 @@ pub unsafe fn realloc(ptr: *mut c_void, n: usize) -> Result<*mut c_void, Errno>
 	match n.cmp(&chunk_size) {
 		Ordering::Less => {
 			chunk.shrink(chunk_size - n);
+			#[cfg(config_debug_malloc_sites)]
+			sites::resize(chunk, chunk_size);
 			Ok(ptr)
 		},
 
@@ -96,9 +105,14 @@ pub unsafe fn realloc(ptr: *mut c_void, n: usize) -> Result<*mut c_void, Errno>
 			if !chunk.grow(n - chunk_size) {
 				let new_ptr = alloc(n)?;
 				util::memcpy(new_ptr, ptr, min(chunk.get_size(), n));
+				// The new chunk is accounted to the site that allocated the previous one
+				#[cfg(config_debug_malloc_sites)]
+				sites::retrack(Chunk::from_ptr(new_ptr), chunk.site);
 				free(ptr);
 				Ok(new_ptr)
 			} else {
+				#[cfg(config_debug_malloc_sites)]
+				sites::resize(chunk, chunk_size);
 				Ok(ptr)
 			}
 		},
@@ -118,6 +132,8 @@ pub unsafe fn free(ptr: *mut c_void) {
 	#[cfg(config_debug_debug)]
 	chunk.check();
 	assert!(chunk.is_used());
+	#[cfg(config_debug_malloc_sites)]
+	sites::untrack(chunk);
 
 	chunk.set_used(false);
 	ptr::write_volatile(&mut chunk.as_free_chunk().free_list, ListNode::new_single());
@@ -265,6 +281,9 @@ mod test {
 	use crate::memory;
 	use crate::util::math;
 	use super::*;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
+	use crate::selftest;
 
 	#[test_case]
 	fn alloc_free0() {
@@ -461,4 +480,16 @@ mod test {
 	}
 
 	// TODO More tests on free
+
+	fn alloc_free_bench(b: &mut Bencher) {
+		for size in [8, 64, memory::PAGE_SIZE].iter() {
+			b.iter_param(format_args!("{}", size), || unsafe {
+				let ptr = alloc(selftest::black_box(*size)).unwrap();
+				free(selftest::black_box(ptr));
+			});
+		}
+	}
+
+	#[test_case]
+	static ALLOC_FREE_BENCH: Bench = Bench::new("malloc::alloc_free", alloc_free_bench);
 }
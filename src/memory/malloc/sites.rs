@@ -0,0 +1,154 @@
+//! This module implements a tracker of the sites allocating memory with `malloc`, allowing to find
+//! which code holds memory when looking for leaks or bloat.
+//!
+//! Each used chunk stores the address of the code that allocated it. For each site, the tracker
+//! keeps the number of live allocations and their total size in a `FixedTable`, so that tracking
+//! never allocates memory.
+
+use core::ffi::c_void;
+use core::fmt;
+use crate::debug;
+use crate::util::fixed_table::FixedTable;
+use crate::util::lock::mutex::Mutex;
+use crate::util::lock::mutex::TMutex;
+use super::chunk::Chunk;
+
+/// The number of slots in the table of sites. This value must be a power of two.
+const SITES_COUNT: usize = 512;
+
+/// Statistics on the live allocations made by a site.
+#[derive(Clone, Copy)]
+struct Site {
+	/// The number of live allocations.
+	count: usize,
+	/// The total size of the live allocations in bytes.
+	size: usize,
+}
+
+/// An empty site, used for initialization.
+const EMPTY_SITE: Site = Site {
+	count: 0,
+	size: 0,
+};
+
+/// A table of sites, keyed by the address of the code calling the allocator. The allocations
+/// whose site is unknown are accounted in the overflow entry.
+struct SiteTable(FixedTable<Site, SITES_COUNT>);
+
+impl SiteTable {
+	/// Creates a new empty table.
+	const fn new() -> Self {
+		Self(FixedTable::new(EMPTY_SITE))
+	}
+
+	/// Returns the entry for the site at address `addr`, inserting it if not present.
+	fn get_mut(&mut self, addr: u32) -> &mut Site {
+		if addr == 0 {
+			self.0.get_other_mut()
+		} else {
+			self.0.get_mut(addr as _, EMPTY_SITE)
+		}
+	}
+
+	/// Accounts an allocation of `size` bytes made by the site at address `addr`.
+	fn add(&mut self, addr: u32, size: usize) {
+		let site = self.get_mut(addr);
+		site.count += 1;
+		site.size += size;
+	}
+
+	/// Accounts the release of an allocation of `size` bytes made by the site at address `addr`.
+	fn remove(&mut self, addr: u32, size: usize) {
+		let site = self.get_mut(addr);
+		site.count -= 1;
+		site.size -= size;
+	}
+}
+
+/// The table of sites.
+static mut SITES: Mutex<SiteTable> = Mutex::new(SiteTable::new());
+
+/// Records that the chunk `chunk` has been allocated by the code at address `addr`.
+pub fn track(chunk: &mut Chunk, addr: u32) {
+	chunk.site = addr;
+
+	let mutex = unsafe { // Safe because using Mutex
+		&mut SITES
+	};
+	mutex.lock().get_mut().add(addr, chunk.get_size());
+}
+
+/// Records that the chunk `chunk` is being freed.
+pub fn untrack(chunk: &Chunk) {
+	let mutex = unsafe { // Safe because using Mutex
+		&mut SITES
+	};
+	mutex.lock().get_mut().remove(chunk.site, chunk.get_size());
+}
+
+/// Records that the size of the chunk `chunk` has changed from `old_size` bytes. The number of
+/// allocations of the site is unchanged.
+pub fn resize(chunk: &Chunk, old_size: usize) {
+	let mutex = unsafe { // Safe because using Mutex
+		&mut SITES
+	};
+	let mut guard = mutex.lock();
+	let table = guard.get_mut();
+	table.remove(chunk.site, old_size);
+	table.add(chunk.site, chunk.get_size());
+}
+
+/// Accounts the chunk `chunk` to the site at address `addr` instead of the one that allocated it.
+pub fn retrack(chunk: &mut Chunk, addr: u32) {
+	untrack(chunk);
+	track(chunk, addr);
+}
+
+/// Writes the sites holding memory with `w`, one per line, with the address of the site, the
+/// number of live allocations, their total size in bytes and the name of the function.
+pub fn write(w: &mut dyn fmt::Write) -> fmt::Result {
+	let mutex = unsafe { // Safe because using Mutex
+		&mut SITES
+	};
+	let guard = mutex.lock();
+	let table = guard.get();
+
+	for (addr, site) in table.0.iter() {
+		if site.count == 0 {
+			continue;
+		}
+
+		let addr = addr.unwrap_or(0);
+		let name = if addr != 0 {
+			debug::get_function_name(addr as *const c_void).unwrap_or("???")
+		} else {
+			"(other)"
+		};
+		writeln!(w, "{:#010x} {} {} {}", addr, site.count, site.size, name)?;
+	}
+
+	Ok(())
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn site_table0() {
+		let mut table = SiteTable::new();
+
+		table.add(0x1000, 16);
+		table.add(0x1000, 32);
+		table.add(0x2000, 8);
+		table.add(0, 4);
+		assert_eq!(table.get_mut(0x1000).count, 2);
+		assert_eq!(table.get_mut(0x1000).size, 48);
+		assert_eq!(table.get_mut(0x2000).size, 8);
+		assert_eq!(table.get_mut(0).size, 4);
+
+		table.remove(0x1000, 16);
+		assert_eq!(table.get_mut(0x1000).count, 1);
+		assert_eq!(table.get_mut(0x1000).size, 32);
+	}
+}
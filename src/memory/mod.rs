@@ -7,6 +7,7 @@ pub mod buddy;
 pub mod malloc;
 pub mod memmap;
 pub mod stack;
+pub mod stats;
 pub mod vmem;
 
 use core::ffi::c_void;
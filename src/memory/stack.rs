@@ -28,3 +28,28 @@ pub unsafe fn switch<T>(stack: *mut c_void, f: fn(*mut c_void), data: T) -> Resu
 	stack_switch_(stack, f as _, data_ptr as _);
 	Ok(data_box.take())
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
+
+	/// The size of the stack used for benchmarks.
+	const BENCH_STACK_SIZE: usize = 8192;
+
+	// Switching to another stack and back is the core of a context switch, without the scheduler
+	fn switch_bench(b: &mut Bencher) {
+		let stack = Box::<[u8; BENCH_STACK_SIZE]>::new([0; BENCH_STACK_SIZE]).unwrap();
+		let stack_top = unsafe {
+			(stack.as_ptr() as *mut c_void).add(BENCH_STACK_SIZE)
+		};
+
+		b.iter(|| unsafe {
+			switch(stack_top, | _ | {}, 0).unwrap();
+		});
+	}
+
+	#[test_case]
+	static SWITCH_BENCH: Bench = Bench::new("stack::switch", switch_bench);
+}
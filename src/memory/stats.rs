@@ -0,0 +1,55 @@
+//! This module formats statistics on the usage of physical memory, which are exposed through the
+//! device `/dev/meminfo`.
+//!
+//! Each line is made of a name followed by a colon and values separated by spaces. Sizes are in
+//! pages.
+
+use core::fmt;
+use crate::memory::buddy;
+
+/// Returns the name of the zone with type `type_`.
+fn get_zone_name(type_: buddy::Flags) -> &'static str {
+	match type_ {
+		buddy::FLAG_ZONE_TYPE_USER => "user",
+		buddy::FLAG_ZONE_TYPE_KERNEL => "kernel",
+		buddy::FLAG_ZONE_TYPE_DMA => "dma",
+		_ => "unknown",
+	}
+}
+
+/// Writes the statistics on memory with `w`.
+pub fn write(w: &mut dyn fmt::Write) -> fmt::Result {
+	let mut usage_pages = [0; buddy::USAGES_COUNT];
+
+	for slot in 0..buddy::ZONES_COUNT {
+		let (type_, stats) = buddy::get_zone_stats(slot);
+		let name = get_zone_name(type_);
+
+		writeln!(w, "zone_{}_total: {}", name, stats.pages_count)?;
+		writeln!(w, "zone_{}_allocated: {}", name, stats.allocated_pages)?;
+
+		// The number of allocated frames for each order, starting from order 0
+		write!(w, "zone_{}_frames:", name)?;
+		for count in stats.allocated_frames.iter() {
+			write!(w, " {}", count)?;
+		}
+		writeln!(w)?;
+
+		for (total, pages) in usage_pages.iter_mut().zip(stats.usage_pages.iter()) {
+			*total += pages;
+		}
+	}
+
+	for (usage, pages) in buddy::USAGES.iter().zip(usage_pages.iter()) {
+		writeln!(w, "usage_{}: {}", usage.get_name(), pages)?;
+	}
+
+	#[cfg(config_debug_malloc_sites)]
+	{
+		// Each site has the following format: `<addr> <allocations> <bytes> <function>`
+		writeln!(w, "malloc_sites:")?;
+		super::malloc::sites::write(w)?;
+	}
+
+	Ok(())
+}
@@ -86,7 +86,8 @@ extern "C" {
 /// Allocates a paging object and returns its virtual address.
 /// Returns Err if the allocation fails.
 fn alloc_obj() -> Result<*mut u32, Errno> {
-	let ptr = buddy::alloc_kernel(0)? as *mut c_void;
+	let flags = buddy::FLAG_ZONE_TYPE_KERNEL | buddy::FLAG_USAGE_PAGE_TABLE;
+	let ptr = memory::kern_to_virt(buddy::alloc(0, flags)?) as *mut c_void;
 	unsafe {
 		util::bzero(ptr as _, buddy::get_frame_size(0));
 	}
@@ -4,8 +4,9 @@
 
 use core::ffi::c_void;
 use core::fmt;
-#[cfg(config_debug_debug)]
 use crate::debug;
+use crate::device::serial;
+use crate::logger;
 use crate::memory;
 use crate::tty;
 
@@ -42,6 +43,9 @@ it.");
 pub fn kernel_panic_(reason: &str, code: u32, _file: &str, _line: u32, _col: u32) -> ! {
 	crate::cli!();
 	print_panic(reason, code);
+	logger::force_flush();
+	debug::trace::dump();
+	serial::flush_all();
 	crate::halt();
 }
 
@@ -60,6 +64,9 @@ pub fn kernel_panic_(reason: &str, code: u32, file: &str, line: u32, col: u32) -
 		crate::register_get!("ebp") as *const _
 	};
 	debug::print_callstack(ebp, 8);
+	logger::force_flush();
+	debug::trace::dump();
+	serial::flush_all();
 
 	crate::halt();
 }
@@ -82,6 +89,9 @@ it.");
 pub fn rust_panic<'a>(args: &'a fmt::Arguments<'a>) -> ! {
 	crate::cli!();
 	print_rust_panic(args);
+	logger::force_flush();
+	debug::trace::dump();
+	serial::flush_all();
 
 	crate::halt();
 }
@@ -97,6 +107,9 @@ pub fn rust_panic<'a>(args: &'a fmt::Arguments<'a>) -> ! {
 		crate::register_get!("ebp") as *const _
 	};
 	debug::print_callstack(ebp, 8);
+	logger::force_flush();
+	debug::trace::dump();
+	serial::flush_all();
 
 	crate::halt();
 }
@@ -18,8 +18,15 @@ const CHANNEL_2: u16 = 0x42;
 /// The port to send a command to the PIT.
 const PIT_COMMAND: u16 = 0x43;
 
-/// The command to enable the PC speaker.
-const BEEPER_ENABLE_COMMAND: u8 = 0x61;
+/// The port controlling the gate of channel 2 and the PC speaker. It also reports the state of
+/// channel 2's output.
+const CONTROL_PORT: u16 = 0x61;
+/// Bit of the control port enabling the gate of channel 2.
+const CONTROL_GATE_2: u8 = 1 << 0;
+/// Bit of the control port connecting channel 2 to the PC speaker.
+const CONTROL_SPEAKER: u8 = 1 << 1;
+/// Bit of the control port reporting the state of channel 2's output.
+const CONTROL_OUT_2: u8 = 1 << 5;
 
 /// TODO doc
 const SELECT_CHANNEL_0: u8 = 0x0;
@@ -53,7 +60,7 @@ const MODE_4: u8 = 0x4;
 const MODE_5: u8 = 0x5;
 
 /// The base frequency of the PIT.
-const BASE_FREQUENCY: Frequency = 1193180;
+pub const BASE_FREQUENCY: Frequency = 1193180;
 
 /// The current frequency of the PIT.
 static mut CURRENT_FREQUENCY: Mutex::<Frequency> = Mutex::new(0);
@@ -101,6 +108,29 @@ pub fn set_frequency(frequency: Frequency) {
 	set_value(c as u16);
 }
 
+/// Starts a countdown of `count` ticks of the base frequency on channel 2. Since this channel is
+/// not connected to an interrupt, the end of the countdown has to be polled with
+/// `is_countdown_over`. This is meant to calibrate other timers.
+pub fn start_countdown(count: u16) {
+	unsafe {
+		// Enabling the gate without the speaker
+		let control = io::inb(CONTROL_PORT);
+		io::outb(CONTROL_PORT, (control & !CONTROL_SPEAKER) | CONTROL_GATE_2);
+
+		// In mode 0, the output goes high when the counter reaches zero
+		io::outb(PIT_COMMAND, SELECT_CHANNEL_2 | ACCESS_LOBYTE_HIBYTE | MODE_0);
+		io::outb(CHANNEL_2, (count & 0xff) as u8);
+		io::outb(CHANNEL_2, ((count >> 8) & 0xff) as u8);
+	}
+}
+
+/// Tells whether the countdown started with `start_countdown` is over.
+pub fn is_countdown_over() -> bool {
+	unsafe {
+		io::inb(CONTROL_PORT) & CONTROL_OUT_2 != 0
+	}
+}
+
 /// Makes PC speaker ring the bell.
 pub fn beep() {
 	// TODO
@@ -3,14 +3,11 @@
 //! argument but they will be kept in the logger anyways.
 
 use crate::logger;
-use crate::util::lock::mutex::MutexGuard;
 
 /// Prints the specified message on the current TTY. This function is meant to be used through
 /// `print!` and `println!` macros only.
 pub fn _print(args: core::fmt::Arguments) {
-	let mutex = logger::get();
-	let mut guard = MutexGuard::new(mutex);
-	core::fmt::write(guard.get_mut(), args).ok();
+	logger::log(args);
 }
 
 /// Prints the given formatted string with the given values.
@@ -0,0 +1,312 @@
+//! A futex (Fast Userspace Mutex) allows userspace to implement blocking synchronization
+//! primitives. The lock itself is an integer in userspace memory, which is manipulated with
+//! atomic operations. The kernel is called only when a process has to sleep or to wake up other
+//! processes.
+//!
+//! Waiting processes are stored into buckets according to the hash of the futex's key.
+//! A private futex is identified by its memory space and its virtual address, while a shared
+//! futex is identified by its physical address, which requires a translation.
+
+use core::cmp::max;
+use core::cmp::min;
+use core::ffi::c_void;
+use core::ptr;
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::process::State;
+use crate::process::pid::Pid;
+use crate::time::timer::Tick;
+use crate::time::timer::TimerId;
+use crate::time::timer;
+use crate::util::container::vec::Vec;
+use crate::util::lock::mutex::*;
+use crate::util;
+
+/// Operation: waits on the futex if its value equals the given value.
+pub const FUTEX_WAIT: u32 = 0;
+/// Operation: wakes processes waiting on the futex.
+pub const FUTEX_WAKE: u32 = 1;
+/// Operation: wakes processes waiting on the futex, then moves the remaining waiters to another
+/// futex.
+pub const FUTEX_REQUEUE: u32 = 3;
+/// Same as `FUTEX_REQUEUE`, except the operation checks the value of the futex first.
+pub const FUTEX_CMP_REQUEUE: u32 = 4;
+/// Flag telling that the futex is not shared with other memory spaces, which avoids the
+/// translation to the physical address.
+pub const FUTEX_PRIVATE_FLAG: u32 = 128;
+
+/// The number of waiters buckets.
+const BUCKETS_COUNT: usize = 64;
+
+/// The key identifying a futex.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub enum FutexKey {
+	/// A futex that is private to a memory space.
+	Private {
+		/// The address of the memory space.
+		mem_space: usize,
+		/// The virtual address of the futex.
+		addr: usize,
+	},
+	/// A futex that may be shared between several memory spaces.
+	Shared {
+		/// The physical address of the futex.
+		addr: usize,
+	},
+}
+
+impl FutexKey {
+	/// Creates the key for the futex at virtual address `addr` in the memory space of the process
+	/// `proc`.
+	/// `private` tells whether the futex is private to the memory space.
+	pub fn new(proc: &mut Process, addr: *const u32, private: bool) -> Result<Self, Errno> {
+		if !util::is_aligned(addr as _, 4) {
+			return Err(errno::EINVAL);
+		}
+
+		let mut mem_space_guard = proc.get_mem_space_mut().lock();
+		let mem_space = mem_space_guard.get_mut();
+		if !mem_space.can_access(addr as _, 4, true, false) {
+			return Err(errno::EFAULT);
+		}
+
+		if private {
+			// Threads sharing the memory space share the same structure
+			Ok(Self::Private {
+				mem_space: mem_space as *const _ as usize,
+				addr: addr as usize,
+			})
+		} else {
+			// The page must be resident and private to the memory space, else its physical
+			// address might change after the key is created
+			mem_space.fault_in(addr as _)?;
+			let phys_addr = mem_space.get_vmem().translate(addr as *const c_void)
+				.ok_or(errno::EFAULT)?;
+			Ok(Self::Shared {
+				addr: phys_addr as usize,
+			})
+		}
+	}
+
+	/// Returns the index of the bucket associated with the key.
+	fn get_bucket_index(&self) -> usize {
+		let (a, b) = match self {
+			Self::Private { mem_space, addr } => (*mem_space, *addr),
+			Self::Shared { addr } => (0, *addr),
+		};
+
+		// Fibonacci hashing, the low bits of the address being always zero
+		let hash = (a ^ (b >> 2)).wrapping_mul(0x9e3779b9);
+		(hash >> (32 - 6)) % BUCKETS_COUNT
+	}
+}
+
+/// Structure representing a process waiting on a futex.
+#[derive(Clone, Copy)]
+struct Waiter {
+	/// The key of the futex.
+	key: FutexKey,
+	/// The PID of the waiting process.
+	pid: Pid,
+	/// The timer of the timeout, if any.
+	timer: Option<TimerId>,
+}
+
+/// An empty bucket, used for initialization.
+const EMPTY_BUCKET: Mutex<Vec<Waiter>> = Mutex::new(Vec::new());
+/// The waiters buckets. Waiters are stored in FIFO order.
+static mut BUCKETS: [Mutex<Vec<Waiter>>; BUCKETS_COUNT] = [EMPTY_BUCKET; BUCKETS_COUNT];
+
+/// Returns the bucket at index `i`.
+fn get_bucket(i: usize) -> &'static mut Mutex<Vec<Waiter>> {
+	unsafe { // Safe because using Mutex
+		&mut BUCKETS[i]
+	}
+}
+
+/// Called when the timeout of the waiter with PID `pid` expires. The waiter is removed and the
+/// process is woken up with the error `ETIMEDOUT`.
+fn timeout(pid: usize) {
+	let pid = pid as Pid;
+
+	// The waiter may have been requeued to another bucket
+	let found = (0..BUCKETS_COUNT).any(| i | {
+		let mut guard = get_bucket(i).lock();
+		let waiters = guard.get_mut();
+
+		if let Some(j) = waiters.iter().position(| w | w.pid == pid) {
+			waiters.remove(j);
+			true
+		} else {
+			false
+		}
+	});
+	if !found {
+		return;
+	}
+
+	if let Some(mut proc) = Process::get_by_pid(pid) {
+		let mut guard = proc.lock();
+		let proc = guard.get_mut();
+
+		if proc.get_state() == State::Sleeping {
+			let mut regs = *proc.get_regs();
+			regs.eax = (-errno::ETIMEDOUT) as _;
+			proc.set_regs(&regs);
+			proc.set_state(State::Running);
+		}
+	}
+}
+
+/// Makes the process `proc` wait on the futex at address `addr` if its value is equal to `val`.
+/// `private` tells whether the futex is private to the memory space.
+/// `timeout` is the maximum number of ticks to wait. If None, the process waits until woken up.
+/// On success, the process is put in `Sleeping` state. If the value doesn't match, the function
+/// returns `EAGAIN`. If the timeout expires, the process is woken up with the error `ETIMEDOUT`.
+pub fn wait(proc: &mut Process, addr: *const u32, val: u32, private: bool,
+	timeout: Option<Tick>) -> Result<(), Errno> {
+	let key = FutexKey::new(proc, addr, private)?;
+	let mut guard = get_bucket(key.get_bucket_index()).lock();
+
+	// The value is checked with the bucket locked so that a wake up cannot be missed
+	let curr = unsafe { // Safe because the access has been checked when creating the key
+		ptr::read_volatile(addr)
+	};
+	if curr != val {
+		return Err(errno::EAGAIN);
+	}
+
+	let pid = proc.get_pid();
+	let timer = match timeout {
+		Some(ticks) => Some(timer::add(ticks, 0, self::timeout, pid as _)?),
+		None => None,
+	};
+	let result = guard.get_mut().push(Waiter {
+		key,
+		pid,
+		timer,
+	});
+	if let Err(e) = result {
+		if let Some(timer) = timer {
+			timer::cancel(timer);
+		}
+		return Err(e);
+	}
+	proc.set_state(State::Sleeping);
+
+	Ok(())
+}
+
+/// Wakes at most `count` processes of the bucket `waiters` waiting on the futex with key `key`,
+/// removing them from the bucket.
+/// The function returns the number of processes that have been woken up.
+fn wake_waiters(waiters: &mut Vec<Waiter>, key: FutexKey, count: u32) -> u32 {
+	let mut woken = 0;
+	let mut i = 0;
+	while woken < count && i < waiters.len() {
+		if waiters[i].key == key {
+			let waiter = waiters.remove(i);
+			if let Some(timer) = waiter.timer {
+				timer::cancel(timer);
+			}
+			if Process::wake_by_pid(waiter.pid) {
+				woken += 1;
+			}
+		} else {
+			i += 1;
+		}
+	}
+
+	woken
+}
+
+/// Wakes at most `count` processes waiting on the futex with key `key`.
+/// The function returns the number of processes that have been woken up.
+pub fn wake(key: FutexKey, count: u32) -> u32 {
+	let mut guard = get_bucket(key.get_bucket_index()).lock();
+	wake_waiters(guard.get_mut(), key, count)
+}
+
+/// Wakes at most `count` processes waiting on the futex with key `key`, then moves at most
+/// `requeue_count` of the remaining waiters to the futex with key `key2`. This allows to avoid
+/// waking up processes that would immediately wait on the second futex.
+/// If `expected` is set to an address and a value, the function returns `EAGAIN` if the futex at
+/// this address doesn't hold this value. The access to the address must have been checked.
+/// Both buckets stay locked during the whole operation so that no waiter can be added or woken up
+/// in between.
+/// The function returns the number of processes that have been woken up or moved.
+pub fn requeue(key: FutexKey, count: u32, key2: FutexKey, requeue_count: u32,
+	expected: Option<(*const u32, u32)>) -> Result<u32, Errno> {
+	let i1 = key.get_bucket_index();
+	let i2 = key2.get_bucket_index();
+	// The value is checked with the buckets locked so that a wake up cannot be missed
+	let check = || {
+		if let Some((addr, val)) = expected {
+			let curr = unsafe { // Safe because the access has been checked by the caller
+				ptr::read_volatile(addr)
+			};
+			if curr != val {
+				return Err(errno::EAGAIN);
+			}
+		}
+
+		Ok(())
+	};
+
+	if i1 == i2 {
+		// Both futexes are in the same bucket, only the keys have to be changed
+		let mut guard = get_bucket(i1).lock();
+		check()?;
+		let waiters = guard.get_mut();
+		let total = wake_waiters(waiters, key, count);
+		let mut moved = 0;
+
+		for i in 0..waiters.len() {
+			if moved >= requeue_count {
+				break;
+			}
+
+			if waiters[i].key == key {
+				waiters[i].key = key2;
+				moved += 1;
+			}
+		}
+
+		return Ok(total + moved);
+	}
+
+	// Buckets are always locked in the same order to avoid deadlocks
+	let mut first_guard = get_bucket(min(i1, i2)).lock();
+	let mut second_guard = get_bucket(max(i1, i2)).lock();
+	let (src, dst) = if i1 < i2 {
+		(first_guard.get_mut(), second_guard.get_mut())
+	} else {
+		(second_guard.get_mut(), first_guard.get_mut())
+	};
+	check()?;
+	let total = wake_waiters(src, key, count);
+
+	let mut moved = 0;
+	let mut i = 0;
+	while moved < requeue_count && i < src.len() {
+		if src[i].key == key {
+			let waiter = src.remove(i);
+
+			if let Err(e) = dst.push(Waiter {
+				key: key2,
+				..waiter
+			}) {
+				// Putting the waiter back cannot fail since removing doesn't shrink the vector
+				src.insert(i, waiter).unwrap();
+				return Err(e);
+			}
+
+			moved += 1;
+		} else {
+			i += 1;
+		}
+	}
+
+	Ok(total + moved)
+}
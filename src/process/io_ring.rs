@@ -0,0 +1,329 @@
+//! An I/O ring is a pair of circular queues shared between a process and the kernel, allowing
+//! the process to submit several I/O operations at once and to retrieve their results without
+//! performing one system call per operation.
+//!
+//! The rings are stored in a single memory mapping of the process, with the following layout:
+//! - The submission ring header, followed by the submission entries
+//! - The completion ring header, followed by the completion entries
+//!
+//! The process pushes entries on the submission ring by writing them and then incrementing the
+//! ring's tail. The kernel consumes them by incrementing the head. The completion ring works the
+//! same way in the other direction.
+
+use core::ffi::c_void;
+use core::mem::size_of;
+use core::ptr;
+use core::slice;
+use core::sync::atomic;
+use crate::errno::Errno;
+use crate::errno;
+use crate::memory;
+use crate::process::Process;
+use crate::process::mem_space::MemSpace;
+use crate::process::mem_space::MAPPING_FLAG_NOLAZY;
+use crate::process::mem_space::MAPPING_FLAG_USER;
+use crate::process::mem_space::MAPPING_FLAG_WRITE;
+use crate::util::lock::mutex::TMutex;
+use crate::util::math;
+
+/// The maximum number of entries in a ring.
+pub const MAX_ENTRIES: u32 = 4096;
+
+/// Opcode of an operation that does nothing.
+pub const OP_NOP: u8 = 0;
+/// Opcode of a read operation.
+pub const OP_READ: u8 = 1;
+/// Opcode of a write operation.
+pub const OP_WRITE: u8 = 2;
+
+/// Offset value telling that the operation must use (and update) the file descriptor's current
+/// offset.
+pub const OFFSET_CURRENT: u64 = u64::MAX;
+
+/// The header of a ring, shared with userspace.
+#[repr(C)]
+pub struct RingHeader {
+	/// The index of the next entry to be consumed.
+	head: u32,
+	/// The index of the next entry to be produced.
+	tail: u32,
+	/// The mask to apply to an index to get the position of the entry in the ring.
+	mask: u32,
+	/// The number of entries in the ring.
+	entries: u32,
+}
+
+/// An entry of the submission ring, describing an operation to perform.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct SubmissionEntry {
+	/// The operation's opcode.
+	opcode: u8,
+	/// Reserved for future use.
+	flags: u8,
+	/// Padding.
+	_padding: u16,
+	/// The file descriptor on which the operation is performed.
+	fd: u32,
+	/// The offset in the file. If `OFFSET_CURRENT`, the file descriptor's offset is used.
+	off: u64,
+	/// The address of the buffer in userspace.
+	addr: u32,
+	/// The length of the buffer in bytes.
+	len: u32,
+	/// Data given by userspace, copied as-is into the completion entry.
+	user_data: u64,
+}
+
+/// An entry of the completion ring, giving the result of an operation.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct CompletionEntry {
+	/// The data given in the submission entry.
+	user_data: u64,
+	/// The result of the operation. If negative, the value is an errno.
+	res: i32,
+	/// Reserved for future use.
+	flags: u32,
+}
+
+/// Structure filled by the kernel at the creation of an I/O ring to tell userspace where the
+/// rings are located.
+#[repr(C)]
+pub struct IORingParams {
+	/// The number of entries in each ring.
+	pub entries: u32,
+	/// The address of the beginning of the mapping containing the rings.
+	pub addr: u32,
+	/// The offset of the submission ring's header in the mapping.
+	pub sq_off: u32,
+	/// The offset of the completion ring's header in the mapping.
+	pub cq_off: u32,
+}
+
+/// Structure representing an I/O ring bound to a process.
+#[derive(Clone, Copy)]
+pub struct IORing {
+	/// The number of entries in each ring.
+	entries: u32,
+
+	/// Pointer to the submission ring's header.
+	sq: *mut RingHeader,
+	/// Pointer to the submission ring's entries.
+	sqes: *mut SubmissionEntry,
+	/// Pointer to the completion ring's header.
+	cq: *mut RingHeader,
+	/// Pointer to the completion ring's entries.
+	cqes: *mut CompletionEntry,
+}
+
+/// Returns the offset of the completion ring's header in the mapping for a ring of `entries`
+/// entries.
+fn get_cq_offset(entries: u32) -> usize {
+	let sq_size = size_of::<RingHeader>() + entries as usize * size_of::<SubmissionEntry>();
+	math::ceil_division(sq_size, size_of::<u64>()) * size_of::<u64>()
+}
+
+/// Returns the total size of the mapping in bytes for a ring of `entries` entries.
+fn get_mapping_size(entries: u32) -> usize {
+	get_cq_offset(entries) + size_of::<RingHeader>()
+		+ entries as usize * size_of::<CompletionEntry>()
+}
+
+impl IORing {
+	/// Creates a new I/O ring in the memory space of the process `proc`.
+	/// `entries` is the number of entries in each ring. It must be a power of two and must not
+	/// exceed `MAX_ENTRIES`.
+	/// On success, the function returns the ring and the parameters to be given to userspace.
+	pub fn new(proc: &mut Process, entries: u32) -> Result<(Self, IORingParams), Errno> {
+		if entries == 0 || entries > MAX_ENTRIES || !entries.is_power_of_two() {
+			return Err(errno::EINVAL);
+		}
+
+		let cq_off = get_cq_offset(entries);
+		let pages = math::ceil_division(get_mapping_size(entries), memory::PAGE_SIZE);
+		// The mapping is not lazy since the kernel accesses it directly
+		let flags = MAPPING_FLAG_WRITE | MAPPING_FLAG_USER | MAPPING_FLAG_NOLAZY;
+		let ptr = proc.get_mem_space_mut().lock().get_mut()
+			.map(None, pages, flags)? as *mut u8;
+
+		let s = unsafe { // Safe because the mapping is large enough
+			Self {
+				entries,
+
+				sq: ptr as *mut RingHeader,
+				sqes: ptr.add(size_of::<RingHeader>()) as *mut SubmissionEntry,
+				cq: ptr.add(cq_off) as *mut RingHeader,
+				cqes: ptr.add(cq_off + size_of::<RingHeader>()) as *mut CompletionEntry,
+			}
+		};
+
+		unsafe { // Safe because the mapping is bound to the current process
+			for header in &[s.sq, s.cq] {
+				ptr::write_volatile(*header, RingHeader {
+					head: 0,
+					tail: 0,
+					mask: entries - 1,
+					entries,
+				});
+			}
+		}
+
+		let params = IORingParams {
+			entries,
+			addr: ptr as _,
+			sq_off: 0,
+			cq_off: cq_off as _,
+		};
+		Ok((s, params))
+	}
+
+	/// Checks that the rings are still mapped in the memory space `mem_space` and makes their
+	/// pages resident and private, so that the kernel can access them without faulting. For
+	/// example, the pages are subject to Copy-On-Write after a fork.
+	/// This function must be called before accessing the rings.
+	pub fn check_access(&self, mem_space: &mut MemSpace) -> Result<(), Errno> {
+		let size = get_mapping_size(self.entries);
+		if !mem_space.can_access(self.sq as _, size, true, true) {
+			return Err(errno::EFAULT);
+		}
+
+		mem_space.fault_in_range(self.sq as _, size)
+	}
+
+	/// Returns the number of entries in each ring.
+	pub fn get_entries(&self) -> u32 {
+		self.entries
+	}
+
+	/// Performs the operation described by the submission entry `sqe` for process `proc`.
+	/// The function returns the number of bytes transfered.
+	fn perform(proc: &mut Process, sqe: &SubmissionEntry) -> Result<i32, Errno> {
+		if sqe.opcode == OP_NOP {
+			return Ok(0);
+		}
+
+		let write = match sqe.opcode {
+			OP_READ => false,
+			OP_WRITE => true,
+			_ => return Err(errno::EINVAL),
+		};
+
+		let buf = sqe.addr as *mut u8;
+		let len = sqe.len as usize;
+		{
+			let mut mem_space_guard = proc.get_mem_space_mut().lock();
+			let mem_space = mem_space_guard.get_mut();
+			if !mem_space.can_access(buf, len, true, !write) {
+				return Err(errno::EFAULT);
+			}
+
+			// Reading from the file writes to the buffer, which must not fault
+			if !write {
+				mem_space.fault_in_range(buf as _, len)?;
+			}
+		}
+
+		proc.with_fd(sqe.fd, | fd | {
+			let off = if sqe.off == OFFSET_CURRENT {
+				fd.get_offset()
+			} else {
+				sqe.off
+			};
+
+			let len = {
+				let file = fd.get_file_mut();
+				let mut file_guard = file.lock();
+
+				// Safe because the permission to access the memory has been checked before
+				if write {
+					let data = unsafe {
+						slice::from_raw_parts(buf, len)
+					};
+					file_guard.get_mut().write(off as usize, data)?
+				} else {
+					let data = unsafe {
+						slice::from_raw_parts_mut(buf, len)
+					};
+					file_guard.get_mut().read(off as usize, data)?
+				}
+			};
+
+			if sqe.off == OFFSET_CURRENT {
+				fd.set_offset(off + len as u64);
+			}
+			Ok(len as _)
+		})
+	}
+
+	/// Consumes at most `to_submit` entries from the submission ring, performs the associated
+	/// operations for process `proc`, then pushes their results on the completion ring.
+	/// If the completion ring is full, the remaining submissions are left on the ring for a
+	/// subsequent call.
+	/// The function returns the number of consumed submission entries.
+	///
+	/// The rings' memory must be accessible, meaning that the process's memory space must be
+	/// bound and `check_access` must have succeeded.
+	pub fn submit(&self, proc: &mut Process, to_submit: u32) -> u32 {
+		let mask = self.entries - 1;
+		let mut submitted = 0;
+
+		unsafe { // Safe because the mapping is bound to the current process
+			let mut sq_head = ptr::read_volatile(&(*self.sq).head);
+			let sq_tail = ptr::read_volatile(&(*self.sq).tail);
+			let cq_head = ptr::read_volatile(&(*self.cq).head);
+			let mut cq_tail = ptr::read_volatile(&(*self.cq).tail);
+			// Ensures entries are read after the tail
+			atomic::fence(atomic::Ordering::Acquire);
+
+			while submitted < to_submit && sq_head != sq_tail
+				&& cq_tail.wrapping_sub(cq_head) < self.entries {
+				let sqe = ptr::read_volatile(self.sqes.add((sq_head & mask) as usize));
+				sq_head = sq_head.wrapping_add(1);
+
+				let res = match Self::perform(proc, &sqe) {
+					Ok(n) => n,
+					Err(errno) => -errno,
+				};
+				ptr::write_volatile(self.cqes.add((cq_tail & mask) as usize), CompletionEntry {
+					user_data: sqe.user_data,
+					res,
+					flags: 0,
+				});
+				cq_tail = cq_tail.wrapping_add(1);
+
+				submitted += 1;
+			}
+
+			// Ensures entries are written before the heads and tails
+			atomic::fence(atomic::Ordering::Release);
+			ptr::write_volatile(&mut (*self.sq).head, sq_head);
+			ptr::write_volatile(&mut (*self.cq).tail, cq_tail);
+		}
+
+		submitted
+	}
+
+	/// Returns the number of entries waiting on the submission ring.
+	pub fn get_submissions_count(&self) -> u32 {
+		unsafe { // Safe because the mapping is bound to the current process
+			let head = ptr::read_volatile(&(*self.sq).head);
+			let tail = ptr::read_volatile(&(*self.sq).tail);
+			tail.wrapping_sub(head)
+		}
+	}
+
+	/// Returns the number of entries available on the completion ring.
+	pub fn get_completions_count(&self) -> u32 {
+		unsafe { // Safe because the mapping is bound to the current process
+			let head = ptr::read_volatile(&(*self.cq).head);
+			let tail = ptr::read_volatile(&(*self.cq).tail);
+			tail.wrapping_sub(head)
+		}
+	}
+
+	/// Returns a pointer to the beginning of the mapping containing the rings.
+	pub fn get_ptr(&self) -> *const c_void {
+		self.sq as _
+	}
+}
@@ -1,9 +1,11 @@
 //! A gap is a region of the virtual memory which is available for allocation.
 
+use core::cmp::max;
 use core::ffi::c_void;
 use crate::memory;
 use crate::util::FailableClone;
-use crate::util::list::ListNode;
+use crate::util::rbtree::RBElement;
+use crate::util::rbtree::RBNode;
 use crate::util;
 
 /// A gap in the memory space that can use for new mappings.
@@ -13,8 +15,11 @@ pub struct MemGap {
 	/// The size of the gap in pages.
 	size: usize,
 
-	/// The node in the list storing the gap to be searched by size.
-	pub list: ListNode,
+	/// The size in pages of the largest gap in the subtree of this gap. Maintained by the tree
+	/// to find a gap large enough for a mapping in logarithmic time.
+	max_size: usize,
+	/// The node in the tree storing the gaps.
+	pub node: RBNode,
 }
 
 impl MemGap {
@@ -30,7 +35,8 @@ impl MemGap {
 			begin,
 			size,
 
-			list: ListNode::new_single(),
+			max_size: size,
+			node: RBNode::new(),
 		}
 	}
 
@@ -44,31 +50,55 @@ impl MemGap {
 		self.size
 	}
 
-	/// Creates a new gap to replace the current one after mapping memory on it. After calling
-	/// this function, the callee shall removed the current gap from its container before inserting
-	/// the new one in it.
-	/// `size` is the size of the part that has been consumed on the gap.
-	/// The function returns a new gap. If the gap is fully consumed, the function returns None.
-	pub fn consume(&self, size: usize) -> Option::<Self> {
-		debug_assert!(size <= self.size);
-		if size < self.size {
-			let new_addr = ((self.begin as usize) + (size * memory::PAGE_SIZE)) as _;
-			let new_size = self.size - size;
-			Some(Self::new(new_addr, new_size))
-		} else {
-			None
-		}
+	/// Returns the size in memory pages of the largest gap in the subtree of this gap.
+	pub fn get_max_size(&self) -> usize {
+		self.max_size
+	}
+
+	/// Consumes the beginning of the gap after mapping memory on it. After calling this function,
+	/// the caller shall update the gap in its tree.
+	/// `size` is the size of the part that has been consumed on the gap. It must be lower than
+	/// the size of the gap.
+	pub fn consume(&mut self, size: usize) {
+		debug_assert!(size < self.size);
+
+		self.begin = ((self.begin as usize) + (size * memory::PAGE_SIZE)) as _;
+		self.size -= size;
+	}
+
+	/// Shrinks the gap to the given size `size`, removing pages at its end. After calling this
+	/// function, the caller shall update the gap in its tree.
+	pub fn truncate(&mut self, size: usize) {
+		debug_assert!(size > 0 && size <= self.size);
+		self.size = size;
+	}
+
+	/// Extends the gap by `size` pages at its end. After calling this function, the caller shall
+	/// update the gap in its tree.
+	pub fn extend(&mut self, size: usize) {
+		self.size += size;
+	}
+}
+
+impl RBElement for MemGap {
+	type Key = *const c_void;
+
+	const AUGMENTED: bool = true;
+
+	fn get_key(&self) -> Self::Key {
+		self.begin
+	}
+
+	fn augment(&mut self, left: Option<&Self>, right: Option<&Self>) {
+		let left = left.map_or(0, | g | g.max_size);
+		let right = right.map_or(0, | g | g.max_size);
+		self.max_size = max(self.size, max(left, right));
 	}
 }
 
 impl Clone for MemGap {
 	fn clone(&self) -> Self {
-		Self {
-			begin: self.begin,
-			size: self.size,
-
-			list: ListNode::new_single(),
-		}
+		Self::new(self.begin, self.size)
 	}
 }
 
@@ -5,6 +5,8 @@ use core::ffi::c_void;
 use core::ptr::NonNull;
 use core::ptr;
 use crate::errno::Errno;
+use crate::file::File;
+use crate::file::page_cache;
 use crate::memory::buddy;
 use crate::memory::vmem::VMem;
 use crate::memory::vmem::vmem_switch;
@@ -12,6 +14,9 @@ use crate::memory::vmem;
 use crate::memory;
 use crate::util::boxed::Box;
 use crate::util::lock::mutex::*;
+use crate::util::ptr::SharedPtr;
+use crate::util::rbtree::RBElement;
+use crate::util::rbtree::RBNode;
 use crate::util;
 use super::MemSpace;
 
@@ -39,6 +44,19 @@ fn get_default_page() -> *const c_void {
 	default_page.unwrap()
 }
 
+/// Structure representing the content of a file backing a mapping.
+#[derive(Clone)]
+pub struct FileBacking {
+	/// The file.
+	pub file: SharedPtr<File>,
+	/// The offset in the file of the data at the beginning of the mapping. This offset must be
+	/// page-aligned.
+	pub off: u64,
+	/// The number of bytes from the beginning of the mapping that are read from the file. The
+	/// rest of the mapping is filled with zeros.
+	pub size: usize,
+}
+
 /// A mapping in the memory space.
 pub struct MemMapping {
 	/// Pointer on the virtual memory to the beginning of the mapping
@@ -47,9 +65,18 @@ pub struct MemMapping {
 	size: usize,
 	/// The mapping's flags.
 	flags: u8,
+	/// The file backing the mapping, if any. Pages of a file-backed mapping are read from the
+	/// file on the first access.
+	file: Option<FileBacking>,
+	/// The number of pages of the mapping that are backed by a physical page, not counting the
+	/// default page.
+	resident: usize,
 
 	/// Pointer to the virtual memory context handler.
 	vmem: NonNull::<dyn VMem>, // TODO Use a weak pointer
+
+	/// The node in the tree storing the mappings.
+	pub node: RBNode,
 }
 
 impl MemMapping {
@@ -67,11 +94,26 @@ impl MemMapping {
 			begin,
 			size,
 			flags,
+			file: None,
+			resident: 0,
 
 			vmem,
+
+			node: RBNode::new(),
 		}
 	}
 
+	/// Creates a new instance backed by the file described by `file`. Arguments are the same as
+	/// `new`.
+	pub fn new_file(begin: *const c_void, size: usize, flags: u8, file: FileBacking,
+		vmem: NonNull::<dyn VMem>) -> Self {
+		debug_assert!(util::is_aligned(file.off as _, memory::PAGE_SIZE));
+
+		let mut s = Self::new(begin, size, flags, vmem);
+		s.file = Some(file);
+		s
+	}
+
 	/// Returns a pointer on the virtual memory to the beginning of the mapping.
 	pub fn get_begin(&self) -> *const c_void {
 		self.begin
@@ -87,6 +129,11 @@ impl MemMapping {
 		self.flags
 	}
 
+	/// Returns the number of pages of the mapping that are resident in physical memory.
+	pub fn get_resident_pages(&self) -> usize {
+		self.resident
+	}
+
 	/// Returns a reference to the virtual memory context handler associated with the mapping.
 	pub fn get_vmem(&self) -> &'static dyn VMem {
 		unsafe {
@@ -154,7 +201,13 @@ impl MemMapping {
 	/// Maps the mapping to the given virtual memory context with the default page. If the mapping
 	/// is marked as nolazy, the function allocates physical memory and maps it instead of the
 	/// default page.
+	/// Pages of a file-backed mapping are left unmapped so that the first access, including
+	/// reading, triggers a page fault.
 	pub fn map_default(&mut self) -> Result<(), Errno> {
+		if self.file.is_some() {
+			return Ok(());
+		}
+
 		let vmem = self.get_mut_vmem();
 		let nolazy = (self.flags & super::MAPPING_FLAG_NOLAZY) != 0;
 		let default_page = get_default_page();
@@ -162,12 +215,25 @@ impl MemMapping {
 		for i in 0..self.size {
 			let phys_ptr = {
 				if nolazy {
-					let ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER);
+					let ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER | buddy::FLAG_USAGE_USER);
 					if let Err(errno) = ptr {
 						self.unmap();
 						return Err(errno);
 					}
-					ptr.unwrap()
+					let ptr = ptr.unwrap();
+
+					// Like any allocated page, the page is referenced by the mapping so that
+					// sharing it on fork makes it subject to Copy-On-Write
+					let result = unsafe {
+						super::PHYSICAL_REF_COUNTER.lock()
+					}.get_mut().increment(ptr);
+					if let Err(errno) = result {
+						buddy::free(ptr, 0);
+						self.unmap();
+						return Err(errno);
+					}
+
+					ptr
 				} else {
 					default_page
 				}
@@ -176,15 +242,58 @@ impl MemMapping {
 			let flags = self.get_vmem_flags(nolazy, i);
 
 			if let Err(errno) = vmem.map(phys_ptr, virt_ptr, flags) {
+				if nolazy {
+					unsafe {
+						super::PHYSICAL_REF_COUNTER.lock()
+					}.get_mut().decrement(phys_ptr);
+					buddy::free(phys_ptr, 0);
+				}
 				self.unmap();
 				return Err(errno);
 			}
+			if nolazy {
+				self.resident += 1;
+			}
 		}
 
 		vmem.flush();
 		Ok(())
 	}
 
+	/// Tells whether the mapping is backed by a file.
+	pub fn is_file_backed(&self) -> bool {
+		self.file.is_some()
+	}
+
+	/// Maps the page at offset `offset` of a file-backed mapping with the file's content.
+	/// If the page is entirely contained in the file, the page from the page cache is mapped,
+	/// which makes it subject to Copy-On-Write. Else, a private page is allocated and the part
+	/// beyond the file's data is filled with zeros.
+	fn map_file_page(&mut self, offset: usize) -> Result<(), Errno> {
+		let file = self.file.as_ref().unwrap();
+		let begin = offset * memory::PAGE_SIZE;
+		debug_assert!(begin < file.size);
+		let file_off = file.off + begin as u64;
+
+		if begin + memory::PAGE_SIZE <= file.size {
+			let phys_ptr = page_cache::get_page(&file.file, file_off)?;
+			return self.map_physical(offset, phys_ptr);
+		}
+
+		// The kernel zone is used so that the page can be filled from the kernel
+		let phys_ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_KERNEL | buddy::FLAG_USAGE_USER)?;
+		unsafe {
+			util::bzero(memory::kern_to_virt(phys_ptr) as _, memory::PAGE_SIZE);
+		}
+
+		let result = page_cache::read_page(&file.file, file_off, phys_ptr, file.size - begin)
+			.and_then(| _ | self.map_physical(offset, phys_ptr));
+		if result.is_err() {
+			buddy::free(phys_ptr, 0);
+		}
+		result
+	}
+
 	/// Maps the page at offset `offset` in the mapping to the given virtual memory context. The
 	/// function allocates the physical memory to be mapped.
 	/// If the mapping is in forking state, the function shall apply Copy-On-Write and allocate
@@ -192,6 +301,13 @@ impl MemMapping {
 	pub fn map(&mut self, offset: usize) -> Result<(), Errno> {
 		let vmem = self.get_mut_vmem();
 		let virt_ptr = (self.begin as usize + offset * memory::PAGE_SIZE) as *mut c_void;
+
+		// Pages beyond the file's data are allocated like any other page
+		if let Some(file) = &self.file {
+			if offset * memory::PAGE_SIZE < file.size && vmem.translate(virt_ptr).is_none() {
+				return self.map_file_page(offset);
+			}
+		}
 		let cow = self.is_cow(offset);
 		let cow_buffer = {
 			if cow {
@@ -212,7 +328,7 @@ impl MemMapping {
 			return Ok(());
 		}
 
-		let new_phys_ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER)?;
+		let new_phys_ptr = buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER | buddy::FLAG_USAGE_USER)?;
 		let flags = self.get_vmem_flags(true, offset);
 
 		{
@@ -231,6 +347,8 @@ impl MemMapping {
 
 			if let Some(prev_phys_ptr) = prev_phys_ptr {
 				ref_counter.get_mut().decrement(prev_phys_ptr);
+			} else {
+				self.resident += 1;
 			}
 		}
 		vmem.flush();
@@ -251,13 +369,73 @@ impl MemMapping {
 		Ok(())
 	}
 
+	/// Maps the page at offset `offset` in the mapping to the given physical page `phys_ptr`.
+	/// The reference counter of the physical page is incremented, thus if the page is owned by
+	/// another object, it is considered as shared.
+	pub fn map_physical(&mut self, offset: usize, phys_ptr: *const c_void) -> Result<(), Errno> {
+		let vmem = self.get_mut_vmem();
+		let virt_ptr = (self.begin as usize + offset * memory::PAGE_SIZE) as *const c_void;
+
+		{
+			let mut ref_counter = unsafe {
+				super::PHYSICAL_REF_COUNTER.lock()
+			};
+			ref_counter.get_mut().increment(phys_ptr)?;
+		}
+
+		// The page is first mapped read-only since Copy-On-Write can be determined only once the
+		// page is mapped
+		let was_resident = self.get_physical_page(offset).is_some();
+		let flags = self.get_vmem_flags(false, offset);
+		if let Err(errno) = vmem.map(phys_ptr, virt_ptr, flags) {
+			let mut ref_counter = unsafe {
+				super::PHYSICAL_REF_COUNTER.lock()
+			};
+			ref_counter.get_mut().decrement(phys_ptr);
+			return Err(errno);
+		}
+		if !was_resident {
+			self.resident += 1;
+		}
+
+		self.update_vmem(offset);
+		Ok(())
+	}
+
 	/// Unmaps the mapping from the given virtual memory context.
-	pub fn unmap(&self) {
-		// TODO
-		// TODO Remove the physical memory only if the page is not shared
-		todo!();
+	/// The physical memory is freed unless shared with other mappings or objects.
+	pub fn unmap(&mut self) {
+		let vmem = self.get_mut_vmem();
+		let default_page = get_default_page();
 
-		// self.get_vmem().flush();
+		let mut ref_counter = unsafe {
+			super::PHYSICAL_REF_COUNTER.lock()
+		};
+		let ref_counter = ref_counter.get_mut();
+
+		for i in 0..self.size {
+			let virt_ptr = (self.begin as usize + i * memory::PAGE_SIZE) as *const c_void;
+			let phys_ptr = match vmem.translate(virt_ptr) {
+				Some(phys_ptr) => phys_ptr,
+				None => continue,
+			};
+
+			if phys_ptr != default_page {
+				// The page is freed only when the mapping holds its last reference. A page
+				// without reference is not owned by the mapping, thus it is left untouched
+				let count = ref_counter.get_ref_count(phys_ptr);
+				ref_counter.decrement(phys_ptr);
+				if count == 1 {
+					buddy::free(phys_ptr, 0);
+				}
+			}
+
+			// TODO Handle the failure to expand a large page
+			let _ = vmem.unmap(virt_ptr);
+		}
+		self.resident = 0;
+
+		vmem.flush();
 	}
 
 	/// Updates the virtual memory context according to the mapping for the page at offset
@@ -287,8 +465,12 @@ impl MemMapping {
 			begin: self.begin,
 			size: self.size,
 			flags: self.flags,
+			file: self.file.clone(),
+			resident: self.resident,
 
 			vmem: NonNull::new(mem_space.get_vmem().as_mut()).unwrap(),
+
+			node: RBNode::new(),
 		};
 
 		unsafe { // Safe because the global variable is wrapped into a Mutex
@@ -311,7 +493,15 @@ impl MemMapping {
 			}
 		};
 
-		mem_space.mappings.insert(new_mapping.get_begin(), new_mapping)
+		mem_space.mapping_insert(new_mapping)
+	}
+}
+
+impl RBElement for MemMapping {
+	type Key = *const c_void;
+
+	fn get_key(&self) -> Self::Key {
+		self.begin
 	}
 }
 
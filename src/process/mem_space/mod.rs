@@ -9,10 +9,11 @@ mod gap;
 mod mapping;
 mod physical_ref_counter;
 
-use core::cmp::Ordering;
-use core::cmp::min;
 use core::ffi::c_void;
 use core::ptr::NonNull;
+use core::ptr;
+use core::slice;
+use crate::debug::trace;
 use crate::errno::Errno;
 use crate::errno;
 use crate::memory::stack;
@@ -21,14 +22,15 @@ use crate::memory::vmem;
 use crate::memory;
 use crate::util::FailableClone;
 use crate::util::boxed::Box;
-use crate::util::container::binary_tree::BinaryTree;
-use crate::util::list::List;
 use crate::util::lock::mutex::Mutex;
-use crate::util::math;
+use crate::util::rbtree::RBTree;
+use crate::util;
 use gap::MemGap;
 use mapping::MemMapping;
 use physical_ref_counter::PhysRefCounter;
 
+pub use mapping::FileBacking;
+
 /// Flag telling that a memory mapping can be written to.
 pub const MAPPING_FLAG_WRITE: u8  = 0b00001;
 /// Flag telling that a memory mapping can contain executable instructions.
@@ -42,9 +44,6 @@ pub const MAPPING_FLAG_NOLAZY: u8 = 0b01000;
 /// mappings.
 pub const MAPPING_FLAG_SHARED: u8 = 0b10000;
 
-/// The number of buckets for available gaps in memory.
-const GAPS_BUCKETS_COUNT: usize = 8;
-
 /// The size of the temporary stack used to fork a memory space.
 const TMP_STACK_SIZE: usize = memory::PAGE_SIZE * 8;
 
@@ -62,72 +61,171 @@ struct ForkData<'a> {
 }
 
 /// Structure representing the virtual memory space of a context.
+/// Gaps and mappings are allocated once when created and owned by the memory space. Since they
+/// are linked into intrusive trees, operations on the trees never allocate memory.
 pub struct MemSpace {
-	/// Binary tree storing the list of memory gaps, ready for new mappings. Sorted by pointer to
-	/// the beginning of the mapping on the virtual memory.
-	gaps: BinaryTree::<*const c_void, MemGap>, // TODO Sort by size instead?
-	/// The gaps bucket, sorted by size. The minimum size in pages of a gap is: `2^^n`, where `n`
-	/// is the index in the list.
-	gaps_buckets: [List::<MemGap>; GAPS_BUCKETS_COUNT],
-
-	/// Binary tree storing the list of memory mappings. Sorted by pointer to the beginning of the
+	/// Tree storing the list of memory gaps, ready for new mappings. Sorted by pointer to the
+	/// beginning of the gap on the virtual memory. Each gap keeps the size of the largest gap in
+	/// its subtree, which allows to find a gap for a mapping in logarithmic time.
+	gaps: RBTree::<MemGap>,
+
+	/// Tree storing the list of memory mappings. Sorted by pointer to the beginning of the
 	/// mapping on the virtual memory.
-	mappings: BinaryTree::<*const c_void, MemMapping>,
+	mappings: RBTree::<MemMapping>,
 
 	/// The virtual memory context handler.
 	vmem: Box::<dyn VMem>,
 }
 
 impl MemSpace {
-	/// Returns the bucket index for a gap of size `size`.
-	fn get_gap_bucket_index(size: usize) -> usize {
-		min(math::log2(size), GAPS_BUCKETS_COUNT - 1)
+	/// Frees the given gap or mapping, which must have been removed from its tree.
+	unsafe fn free<T>(elem: &mut T) {
+		drop(Box::from_raw(elem as *mut T));
 	}
 
 	/// Inserts the given gap into the memory space's structures.
 	fn gap_insert(&mut self, gap: MemGap) -> Result<(), Errno> {
-		let gap_ptr = gap.get_begin();
-		let g = self.gaps.insert(gap_ptr, gap)?;
-
-		let bucket_index = Self::get_gap_bucket_index(g.get_size());
-		let bucket = &mut self.gaps_buckets[bucket_index];
-		bucket.insert_front(&mut g.list);
+		let gap = unsafe {
+			&mut *Box::new(gap)?.into_raw()
+		};
+		self.gaps.insert(gap);
 
 		Ok(())
 	}
 
-	/// Removes the given gap from the memory space's structures.
-	fn gap_remove(&mut self, gap_begin: *const c_void) {
-		let g = self.gaps.get_mut(gap_begin).unwrap();
+	/// Inserts the given mapping into the memory space's structures and returns a mutable
+	/// reference to it.
+	fn mapping_insert(&mut self, mapping: MemMapping) -> Result<&mut MemMapping, Errno> {
+		let mapping = unsafe {
+			&mut *Box::new(mapping)?.into_raw()
+		};
+		self.mappings.insert(mapping);
+
+		Ok(mapping)
+	}
 
-		let bucket_index = Self::get_gap_bucket_index(g.get_size());
-		let bucket = &mut self.gaps_buckets[bucket_index];
-		g.list.unlink_from(bucket);
+	/// Removes the mapping beginning at `begin` from the memory space's structures and drops it.
+	fn mapping_remove(&mut self, begin: *const c_void) {
+		let mut cursor = self.mappings.lower_bound_mut(&begin);
+		debug_assert!(cursor.get().map_or(false, | m | m.get_begin() == begin));
 
-		self.gaps.remove(gap_begin);
+		if let Some(mapping) = cursor.remove() {
+			unsafe {
+				Self::free(mapping);
+			}
+		}
 	}
 
-	/// Returns a reference to a gap with at least size `size`.
-	fn gap_get(buckets: &mut [List::<MemGap>], size: usize) -> Option::<&mut MemGap> {
-		let bucket_index = Self::get_gap_bucket_index(size);
+	/// Removes the region of memory beginning at `ptr` with size `size` in pages from the gaps, so
+	/// that a mapping can be inserted at this exact location.
+	/// The region below `ALLOC_BEGIN` is not covered by gaps since it is reserved for programs'
+	/// images, thus a region located there doesn't require any change.
+	/// If the region is neither entirely in a gap nor below `ALLOC_BEGIN`, the function returns
+	/// `ENOMEM`.
+	fn gap_reserve(&mut self, ptr: *const c_void, size: usize) -> Result<(), Errno> {
+		let begin = ptr as usize;
+		let end = begin + size * memory::PAGE_SIZE;
+
+		// The only gap that may contain the region is the last one beginning before it
+		let mut cursor = self.gaps.upper_bound_mut(&ptr);
+		cursor.move_prev();
+
+		let (gap_begin, gap_end) = match cursor.get() {
+			Some(gap) if gap.get_begin() as usize + gap.get_size() * memory::PAGE_SIZE > begin => {
+				let gap_begin = gap.get_begin() as usize;
+				(gap_begin, gap_begin + gap.get_size() * memory::PAGE_SIZE)
+			},
+			_ if end <= memory::ALLOC_BEGIN as usize => return Ok(()),
+			_ => return Err(errno::ENOMEM),
+		};
+		if end > gap_end {
+			return Err(errno::ENOMEM);
+		}
+
+		// Allocating the gap after the region first so that nothing is modified on failure
+		let gap_after = if end < gap_end {
+			let size = (gap_end - end) / memory::PAGE_SIZE;
+			Some(Box::new(MemGap::new(end as _, size))?)
+		} else {
+			None
+		};
 
-		for bucket in buckets.iter_mut().take(GAPS_BUCKETS_COUNT).skip(bucket_index) {
-			let mut node = bucket.get_front();
+		if begin > gap_begin {
+			// Keeping the part before the region in place
+			cursor.get_mut().unwrap().truncate((begin - gap_begin) / memory::PAGE_SIZE);
+			cursor.update();
+		} else if let Some(gap) = cursor.remove() {
+			unsafe {
+				Self::free(gap);
+			}
+		}
 
-			while node.is_some() {
-				let n = node.unwrap();
-				let value = n.get_mut::<MemGap>(bucket.get_inner_offset());
-				if value.get_size() >= size {
-					return Some(value);
+		if let Some(gap) = gap_after {
+			self.gaps.insert(unsafe {
+				&mut *gap.into_raw()
+			});
+		}
+
+		Ok(())
+	}
+
+	/// Gives the region of memory beginning at `ptr` with size `size` in pages back to the gaps,
+	/// merging it with the adjacent gaps. This is the reverse of `gap_reserve`.
+	/// If a new gap cannot be allocated, the function returns an error and the region stays
+	/// unavailable for mappings.
+	fn gap_release(&mut self, ptr: *const c_void, size: usize) -> Result<(), Errno> {
+		let begin = ptr as usize;
+		let end = begin + size * memory::PAGE_SIZE;
+		if end <= memory::ALLOC_BEGIN as usize {
+			return Ok(());
+		}
+
+		// Taking the gap right after the region out of the tree
+		let mut cursor = self.gaps.lower_bound_mut(&(end as *const c_void));
+		let next_adjacent = cursor.get().map_or(false, | gap | gap.get_begin() as usize == end);
+		let next = if next_adjacent {
+			cursor.remove().map(| gap | gap as *mut MemGap)
+		} else {
+			None
+		};
+		let next_size = next.map_or(0, | gap | unsafe {
+			(*gap).get_size()
+		});
+
+		// Extending the gap right before the region in place
+		let mut cursor = self.gaps.upper_bound_mut(&ptr);
+		cursor.move_prev();
+		let prev_adjacent = cursor.get().map_or(false, | gap | {
+			gap.get_begin() as usize + gap.get_size() * memory::PAGE_SIZE == begin
+		});
+		if prev_adjacent {
+			cursor.get_mut().unwrap().extend(size + next_size);
+			cursor.update();
+
+			if let Some(next) = next {
+				unsafe { // Safe because the gap has been removed from the tree
+					Self::free(&mut *next);
 				}
-				node = n.get_next();
 			}
+			return Ok(());
 		}
 
-		None
+		match next {
+			// Reusing the gap after the region to avoid an allocation
+			Some(next) => {
+				let next = unsafe { // Safe because the gap has been removed from the tree
+					&mut *next
+				};
+				*next = MemGap::new(ptr, size + next_size);
+				self.gaps.insert(next);
+				Ok(())
+			},
+
+			None => self.gap_insert(MemGap::new(ptr, size)),
+		}
 	}
 
-	/// Returns a new binary tree containing the default gaps for a memory space.
+	/// Inserts the default gaps for a memory space.
 	fn create_default_gaps(&mut self) -> Result::<(), Errno> {
 		let begin = memory::ALLOC_BEGIN;
 		let size = (memory::PROCESS_END as usize - begin as usize) / memory::PAGE_SIZE;
@@ -137,10 +235,9 @@ impl MemSpace {
 	/// Creates a new virtual memory object.
 	pub fn new() -> Result::<Self, Errno> {
 		let mut s = Self {
-			gaps: BinaryTree::new(),
-			gaps_buckets: [crate::list_new!(MemGap, list); GAPS_BUCKETS_COUNT],
+			gaps: crate::rbtree_new!(MemGap, node),
 
-			mappings: BinaryTree::new(),
+			mappings: crate::rbtree_new!(MemMapping, node),
 
 			vmem: vmem::new()?,
 		};
@@ -164,40 +261,126 @@ impl MemSpace {
 	/// The function returns a pointer to the newly mapped virtual memory.
 	pub fn map(&mut self, ptr: Option::<*const c_void>, size: usize, flags: u8)
 		-> Result<*const c_void, Errno> {
-		if let Some(_ptr) = ptr {
-			// TODO Insert mapping at exact location if possible
-			// Err(errno::ENOMEM)
-			todo!();
-		} else {
-			let gap = Self::gap_get(&mut self.gaps_buckets, size);
-			if gap.is_none() {
-				return Err(errno::ENOMEM);
+		if let Some(ptr) = ptr {
+			if !util::is_aligned(ptr, memory::PAGE_SIZE) {
+				return Err(errno::EINVAL);
 			}
 
-			let gap = gap.unwrap();
-			let gap_ptr = gap.get_begin();
+			let mapping = MemMapping::new(ptr, size, flags,
+				NonNull::new(self.vmem.as_mut_ptr()).unwrap());
+			self.map_fixed(mapping)
+		} else {
+			// Taking the gap with the lowest address among those that are large enough
+			let gap_ptr = self.gaps.find_first(| g | g.get_max_size() >= size,
+				| g | g.get_size() >= size).get().map(| g | g.get_begin());
+			let gap_ptr = gap_ptr.ok_or(errno::ENOMEM)?;
 
 			let mapping = MemMapping::new(gap_ptr, size, flags,
 				NonNull::new(self.vmem.as_mut_ptr()).unwrap());
-			let mapping_ptr = mapping.get_begin();
-			let m = self.mappings.insert(mapping_ptr, mapping)?;
-
+			let m = self.mapping_insert(mapping)?;
 			if m.map_default().is_err() {
-				self.mappings.remove(mapping_ptr);
+				self.mapping_remove(gap_ptr);
 				return Err(errno::ENOMEM);
 			}
 
-			if let Some(new_gap) = gap.consume(size) {
-				if self.gap_insert(new_gap).is_err() {
-					self.mappings.get_mut(mapping_ptr).unwrap().unmap();
-					self.mappings.remove(mapping_ptr);
-					return Err(errno::ENOMEM);
+			// Consuming the gap in place, which cannot fail
+			let mut cursor = self.gaps.lower_bound_mut(&gap_ptr);
+			let gap = cursor.get_mut().unwrap();
+			if gap.get_size() > size {
+				gap.consume(size);
+				cursor.update();
+			} else if let Some(gap) = cursor.remove() {
+				unsafe {
+					Self::free(gap);
 				}
 			}
 
-			self.gap_remove(gap_ptr);
-			Ok(mapping_ptr)
+			Ok(gap_ptr)
+		}
+	}
+
+	/// Inserts the given mapping at its exact location in the memory space.
+	/// If the mapping's location isn't available, the function returns `ENOMEM`.
+	fn map_fixed(&mut self, mapping: MemMapping) -> Result<*const c_void, Errno> {
+		let begin = mapping.get_begin();
+		let size = mapping.get_size();
+		let end = begin as usize + size * memory::PAGE_SIZE;
+		if begin.is_null() || end > memory::PROCESS_END as usize {
+			return Err(errno::EINVAL);
+		}
+
+		// Since mappings don't overlap, only the last one beginning before the end of the region
+		// may overlap it
+		let mut cursor = self.mappings.lower_bound(&(end as *const c_void));
+		cursor.move_prev();
+		let overlaps = cursor.get().map_or(false, | m | {
+			m.get_begin() as usize + m.get_size() * memory::PAGE_SIZE > begin as usize
+		});
+		if overlaps {
+			return Err(errno::ENOMEM);
+		}
+
+		// The region is taken from the gaps last since `gap_reserve` doesn't modify anything on
+		// failure, while giving the region back to the gaps may fail
+		let m = self.mapping_insert(mapping)?;
+		if m.map_default().is_err() {
+			self.mapping_remove(begin);
+			return Err(errno::ENOMEM);
+		}
+		if let Err(errno) = self.gap_reserve(begin, size) {
+			self.mapping_remove(begin);
+			return Err(errno);
+		}
+
+		Ok(begin)
+	}
+
+	/// Maps the content of a file at the exact location `ptr`. Pages are read from the file on
+	/// the first access. The mapping is not shared, thus written pages are copied.
+	/// `size` represents the size of the region in number of memory pages.
+	/// `flags` represents the flags for the mapping.
+	/// `file` describes the file backing the mapping.
+	/// The function returns a pointer to the newly mapped virtual memory.
+	pub fn map_file(&mut self, ptr: *const c_void, size: usize, flags: u8, file: FileBacking)
+		-> Result<*const c_void, Errno> {
+		let flags = flags & !(MAPPING_FLAG_SHARED | MAPPING_FLAG_NOLAZY);
+		let mapping = MemMapping::new_file(ptr, size, flags, file,
+			NonNull::new(self.vmem.as_mut_ptr()).unwrap());
+		self.map_fixed(mapping)
+	}
+
+	/// Maps the given physical pages `pages` into a new region of memory with the shared flag,
+	/// meaning that writes are visible to every other mapping of the same pages instead of
+	/// triggering Copy-On-Write.
+	/// `flags` represents the flags for the mapping.
+	/// If `clear` is true, the pages are filled with zeros once mapped. This allows to clear pages
+	/// that aren't accessible from the kernel.
+	/// The function returns a pointer to the newly mapped virtual memory.
+	pub fn map_shared(&mut self, pages: &[*const c_void], flags: u8, clear: bool)
+		-> Result<*const c_void, Errno> {
+		let flags = (flags | MAPPING_FLAG_SHARED) & !MAPPING_FLAG_NOLAZY;
+		let mapping_ptr = self.map(None, pages.len(), flags)?;
+
+		for (i, page) in pages.iter().enumerate() {
+			let mapping = self.mappings.get_mut(&mapping_ptr).unwrap();
+			if let Err(errno) = mapping.map_physical(i, *page) {
+				// Removing the mapping also releases the pages mapped so far
+				self.unmap_mapping(mapping_ptr);
+				return Err(errno);
+			}
+		}
+
+		if clear {
+			vmem::vmem_switch(self.vmem.as_ref(), || {
+				unsafe { // Safe because the region has just been mapped
+					vmem::write_lock_wrap(|| {
+						util::bzero(mapping_ptr as _, pages.len() * memory::PAGE_SIZE);
+					});
+				}
+			});
 		}
+
+		Ok(mapping_ptr)
 	}
 
 	/// Same as `map`, except the function returns a pointer to the end of the memory region.
@@ -212,19 +395,55 @@ impl MemSpace {
 	/// Returns a mutable reference to the memory mapping containing the given virtual address
 	/// `ptr` from mappings container `mappings`. If no mapping contains the address, the function
 	/// returns None.
-	fn get_mapping_for(mappings: &mut BinaryTree::<*const c_void, MemMapping>, ptr: *const c_void)
+	fn get_mapping_for(mappings: &mut RBTree::<MemMapping>, ptr: *const c_void)
 		-> Option::<&mut MemMapping> {
-		mappings.cmp_get(| key, value | {
-			let begin = *key;
-			let end = (begin as usize + value.get_size() * memory::PAGE_SIZE) as *const c_void;
-			if ptr >= begin && ptr < end {
-				Ordering::Equal
-			} else if ptr < begin {
-				Ordering::Less
-			} else {
-				Ordering::Greater
-			}
-		})
+		// The only mapping that may contain the address is the last one beginning before it
+		let mut cursor = mappings.upper_bound_mut(&ptr);
+		cursor.move_prev();
+
+		let mapping = cursor.into_mut()?;
+		let end = mapping.get_begin() as usize + mapping.get_size() * memory::PAGE_SIZE;
+		if (ptr as usize) < end {
+			Some(mapping)
+		} else {
+			None
+		}
+	}
+
+	/// Same as `get_mapping_for`, except the function returns an immutable reference.
+	fn get_mapping(&self, ptr: *const c_void) -> Option::<&MemMapping> {
+		// The only mapping that may contain the address is the last one beginning before it
+		let mut cursor = self.mappings.upper_bound(&ptr);
+		cursor.move_prev();
+
+		let mapping = cursor.get()?;
+		let end = mapping.get_begin() as usize + mapping.get_size() * memory::PAGE_SIZE;
+		if (ptr as usize) < end {
+			Some(mapping)
+		} else {
+			None
+		}
+	}
+
+	/// Removes the mapping beginning at `ptr`, freeing its physical memory unless shared, and
+	/// makes its region available for new mappings.
+	fn unmap_mapping(&mut self, ptr: *const c_void) {
+		let size = match self.mappings.get_mut(&ptr) {
+			Some(mapping) => mapping.get_size(),
+			None => return,
+		};
+
+		self.mapping_remove(ptr);
+		// On fail, the region is lost for further mappings, which is harmless
+		let _ = self.gap_release(ptr, size);
+	}
+
+	/// Unmaps a stack mapped with `map_stack`.
+	/// `stack` is the pointer to the end of the stack, as returned by `map_stack`.
+	/// `size` is the size of the stack in number of memory pages.
+	pub fn unmap_stack(&mut self, stack: *const c_void, size: usize) {
+		let begin = (stack as usize - size * memory::PAGE_SIZE) as *const c_void;
+		self.unmap_mapping(begin);
 	}
 
 	/// Unmaps the given region of memory.
@@ -242,13 +461,126 @@ impl MemSpace {
 	/// Tells whether the given region of memory `ptr` of size `size` in bytes can be accessed.
 	/// `user` tells whether the memory must be accessible from userspace or just kernelspace.
 	/// `write` tells whether to check for write permission.
-	pub fn can_access(&self, _ptr: *const u8, _size: usize, _user: bool, _write: bool) -> bool {
-		// TODO
+	pub fn can_access(&self, ptr: *const u8, size: usize, user: bool, write: bool) -> bool {
+		let end = match (ptr as usize).checked_add(size) {
+			Some(end) => end,
+			None => return false,
+		};
+
+		let mut curr = ptr as usize;
+		while curr < end {
+			// The kernel's memory is mapped in every memory space
+			if curr >= memory::PROCESS_END as usize {
+				return !user;
+			}
+
+			let mapping = match self.get_mapping(curr as _) {
+				Some(mapping) => mapping,
+				None => return false,
+			};
+			let flags = mapping.get_flags();
+			if user && flags & MAPPING_FLAG_USER == 0 {
+				return false;
+			}
+			if write && flags & MAPPING_FLAG_WRITE == 0 {
+				return false;
+			}
+
+			curr = mapping.get_begin() as usize + mapping.get_size() * memory::PAGE_SIZE;
+		}
 
-		//todo!();
 		true
 	}
 
+	/// Tells whether the null-terminated string beginning at `ptr` can be accessed.
+	/// `user` and `write` have the same meaning as for `can_access`.
+	/// If the string can be accessed, the function returns its length, without the terminating
+	/// null byte.
+	pub fn can_access_string(&self, ptr: *const u8, user: bool, write: bool) -> Option<usize> {
+		let mut len = 0;
+
+		// The length is unknown, thus the string is checked page by page until the null byte
+		loop {
+			let curr = (ptr as usize).checked_add(len)?;
+			let size = memory::PAGE_SIZE - curr % memory::PAGE_SIZE;
+			if !self.can_access(curr as _, size, user, write) {
+				return None;
+			}
+
+			let page = unsafe { // Safe because the access has been checked
+				slice::from_raw_parts(curr as *const u8, size)
+			};
+			if let Some(i) = page.iter().position(| c | *c == 0) {
+				return Some(len + i);
+			}
+			len += size;
+		}
+	}
+
+	/// Makes the page containing the address `ptr` resident, as an access would. If the mapping is
+	/// writable, Copy-On-Write is also applied so that the page is private to the memory space and
+	/// its physical address doesn't change until it is unmapped.
+	/// If the address isn't mapped, the function returns `EFAULT`.
+	pub fn fault_in(&mut self, ptr: *const c_void) -> Result<(), Errno> {
+		let mapping = Self::get_mapping_for(&mut self.mappings, ptr).ok_or(errno::EFAULT)?;
+		let offset = (ptr as usize - mapping.get_begin() as usize) / memory::PAGE_SIZE;
+
+		mapping.map(offset)?;
+		// A page of a file-backed mapping is first mapped from the page cache, which makes it
+		// subject to Copy-On-Write
+		let write = mapping.get_flags() & MAPPING_FLAG_WRITE != 0;
+		if write && mapping.is_cow(offset) {
+			mapping.map(offset)?;
+		}
+
+		mapping.update_vmem(offset);
+		Ok(())
+	}
+
+	/// Same as `fault_in`, for every page of the region beginning at `ptr` with size `size` in
+	/// bytes.
+	pub fn fault_in_range(&mut self, ptr: *const c_void, size: usize) -> Result<(), Errno> {
+		if size == 0 {
+			return Ok(());
+		}
+
+		let begin = util::down_align(ptr, memory::PAGE_SIZE) as usize;
+		let end = (ptr as usize).checked_add(size).ok_or(errno::EFAULT)?;
+		for page in (begin..end).step_by(memory::PAGE_SIZE) {
+			self.fault_in(page as _)?;
+		}
+
+		Ok(())
+	}
+
+	/// Copies the buffer `buf` to the userspace address `ptr` in the memory space, which doesn't
+	/// need to be bound. The pages are made resident beforehand so that the copy doesn't fault.
+	/// If the region isn't writable from userspace, the function returns `EFAULT`.
+	pub fn copy_to_user(&mut self, ptr: *mut u8, buf: &[u8]) -> Result<(), Errno> {
+		if buf.is_empty() {
+			return Ok(());
+		}
+		if !self.can_access(ptr, buf.len(), true, true) {
+			return Err(errno::EFAULT);
+		}
+
+		self.fault_in_range(ptr as _, buf.len())?;
+
+		vmem::vmem_switch(self.vmem.as_ref(), || {
+			unsafe { // Safe because the region is mapped and resident
+				ptr::copy_nonoverlapping(buf.as_ptr(), ptr, buf.len());
+			}
+		});
+		Ok(())
+	}
+
+	/// Returns the resident set size of the memory space, which is the number of pages of its
+	/// mappings that are backed by physical memory. Pages shared with other memory spaces are
+	/// counted in each of them.
+	pub fn get_rss(&self) -> usize {
+		self.mappings.iter().map(| m | m.get_resident_pages()).sum()
+	}
+
 	/// Binds the CPU to this memory space.
 	pub fn bind(&self) {
 		self.vmem.bind();
@@ -257,20 +589,19 @@ impl MemSpace {
 	/// Performs the actions of `fork`. This function is meant to be called onto a temporary stack.
 	fn do_fork(&mut self) -> Result<MemSpace, Errno> {
 		let mut mem_space = Self {
-			gaps: BinaryTree::new(),
-			gaps_buckets: [crate::list_new!(MemGap, list); GAPS_BUCKETS_COUNT],
+			gaps: crate::rbtree_new!(MemGap, node),
 
-			mappings: BinaryTree::new(),
+			mappings: crate::rbtree_new!(MemMapping, node),
 
 			vmem: vmem::clone(&self.vmem)?,
 		};
 
-		for (_, g) in self.gaps.into_iter() {
+		for g in self.gaps.iter() {
 			let new_gap = g.failable_clone()?;
 			mem_space.gap_insert(new_gap)?;
 		}
 
-		for (_, m) in self.mappings.iter_mut() {
+		for m in self.mappings.iter_mut() {
 			let new_mapping = m.fork(&mut mem_space)?;
 
 			for i in 0..new_mapping.get_size() {
@@ -316,28 +647,200 @@ impl MemSpace {
 	///
 	/// `virt_addr` is the virtual address of the wrong memory access that caused the fault.
 	/// `code` is the error code given along with the error.
-	/// If the process should continue, the function returns `true`, else `false`.
-	pub fn handle_page_fault(&mut self, virt_addr: *const c_void, code: u32) -> bool {
-		if code & vmem::x86::PAGE_FAULT_PRESENT == 0 {
-			return false;
-		}
+	/// If the process should continue, the function returns `true`. If the access is invalid,
+	/// the function returns `false`. If the page couldn't be mapped, such as when reading the
+	/// content of a file fails or when running out of memory, the function returns an error.
+	pub fn handle_page_fault(&mut self, virt_addr: *const c_void, code: u32)
+		-> Result<bool, Errno> {
+		crate::trace!(trace::PAGE_FAULT, virt_addr as usize, code);
 
 		if let Some(mapping) = Self::get_mapping_for(&mut self.mappings, virt_addr) {
-			let offset = (virt_addr as usize - mapping.get_begin() as usize) / memory::PAGE_SIZE;
-			if mapping.map(offset).is_err() {
-				// TODO Use OOM-killer
-				// TODO Check if current process has been killed
-				todo!();
-
-				//if mapping.map(offset).is_err() {
-				//    crate::kernel_panic!("OOM killer is unable to free up space for new allocation!");
-				//}
+			// Only pages of file-backed mappings may be absent
+			if code & vmem::x86::PAGE_FAULT_PRESENT == 0 && !mapping.is_file_backed() {
+				return Ok(false);
 			}
 
+			let offset = (virt_addr as usize - mapping.get_begin() as usize) / memory::PAGE_SIZE;
+			// TODO Use OOM-killer on ENOMEM
+			mapping.map(offset)?;
+
 			mapping.update_vmem(offset);
-			true
+			Ok(true)
 		} else {
-			false
+			Ok(false)
+		}
+	}
+}
+
+impl Drop for MemSpace {
+	fn drop(&mut self) {
+		let mut cursor = self.gaps.cursor_front_mut();
+		while let Some(gap) = cursor.remove() {
+			unsafe {
+				Self::free(gap);
+			}
+		}
+
+		let mut cursor = self.mappings.cursor_front_mut();
+		while let Some(mapping) = cursor.remove() {
+			unsafe {
+				Self::free(mapping);
+			}
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
+	use crate::selftest;
+	use crate::util::lock::mutex::TMutex;
+
+	#[test_case]
+	fn mem_space_rss0() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let begin = mem_space.map(None, 4, MAPPING_FLAG_WRITE | MAPPING_FLAG_USER).unwrap();
+		assert_eq!(mem_space.get_rss(), 0);
+
+		let code = vmem::x86::PAGE_FAULT_PRESENT | vmem::x86::PAGE_FAULT_WRITE;
+		for i in 0..2 {
+			let addr = unsafe {
+				begin.add(i * memory::PAGE_SIZE)
+			};
+			assert!(mem_space.handle_page_fault(addr, code).unwrap());
+		}
+		assert_eq!(mem_space.get_rss(), 2);
+
+		mem_space.map(None, 3, MAPPING_FLAG_NOLAZY).unwrap();
+		assert_eq!(mem_space.get_rss(), 5);
+	}
+
+	#[test_case]
+	fn mem_space_can_access0() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let size = 4 * memory::PAGE_SIZE;
+		let rw = mem_space.map(None, 4, MAPPING_FLAG_WRITE | MAPPING_FLAG_USER).unwrap() as *const u8;
+		let ro = mem_space.map(None, 4, MAPPING_FLAG_USER).unwrap() as *const u8;
+
+		assert!(mem_space.can_access(rw, size, true, true));
+		assert!(mem_space.can_access(ro, size, true, false));
+		assert!(!mem_space.can_access(ro, size, true, true));
+		assert!(!mem_space.can_access(0 as _, 1, true, false));
+		assert!(!mem_space.can_access(usize::MAX as _, 2, false, false));
+
+		// The region beyond the end of the mapping must not be accessible, unless it is the
+		// beginning of another mapping
+		let end = rw as usize + size;
+		if end != ro as usize {
+			assert!(!mem_space.can_access(rw, size + 1, true, false));
 		}
+		assert!(!mem_space.can_access(memory::PROCESS_END as _, 1, true, false));
+		assert!(mem_space.can_access(memory::PROCESS_END as _, 1, false, false));
 	}
+
+	#[test_case]
+	fn mem_space_access_string0() {
+		let mem_space = MemSpace::new().unwrap();
+		let s = b"hello\0world\0";
+
+		assert_eq!(mem_space.can_access_string(s.as_ptr(), false, false), Some(5));
+		assert_eq!(mem_space.can_access_string(&s[5], false, false), Some(0));
+	}
+
+	#[test_case]
+	fn mem_space_fault_in0() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let begin = mem_space.map(None, 4, MAPPING_FLAG_WRITE | MAPPING_FLAG_USER).unwrap();
+
+		let addr = unsafe {
+			begin.add(memory::PAGE_SIZE + 8)
+		};
+		mem_space.fault_in(addr).unwrap();
+		assert_eq!(mem_space.get_rss(), 1);
+		let phys_addr = mem_space.get_vmem().translate(addr).unwrap();
+
+		// The page is already resident, thus it must not move
+		mem_space.fault_in(addr).unwrap();
+		assert_eq!(mem_space.get_vmem().translate(addr), Some(phys_addr));
+		assert_eq!(mem_space.get_rss(), 1);
+
+		assert_eq!(mem_space.fault_in(0 as _), Err(errno::EFAULT));
+	}
+
+	#[test_case]
+	fn mem_space_copy_to_user0() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let rw = mem_space.map(None, 2, MAPPING_FLAG_WRITE | MAPPING_FLAG_USER).unwrap();
+		let ro = mem_space.map(None, 2, MAPPING_FLAG_USER).unwrap();
+
+		// Crossing the boundary between the two pages
+		let ptr = (rw as usize + memory::PAGE_SIZE - 2) as *mut u8;
+		mem_space.copy_to_user(ptr, b"abcd").unwrap();
+		assert_eq!(mem_space.get_rss(), 2);
+
+		let mut buf = [0u8; 4];
+		vmem::vmem_switch(mem_space.get_vmem().as_ref(), || {
+			unsafe {
+				ptr::copy_nonoverlapping(ptr, buf.as_mut_ptr(), buf.len());
+			}
+		});
+		assert_eq!(&buf, b"abcd");
+
+		assert_eq!(mem_space.copy_to_user(ro as _, b"abcd"), Err(errno::EFAULT));
+	}
+
+	#[test_case]
+	fn mem_space_fork_nolazy() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let begin = mem_space.map(None, 1, MAPPING_FLAG_WRITE | MAPPING_FLAG_NOLAZY).unwrap();
+		let phys_ptr = mem_space.get_vmem().translate(begin).unwrap();
+
+		// The child gets its own copy of the page, which must not free the parent's page
+		drop(mem_space.fork().unwrap());
+		let ref_counter = unsafe {
+			PHYSICAL_REF_COUNTER.lock()
+		};
+		assert_eq!(ref_counter.get().get_ref_count(phys_ptr), 1);
+	}
+
+	#[test_case]
+	fn mem_space_unmap0() {
+		let mut mem_space = MemSpace::new().unwrap();
+		let a = mem_space.map_stack(None, 4, MAPPING_FLAG_NOLAZY).unwrap();
+		let b = mem_space.map_stack(None, 4, MAPPING_FLAG_NOLAZY).unwrap();
+		let c = mem_space.map_stack(None, 4, MAPPING_FLAG_NOLAZY).unwrap();
+		assert_eq!(mem_space.get_rss(), 12);
+
+		// The freed regions are merged with the adjacent gaps
+		mem_space.unmap_stack(b, 4);
+		mem_space.unmap_stack(a, 4);
+		mem_space.unmap_stack(c, 4);
+		assert_eq!(mem_space.get_rss(), 0);
+		assert_eq!(mem_space.gaps.iter().count(), 1);
+
+		assert_eq!(mem_space.map_stack(None, 12, MAPPING_FLAG_NOLAZY).unwrap(), c);
+	}
+
+	fn page_fault_bench(b: &mut Bencher) {
+		let mut mem_space = MemSpace::new().unwrap();
+		let pages = selftest::BENCH_WARMUP + selftest::BENCH_ITERATIONS;
+		let begin = mem_space.map(None, pages, MAPPING_FLAG_WRITE | MAPPING_FLAG_USER).unwrap();
+
+		// The mapping is lazy, thus each write fault allocates a new page
+		let code = vmem::x86::PAGE_FAULT_PRESENT | vmem::x86::PAGE_FAULT_WRITE
+			| vmem::x86::PAGE_FAULT_USER;
+		let mut page = 0;
+		b.iter(|| {
+			let addr = unsafe {
+				begin.add(page * memory::PAGE_SIZE)
+			};
+			assert!(mem_space.handle_page_fault(addr, code).unwrap());
+			page += 1;
+		});
+	}
+
+	#[test_case]
+	static PAGE_FAULT_BENCH: Bench = Bench::new("mem_space::page_fault", page_fault_bench);
 }
@@ -1,18 +1,25 @@
 //! A process is a task running on the kernel. A multitasking system allows several processes to
 //! run at the same time by sharing the CPU resources using a scheduler.
 
+pub mod futex;
+pub mod io_ring;
 pub mod mem_space;
 pub mod pid;
 pub mod scheduler;
 pub mod semaphore;
+pub mod shm;
 pub mod signal;
 pub mod tss;
 
 use core::ffi::c_void;
 use core::mem::ManuallyDrop;
 use core::mem::MaybeUninit;
+use core::mem::size_of;
+use core::mem;
 use core::ptr::NonNull;
+use core::slice;
 use crate::errno::Errno;
+use crate::elf;
 use crate::errno;
 use crate::event::{InterruptResult, InterruptResultAction};
 use crate::event;
@@ -23,12 +30,18 @@ use crate::file::file_descriptor::FileDescriptor;
 use crate::file::path::Path;
 use crate::file;
 use crate::limits;
+use crate::logger;
 use crate::memory::vmem;
+use crate::time::Timespec;
+use crate::time::timer::Tick;
+use crate::time::timer::TimerId;
+use crate::time::timer;
 use crate::util::FailableClone;
 use crate::util::Regs;
 use crate::util::container::vec::Vec;
 use crate::util::lock::mutex::*;
 use crate::util::ptr::SharedPtr;
+use io_ring::IORing;
 use mem_space::MemSpace;
 use mem_space::{MAPPING_FLAG_WRITE, MAPPING_FLAG_USER, MAPPING_FLAG_NOLAZY};
 use pid::PIDManager;
@@ -59,6 +72,18 @@ const TTY_DEVICE_PATH: &str = "/dev/tty";
 /// The default file creation mask.
 const DEFAULT_UMASK: u16 = 0o022;
 
+/// Clone flag: the memory space is shared with the new process.
+pub const CLONE_VM: u32 = 0x100;
+/// Clone flag: the file descriptors table is shared with the new process.
+pub const CLONE_FILES: u32 = 0x400;
+/// Clone flag: the signal handlers table is shared with the new process.
+pub const CLONE_SIGHAND: u32 = 0x800;
+/// Clone flag: the new process is a thread in the same thread group as the current process.
+pub const CLONE_THREAD: u32 = 0x10000;
+
+/// Type representing the table of signal handlers of a process.
+type SignalHandlers = [Option<SignalHandler>; signal::SIGNALS_COUNT];
+
 /// The file descriptor number of the standard input stream.
 const STDIN_FILENO: u32 = 0;
 /// The file descriptor number of the standard output stream.
@@ -88,6 +113,8 @@ pub struct Process {
 	pid: Pid,
 	/// The ID of the process group.
 	pgid: Pid,
+	/// The ID of the thread group, which is the PID of the thread group's leader.
+	tgid: Pid,
 
 	/// The ID of the process's user owner.
 	uid: Uid,
@@ -117,8 +144,12 @@ pub struct Process {
 	regs: Regs,
 	/// Tells whether the process was syscalling or not.
 	syscalling: bool,
-	/// The virtual memory of the process containing every mappings.
-	mem_space: MemSpace,
+	/// The virtual memory of the process containing every mappings. Shared between threads.
+	mem_space: SharedPtr<MemSpace>,
+	/// The previous memory space of the process after executing a new program, along with the
+	/// kernel stack mapped in it. It is kept until the new memory space is bound since the kernel
+	/// stack in use is located in it.
+	old_mem_space: Option<(SharedPtr<MemSpace>, *const c_void)>,
 
 	/// A pointer to the userspace stack.
 	user_stack: *const c_void,
@@ -127,13 +158,20 @@ pub struct Process {
 
 	/// The current working directory.
 	cwd: Path,
-	/// The list of open file descriptors.
-	file_descriptors: Vec<FileDescriptor>,
+	/// The list of open file descriptors. May be shared between threads.
+	file_descriptors: SharedPtr<Vec<FileDescriptor>>,
+	/// The process's asynchronous I/O ring, if created.
+	io_ring: Option<IORing>,
+
+	/// The timer ending the current `nanosleep`, the tick at which it expires and the userspace
+	/// pointer to which the remaining time is written if the sleep is interrupted (null if none).
+	/// None if the process isn't in `nanosleep`.
+	sleep_timer: Option<(TimerId, Tick, *mut Timespec)>,
 
 	/// The FIFO containing awaiting signals.
 	signals_queue: Vec<Signal>, // TODO Use a dedicated FIFO structure
-	/// The list of signal handlers.
-	signal_handlers: [Option<SignalHandler>; signal::SIGNALS_COUNT],
+	/// The list of signal handlers. May be shared between threads.
+	signal_handlers: SharedPtr<SignalHandlers>,
 
 	/// The exit status of the process after exiting.
 	exit_status: ExitStatus,
@@ -174,7 +212,8 @@ pub fn init() -> Result<(), Errno> {
 
 			match id {
 				0x0d => {
-					let vmem = curr_proc.get_mem_space_mut().get_vmem();
+					let mut mem_space_guard = curr_proc.get_mem_space_mut().lock();
+					let vmem = mem_space_guard.get_mut().get_vmem();
 					let mut inst_prefix = 0;
 					vmem::vmem_switch(vmem.as_ref(), || {
 						inst_prefix = unsafe {
@@ -182,6 +221,8 @@ pub fn init() -> Result<(), Errno> {
 						};
 					});
 
+					drop(mem_space_guard);
+
 					if inst_prefix == HLT_INSTRUCTION {
 						curr_proc.exit(regs.eax);
 					} else {
@@ -193,8 +234,13 @@ pub fn init() -> Result<(), Errno> {
 						vmem::x86::cr2_get()
 					};
 
-					if !curr_proc.mem_space.handle_page_fault(accessed_ptr, code) {
-						curr_proc.kill(signal::SIGSEGV).unwrap();
+					let result = curr_proc.mem_space.lock().get_mut()
+						.handle_page_fault(accessed_ptr, code);
+					match result {
+						Ok(true) => {},
+						Ok(false) => curr_proc.kill(signal::SIGSEGV).unwrap(),
+						// The access is valid but the page couldn't be mapped
+						Err(_) => curr_proc.kill(signal::SIGBUS).unwrap(),
 					}
 				},
 				_ => {},
@@ -214,6 +260,9 @@ pub fn init() -> Result<(), Errno> {
 	let _ = ManuallyDrop::new(event::register_callback(0x0d, u32::MAX, callback)?);
 	let _ = ManuallyDrop::new(event::register_callback(0x0e, u32::MAX, callback)?);
 
+	// From now on, kernel logs are written to the console on the scheduler's ticks
+	logger::set_deferred(true);
+
 	Ok(())
 }
 
@@ -242,6 +291,22 @@ impl Process {
 		guard.get_mut().get_current_process()
 	}
 
+	/// Wakes up the process with PID `pid` if it is sleeping. If the process doesn't exist or
+	/// isn't sleeping, the function returns `false`.
+	pub fn wake_by_pid(pid: Pid) -> bool {
+		if let Some(mut proc) = Self::get_by_pid(pid) {
+			let mut guard = proc.lock();
+			let proc = guard.get_mut();
+
+			if proc.get_state() == State::Sleeping {
+				proc.set_state(State::Running);
+				return true;
+			}
+		}
+
+		false
+	}
+
 	/// Creates a new process, assigns an unique PID to it and places it into the scheduler's
 	/// queue. The process is set to state `Running` by default.
 	/// `parent` is the parent of the process (optional).
@@ -266,6 +331,7 @@ impl Process {
 		let mut process = Self {
 			pid,
 			pgid: pid,
+			tgid: pid,
 
 			uid,
 			gid,
@@ -293,16 +359,20 @@ impl Process {
 				edi: 0x0,
 			},
 			syscalling: false,
-			mem_space,
+			mem_space: SharedPtr::new(Mutex::new(mem_space))?,
+			old_mem_space: None,
 
 			user_stack,
 			kernel_stack,
 
 			cwd,
-			file_descriptors: Vec::new(),
+			file_descriptors: SharedPtr::new(Mutex::new(Vec::new()))?,
+			io_ring: None,
+
+			sleep_timer: None,
 
 			signals_queue: Vec::new(),
-			signal_handlers: [None; signal::SIGNALS_COUNT],
+			signal_handlers: SharedPtr::new(Mutex::new([None; signal::SIGNALS_COUNT]))?,
 
 			exit_status: 0,
 		};
@@ -315,7 +385,7 @@ impl Process {
 			let tty_path = Path::from_string(TTY_DEVICE_PATH)?;
 			let tty_file = files_cache.get_file_from_path(&tty_path)?;
 			let stdin_fd = process.open_file(tty_file)?;
-			assert_eq!(stdin_fd.get_id(), STDIN_FILENO);
+			assert_eq!(stdin_fd, STDIN_FILENO);
 			process.duplicate_fd(STDIN_FILENO, Some(STDOUT_FILENO))?;
 			process.duplicate_fd(STDIN_FILENO, Some(STDERR_FILENO))?;
 		}
@@ -331,6 +401,11 @@ impl Process {
 		self.pid
 	}
 
+	/// Returns the process's thread group ID.
+	pub fn get_tgid(&self) -> Pid {
+		self.tgid
+	}
+
 	/// Returns the process's group ID.
 	pub fn get_pgid(&self) -> Pid {
 		self.pgid
@@ -426,9 +501,61 @@ impl Process {
 
 	/// Sets the process's state to `new_state`.
 	pub fn set_state(&mut self, new_state: State) {
+		// Leaving the sleeping state before the timer expires interrupts the sleep
+		if new_state != State::Sleeping {
+			self.interrupt_sleep();
+		}
+
 		self.state = new_state;
 	}
 
+	/// Makes the process sleep until the timer `timer` expires at tick `end`. The timer must call
+	/// `wake_from_sleep` with the process's PID.
+	/// If not null, `rem` is the userspace pointer to which the remaining time is written if the
+	/// sleep is interrupted.
+	pub fn sleep_until(&mut self, timer: TimerId, end: Tick, rem: *mut Timespec) {
+		self.sleep_timer = Some((timer, end, rem));
+		self.set_state(State::Sleeping);
+	}
+
+	/// Ends the sleep of the process with PID `pid` started with `sleep_until`. If the process
+	/// doesn't exist, isn't sleeping this way or its sleep isn't over, the function does nothing.
+	/// This prevents a stale timer from waking up a process sleeping for another reason.
+	pub fn wake_from_sleep(pid: Pid) {
+		if let Some(mut proc) = Self::get_by_pid(pid) {
+			let mut guard = proc.lock();
+			let proc = guard.get_mut();
+
+			let expired = proc.sleep_timer.map_or(false, | (_, end, _) | timer::get_ticks() >= end);
+			if expired && proc.state == State::Sleeping {
+				proc.sleep_timer = None;
+				proc.set_state(State::Running);
+			}
+		}
+	}
+
+	/// Interrupts the sleep started with `sleep_until`, if any. The timer is cancelled, the
+	/// remaining time is written to userspace if requested and the system call returns `EINTR`.
+	/// The process's memory space must not be locked.
+	fn interrupt_sleep(&mut self) {
+		if let Some((timer, end, rem)) = self.sleep_timer.take() {
+			timer::cancel(timer);
+			self.regs.eax = (-errno::EINTR) as _;
+
+			if !rem.is_null() {
+				let ticks = end.saturating_sub(timer::get_ticks());
+				let remaining = Timespec::from_nano(ticks * timer::TICK_NS);
+				let buf = unsafe { // Safe because the slice covers the structure only
+					slice::from_raw_parts(&remaining as *const _ as *const u8,
+						size_of::<Timespec>())
+				};
+
+				// If the pointer has been unmapped in the meantime, the remaining time is lost
+				let _ = self.mem_space.lock().get_mut().copy_to_user(rem as _, buf);
+			}
+		}
+	}
+
 	/// Returns the priority of the process. A greater number means a higher priority relative to
 	/// other processes.
 	pub fn get_priority(&self) -> usize {
@@ -465,15 +592,29 @@ impl Process {
 	}
 
 	/// Returns a reference to the process's memory space.
-	pub fn get_mem_space(&self) -> &MemSpace {
+	pub fn get_mem_space(&self) -> &SharedPtr<MemSpace> {
 		&self.mem_space
 	}
 
 	/// Returns a mutable reference to the process's memory space.
-	pub fn get_mem_space_mut(&mut self) -> &mut MemSpace {
+	pub fn get_mem_space_mut(&mut self) -> &mut SharedPtr<MemSpace> {
 		&mut self.mem_space
 	}
 
+	/// Tells whether the process's memory space has been replaced and is waiting to be bound.
+	pub fn is_mem_space_pending(&self) -> bool {
+		self.old_mem_space.is_some()
+	}
+
+	/// Drops the previous memory space of the process. This function must be called once the
+	/// current memory space has been bound.
+	pub fn release_old_mem_space(&mut self) {
+		if let Some((mut mem_space, kernel_stack)) = self.old_mem_space.take() {
+			// The memory space may be shared with other threads, which keep using it
+			mem_space.lock().get_mut().unmap_stack(kernel_stack, KERNEL_STACK_SIZE);
+		}
+	}
+
 	/// Returns a reference to the process's current working directory.
 	pub fn get_cwd(&self) -> &Path {
 		&self.cwd
@@ -499,21 +640,29 @@ impl Process {
 		self.syscalling
 	}
 
-	/// Returns an available file descriptor ID. If no ID is available, the function returns an
-	/// error.
-	fn get_available_fd(&mut self) -> Result<u32, Errno> {
-		if self.file_descriptors.is_empty() {
+	/// Makes the process resume in userspace with the registers `regs` once scheduled again. This
+	/// function is used when the process leaves a syscall without returning from it, since its
+	/// kernel stack is then discarded.
+	pub fn leave_syscall(&mut self, regs: &Regs) {
+		self.regs = *regs;
+		self.syscalling = false;
+	}
+
+	/// Returns an available file descriptor ID in the table `file_descriptors`. If no ID is
+	/// available, the function returns an error.
+	fn get_available_fd(file_descriptors: &Vec<FileDescriptor>) -> Result<u32, Errno> {
+		if file_descriptors.is_empty() {
 			return Ok(0);
 		}
 
 		// TODO Use a binary search
-		for (i, fd) in self.file_descriptors.iter().enumerate() {
+		for (i, fd) in file_descriptors.iter().enumerate() {
 			if (i as u32) < fd.get_id() {
 				return Ok(i as u32);
 			}
 		}
 
-		let id = self.file_descriptors.len();
+		let id = file_descriptors.len();
 		if id < limits::OPEN_MAX {
 			Ok(id as u32)
 		} else {
@@ -521,82 +670,101 @@ impl Process {
 		}
 	}
 
-	/// Opens a file, creates a file descriptor and returns a mutable reference to it.
+	/// Inserts the file descriptor `fd` in the table `file_descriptors`. If a file descriptor
+	/// with the same ID is already present, it is replaced, which closes it.
+	fn insert_fd(file_descriptors: &mut Vec<FileDescriptor>, fd: FileDescriptor)
+		-> Result<(), Errno> {
+		let id = fd.get_id();
+		let index = file_descriptors.binary_search_by(| fd | {
+			fd.get_id().cmp(&id)
+		});
+
+		match index {
+			Ok(i) => file_descriptors[i] = fd,
+			Err(i) => file_descriptors.insert(i, fd)?,
+		}
+		Ok(())
+	}
+
+	/// Opens a file, creates a file descriptor and returns its ID.
 	/// `file` the file to open.
 	/// If the file cannot be open, the function returns an Err.
-	pub fn open_file(&mut self, file: SharedPtr<File>) -> Result<&mut FileDescriptor, Errno> {
-		let id = self.get_available_fd()?;
-		let fd = FileDescriptor::new(id, file)?;
-		let index = self.file_descriptors.binary_search_by(| fd | {
-			fd.get_id().cmp(&id)
-		}).unwrap_err();
+	pub fn open_file(&mut self, file: SharedPtr<File>) -> Result<u32, Errno> {
+		// The table is locked for the whole operation since it may be shared with other threads
+		let mut guard = self.file_descriptors.lock();
+		let file_descriptors = guard.get_mut();
 
-		self.file_descriptors.insert(index, fd)?;
-		Ok(&mut self.file_descriptors[index])
+		let id = Self::get_available_fd(file_descriptors)?;
+		Self::insert_fd(file_descriptors, FileDescriptor::new(id, file)?)?;
+		Ok(id)
 	}
 
-	/// Duplicates the file descriptor with id `id`.
+	/// Duplicates the file descriptor with id `id` and returns the ID of the new file descriptor.
 	/// `new_id` if specified, the id of the new file descriptor. If already used, the previous
 	/// file descriptor shall be closed.
-	pub fn duplicate_fd(&mut self, id: u32, new_id: Option<u32>)
-		-> Result<&mut FileDescriptor, Errno> {
+	pub fn duplicate_fd(&mut self, id: u32, new_id: Option<u32>) -> Result<u32, Errno> {
+		let mut guard = self.file_descriptors.lock();
+		let file_descriptors = guard.get_mut();
+
 		let new_id = {
 			if let Some(new_id) = new_id {
 				new_id
 			} else {
-				self.get_available_fd()?
+				Self::get_available_fd(file_descriptors)?
 			}
 		};
 
-		let curr_fd = self.get_fd(id).ok_or(errno::EBADF)?;
-		let new_fd = FileDescriptor::new(new_id, curr_fd.get_file().clone())?;
-
-		let index = self.file_descriptors.binary_search_by(| fd | {
-			fd.get_id().cmp(&new_id)
-		});
-		let index = {
-			if let Ok(i) = index {
-				self.file_descriptors[i] = new_fd;
-				i
-			} else {
-				let i = index.unwrap_err();
-				self.file_descriptors.insert(i, new_fd)?;
-				i
-			}
-		};
+		let curr_fd = file_descriptors.binary_search_by(| fd | {
+			fd.get_id().cmp(&id)
+		}).map_err(| _ | errno::EBADF)?;
+		let new_fd = FileDescriptor::new(new_id, file_descriptors[curr_fd].get_file().clone())?;
 
-		Ok(&mut self.file_descriptors[index])
+		Self::insert_fd(file_descriptors, new_fd)?;
+		Ok(new_id)
 	}
 
-	/// Returns the file descriptor with ID `id`. If the file descriptor doesn't exist, the
-	/// function returns None.
-	pub fn get_fd(&mut self, id: u32) -> Option<&mut FileDescriptor> {
-		let result = self.file_descriptors.binary_search_by(| fd | {
-			fd.get_id().cmp(&id)
-		});
+	/// Executes the closure `f` on the file descriptor with ID `id`, with the file descriptors
+	/// table locked. The function returns the result of the closure.
+	/// If the file descriptor doesn't exist, the function returns `EBADF`.
+	pub fn with_fd<T, F: FnOnce(&mut FileDescriptor) -> Result<T, Errno>>(&mut self, id: u32,
+		f: F) -> Result<T, Errno> {
+		let mut guard = self.file_descriptors.lock();
+		let file_descriptors = guard.get_mut();
 
-		if let Ok(index) = result {
-			Some(&mut self.file_descriptors[index])
-		} else {
-			None
-		}
+		let index = file_descriptors.binary_search_by(| fd | {
+			fd.get_id().cmp(&id)
+		}).map_err(| _ | errno::EBADF)?;
+		f(&mut file_descriptors[index])
 	}
 
 	/// Closes the file descriptor with the ID `id`. The function returns an Err if the file
 	/// descriptor doesn't exist.
 	pub fn close_fd(&mut self, id: u32) -> Result<(), Errno> {
-		let result = self.file_descriptors.binary_search_by(| fd | {
+		let mut guard = self.file_descriptors.lock();
+		let file_descriptors = guard.get_mut();
+
+		let result = file_descriptors.binary_search_by(| fd | {
 			fd.get_id().cmp(&id)
 		});
 
 		if let Ok(index) = result {
-			self.file_descriptors.remove(index);
+			file_descriptors.remove(index);
 			Ok(())
 		} else {
 			Err(errno::EBADF)
 		}
 	}
 
+	/// Returns the process's I/O ring, if created.
+	pub fn get_io_ring(&self) -> Option<IORing> {
+		self.io_ring
+	}
+
+	/// Sets the process's I/O ring.
+	pub fn set_io_ring(&mut self, io_ring: IORing) {
+		self.io_ring = Some(io_ring);
+	}
+
 	/// Returns the exit code if the process has ended.
 	pub fn get_exit_code(&self) -> Option<ExitStatus> {
 		if self.state == State::Zombie {
@@ -610,6 +778,26 @@ impl Process {
 	/// the parent process and children processes. On fail, the function returns an Err with the
 	/// appropriate Errno.
 	pub fn fork(&mut self) -> Result<SharedPtr<Self>, Errno> {
+		self.clone(0, None)
+	}
+
+	/// Creates a new process from the current process. Unlike `fork`, the new process may share
+	/// resources with the current process according to the given flags.
+	/// `flags` is a combination of `CLONE_*` flags.
+	/// `stack` is the pointer to the userspace stack of the new process. If None, the new process
+	/// uses the same stack pointer as the current process. A stack is required when the memory
+	/// space is shared.
+	/// On fail, the function returns an Err with the appropriate Errno.
+	pub fn clone(&mut self, flags: u32, stack: Option<*const c_void>)
+		-> Result<SharedPtr<Self>, Errno> {
+		// Threads in the same group share their signal handlers, which only makes sense when
+		// sharing the memory space
+		if (flags & CLONE_THREAD != 0 && flags & CLONE_SIGHAND == 0)
+			|| (flags & CLONE_SIGHAND != 0 && flags & CLONE_VM == 0)
+			|| (flags & CLONE_VM != 0 && stack.is_none()) {
+			return Err(errno::EINVAL);
+		}
+
 		// TODO Free if the function fails
 		let pid = {
 			let mutex = unsafe {
@@ -621,10 +809,43 @@ impl Process {
 
 		let mut regs = self.regs;
 		regs.eax = 0;
+		if let Some(stack) = stack {
+			regs.esp = stack as _;
+		}
+
+		let (mem_space, user_stack, kernel_stack) = if flags & CLONE_VM != 0 {
+			// Each thread needs its own kernel stack in the shared memory space
+			let kernel_stack = self.mem_space.lock().get_mut()
+				.map_stack(None, KERNEL_STACK_SIZE, KERNEL_STACK_FLAGS)?;
+			(self.mem_space.clone(), stack.unwrap(), kernel_stack)
+		} else {
+			let mem_space = self.mem_space.lock().get_mut().fork()?;
+			let user_stack = stack.unwrap_or(self.user_stack);
+			(SharedPtr::new(Mutex::new(mem_space))?, user_stack, self.kernel_stack)
+		};
+
+		let file_descriptors = if flags & CLONE_FILES != 0 {
+			self.file_descriptors.clone()
+		} else {
+			let fds = self.file_descriptors.lock().get().failable_clone()?;
+			SharedPtr::new(Mutex::new(fds))?
+		};
+
+		let signal_handlers = if flags & CLONE_SIGHAND != 0 {
+			self.signal_handlers.clone()
+		} else {
+			let handlers = *self.signal_handlers.lock().get();
+			SharedPtr::new(Mutex::new(handlers))?
+		};
 
 		let process = Self {
 			pid,
 			pgid: self.pgid,
+			tgid: if flags & CLONE_THREAD != 0 {
+				self.tgid
+			} else {
+				pid
+			},
 
 			uid: self.uid,
 			gid: self.gid,
@@ -641,16 +862,21 @@ impl Process {
 
 			regs,
 			syscalling: self.syscalling,
-			mem_space: self.mem_space.fork()?,
+			mem_space,
+			old_mem_space: None,
 
-			user_stack: self.user_stack,
-			kernel_stack: self.kernel_stack,
+			user_stack,
+			kernel_stack,
 
 			cwd: self.cwd.failable_clone()?,
-			file_descriptors: self.file_descriptors.failable_clone()?,
+			file_descriptors,
+			// The new process doesn't inherit the I/O ring
+			io_ring: None,
+
+			sleep_timer: None,
 
 			signals_queue: Vec::new(),
-			signal_handlers: self.signal_handlers,
+			signal_handlers,
 
 			exit_status: self.exit_status,
 		};
@@ -662,9 +888,52 @@ impl Process {
 		guard.get_mut().add_process(process)
 	}
 
+	/// Replaces the program executed by the process with the executable file `file`.
+	/// The process gets a new memory space in which the program's segments are mapped. Pages are
+	/// read from the file on the first access.
+	/// On success, the process resumes at the program's entry point the next time it is
+	/// scheduled. On fail, the process is left unchanged.
+	pub fn exec(&mut self, file: &SharedPtr<File>) -> Result<(), Errno> {
+		let mut mem_space = MemSpace::new()?;
+		let entry_point = elf::loader::load(file, &mut mem_space)?;
+		let user_stack = mem_space.map_stack(None, USER_STACK_SIZE, USER_STACK_FLAGS)?;
+		let kernel_stack = mem_space.map_stack(None, KERNEL_STACK_SIZE, KERNEL_STACK_FLAGS)?;
+		let mem_space = SharedPtr::new(Mutex::new(mem_space))?;
+
+		// Handlers are located in the previous program, thus they are reset
+		let signal_handlers = SharedPtr::new(Mutex::new([None; signal::SIGNALS_COUNT]))?;
+
+		// TODO Kill the other threads of the group
+		// TODO Close file descriptors with `O_CLOEXEC`
+		let old_mem_space = mem::replace(&mut self.mem_space, mem_space);
+		let old_kernel_stack = mem::replace(&mut self.kernel_stack, kernel_stack);
+		self.old_mem_space = Some((old_mem_space, old_kernel_stack));
+		self.user_stack = user_stack;
+		// The rings are located in the previous memory space
+		self.io_ring = None;
+		self.signal_handlers = signal_handlers;
+		self.signals_queue.clear();
+
+		self.regs = Regs {
+			ebp: 0x0,
+			esp: user_stack as _,
+			eip: entry_point as _,
+			eflags: DEFAULT_EFLAGS,
+			eax: 0x0,
+			ebx: 0x0,
+			ecx: 0x0,
+			edx: 0x0,
+			esi: 0x0,
+			edi: 0x0,
+		};
+		self.syscalling = false;
+
+		Ok(())
+	}
+
 	/// Returns the signal handler for the signal type `type_`.
 	pub fn get_signal_handler(&self, type_: SignalType) -> Option<SignalHandler> {
-		self.signal_handlers[type_ as usize]
+		self.signal_handlers.get_mut().lock().get()[type_ as usize]
 	}
 
 	/// Kills the process with the given signal type `type`. This function enqueues a new signal
@@ -685,6 +954,10 @@ impl Process {
 	/// Exits the process with the given `status`. This function changes the process's status to
 	/// `Zombie`.
 	pub fn exit(&mut self, status: u32) {
+		// The remaining time of the sleep, if any, doesn't matter anymore
+		if let Some((timer, ..)) = self.sleep_timer.take() {
+			timer::cancel(timer);
+		}
 		self.exit_status = (status & 0xff) as ExitStatus;
 		self.state = State::Zombie;
 	}
@@ -692,6 +965,9 @@ impl Process {
 
 impl Drop for Process {
 	fn drop(&mut self) {
+		// The memory space may be shared with other threads, which keep using it
+		self.mem_space.lock().get_mut().unmap_stack(self.kernel_stack, KERNEL_STACK_SIZE);
+
 		if let Some(mut parent) = self.get_parent() {
 			unsafe {
 				parent.as_mut()
@@ -1,6 +1,7 @@
 //! This module handles process PIDs.
 //! Each process must have an unique PID, thus they have to be allocated. The kernel uses a
-//! bitfield to store the used PIDs.
+//! bitfield to store the used PIDs. PIDs are allocated cyclically so that the PID of a process
+//! that just exited isn't handed out again right away.
 
 use crate::errno::Errno;
 use crate::util::container::id_allocator::IDAllocator;
@@ -21,7 +22,7 @@ impl PIDManager {
 	/// Creates a new instance.
 	pub fn new() -> Result<Self, Errno> {
 		Ok(Self {
-			allocator: IDAllocator::new(MAX_PID as _)?,
+			allocator: IDAllocator::new_cyclic(MAX_PID as _)?,
 		})
 	}
 
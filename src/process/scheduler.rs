@@ -10,10 +10,12 @@
 
 use core::cmp::max;
 use core::ffi::c_void;
+use crate::debug::trace;
 use crate::errno::Errno;
 use crate::event::CallbackHook;
 use crate::event;
 use crate::gdt;
+use crate::logger;
 use crate::memory::malloc;
 use crate::memory::stack;
 use crate::memory;
@@ -21,7 +23,9 @@ use crate::process::Process;
 use crate::process::pid::Pid;
 use crate::process::tss;
 use crate::process;
+use crate::time::timer;
 use crate::util::Regs;
+use crate::util::container::hashmap::HashMap;
 use crate::util::container::vec::Vec;
 use crate::util::lock::mutex::*;
 use crate::util::math;
@@ -64,6 +68,8 @@ pub struct Scheduler {
 
 	/// The list of all processes.
 	processes: Vec<SharedPtr<Process>>,
+	/// The processes, indexed by PID.
+	pids: HashMap<Pid, SharedPtr<Process>>,
 	/// The currently running process.
 	curr_proc: Option<SharedPtr<Process>>,
 
@@ -95,6 +101,7 @@ impl Scheduler {
 			total_ticks: 0,
 
 			processes: Vec::<SharedPtr<Process>>::new(),
+			pids: HashMap::new(),
 			curr_proc: None,
 
 			priority_sum: 0,
@@ -106,16 +113,7 @@ impl Scheduler {
 
 	/// Returns the process with PID `pid`. If the process doesn't exist, the function returns None.
 	pub fn get_by_pid(&mut self, pid: Pid) -> Option<SharedPtr<Process>> {
-		// TODO Optimize
-		for i in 0..self.processes.len() {
-			let proc = &mut self.processes[i];
-
-			if proc.lock().get().get_pid() == pid {
-				return Some(proc.clone());
-			}
-		}
-
-		None
+		self.pids.get(&pid).cloned()
 	}
 
 	/// Returns the current running process. If no process is running, the function returns None.
@@ -123,6 +121,12 @@ impl Scheduler {
 		self.curr_proc.as_ref().cloned()
 	}
 
+	/// Releases the currently running process. This function is used when the process has saved
+	/// its state by itself before stopping, so that the next tick doesn't overwrite it.
+	pub fn release_current_process(&mut self) {
+		self.curr_proc = None;
+	}
+
 	/// Updates the scheduler's heuristic with the new priority of a process.
 	/// `old` is the old priority of the process.
 	/// `new` is the newe priority of the process.
@@ -138,8 +142,12 @@ impl Scheduler {
 	/// Adds a process to the scheduler.
 	pub fn add_process(&mut self, process: Process) -> Result<SharedPtr<Process>, Errno> {
 		let priority = process.get_priority();
+		let pid = process.get_pid();
 		let ptr = SharedPtr::new(Mutex::new(process))?;
+		// Reserving first so that the process cannot be registered in only one of the lists
+		self.pids.try_reserve(1)?;
 		self.processes.push(ptr.clone())?;
+		self.pids.insert(pid, ptr.clone())?;
 		self.update_priority(0, priority);
 
 		Ok(ptr)
@@ -203,17 +211,38 @@ impl Scheduler {
 		}
 	}
 
+	/// Tells whether at least one process is waiting to be resumed.
+	fn has_waiting_processes(&self) -> bool {
+		self.processes.iter().any(| p | {
+			let state = p.clone().lock().get().get_state();
+			state == process::State::Sleeping || state == process::State::Stopped
+		})
+	}
+
+	/// Returns a pointer to the top of the temporary stack for the core with ID `core_id`.
+	fn get_tmp_stack(&mut self, core_id: usize) -> *mut c_void {
+		unsafe { // Safe because the offset stays at the end of the allocation
+			self.tmp_stacks[core_id].as_ptr_mut().add(TMP_STACK_SIZE) as *mut c_void
+		}
+	}
+
 	/// Ticking the scheduler. This function saves the data of the currently running process, then
 	/// switches to the next process to run.
 	/// `mutex` is the scheduler's mutex.
 	/// `regs` is the state of the registers from the paused context.
 	/// `ring` is the ring of the paused context.
 	fn tick(mutex: &mut InterruptMutex<Self>, regs: &util::Regs, ring: u32) -> ! {
+		// Timers are run before locking the scheduler since their callbacks may wake processes up
+		timer::tick();
+
 		let mut guard = mutex.lock();
 		let scheduler = guard.get_mut();
 
 		scheduler.total_ticks += 1;
 
+		// The scheduler's tick acts as the worker writing the kernel logs to the console
+		logger::flush();
+
 		if let Some(mut curr_proc) = scheduler.get_current_process() {
 			let mut guard = curr_proc.lock();
 			let curr_proc = guard.get_mut();
@@ -223,7 +252,12 @@ impl Scheduler {
 		}
 
 		if let Some(next_proc) = scheduler.get_next_process() {
-			scheduler.curr_proc = Some(next_proc.clone());
+			let mut next_proc = next_proc.clone();
+			crate::trace!(trace::SCHED_SWITCH,
+				scheduler.curr_proc.as_mut().map_or(0, | p | p.lock().get().get_pid()),
+				next_proc.lock().get().get_pid());
+
+			scheduler.curr_proc = Some(next_proc);
 
 			let core_id = 0; // TODO
 			let f = | data | {
@@ -239,11 +273,17 @@ impl Scheduler {
 					tss.ss0 = gdt::KERNEL_DATA_OFFSET as _;
 					tss.ss = gdt::USER_DATA_OFFSET as _;
 					tss.esp0 = proc.kernel_stack as _;
-					proc.mem_space.bind();
+					let mut mem_space_guard = proc.mem_space.lock();
+					let mem_space = mem_space_guard.get_mut();
+					mem_space.bind();
 
 					let eip = proc.regs.eip;
-					let vmem = proc.mem_space.get_vmem();
-					debug_assert!(vmem.translate(eip as _).is_some());
+					let vmem = mem_space.get_vmem();
+					// In userspace, the page may be mapped on the first access if backed by a file
+					debug_assert!(!proc.is_syscalling() || vmem.translate(eip as _).is_some());
+					drop(mem_space_guard);
+					// The previous memory space isn't in use anymore
+					proc.release_old_mem_space();
 
 					(proc.is_syscalling(), proc.regs)
 				};
@@ -261,9 +301,7 @@ impl Scheduler {
 				}
 			};
 
-			let tmp_stack = unsafe {
-				scheduler.tmp_stacks[core_id].as_ptr_mut() as *mut c_void
-			};
+			let tmp_stack = scheduler.get_tmp_stack(core_id);
 			let ctx_switch_data = ContextSwitchData {
 				proc: scheduler.curr_proc.as_mut().unwrap().clone(),
 			};
@@ -279,9 +317,23 @@ impl Scheduler {
 				stack::switch(tmp_stack, f, ctx_switch_data).unwrap();
 			}
 			crate::enter_loop();
+		} else if scheduler.has_waiting_processes() {
+			// Every processes are waiting for an event. Idling on the temporary stack until the
+			// next interrupt
+			let core_id = 0; // TODO
+			let tmp_stack = scheduler.get_tmp_stack(core_id);
+			// The registers of the next tick belong to the idle loop, not to the previous process
+			scheduler.release_current_process();
+
+			drop(guard);
+			unsafe {
+				event::unlock_callbacks(0x20);
+				crate::loop_reset(tmp_stack);
+			}
 		} else if cfg!(config_general_scheduler_end_panic) {
 			kernel_panic!("No process remaining to run!");
 		} else {
+			trace::dump();
 			crate::halt();
 		}
 	}
@@ -0,0 +1,259 @@
+//! This module implements shared memory objects, which allow several processes to map the same
+//! physical memory in their memory spaces.
+//!
+//! A shared memory object is identified by a name. Like a file, it has an owner and a mode which
+//! restrict the processes allowed to access or remove it.
+//!
+//! The pages of an object are allocated when it is mapped for the first time and stay allocated
+//! until the object is unlinked and every mapping to it has been removed. Since the size of every
+//! object is reserved at creation, the total size of the objects is limited.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::Gid;
+use crate::file::Mode;
+use crate::file::Uid;
+use crate::file;
+use crate::memory::buddy;
+use crate::memory;
+use crate::process::mem_space::MemSpace;
+use crate::process::mem_space::PHYSICAL_REF_COUNTER;
+use crate::util::container::string::String;
+use crate::util::container::vec::Vec;
+use crate::util::lock::mutex::*;
+use crate::util::math;
+
+/// The maximum size of a shared memory object in pages.
+const MAX_PAGES: usize = 4096;
+/// The maximum total size of the shared memory objects in pages.
+const MAX_TOTAL_PAGES: usize = 16384;
+
+/// The user ID of the superuser, which is allowed to remove any object.
+const ROOT_UID: Uid = 0;
+
+/// Structure representing a shared memory object.
+pub struct SharedMemory {
+	/// The name of the object.
+	name: String,
+
+	/// The user ID of the owner of the object.
+	uid: Uid,
+	/// The group ID of the owner of the object.
+	gid: Gid,
+	/// The permissions of the object.
+	mode: Mode,
+
+	/// The size of the object in pages.
+	pages_count: usize,
+	/// The physical pages of the object. Empty until the object is mapped for the first time.
+	pages: Vec<*const c_void>,
+	/// Tells whether the pages of the object have been filled with zeros.
+	cleared: bool,
+}
+
+impl SharedMemory {
+	/// Creates a new shared memory object with the given name `name` and size `size` in bytes.
+	/// `uid`, `gid` and `mode` are the owner and the permissions of the object.
+	/// The object's memory is allocated only when mapped.
+	fn new(name: String, size: usize, uid: Uid, gid: Gid, mode: Mode) -> Result<Self, Errno> {
+		let pages_count = math::ceil_division(size, memory::PAGE_SIZE);
+		if pages_count == 0 || pages_count > MAX_PAGES {
+			return Err(errno::EINVAL);
+		}
+
+		Ok(Self {
+			name,
+
+			uid,
+			gid,
+			mode,
+
+			pages_count,
+			pages: Vec::new(),
+			cleared: false,
+		})
+	}
+
+	/// Returns the name of the object.
+	pub fn get_name(&self) -> &String {
+		&self.name
+	}
+
+	/// Returns the size of the object in bytes.
+	pub fn get_size(&self) -> usize {
+		self.pages_count * memory::PAGE_SIZE
+	}
+
+	/// Tells if the object can be read from by the given UID and GID.
+	pub fn can_read(&self, uid: Uid, gid: Gid) -> bool {
+		if self.uid == uid && self.mode & file::S_IRUSR != 0 {
+			return true;
+		}
+		if self.gid == gid && self.mode & file::S_IRGRP != 0 {
+			return true;
+		}
+		self.mode & file::S_IROTH != 0
+	}
+
+	/// Tells if the object can be written to by the given UID and GID.
+	pub fn can_write(&self, uid: Uid, gid: Gid) -> bool {
+		if self.uid == uid && self.mode & file::S_IWUSR != 0 {
+			return true;
+		}
+		if self.gid == gid && self.mode & file::S_IWGRP != 0 {
+			return true;
+		}
+		self.mode & file::S_IWOTH != 0
+	}
+
+	/// Tells if the object can be removed by the given UID, which is the case for its owner and
+	/// the superuser.
+	pub fn can_remove(&self, uid: Uid) -> bool {
+		uid == ROOT_UID || uid == self.uid
+	}
+
+	/// Allocates the physical pages of the object if not already allocated.
+	/// The pages are allocated in the user zone, thus they cannot be cleared from the kernel. The
+	/// first mapping of the object has to clear them.
+	fn populate(&mut self) -> Result<(), Errno> {
+		if !self.pages.is_empty() {
+			return Ok(());
+		}
+
+		let mut pages = Vec::with_capacity(self.pages_count)?;
+		for _ in 0..self.pages_count {
+			let page = match buddy::alloc(0, buddy::FLAG_ZONE_TYPE_USER | buddy::FLAG_USAGE_USER) {
+				Ok(page) => page,
+				Err(errno) => {
+					release_pages(&pages);
+					return Err(errno);
+				},
+			};
+
+			// The object holds a reference to each of its pages
+			let result = unsafe { // Safe because using Mutex
+				PHYSICAL_REF_COUNTER.lock().get_mut().increment(page)
+			};
+			if let Err(errno) = result {
+				buddy::free(page, 0);
+				release_pages(&pages);
+				return Err(errno);
+			}
+
+			// Cannot fail since the capacity has been reserved
+			pages.push(page).unwrap();
+		}
+
+		self.pages = pages;
+		Ok(())
+	}
+
+	/// Maps the object into the memory space `mem_space` with the given mapping flags `flags`.
+	/// The function returns a pointer to the mapping.
+	pub fn map(&mut self, mem_space: &mut MemSpace, flags: u8) -> Result<*const c_void, Errno> {
+		self.populate()?;
+
+		let ptr = mem_space.map_shared(self.pages.as_slice(), flags, !self.cleared)?;
+		self.cleared = true;
+		Ok(ptr)
+	}
+}
+
+impl Drop for SharedMemory {
+	fn drop(&mut self) {
+		release_pages(&self.pages);
+	}
+}
+
+/// Releases the references of a shared memory object on the given physical pages `pages`.
+/// If mappings still reference a page, it shall be freed when they are unmapped.
+fn release_pages(pages: &Vec<*const c_void>) {
+	let mut ref_counter = unsafe { // Safe because using Mutex
+		PHYSICAL_REF_COUNTER.lock()
+	};
+	let ref_counter = ref_counter.get_mut();
+
+	for page in pages.iter() {
+		let last = ref_counter.get_ref_count(*page) == 1;
+		ref_counter.decrement(*page);
+		if last {
+			buddy::free(*page, 0);
+		}
+	}
+}
+
+/// The list of shared memory objects.
+static mut OBJECTS: Mutex<Vec<SharedMemory>> = Mutex::new(Vec::new());
+
+/// Returns the index of the object with name `name` in the given list.
+fn find(objects: &Vec<SharedMemory>, name: &str) -> Option<usize> {
+	objects.iter().position(| o | o.name == name)
+}
+
+/// Opens the shared memory object with name `name` on behalf of the user `uid` and group `gid`.
+/// If `create` is true and the object doesn't exist, it is created with size `size` in bytes and
+/// mode `mode`.
+/// If `excl` is true, the function fails if the object already exists.
+/// Opening an existing object requires the permission to read it.
+/// The function returns the size of the object in bytes.
+pub fn open(name: &str, size: usize, create: bool, excl: bool, uid: Uid, gid: Gid, mode: Mode)
+	-> Result<usize, Errno> {
+	let mut guard = unsafe { // Safe because using Mutex
+		OBJECTS.lock()
+	};
+	let objects = guard.get_mut();
+
+	if let Some(i) = find(objects, name) {
+		if create && excl {
+			Err(errno::EEXIST)
+		} else if !objects[i].can_read(uid, gid) {
+			Err(errno::EACCES)
+		} else {
+			Ok(objects[i].get_size())
+		}
+	} else if create {
+		let obj = SharedMemory::new(String::from(name)?, size, uid, gid, mode)?;
+
+		let total: usize = objects.iter().map(| o | o.pages_count).sum();
+		if total + obj.pages_count > MAX_TOTAL_PAGES {
+			return Err(errno::ENOSPC);
+		}
+
+		let size = obj.get_size();
+		objects.push(obj)?;
+		Ok(size)
+	} else {
+		Err(errno::ENOENT)
+	}
+}
+
+/// Calls the given closure `f` with the shared memory object with name `name`.
+/// If the object doesn't exist, the function returns `ENOENT`.
+pub fn with_object<T, F: FnOnce(&mut SharedMemory) -> Result<T, Errno>>(name: &str, f: F)
+	-> Result<T, Errno> {
+	let mut guard = unsafe { // Safe because using Mutex
+		OBJECTS.lock()
+	};
+	let objects = guard.get_mut();
+
+	let i = find(objects, name).ok_or(errno::ENOENT)?;
+	f(&mut objects[i])
+}
+
+/// Removes the shared memory object with name `name` on behalf of the user `uid`. Memory spaces
+/// mapping the object keep their access to its memory.
+pub fn unlink(name: &str, uid: Uid) -> Result<(), Errno> {
+	let mut guard = unsafe { // Safe because using Mutex
+		OBJECTS.lock()
+	};
+	let objects = guard.get_mut();
+
+	let i = find(objects, name).ok_or(errno::ENOENT)?;
+	if !objects[i].can_remove(uid) {
+		return Err(errno::EPERM);
+	}
+
+	objects.remove(i);
+	Ok(())
+}
@@ -2,8 +2,18 @@
 //! integration test.
 //! The kernel uses the serial communication interface to transmit the results of the selftests to
 //! another machine.
+//!
+//! Benchmarks are registered with `#[test_case]` as well, as static `Bench` items. Each
+//! measurement is printed on a single line with the following format, which is parsed by
+//! `testing/bench_compare.py`:
+//!
+//! `bench <name> ... min=<cycles> median=<cycles> p99=<cycles>`
 
 use core::any::type_name;
+use core::fmt;
+use core::mem;
+use core::ptr;
+use crate::time::tsc;
 //use crate::device::serial;
 
 /// Boolean value telling whether selftesting is running.
@@ -62,8 +72,116 @@ impl<T> Testable for T where T: Fn() {
 	}
 }
 
-/// The test runner for the kernel. This function runs every tests for the kernel and halts the
-/// kernel or exits the emulator if possible.
+/// The number of runs of a benchmark before measuring, to warm up the caches and the TLB.
+pub const BENCH_WARMUP: usize = 16;
+/// The number of measured runs of a benchmark.
+pub const BENCH_ITERATIONS: usize = 256;
+
+/// Structure allowing a benchmark to measure the execution time of a piece of code.
+pub struct Bencher {
+	/// The name of the benchmark.
+	name: &'static str,
+	/// The number of cycles taken by reading the TSC twice, subtracted from every measure.
+	overhead: u64,
+	/// The measures of the last run, in cycles.
+	samples: [u64; BENCH_ITERATIONS],
+}
+
+impl Bencher {
+	/// Creates a new instance for the benchmark with name `name`.
+	fn new(name: &'static str) -> Self {
+		let mut overhead = u64::MAX;
+		for _ in 0..BENCH_WARMUP {
+			let begin = tsc::read();
+			overhead = overhead.min(tsc::read() - begin);
+		}
+
+		Self {
+			name,
+			overhead,
+			samples: [0; BENCH_ITERATIONS],
+		}
+	}
+
+	/// Runs `f` `BENCH_WARMUP` times, then measures `BENCH_ITERATIONS` runs and prints the
+	/// results. `param` is appended to the name of the benchmark to distinguish several
+	/// measurements.
+	fn measure<F: FnMut()>(&mut self, param: Option<fmt::Arguments>, mut f: F) {
+		match param {
+			Some(param) => crate::print!("bench {}/{} ... ", self.name, param),
+			None => crate::print!("bench {} ... ", self.name),
+		}
+
+		for _ in 0..BENCH_WARMUP {
+			f();
+		}
+		for s in self.samples.iter_mut() {
+			let begin = tsc::read();
+			f();
+			let end = tsc::read();
+			*s = (end - begin).saturating_sub(self.overhead);
+		}
+
+		// Since the longest runs are usually disturbed by interrupts, the minimum and the median
+		// are more reliable than the average
+		self.samples.sort_unstable();
+		let min = self.samples[0];
+		let median = self.samples[BENCH_ITERATIONS / 2];
+		let p99 = self.samples[BENCH_ITERATIONS * 99 / 100];
+		crate::println!("min={} median={} p99={}", min, median, p99);
+	}
+
+	/// Measures the execution time of `f`.
+	pub fn iter<F: FnMut()>(&mut self, f: F) {
+		self.measure(None, f);
+	}
+
+	/// Same as `iter`, but the results are reported under the name of the benchmark followed by
+	/// `param`. This allows a benchmark to measure several variants of the same operation.
+	pub fn iter_param<F: FnMut()>(&mut self, param: fmt::Arguments, f: F) {
+		self.measure(Some(param), f);
+	}
+}
+
+/// Structure representing a benchmark. It must be declared as a static with the `test_case`
+/// attribute.
+pub struct Bench {
+	/// The name of the benchmark.
+	name: &'static str,
+	/// The function performing the measurements.
+	f: fn(&mut Bencher),
+}
+
+impl Bench {
+	/// Creates a benchmark with name `name`, whose measurements are performed by `f`.
+	pub const fn new(name: &'static str, f: fn(&mut Bencher)) -> Self {
+		Self {
+			name,
+			f,
+		}
+	}
+}
+
+impl Testable for Bench {
+	fn run(&self) {
+		let mut bencher = Bencher::new(self.name);
+		(self.f)(&mut bencher);
+	}
+}
+
+/// Returns `val`, preventing the compiler from making assumptions on it. This allows to prevent
+/// the code measured by a benchmark from being optimized out.
+pub fn black_box<T>(val: T) -> T {
+	unsafe { // Safe because the value is moved out of the original once
+		let ret = ptr::read_volatile(&val);
+		mem::forget(val);
+		ret
+	}
+}
+
+/// The test runner for the kernel. This function runs every tests and benchmarks for the kernel
+/// and halts the kernel or exits the emulator if possible.
+/// If a test fails, the panic handler exits the emulator with a failure status instead.
 pub fn runner(tests: &[&dyn Testable]) {
 	crate::println!("Running {} tests", tests.len());
 
@@ -82,7 +200,7 @@ pub fn runner(tests: &[&dyn Testable]) {
 	crate::println!("No more tests to run");
 
 	#[cfg(config_debug_qemu)]
-	qemu::exit(qemu::SUCCESS); // TODO Handle assertion fail (exit with FAILURE)
+	qemu::exit(qemu::SUCCESS);
 	#[cfg(not(config_debug_qemu))]
 	crate::halt();
 }
@@ -0,0 +1,26 @@
+//! The `clone` system call creates a child process which may share resources with the current
+//! process, such as its memory space. This allows to create threads.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::process::Process;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+
+/// The implementation of the `clone` syscall.
+pub fn clone(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let flags = regs.ebx;
+	let stack = regs.ecx as *const c_void;
+
+	let stack = if stack.is_null() {
+		None
+	} else {
+		Some(stack)
+	};
+
+	let mut mutex = proc.clone(flags, stack)?;
+	let mut guard = mutex.lock();
+	let new_proc = guard.get_mut();
+
+	Ok(new_proc.get_pid() as _)
+}
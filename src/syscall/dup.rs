@@ -7,5 +7,5 @@ use crate::util;
 /// The implementation of the `dup` syscall.
 pub fn dup(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
 	let oldfd = regs.ebx;
-	Ok(proc.duplicate_fd(oldfd, None)?.get_id() as _)
+	Ok(proc.duplicate_fd(oldfd, None)? as _)
 }
@@ -10,5 +10,5 @@ pub fn dup2(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
 	let oldfd = regs.ebx;
 	let newfd = regs.ecx;
 
-	Ok(proc.duplicate_fd(oldfd, Some(newfd))?.get_id() as _)
+	Ok(proc.duplicate_fd(oldfd, Some(newfd))? as _)
 }
@@ -0,0 +1,57 @@
+//! The `execve` system call replaces the program executed by the current process with a new one.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::FileType;
+use crate::file;
+use crate::limits;
+use crate::process::Process;
+use crate::util::lock::mutex::MutexGuard;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+use super::open::get_file_absolute_path;
+
+/// The implementation of the `execve` syscall.
+/// Passing arguments (`ecx`) and environment (`edx`) to the new program is not supported yet,
+/// thus the syscall returns `EINVAL` if any of them is specified.
+/// On success, the syscall doesn't return to the previous program. Instead, the process resumes
+/// at the entry point of the new program.
+pub fn execve(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let pathname = regs.ebx as *const c_void;
+	let argv = regs.ecx as *const c_void;
+	let envp = regs.edx as *const c_void;
+	if !argv.is_null() || !envp.is_null() {
+		return Err(errno::EINVAL);
+	}
+
+	let len = proc.get_mem_space_mut().lock().get().can_access_string(pathname as _, true, false)
+		.ok_or(errno::EFAULT)?;
+	if len > limits::PATH_MAX {
+		return Err(errno::ENAMETOOLONG);
+	}
+	let path_str = unsafe { // Safe because the access has been checked
+		util::ptr_to_str_len(&*(pathname as *const u8), len)
+	};
+
+	let path = get_file_absolute_path(proc, path_str)?;
+	let file = {
+		let mutex = file::get_files_cache();
+		let mut guard = MutexGuard::new(mutex);
+		guard.get_mut().get_file_from_path(&path)?
+	};
+
+	{
+		let guard = file.get_mut().lock();
+		let f = guard.get();
+		if f.get_file_type() != FileType::Regular {
+			return Err(errno::EACCES);
+		}
+		if !f.can_execute(proc.get_uid(), proc.get_gid()) {
+			return Err(errno::EACCES);
+		}
+	}
+
+	proc.exec(&file)?;
+	Ok(0)
+}
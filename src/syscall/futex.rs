@@ -0,0 +1,71 @@
+//! The `futex` system call allows processes to wait on and to wake up each other using integers
+//! located in userspace memory.
+
+use core::mem::size_of;
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::process::futex::FutexKey;
+use crate::process::futex;
+use crate::time::Timespec;
+use crate::time::timer;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+
+/// The implementation of the `futex` syscall.
+pub fn futex(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let uaddr = regs.ebx as *const u32;
+	let op = regs.ecx;
+	let val = regs.edx;
+	let val2 = regs.esi;
+	let uaddr2 = regs.edi as *const u32;
+	let val3 = regs.ebp;
+
+	let private = op & futex::FUTEX_PRIVATE_FLAG != 0;
+	match op & !futex::FUTEX_PRIVATE_FLAG {
+		futex::FUTEX_WAIT => {
+			let timeout = regs.esi as *const Timespec;
+			let timeout = if !timeout.is_null() {
+				let len = size_of::<Timespec>();
+				let mem_space_guard = proc.get_mem_space_mut().lock();
+				if !mem_space_guard.get().can_access(timeout as _, len, true, false) {
+					return Err(errno::EFAULT);
+				}
+				drop(mem_space_guard);
+
+				let timeout = unsafe { // Safe because the access has been checked
+					*timeout
+				};
+				let ns = timeout.to_nano().ok_or(errno::EINVAL)?;
+				// Adding one tick since the current one is already partially elapsed
+				Some(timer::ns_to_ticks(ns) + 1)
+			} else {
+				None
+			};
+
+			futex::wait(proc, uaddr, val, private, timeout)?;
+			Ok(0)
+		},
+
+		futex::FUTEX_WAKE => {
+			let key = FutexKey::new(proc, uaddr, private)?;
+			Ok(futex::wake(key, val) as _)
+		},
+
+		futex::FUTEX_REQUEUE | futex::FUTEX_CMP_REQUEUE => {
+			let key = FutexKey::new(proc, uaddr, private)?;
+			let key2 = FutexKey::new(proc, uaddr2, private)?;
+
+			// The access to the futex has been checked when creating the key
+			let expected = if op & !futex::FUTEX_PRIVATE_FLAG == futex::FUTEX_CMP_REQUEUE {
+				Some((uaddr, val3))
+			} else {
+				None
+			};
+
+			Ok(futex::requeue(key, val, key2, val2, expected)? as _)
+		},
+
+		_ => Err(errno::ENOSYS),
+	}
+}
@@ -6,5 +6,6 @@ use crate::util;
 
 /// The implementation of the `getpid` syscall.
 pub fn getpid(proc: &mut Process, _regs: &util::Regs) -> Result<i32, Errno> {
-	Ok(proc.get_pid() as _)
+	// Threads of the same group share the same PID
+	Ok(proc.get_tgid() as _)
 }
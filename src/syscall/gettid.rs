@@ -0,0 +1,10 @@
+//! The `gettid` system call returns the thread ID of the current process.
+
+use crate::errno::Errno;
+use crate::process::Process;
+use crate::util;
+
+/// The implementation of the `gettid` syscall.
+pub fn gettid(proc: &mut Process, _regs: &util::Regs) -> Result<i32, Errno> {
+	Ok(proc.get_pid() as _)
+}
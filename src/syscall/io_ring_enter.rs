@@ -0,0 +1,44 @@
+//! The `io_ring_enter` system call submits the pending entries of the current process's I/O ring
+//! and retrieves the number of available completions.
+
+use core::cmp::min;
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+
+/// The implementation of the `io_ring_enter` syscall.
+/// `to_submit` is the maximum number of submission entries to consume.
+/// `min_complete` is the minimum number of completion entries to wait for.
+///
+/// Since operations are performed synchronously, every consumed submission has its completion
+/// available when the syscall returns and no completion can arrive afterwards. Thus, if the
+/// completions available after submitting cannot reach `min_complete`, waiting would never end
+/// and the syscall fails with `EINVAL` without submitting anything. If no entry can be consumed
+/// because the completion ring is full, the syscall fails with `EBUSY`.
+///
+/// If the rings are not mapped anymore, the syscall fails with `EFAULT`. Buffers given by
+/// submission entries are checked when performing each operation.
+pub fn io_ring_enter(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let to_submit = regs.ebx;
+	let min_complete = regs.ecx;
+
+	let io_ring = proc.get_io_ring().ok_or(errno::EBADF)?;
+	io_ring.check_access(proc.get_mem_space_mut().lock().get_mut())?;
+
+	// Submission stops when the completion ring is full
+	let completions = io_ring.get_completions_count();
+	let submittable = min(to_submit, io_ring.get_submissions_count());
+	let reachable = min(completions.saturating_add(submittable), io_ring.get_entries());
+	if min_complete > reachable {
+		return Err(errno::EINVAL);
+	}
+
+	let submitted = io_ring.submit(proc, to_submit);
+	if submitted == 0 && to_submit > 0 && completions >= io_ring.get_entries() {
+		return Err(errno::EBUSY);
+	}
+
+	Ok(submitted as _)
+}
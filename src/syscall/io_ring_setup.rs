@@ -0,0 +1,40 @@
+//! The `io_ring_setup` system call creates an I/O ring for the current process, allowing it to
+//! submit I/O operations in batches.
+
+use core::mem::size_of;
+use core::ptr;
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::process::io_ring::IORing;
+use crate::process::io_ring::IORingParams;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+
+/// The implementation of the `io_ring_setup` syscall.
+pub fn io_ring_setup(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let entries = regs.ebx;
+	let params = regs.ecx as *mut IORingParams;
+
+	if proc.get_io_ring().is_some() {
+		return Err(errno::EBUSY);
+	}
+	let len = size_of::<IORingParams>();
+	{
+		let mut mem_space_guard = proc.get_mem_space_mut().lock();
+		let mem_space = mem_space_guard.get_mut();
+		if !mem_space.can_access(params as _, len, true, true) {
+			return Err(errno::EFAULT);
+		}
+		// Writing the parameters must not fault
+		mem_space.fault_in_range(params as _, len)?;
+	}
+
+	let (io_ring, p) = IORing::new(proc, entries)?;
+	proc.set_io_ring(io_ring);
+
+	unsafe { // Safe because the access has been checked before
+		ptr::write_volatile(params, p);
+	}
+	Ok(0)
+}
@@ -2,27 +2,41 @@
 //! userspace and kernelspace.
 //! TODO doc
 
+use crate::debug::trace;
 use crate::util::lock::mutex::TMutex;
 use crate::process::Process;
+use crate::process::State;
 use crate::process::signal;
+use crate::process::tss;
+use crate::process;
 
 mod _exit;
 mod chroot;
+mod clone;
 mod close;
 mod dup2;
 mod dup;
+mod execve;
 mod fork;
+mod futex;
 mod getgid;
 mod getpgid;
 mod getpid;
 mod getppid;
+mod gettid;
 mod getuid;
+mod io_ring_enter;
+mod io_ring_setup;
 mod kill;
+mod nanosleep;
 mod open;
 mod read;
 mod setgid;
 mod setpgid;
 mod setuid;
+mod shm_map;
+mod shm_open;
+mod shm_unlink;
 mod umask;
 mod uname;
 mod unlink;
@@ -31,22 +45,32 @@ mod write;
 
 use _exit::_exit;
 use chroot::chroot;
+use clone::clone;
 use close::close;
 use crate::util;
 use dup2::dup2;
 use dup::dup;
+use execve::execve;
 use fork::fork;
+use futex::futex;
 use getgid::getgid;
 use getpgid::getpgid;
 use getpid::getpid;
 use getppid::getppid;
+use gettid::gettid;
 use getuid::getuid;
+use io_ring_enter::io_ring_enter;
+use io_ring_setup::io_ring_setup;
 use kill::kill;
+use nanosleep::nanosleep;
 use open::open;
 use read::read;
 use setgid::setgid;
 use setpgid::setpgid;
 use setuid::setuid;
+use shm_map::shm_map;
+use shm_open::shm_open;
+use shm_unlink::shm_unlink;
 use umask::umask;
 use uname::uname;
 use unlink::unlink;
@@ -63,6 +87,7 @@ pub extern "C" fn syscall_handler(regs: &util::Regs) -> u32 {
 	// TODO Issue with functions that never return
 
 	let id = regs.eax;
+	crate::trace!(trace::SYSCALL_ENTER, curr_proc.get_pid(), id);
 
 	let result = match id {
 		0 => open(curr_proc, regs),
@@ -128,7 +153,6 @@ pub extern "C" fn syscall_handler(regs: &util::Regs) -> u32 {
 		19 => setpgid(curr_proc, regs),
 		// TODO getsid
 		// TODO setsid
-		// TODO gettid
 		// TODO mmap
 		// TODO munmap
 		// TODO mlock
@@ -155,6 +179,16 @@ pub extern "C" fn syscall_handler(regs: &util::Regs) -> u32 {
 		// TODO gettimeofday
 		// TODO ptrace
 		21 => uname(curr_proc, regs),
+		22 => io_ring_setup(curr_proc, regs),
+		23 => io_ring_enter(curr_proc, regs),
+		24 => futex(curr_proc, regs),
+		25 => clone(curr_proc, regs),
+		26 => gettid(curr_proc, regs),
+		27 => shm_open(curr_proc, regs),
+		28 => shm_map(curr_proc, regs),
+		29 => shm_unlink(curr_proc, regs),
+		30 => execve(curr_proc, regs),
+		31 => nanosleep(curr_proc, regs),
 		// TODO reboot
 
 		_ => {
@@ -163,9 +197,34 @@ pub extern "C" fn syscall_handler(regs: &util::Regs) -> u32 {
 		}
 	};
 
-	if let Ok(val) = result {
-		val as _
-	} else {
-		-result.unwrap_err() as _
+	let val = {
+		if let Ok(val) = result {
+			val as _
+		} else {
+			-result.unwrap_err() as _
+		}
+	};
+	crate::trace!(trace::SYSCALL_EXIT, curr_proc.get_pid(), id, val);
+
+	if curr_proc.get_state() != State::Running || curr_proc.is_mem_space_pending() {
+		// The process cannot continue right now or its program has been replaced. It shall resume
+		// in userspace with the result of the syscall once scheduled again
+		let mut regs = if curr_proc.is_mem_space_pending() {
+			*curr_proc.get_regs()
+		} else {
+			*regs
+		};
+		regs.eax = val;
+		curr_proc.leave_syscall(&regs);
+
+		drop(guard);
+		drop(mutex);
+		process::get_scheduler().lock().get_mut().release_current_process();
+
+		unsafe {
+			crate::loop_reset(tss::get().esp0 as _);
+		}
 	}
+
+	val
 }
@@ -0,0 +1,52 @@
+//! The `nanosleep` system call allows to suspend the execution of the current process for a given
+//! duration.
+
+use core::mem::size_of;
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::time::Timespec;
+use crate::time::timer;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+
+/// Called at the end of the sleep of the process with PID `pid`.
+fn wake(pid: usize) {
+	Process::wake_from_sleep(pid as _);
+}
+
+/// The implementation of the `nanosleep` syscall.
+/// If the sleep is interrupted, the call returns `EINTR` and the remaining time is written to
+/// `rem` if not null.
+pub fn nanosleep(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let req = regs.ebx as *const Timespec;
+	let rem = regs.ecx as *mut Timespec;
+
+	let len = size_of::<Timespec>();
+	{
+		let mem_space_guard = proc.get_mem_space_mut().lock();
+		let mem_space = mem_space_guard.get();
+		if !mem_space.can_access(req as _, len, true, false) {
+			return Err(errno::EFAULT);
+		}
+		if !rem.is_null() && !mem_space.can_access(rem as _, len, true, true) {
+			return Err(errno::EFAULT);
+		}
+	}
+	let req = unsafe { // Safe because the access has been checked
+		*req
+	};
+	let ns = req.to_nano().ok_or(errno::EINVAL)?;
+	if ns == 0 {
+		return Ok(0);
+	}
+
+	// Adding one tick since the current one is already partially elapsed
+	let ticks = timer::ns_to_ticks(ns) + 1;
+	let end = timer::get_ticks() + ticks;
+	let timer = timer::add(ticks, 0, wake, proc.get_pid() as _)?;
+	// If the sleep is interrupted, the timer is cancelled and the return value becomes `EINTR`
+	proc.sleep_until(timer, end, rem);
+
+	Ok(0)
+}
@@ -41,7 +41,7 @@ pub const O_SYNC: u32 =      0b01000000000000;
 pub const O_TRUNC: u32 =     0b10000000000000;
 
 /// Returns the absolute path to the file.
-fn get_file_absolute_path(process: &Process, path_str: &str) -> Result<Path, Errno> {
+pub fn get_file_absolute_path(process: &Process, path_str: &str) -> Result<Path, Errno> {
 	let path = Path::from_string(path_str)?;
 	if !path.is_absolute() {
 		let cwd = process.get_cwd();
@@ -85,5 +85,5 @@ pub fn open(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
 	let file_path = get_file_absolute_path(&proc, path_str)?;
 	let file = get_file(file_path, flags)?;
 	let fd = proc.open_file(file)?;
-	Ok(fd.get_id() as _)
+	Ok(fd as _)
 }
@@ -0,0 +1,41 @@
+//! The `shm_map` system call maps a shared memory object into the memory space of the current
+//! process. Writes to the mapping are visible to every process mapping the same object.
+
+use crate::errno::Errno;
+use crate::errno;
+use crate::process::Process;
+use crate::process::mem_space::MAPPING_FLAG_USER;
+use crate::process::mem_space::MAPPING_FLAG_WRITE;
+use crate::process::shm;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+use super::shm_open::get_name;
+
+/// Protection flag: the mapping can be written.
+const PROT_WRITE: u32 = 0b10;
+
+/// The implementation of the `shm_map` syscall.
+/// Mapping the object requires the permission to read it, and to write it if `PROT_WRITE` is set.
+/// On success, the syscall returns the address of the mapping.
+pub fn shm_map(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let name = get_name(proc, regs.ebx as _)?;
+	let prot = regs.ecx;
+
+	let mut flags = MAPPING_FLAG_USER;
+	if prot & PROT_WRITE != 0 {
+		flags |= MAPPING_FLAG_WRITE;
+	}
+
+	let uid = proc.get_uid();
+	let gid = proc.get_gid();
+	let ptr = shm::with_object(name, | obj | {
+		let allowed = obj.can_read(uid, gid) && (flags & MAPPING_FLAG_WRITE == 0
+			|| obj.can_write(uid, gid));
+		if !allowed {
+			return Err(errno::EACCES);
+		}
+
+		obj.map(proc.get_mem_space_mut().lock().get_mut(), flags)
+	})?;
+	Ok(ptr as _)
+}
@@ -0,0 +1,45 @@
+//! The `shm_open` system call opens a shared memory object, creating it if requested.
+
+use core::ffi::c_void;
+use crate::errno::Errno;
+use crate::errno;
+use crate::file::Mode;
+use crate::limits;
+use crate::process::Process;
+use crate::process::shm;
+use crate::util::lock::mutex::TMutex;
+use crate::util;
+use super::open::O_CREAT;
+use super::open::O_EXCL;
+
+/// Returns the name of the shared memory object at the given userspace pointer `ptr` in the memory
+/// space of the process `proc`.
+pub fn get_name(proc: &mut Process, ptr: *const c_void) -> Result<&'static str, Errno> {
+	let len = proc.get_mem_space_mut().lock().get().can_access_string(ptr as _, true, false)
+		.ok_or(errno::EFAULT)?;
+	let name = unsafe { // Safe because the access has been checked
+		util::ptr_to_str_len(&*(ptr as *const u8), len)
+	};
+
+	if name.is_empty() {
+		Err(errno::EINVAL)
+	} else if name.len() > limits::NAME_MAX {
+		Err(errno::ENAMETOOLONG)
+	} else {
+		Ok(name)
+	}
+}
+
+/// The implementation of the `shm_open` syscall.
+/// If the object is created, its mode is the given mode, restricted by the process's umask.
+/// On success, the syscall returns the size of the object in bytes.
+pub fn shm_open(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let name = get_name(proc, regs.ebx as _)?;
+	let flags = regs.ecx;
+	let size = regs.edx as usize;
+	let mode = regs.esi as Mode & 0o777 & !proc.get_umask();
+
+	let size = shm::open(name, size, flags & O_CREAT != 0, flags & O_EXCL != 0, proc.get_uid(),
+		proc.get_gid(), mode)?;
+	Ok(size as _)
+}
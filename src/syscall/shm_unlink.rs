@@ -0,0 +1,16 @@
+//! The `shm_unlink` system call removes a shared memory object. Existing mappings of the object
+//! stay valid.
+
+use crate::errno::Errno;
+use crate::process::Process;
+use crate::process::shm;
+use crate::util;
+use super::shm_open::get_name;
+
+/// The implementation of the `shm_unlink` syscall.
+/// Only the owner of the object and the superuser are allowed to remove it.
+pub fn shm_unlink(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
+	let name = get_name(proc, regs.ebx as _)?;
+	shm::unlink(name, proc.get_uid())?;
+	Ok(0)
+}
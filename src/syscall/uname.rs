@@ -5,6 +5,7 @@ use core::ptr::copy_nonoverlapping;
 use crate::errno::Errno;
 use crate::errno;
 use crate::process::Process;
+use crate::util::lock::mutex::TMutex;
 use crate::util;
 
 /// The length of a field of the utsname structure.
@@ -40,7 +41,8 @@ pub fn uname(proc: &mut Process, regs: &util::Regs) -> Result<i32, Errno> {
 	// TODO version
 	// TODO machine
 
-	if proc.get_mem_space().can_access(buf as _, size_of::<Utsname>(), true, true) {
+	let len = size_of::<Utsname>();
+	if proc.get_mem_space_mut().lock().get().can_access(buf as _, len, true, true) {
 		unsafe {
 			copy_nonoverlapping(&utsname as *const Utsname, buf, 1);
 		}
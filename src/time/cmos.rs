@@ -237,6 +237,11 @@ impl ClockSource for CMOSClock {
 		"CMOS"
 	}
 
+	fn get_rating(&self) -> u32 {
+		// Slow to read and only precise to the second
+		10
+	}
+
 	fn get_time(&mut self) -> Timestamp {
 		if self.timestamp.is_none() {
 			self.init();
@@ -1,21 +1,68 @@
 //! This module handles time-releated features.
 //! The kernel stores a list of clock sources. A clock source is an object that allow to get the
 //! current timestamp.
+//! Each source has a rating, the source with the highest rating being the preferred one.
+//!
+//! When the TSC is available, the kernel also maintains a clock base: a reference point
+//! associating a TSC value with the monotonic and wall-clock times in nanoseconds. Reading the
+//! time then only requires reading the TSC and the clock base, which is protected by a SeqLock so
+//! that readers never block.
 
 use crate::errno::Errno;
 use crate::util::boxed::Box;
 use crate::util::container::vec::Vec;
 use crate::util::lock::mutex::*;
+use crate::util::lock::seqlock::SeqLock;
 
 pub mod cmos;
+pub mod timer;
+pub mod tsc;
 
-/// Type representing a timestamp.
+/// The number of nanoseconds in a second.
+pub const NS_PER_SEC: u64 = 1000000000;
+
+/// Type representing a timestamp in seconds.
 pub type Timestamp = u32;
+/// Type representing a timestamp in nanoseconds.
+pub type NanoTimestamp = u64;
+
+/// Structure representing a duration or a point in time, as used by the system calls.
+#[repr(C)]
+#[derive(Clone, Copy, Debug)]
+pub struct Timespec {
+	/// The number of seconds.
+	pub tv_sec: i32,
+	/// The number of nanoseconds, in addition to the seconds.
+	pub tv_nsec: i32,
+}
+
+impl Timespec {
+	/// Returns the value in nanoseconds. If the structure is invalid, the function returns None.
+	pub fn to_nano(&self) -> Option<NanoTimestamp> {
+		if self.tv_sec < 0 || self.tv_nsec < 0 || self.tv_nsec as u64 >= NS_PER_SEC {
+			return None;
+		}
+
+		Some(self.tv_sec as u64 * NS_PER_SEC + self.tv_nsec as u64)
+	}
+
+	/// Creates a structure from the value `ns` in nanoseconds. The number of seconds saturates if
+	/// too large.
+	pub fn from_nano(ns: NanoTimestamp) -> Self {
+		Self {
+			tv_sec: (ns / NS_PER_SEC).min(i32::MAX as u64) as _,
+			tv_nsec: (ns % NS_PER_SEC) as _,
+		}
+	}
+}
 
 /// Trait representing a source able to provide the current timestamp.
 pub trait ClockSource {
 	/// The name of the source.
 	fn get_name(&self) -> &str;
+	/// Returns the rating of the source. The higher the rating, the more precise and the cheaper
+	/// to read the source is.
+	fn get_rating(&self) -> u32;
 	/// Returns the current timestamp in seconds.
 	fn get_time(&mut self) -> Timestamp;
 }
@@ -41,8 +88,8 @@ pub fn add_clock_source<T: 'static + ClockSource>(source: T) -> Result<(), Errno
 	Ok(())
 }
 
-/// Returns the current timestamp from the preferred clock source.
-pub fn get() -> Timestamp {
+/// Returns the current timestamp from the clock source with the highest rating.
+fn get_from_source() -> Timestamp {
 	let mutex = unsafe { // Safe because using Mutex
 		&mut CLOCK_SOURCES
 	};
@@ -52,6 +99,159 @@ pub fn get() -> Timestamp {
 		crate::kernel_panic!("No clock source available!");
 	}
 
-	let cmos = &mut sources[0]; // TODO Select the preferred source
-	cmos.get_time()
+	sources.iter_mut()
+		.max_by_key(| s | s.get_rating())
+		.unwrap()
+		.get_time()
+}
+
+/// Returns the current timestamp in seconds. If the clock base is initialized, the function
+/// doesn't lock the clock sources.
+pub fn get() -> Timestamp {
+	if let Some(realtime) = get_realtime() {
+		(realtime / NS_PER_SEC) as _
+	} else {
+		get_from_source()
+	}
+}
+
+/// Structure associating a TSC value with the time in nanoseconds.
+#[derive(Clone, Copy)]
+struct ClockBase {
+	/// The value of the TSC at the reference point.
+	tsc: u64,
+	/// The monotonic time at the reference point.
+	monotonic: NanoTimestamp,
+	/// The wall-clock time at the reference point.
+	realtime: NanoTimestamp,
+
+	/// The multiplier to convert TSC cycles to nanoseconds.
+	mult: u32,
+	/// The shift to convert TSC cycles to nanoseconds. Lower or equal to `32`.
+	shift: u32,
+}
+
+impl ClockBase {
+	/// Returns the number of nanoseconds elapsed since the reference point.
+	/// `tsc` is the current value of the TSC.
+	fn elapsed(&self, tsc: u64) -> NanoTimestamp {
+		let delta = tsc.wrapping_sub(self.tsc);
+		// Splitting the delta to compute `(delta * mult) >> shift` without overflowing
+		let lo = delta & 0xffffffff;
+		let hi = delta >> 32;
+		let mult = self.mult as u64;
+		((lo * mult) >> self.shift) + ((hi * mult) << (32 - self.shift))
+	}
+}
+
+/// The clock base. If None, the TSC is not available.
+static CLOCK_BASE: SeqLock<Option<ClockBase>> = SeqLock::new(None);
+
+/// Computes the multiplier and the shift used to convert cycles of a counter at frequency
+/// `frequency` (in Hertz) to nanoseconds. The shift is chosen as high as possible for precision.
+fn compute_mult_shift(frequency: u64) -> (u32, u32) {
+	let mut shift = 32;
+	loop {
+		let mult = (NS_PER_SEC << shift) / frequency;
+		if mult <= u32::MAX as u64 || shift == 0 {
+			return (mult as _, shift);
+		}
+		shift -= 1;
+	}
+}
+
+/// Returns the frequency of the TSC in Hertz. If the clock base isn't initialized, the function
+/// returns None.
+pub fn get_tsc_frequency() -> Option<u64> {
+	CLOCK_BASE.read().map(| base | (NS_PER_SEC << base.shift) / base.mult as u64)
+}
+
+/// Returns the monotonic time in nanoseconds, which is the time elapsed since the initialization
+/// of the clock. If the clock base isn't initialized, the function returns `0`.
+pub fn get_monotonic() -> NanoTimestamp {
+	CLOCK_BASE.read()
+		.map(| base | base.monotonic + base.elapsed(tsc::read()))
+		.unwrap_or(0)
+}
+
+/// Returns the wall-clock time in nanoseconds since the Unix epoch. If the clock base isn't
+/// initialized, the function returns None.
+pub fn get_realtime() -> Option<NanoTimestamp> {
+	CLOCK_BASE.read().map(| base | base.realtime + base.elapsed(tsc::read()))
+}
+
+/// Sets the wall-clock time to `realtime` in nanoseconds since the Unix epoch. The monotonic time
+/// is left unchanged. If the clock base isn't initialized, the function does nothing.
+pub fn set_realtime(realtime: NanoTimestamp) {
+	CLOCK_BASE.write(| base | {
+		if let Some(base) = base {
+			let tsc = tsc::read();
+			base.monotonic += base.elapsed(tsc);
+			base.realtime = realtime;
+			base.tsc = tsc;
+		}
+	});
+}
+
+/// Initializes timers and the clock base. This function must be called after the registration of
+/// a clock source giving the current date, which is used as the initial wall-clock time.
+/// If the CPU doesn't have a TSC, the clock base is not initialized.
+pub fn init() -> Result<(), Errno> {
+	timer::init();
+
+	let tsc = match tsc::TSCClock::new() {
+		Some(tsc) => tsc,
+		None => return Ok(()),
+	};
+	let (mult, shift) = compute_mult_shift(tsc.get_frequency());
+	let realtime = get_from_source() as u64 * NS_PER_SEC;
+
+	CLOCK_BASE.write(| base | {
+		*base = Some(ClockBase {
+			tsc: tsc::read(),
+			monotonic: 0,
+			realtime,
+
+			mult,
+			shift,
+		});
+	});
+	add_clock_source(tsc)
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn clock_base_elapsed0() {
+		for frequency in [1000000, 100000000, 1000000000, 3000000000, 5000000000].iter() {
+			let (mult, shift) = compute_mult_shift(*frequency);
+			let base = ClockBase {
+				tsc: 0,
+				monotonic: 0,
+				realtime: 0,
+
+				mult,
+				shift,
+			};
+
+			for secs in [0, 1, 60, 86400, 31536000].iter() {
+				let ns = base.elapsed(*frequency * secs);
+				let expected = secs * NS_PER_SEC;
+				// Allowing a relative error of one millionth
+				assert!(ns.max(expected) - ns.min(expected) <= expected / 1000000 + 1);
+			}
+		}
+	}
+
+	#[test_case]
+	fn timespec_nano0() {
+		for ns in [0, 1, NS_PER_SEC - 1, NS_PER_SEC, 86400 * NS_PER_SEC + 42].iter() {
+			assert_eq!(Timespec::from_nano(*ns).to_nano(), Some(*ns));
+		}
+
+		let ts = Timespec::from_nano(u64::MAX);
+		assert_eq!(ts.tv_sec, i32::MAX);
+	}
 }
@@ -0,0 +1,412 @@
+//! This module implements timers, allowing to call a function after a given delay.
+//!
+//! Pending timers are stored in a hierarchical timing wheel. The wheel is made of several levels
+//! of slots, each slot being a linked list of timers. The first level has one slot per tick, and
+//! each following level has slots covering a range of ticks `LEVEL_SIZE` times larger than the
+//! previous one.
+//! When a level's cursor wraps around, the timers of the current slot of the next level are
+//! redistributed into the lower levels (this is called cascading). This way, inserting or
+//! cancelling a timer is done in constant time and a tick only processes the timers that expire on
+//! it, regardless of the number of pending timers.
+//!
+//! The wheel is advanced by the scheduler's tick.
+
+use crate::errno::Errno;
+use crate::errno;
+use crate::pit;
+use crate::util::container::vec::Vec;
+use crate::util::lock::mutex::*;
+use super::NS_PER_SEC;
+use super::NanoTimestamp;
+
+/// The frequency of the ticks, in Hertz.
+pub const TICK_FREQUENCY: pit::Frequency = 100;
+/// The duration of a tick, in nanoseconds.
+pub const TICK_NS: NanoTimestamp = NS_PER_SEC / TICK_FREQUENCY as u64;
+
+/// The base 2 logarithm of the number of slots in a level.
+const LEVEL_BITS: usize = 6;
+/// The number of slots in a level.
+const LEVEL_SIZE: usize = 1 << LEVEL_BITS;
+/// The number of levels of the wheel. Timers expiring further than `2^(LEVEL_BITS * LEVELS)`
+/// ticks in the future are stored in the last level and cascaded until they fit.
+const LEVELS: usize = 5;
+
+/// The index of the list containing timers that expired and whose callback has to be called.
+const EXPIRED_SLOT: u16 = (LEVELS * LEVEL_SIZE) as _;
+/// The value of `slot` for entries that are not allocated.
+const FREE_SLOT: u16 = u16::MAX;
+/// Value representing the absence of an entry in links.
+const NONE: u32 = u32::MAX;
+
+/// Type representing a number of ticks.
+pub type Tick = u64;
+
+/// Converts the duration `ns` in nanoseconds to a number of ticks, rounding up.
+pub fn ns_to_ticks(ns: NanoTimestamp) -> Tick {
+	ns / TICK_NS + (ns % TICK_NS != 0) as Tick
+}
+
+/// Identifier of a timer, returned when adding it. Since identifiers are never reused, a timer
+/// that has already expired may be cancelled safely.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+pub struct TimerId {
+	/// The index of the entry.
+	index: u32,
+	/// The generation of the entry when the timer was added.
+	generation: u32,
+}
+
+/// A timer entry.
+struct Entry {
+	/// The tick at which the timer expires.
+	expires: Tick,
+	/// The period of the timer in ticks. If zero, the timer is removed once expired.
+	period: Tick,
+	/// The function to call when the timer expires.
+	callback: fn(usize),
+	/// The argument given to the callback.
+	data: usize,
+
+	/// Incremented each time the entry is freed, to invalidate the identifiers of the timer.
+	generation: u32,
+	/// The slot in which the entry is linked.
+	slot: u16,
+	/// The previous entry in the slot.
+	prev: u32,
+	/// The next entry in the slot. For free entries, the next free entry.
+	next: u32,
+}
+
+/// A timing wheel.
+pub struct Wheel {
+	/// The current tick.
+	ticks: Tick,
+
+	/// The entries storage.
+	entries: Vec<Entry>,
+	/// The first free entry.
+	free: u32,
+	/// The first entry of each slot, followed by the list of expired timers.
+	slots: [u32; LEVELS * LEVEL_SIZE + 1],
+}
+
+impl Wheel {
+	/// Creates a new empty wheel.
+	pub const fn new() -> Self {
+		Self {
+			ticks: 0,
+
+			entries: Vec::new(),
+			free: NONE,
+			slots: [NONE; LEVELS * LEVEL_SIZE + 1],
+		}
+	}
+
+	/// Returns the current tick.
+	pub fn get_ticks(&self) -> Tick {
+		self.ticks
+	}
+
+	/// Links the entry at index `i` at the front of the slot `slot`.
+	fn link(&mut self, i: u32, slot: u16) {
+		let head = self.slots[slot as usize];
+		if head != NONE {
+			self.entries[head as usize].prev = i;
+		}
+
+		let entry = &mut self.entries[i as usize];
+		entry.slot = slot;
+		entry.prev = NONE;
+		entry.next = head;
+		self.slots[slot as usize] = i;
+	}
+
+	/// Unlinks the entry at index `i` from its slot.
+	fn unlink(&mut self, i: u32) {
+		let (slot, prev, next) = {
+			let entry = &self.entries[i as usize];
+			(entry.slot, entry.prev, entry.next)
+		};
+
+		if prev != NONE {
+			self.entries[prev as usize].next = next;
+		} else {
+			self.slots[slot as usize] = next;
+		}
+		if next != NONE {
+			self.entries[next as usize].prev = prev;
+		}
+	}
+
+	/// Links the entry at index `i` into the slot corresponding to its expiration tick.
+	fn insert(&mut self, i: u32) {
+		let expires = self.entries[i as usize].expires;
+		if expires < self.ticks {
+			self.link(i, EXPIRED_SLOT);
+			return;
+		}
+
+		let delta = expires - self.ticks;
+		let level = (0..LEVELS)
+			.find(| l | delta < 1 << (LEVEL_BITS * (l + 1)))
+			.unwrap_or(LEVELS - 1);
+		// Timers too far in the future are placed in the last slot reachable by the last level
+		let max = (1 << (LEVEL_BITS * LEVELS)) - 1;
+		let expires = self.ticks + delta.min(max);
+
+		let index = (expires >> (LEVEL_BITS * level)) as usize & (LEVEL_SIZE - 1);
+		self.link(i, (level * LEVEL_SIZE + index) as _);
+	}
+
+	/// Adds a timer.
+	/// `delay` is the number of ticks before the timer expires. If zero, the timer expires at the
+	/// next call to `pop_expired`.
+	/// `period` is the number of ticks between each expiration after the first one. If zero, the
+	/// timer expires only once.
+	/// `callback` is the function to call with the argument `data` when the timer expires.
+	pub fn add(&mut self, delay: Tick, period: Tick, callback: fn(usize), data: usize)
+		-> Result<TimerId, Errno> {
+		let i = if self.free != NONE {
+			let i = self.free;
+			self.free = self.entries[i as usize].next;
+			i
+		} else {
+			let i = self.entries.len();
+			if i >= NONE as usize {
+				return Err(errno::ENOMEM);
+			}
+
+			self.entries.push(Entry {
+				expires: 0,
+				period: 0,
+				callback,
+				data,
+
+				generation: 0,
+				slot: FREE_SLOT,
+				prev: NONE,
+				next: NONE,
+			})?;
+			i as u32
+		};
+
+		let entry = &mut self.entries[i as usize];
+		entry.expires = self.ticks + delay;
+		entry.period = period;
+		entry.callback = callback;
+		entry.data = data;
+		let generation = entry.generation;
+
+		if delay == 0 {
+			// The current slot has already been processed
+			self.link(i, EXPIRED_SLOT);
+		} else {
+			self.insert(i);
+		}
+
+		Ok(TimerId {
+			index: i,
+			generation,
+		})
+	}
+
+	/// Frees the entry at index `i`, which must be unlinked.
+	fn free(&mut self, i: u32) {
+		let entry = &mut self.entries[i as usize];
+		entry.generation = entry.generation.wrapping_add(1);
+		entry.slot = FREE_SLOT;
+		entry.next = self.free;
+		self.free = i;
+	}
+
+	/// Cancels the timer with identifier `id`. If the timer has already expired, the function
+	/// returns `false`.
+	pub fn cancel(&mut self, id: TimerId) -> bool {
+		let pending = self.entries.get(id.index as usize).map_or(false, | e | {
+			e.generation == id.generation && e.slot != FREE_SLOT
+		});
+		if pending {
+			self.unlink(id.index);
+			self.free(id.index);
+		}
+
+		pending
+	}
+
+	/// Redistributes the timers of the slot `index` of the level `level` into the lower levels.
+	fn cascade(&mut self, level: usize, index: usize) {
+		let slot = level * LEVEL_SIZE + index;
+		let mut i = self.slots[slot];
+		self.slots[slot] = NONE;
+
+		while i != NONE {
+			let next = self.entries[i as usize].next;
+			self.insert(i);
+			i = next;
+		}
+	}
+
+	/// Advances the wheel by one tick. Timers expiring on the new tick are moved to the expired
+	/// list, to be retrieved with `pop_expired`.
+	pub fn advance(&mut self) {
+		self.ticks += 1;
+
+		let index = self.ticks as usize & (LEVEL_SIZE - 1);
+		if index == 0 {
+			for level in 1..LEVELS {
+				let index = (self.ticks >> (LEVEL_BITS * level)) as usize & (LEVEL_SIZE - 1);
+				self.cascade(level, index);
+				if index != 0 {
+					break;
+				}
+			}
+		}
+
+		// Appending the slot to the expired list
+		let mut i = self.slots[index];
+		self.slots[index] = NONE;
+		while i != NONE {
+			let next = self.entries[i as usize].next;
+			self.link(i, EXPIRED_SLOT);
+			i = next;
+		}
+	}
+
+	/// Removes an expired timer and returns its callback along with the callback's argument. If
+	/// the timer is periodic, it is rearmed. If no timer has expired, the function returns None.
+	pub fn pop_expired(&mut self) -> Option<(fn(usize), usize)> {
+		let i = self.slots[EXPIRED_SLOT as usize];
+		if i == NONE {
+			return None;
+		}
+		self.unlink(i);
+
+		let entry = &mut self.entries[i as usize];
+		let result = (entry.callback, entry.data);
+		if entry.period != 0 {
+			// If late, the missed expirations are skipped
+			entry.expires = (entry.expires + entry.period).max(self.ticks + 1);
+			self.insert(i);
+		} else {
+			self.free(i);
+		}
+
+		Some(result)
+	}
+}
+
+/// The timing wheel.
+static mut WHEEL: InterruptMutex<Wheel> = InterruptMutex::new(Wheel::new());
+
+/// Returns the timing wheel.
+fn get_wheel() -> &'static mut InterruptMutex<Wheel> {
+	unsafe { // Safe because using Mutex
+		&mut WHEEL
+	}
+}
+
+/// Initializes timers, setting the frequency of the ticks.
+pub fn init() {
+	pit::set_frequency(TICK_FREQUENCY);
+}
+
+/// Returns the number of ticks elapsed since the initialization of timers.
+pub fn get_ticks() -> Tick {
+	get_wheel().lock().get().get_ticks()
+}
+
+/// Adds a timer. See `Wheel::add`.
+pub fn add(delay: Tick, period: Tick, callback: fn(usize), data: usize)
+	-> Result<TimerId, Errno> {
+	get_wheel().lock().get_mut().add(delay, period, callback, data)
+}
+
+/// Cancels the timer with identifier `id`. If the timer has already expired, the function returns
+/// `false`.
+pub fn cancel(id: TimerId) -> bool {
+	get_wheel().lock().get_mut().cancel(id)
+}
+
+/// Advances the timers by one tick and calls the callbacks of the expired ones. This function is
+/// called at each tick. Callbacks are called with the wheel unlocked, which allows them to add or
+/// cancel timers.
+pub fn tick() {
+	get_wheel().lock().get_mut().advance();
+
+	loop {
+		let expired = get_wheel().lock().get_mut().pop_expired();
+		match expired {
+			Some((callback, data)) => callback(data),
+			None => break,
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// Callback doing nothing, the tests checking the data returned by `pop_expired` instead.
+	fn dummy(_: usize) {}
+
+	/// Advances the wheel `n` times and returns the data of the expired timers, along with the
+	/// tick at which they expired.
+	fn run(wheel: &mut Wheel, n: usize) -> Vec<(usize, Tick)> {
+		let mut expired = Vec::new();
+		for _ in 0..n {
+			wheel.advance();
+			while let Some((_, data)) = wheel.pop_expired() {
+				expired.push((data, wheel.get_ticks())).unwrap();
+			}
+		}
+		expired
+	}
+
+	#[test_case]
+	fn timer_wheel0() {
+		let mut wheel = Wheel::new();
+		let delays = [1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 10000, 300000];
+		for (i, delay) in delays.iter().enumerate() {
+			wheel.add(*delay, 0, dummy, i).unwrap();
+		}
+
+		let expired = run(&mut wheel, 300001);
+		assert_eq!(expired.len(), delays.len());
+		for (data, tick) in expired.iter() {
+			assert_eq!(*tick, delays[*data]);
+		}
+	}
+
+	#[test_case]
+	fn timer_wheel_cancel0() {
+		let mut wheel = Wheel::new();
+		let a = wheel.add(10, 0, dummy, 0).unwrap();
+		let b = wheel.add(100, 0, dummy, 1).unwrap();
+		assert!(wheel.cancel(a));
+		assert!(!wheel.cancel(a));
+
+		let expired = run(&mut wheel, 200);
+		assert_eq!(expired.len(), 1);
+		assert_eq!(expired[0], (1, 100));
+		assert!(!wheel.cancel(b));
+
+		// The entry is reused by a new timer, which must not be cancelled through the old identifier
+		let c = wheel.add(10, 0, dummy, 2).unwrap();
+		assert!(!wheel.cancel(b));
+		assert!(wheel.cancel(c));
+	}
+
+	#[test_case]
+	fn timer_wheel_periodic0() {
+		let mut wheel = Wheel::new();
+		let id = wheel.add(5, 5, dummy, 0).unwrap();
+
+		let expired = run(&mut wheel, 22);
+		assert_eq!(expired.len(), 4);
+		for (i, (_, tick)) in expired.iter().enumerate() {
+			assert_eq!(*tick, (i as Tick + 1) * 5);
+		}
+		assert!(wheel.cancel(id));
+	}
+}
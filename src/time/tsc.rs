@@ -0,0 +1,110 @@
+//! This module implements the TSC (Time Stamp Counter) clock source. The TSC is a counter
+//! incremented by the CPU at a fixed rate, which can be read with a single instruction.
+//!
+//! Since the frequency of the TSC isn't reported by the CPU, it is calibrated against the PIT at
+//! boot.
+
+use core::arch::x86;
+use crate::idt;
+use crate::pit;
+use super::ClockSource;
+use super::Timestamp;
+
+/// The number of PIT ticks during which the TSC is measured for each calibration attempt. This
+/// corresponds to 10 milliseconds.
+const CALIBRATION_TICKS: u16 = (pit::BASE_FREQUENCY / 100) as _;
+/// The number of calibration attempts. The shortest measure is kept since longer ones have been
+/// disturbed (by an SMI for example).
+const CALIBRATION_ATTEMPTS: usize = 3;
+
+/// The rating of the TSC if it runs at a constant rate regardless of the CPU's power state.
+const RATING_INVARIANT: u32 = 300;
+/// The rating of the TSC if its rate may vary.
+const RATING_VARIANT: u32 = 100;
+
+/// Reads the current value of the TSC.
+#[inline(always)]
+pub fn read() -> u64 {
+	unsafe {
+		x86::_rdtsc()
+	}
+}
+
+/// Tells whether the CPU has a TSC.
+pub fn is_present() -> bool {
+	let edx = unsafe {
+		x86::__cpuid(1)
+	}.edx;
+	edx & (1 << 4) != 0
+}
+
+/// Tells whether the TSC runs at a constant rate.
+fn is_invariant() -> bool {
+	unsafe {
+		if x86::__cpuid(0x80000000).eax < 0x80000007 {
+			return false;
+		}
+		x86::__cpuid(0x80000007).edx & (1 << 8) != 0
+	}
+}
+
+/// Measures the frequency of the TSC in Hertz against the PIT.
+fn calibrate() -> u64 {
+	let cycles = idt::wrap_disable_interrupts(|| {
+		(0..CALIBRATION_ATTEMPTS).map(| _ | {
+			pit::start_countdown(CALIBRATION_TICKS);
+			let begin = read();
+			while !pit::is_countdown_over() {}
+			read() - begin
+		}).min().unwrap()
+	});
+
+	cycles * pit::BASE_FREQUENCY as u64 / CALIBRATION_TICKS as u64
+}
+
+/// Structure representing the TSC clock source.
+pub struct TSCClock {
+	/// The frequency of the TSC in Hertz.
+	frequency: u64,
+	/// Tells whether the TSC runs at a constant rate.
+	invariant: bool,
+}
+
+impl TSCClock {
+	/// Creates a new instance, calibrating the TSC. If the CPU doesn't have a TSC, the function
+	/// returns None.
+	pub fn new() -> Option<Self> {
+		if !is_present() {
+			return None;
+		}
+
+		Some(Self {
+			frequency: calibrate(),
+			invariant: is_invariant(),
+		})
+	}
+
+	/// Returns the frequency of the TSC in Hertz.
+	pub fn get_frequency(&self) -> u64 {
+		self.frequency
+	}
+}
+
+impl ClockSource for TSCClock {
+	fn get_name(&self) -> &str {
+		"TSC"
+	}
+
+	fn get_rating(&self) -> u32 {
+		if self.invariant {
+			RATING_INVARIANT
+		} else {
+			RATING_VARIANT
+		}
+	}
+
+	fn get_time(&mut self) -> Timestamp {
+		// The TSC only counts time: the date comes from the clock base
+		(super::get_realtime().unwrap_or(0) / super::NS_PER_SEC) as _
+	}
+}
@@ -298,7 +298,6 @@ fn parse_csi(tty: &mut TTY) -> (ANSIState, usize) {
 		_ => ANSIState::Invalid,
 	};
 
-	tty.update();
 	(status, 2 + nbr_len + 1)
 }
 
@@ -335,7 +334,6 @@ pub fn handle(tty: &mut TTY, buffer: &[u8]) -> (ANSIState, usize) {
 			for b in buffer.iter().skip(len) {
 				tty.putchar(*b);
 			}
-			tty.update();
 			tty.ansi_buffer.clear();
 		},
 
@@ -343,7 +341,6 @@ pub fn handle(tty: &mut TTY, buffer: &[u8]) -> (ANSIState, usize) {
 			for b in buffer.iter() {
 				tty.putchar(*b);
 			}
-			tty.update();
 			tty.ansi_buffer.clear();
 		},
 
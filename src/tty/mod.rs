@@ -16,6 +16,13 @@ use crate::vga;
 /// The number of TTYs.
 const TTYS_COUNT: usize = 8;
 /// The number of history lines for one TTY.
+#[cfg(config_general_tty_scrollback = "512")]
+const HISTORY_LINES: vga::Pos = 512;
+/// The number of history lines for one TTY.
+#[cfg(config_general_tty_scrollback = "2048")]
+const HISTORY_LINES: vga::Pos = 2048;
+/// The number of history lines for one TTY.
+#[cfg(not(any(config_general_tty_scrollback = "512", config_general_tty_scrollback = "2048")))]
 const HISTORY_LINES: vga::Pos = 128;
 /// The number of characters a TTY can store.
 const HISTORY_SIZE: usize = (vga::WIDTH as usize) * (HISTORY_LINES as usize);
@@ -31,13 +38,6 @@ const BELL_FREQUENCY: u32 = 2000;
 /// The duraction of the bell in ms.
 const BELL_DURATION: u32 = 500;
 
-/// Returns the position of the cursor in the history array from `x` and `y` position.
-fn get_history_offset(x: vga::Pos, y: vga::Pos) -> usize {
-	let off = (y * vga::WIDTH + x) as usize;
-	debug_assert!(off < HISTORY_SIZE);
-	off
-}
-
 /// Returns the position of a tab character for the given cursor X position.
 fn get_tab_size(cursor_x: vga::Pos) -> usize {
 	TAB_SIZE - ((cursor_x as usize) % TAB_SIZE)
@@ -57,8 +57,10 @@ pub struct TTY {
 	/// The current color for the text to be written
 	current_color: vga::Color,
 
-	/// The content of the TTY's history
+	/// The content of the TTY's history. Lines are stored in a circular buffer
 	history: [vga::Char; HISTORY_SIZE],
+	/// The index in the history buffer of the first line of the history
+	head: usize,
 
 	/// The ANSI escape codes buffer.
 	ansi_buffer: ansi::ANSIBuffer,
@@ -67,6 +69,16 @@ pub struct TTY {
 	prompted_chars: usize,
 	/// Tells whether TTY updates are enabled or not
 	update: bool,
+
+	/// The range of lines of the history which have been modified since the last rendering. The
+	/// end of the range is exclusive.
+	dirty: Option<(vga::Pos, vga::Pos)>,
+	/// The Y position of the screen in the history at the last rendering. If different from
+	/// `screen_y`, the whole screen has to be rendered again. `-1` forces the rendering.
+	rendered_screen_y: vga::Pos,
+	/// The position of the cursor on the screen at the last rendering. None if the cursor was
+	/// hidden.
+	rendered_cursor: Option<(vga::Pos, vga::Pos)>,
 }
 
 /// The array of every TTYs.
@@ -98,7 +110,7 @@ pub fn init() {
 	for i in 0..TTYS_COUNT {
 		let mut guard = MutexGuard::new(get(i));
 		let t = guard.get_mut();
-		t.init();
+		t.init(i);
 	}
 
 	switch(0);
@@ -115,24 +127,31 @@ pub fn switch(tty: usize) {
 
 	let mut guard = MutexGuard::new(get(tty));
 	let t = guard.get_mut();
-	vga::enable_cursor();
-	vga::move_cursor(t.cursor_x, t.cursor_y);
+	// The screen contains the previous TTY
+	t.invalidate();
 	t.update();
 }
 
 impl TTY {
 	// TODO Clean
-	/// Creates a new TTY.
-	pub fn init(&mut self) {
-		self.id = 0;
+	/// Creates a new TTY with id `id`.
+	pub fn init(&mut self, id: usize) {
+		self.id = id;
 		self.cursor_x = 0;
 		self.cursor_y = 0;
 		self.screen_y = 0;
 		self.current_color = vga::DEFAULT_COLOR;
-		self.history = [0; HISTORY_SIZE];
+		// Cleared in place since a temporary array of this size may not fit on the stack
+		for c in self.history.iter_mut() {
+			*c = 0;
+		}
+		self.head = 0;
 		self.ansi_buffer = ansi::ANSIBuffer::new();
 		self.prompted_chars = 0;
 		self.update = true;
+		self.dirty = None;
+		self.rendered_screen_y = -1;
+		self.rendered_cursor = None;
 	}
 
 	/// Returns the id of the TTY.
@@ -140,30 +159,116 @@ impl TTY {
 		self.id
 	}
 
-	/// Updates the TTY to the screen.
+	/// Returns the offset in the history buffer of the character at position `x` and `y` in the
+	/// history.
+	fn get_history_offset(&self, x: vga::Pos, y: vga::Pos) -> usize {
+		debug_assert!((0..vga::WIDTH).contains(&x));
+		debug_assert!((0..HISTORY_LINES).contains(&y));
+
+		let line = (self.head + y as usize) % HISTORY_LINES as usize;
+		line * vga::WIDTH as usize + x as usize
+	}
+
+	/// Clears the line `y` of the history.
+	fn clear_line(&mut self, y: vga::Pos) {
+		let off = self.get_history_offset(0, y);
+		for c in &mut self.history[off..(off + vga::WIDTH as usize)] {
+			*c = 0;
+		}
+	}
+
+	/// Copies `count` lines of the history beginning at line `y` to the screen at line
+	/// `screen_line`. Since the history is circular, the copy is split in at most two parts.
+	fn render_lines(&self, y: vga::Pos, screen_line: vga::Pos, count: vga::Pos) {
+		let width = vga::WIDTH as usize;
+		let first = self.get_history_offset(0, y) / width;
+		let count = count as usize;
+		let first_count = min(count, HISTORY_LINES as usize - first);
+
+		let parts = [
+			(first, screen_line as usize, first_count),
+			(0, screen_line as usize + first_count, count - first_count),
+		];
+		for (line, screen_line, count) in parts.iter() {
+			if *count == 0 {
+				continue;
+			}
+
+			let buff = &self.history[line * width];
+			unsafe {
+				vmem::write_lock_wrap(|| {
+					core::ptr::copy_nonoverlapping(buff as *const vga::Char,
+						(vga::BUFFER_VIRT as *mut vga::Char).add(screen_line * width),
+						count * width);
+				});
+			}
+		}
+	}
+
+	/// Marks the lines of the history from `begin` to `end` (exclusive) as modified, so that
+	/// they are rendered at the next update.
+	fn mark_dirty(&mut self, begin: vga::Pos, end: vga::Pos) {
+		self.dirty = match self.dirty {
+			Some((b, e)) => Some((min(b, begin), max(e, end))),
+			None => Some((begin, end)),
+		};
+	}
+
+	/// Forces the rendering of the whole screen and of the cursor at the next update.
+	fn invalidate(&mut self) {
+		self.rendered_screen_y = -1;
+	}
+
+	/// Enables or disables updates of the TTY to the screen. While disabled, modifications are
+	/// accumulated and rendered at once when updates are enabled again.
+	pub fn set_update(&mut self, update: bool) {
+		self.update = update;
+		if update {
+			self.update();
+		}
+	}
+
+	/// Updates the TTY to the screen. Only the lines that have been modified since the last
+	/// update are copied, and the cursor is moved only if its position changed.
 	pub fn update(&mut self) {
 		let current_tty = unsafe { // Safe because using Mutex
 			*CURRENT_TTY.lock().get()
 		};
-		if self.id == current_tty && !self.update {
+		// A TTY in the background is rendered when switching to it
+		if self.id != current_tty || !self.update {
 			return;
 		}
 
-		let buff = &self.history[get_history_offset(0, self.screen_y)];
-		unsafe {
-			vmem::write_lock_wrap(|| {
-				core::ptr::copy_nonoverlapping(buff as *const vga::Char,
-					vga::BUFFER_VIRT as *mut vga::Char,
-					(vga::WIDTH as usize) * (vga::HEIGHT as usize));
-			});
+		let full = self.rendered_screen_y != self.screen_y;
+		let (begin, end) = if full {
+			(0, vga::HEIGHT)
+		} else if let Some((b, e)) = self.dirty {
+			(max(b - self.screen_y, 0), min(e - self.screen_y, vga::HEIGHT))
+		} else {
+			(0, 0)
+		};
+		self.dirty = None;
+		self.rendered_screen_y = self.screen_y;
+
+		if begin < end {
+			self.render_lines(self.screen_y + begin, begin, end - begin);
 		}
 
 		let y = self.cursor_y - self.screen_y;
-		if (0..vga::HEIGHT).contains(&y) {
-			vga::enable_cursor();
-			vga::move_cursor(self.cursor_x, y);
+		let cursor = if (0..vga::HEIGHT).contains(&y) {
+			Some((self.cursor_x, y))
 		} else {
-			vga::disable_cursor();
+			None
+		};
+		if full || cursor != self.rendered_cursor {
+			if let Some((x, y)) = cursor {
+				vga::enable_cursor();
+				vga::move_cursor(x, y);
+			} else {
+				vga::disable_cursor();
+			}
+
+			self.rendered_cursor = cursor;
 		}
 	}
 
@@ -220,6 +325,8 @@ impl TTY {
 		for i in 0..self.history.len() {
 			self.history[i] = 0;
 		}
+		self.head = 0;
+		self.invalidate();
 		self.update();
 	}
 
@@ -254,16 +361,16 @@ impl TTY {
 		}
 
 		if self.screen_y + vga::HEIGHT > HISTORY_LINES {
-			let diff = ((self.screen_y + vga::HEIGHT - HISTORY_LINES) * vga::WIDTH) as usize;
-			let size = self.history.len() - diff;
-			for i in 0..size {
-				self.history[i] = self.history[diff + i];
-			}
-			for i in size..self.history.len() {
-				self.history[i] = 0;
+			// The oldest lines are reused as the new last lines
+			let diff = min(self.screen_y + vga::HEIGHT - HISTORY_LINES, HISTORY_LINES);
+			self.head = (self.head + diff as usize) % HISTORY_LINES as usize;
+			for y in (HISTORY_LINES - diff)..HISTORY_LINES {
+				self.clear_line(y);
 			}
 
 			self.screen_y = HISTORY_LINES - vga::HEIGHT;
+			// Every lines have moved
+			self.invalidate();
 		}
 
 		debug_assert!(self.cursor_x >= 0);
@@ -293,7 +400,8 @@ impl TTY {
 		self.fix_pos();
 	}
 
-	/// Writes the character `c` to the TTY.
+	/// Writes the character `c` to the TTY. The screen is not updated until the next call to
+	/// `update`.
 	pub fn putchar(&mut self, c: u8) {
 		match c {
 			0x07 => {
@@ -319,16 +427,16 @@ impl TTY {
 
 			_ => {
 				let tty_char = (c as vga::Char) | ((self.current_color as vga::Char) << 8);
-				let pos = get_history_offset(self.cursor_x, self.cursor_y);
+				let pos = self.get_history_offset(self.cursor_x, self.cursor_y);
 				self.history[pos] = tty_char;
+				self.mark_dirty(self.cursor_y, self.cursor_y + 1);
 				self.cursor_forward(1, 0);
 			}
 		}
-
-		self.update();
 	}
 
-	/// Writes string `buffer` to TTY.
+	/// Writes string `buffer` to TTY. The screen is updated once the whole buffer has been
+	/// written.
 	pub fn write(&mut self, buffer: &[u8]) {
 		let mut i = 0;
 
@@ -341,9 +449,9 @@ impl TTY {
 				self.putchar(c);
 				i += 1;
 			}
-
-			self.update();
 		}
+
+		self.update();
 	}
 
 	/// Erases `count` characters in TTY.
@@ -354,10 +462,14 @@ impl TTY {
 		}
 		self.cursor_backward(count, 0);
 
-		let begin = get_history_offset(self.cursor_x, self.cursor_y);
-		for i in begin..(begin + count) {
-			self.history[i] = EMPTY_CHAR;
+		let lines = ((self.cursor_x as usize + count) / vga::WIDTH as usize) as vga::Pos;
+		for i in 0..count {
+			let x = (self.cursor_x as usize + i) % vga::WIDTH as usize;
+			let y = self.cursor_y as usize + (self.cursor_x as usize + i) / vga::WIDTH as usize;
+			let off = self.get_history_offset(x as _, y as _);
+			self.history[off] = EMPTY_CHAR;
 		}
+		self.mark_dirty(self.cursor_y, self.cursor_y + lines + 1);
 		self.update();
 		self.prompted_chars -= count;
 	}
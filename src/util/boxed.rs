@@ -74,6 +74,14 @@ impl<T: ?Sized> Box<T> {
 		}
 	}
 
+	/// Consumes the Box and returns a pointer to the data it wrapped. The caller takes the
+	/// ownership of the data, which can be given back to a Box with `from_raw`.
+	pub fn into_raw(self) -> *mut T {
+		let ptr = self.ptr.as_ptr();
+		mem::forget(self);
+		ptr
+	}
+
 	/// Returns a pointer to the data wrapped into the Box.
 	pub fn as_ptr(&self) -> *const T {
 		self.ptr.as_ptr()
@@ -1224,6 +1224,9 @@ impl<K: 'static + Ord, V> Drop for BinaryTree<K, V> {
 #[cfg(test)]
 mod test {
 	use super::*;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
+	use crate::selftest;
 
 	#[test_case]
 	fn binary_tree0() {
@@ -1474,5 +1477,28 @@ mod test {
 		assert!(passed);
 	}
 
+	/// The number of elements in the tree used for benchmarks.
+	const BENCH_SIZE: i32 = 1024;
+
+	fn binary_tree_bench(b: &mut Bencher) {
+		let mut tree = BinaryTree::<i32, i32>::new();
+		for i in 0..BENCH_SIZE {
+			tree.insert(i, i).unwrap();
+		}
+
+		let mut i = 0;
+		b.iter_param(format_args!("get"), || {
+			selftest::black_box(tree.get(i % BENCH_SIZE));
+			i += 1;
+		});
+		b.iter_param(format_args!("insert_remove"), || {
+			tree.insert(BENCH_SIZE, 0).unwrap();
+			selftest::black_box(tree.remove(BENCH_SIZE));
+		});
+	}
+
+	#[test_case]
+	static BINARY_TREE_BENCH: Bench = Bench::new("binary_tree", binary_tree_bench);
+
 	// TODO More foreach tests
 }
@@ -1,15 +1,63 @@
 //! This module stores the Bitfield structure.
+//!
+//! Bits are stored in machine words so that bulk operations and searches process a whole word at
+//! once. A second level summarizes which words are full, which allows to find a clear bit by
+//! scanning only a few words with bit-scan instructions.
 
+use core::cmp::min;
+use core::mem::size_of;
+use core::ops::Range;
 use crate::errno::Errno;
-use crate::util::bit_size_of;
 use crate::util::container::vec::Vec;
 use crate::util::math::ceil_division;
 
+/// The number of bits in a word of the bitfield.
+const WORD_BITS: usize = size_of::<usize>() * 8;
+
+/// Returns a word in which the `n` lowest bits are set.
+#[inline]
+fn low_mask(n: usize) -> usize {
+	if n >= WORD_BITS {
+		!0
+	} else {
+		(1 << n) - 1
+	}
+}
+
+/// Returns the index of the lowest clear bit in the given word `word`, or None if every bits are
+/// set.
+#[inline]
+fn first_clear(word: usize) -> Option<usize> {
+	if word != !0 {
+		// Compiled to `bsf` (or `tzcnt`)
+		Some((!word).trailing_zeros() as _)
+	} else {
+		None
+	}
+}
+
+/// Creates a vector of `len` words in which every bits after the `bits` first ones are set.
+fn new_words(len: usize, bits: usize) -> Result<Vec<usize>, Errno> {
+	let mut v = Vec::with_capacity(len)?;
+	for _ in 0..len {
+		v.push(0)?;
+	}
+
+	if bits % WORD_BITS != 0 {
+		v[len - 1] = !low_mask(bits % WORD_BITS);
+	}
+	Ok(v)
+}
+
 /// A bitfield is a data structure meant to contain only boolean values.
 /// The size of the bitfield is specified at initialization.
 pub struct Bitfield {
-	/// The bitfield's data.
-	data: Vec<u8>,
+	/// The bitfield's data. The padding bits after the end of the bitfield are always set.
+	data: Vec<usize>,
+	/// The summary of the data: a bit is set if every bits of the corresponding word in `data`
+	/// are set. The padding bits after the last word are always set.
+	full: Vec<usize>,
+
 	/// The number of bits in the bitfield.
 	len: usize,
 	/// The number of set bits.
@@ -19,17 +67,16 @@ pub struct Bitfield {
 impl Bitfield {
 	/// Creates a new bitfield with the given number of bits `len`.
 	pub fn new(len: usize) -> Result<Self, Errno> {
-		let size = ceil_division(len, bit_size_of::<u8>());
+		let words = ceil_division(len, WORD_BITS);
+		let summary_words = ceil_division(words, WORD_BITS);
+
+		Ok(Self {
+			data: new_words(words, len)?,
+			full: new_words(summary_words, words)?,
 
-		let mut bitfield = Self {
-			data: Vec::with_capacity(size)?,
 			len,
 			set_count: 0,
-		};
-		for _ in 0..size {
-			bitfield.data.push(0)?;
-		}
-		Ok(bitfield)
+		})
 	}
 
 	/// Returns the number of bit in the bitfield.
@@ -39,7 +86,7 @@ impl Bitfield {
 
 	/// Returns the size of the memory region of the bitfield in bytes.
 	pub fn mem_size(&self) -> usize {
-		ceil_division(self.len, bit_size_of::<u8>())
+		(self.data.len() + self.full.len()) * size_of::<usize>()
 	}
 
 	/// Returns the number of set bits.
@@ -47,47 +94,124 @@ impl Bitfield {
 		self.set_count
 	}
 
+	/// Updates the summary bit of the word at index `word`.
+	#[inline]
+	fn update_summary(&mut self, word: usize) {
+		let bit = 1 << (word % WORD_BITS);
+		if self.data[word] == !0 {
+			self.full[word / WORD_BITS] |= bit;
+		} else {
+			self.full[word / WORD_BITS] &= !bit;
+		}
+	}
+
 	/// Tells whether bit `index` is set.
 	pub fn is_set(&self, index: usize) -> bool {
-		let unit = self.data[(index / bit_size_of::<u8>()) as _];
-		(unit >> (index % bit_size_of::<u8>())) & 1 == 1
+		debug_assert!(index < self.len);
+		(self.data[index / WORD_BITS] >> (index % WORD_BITS)) & 1 == 1
 	}
 
 	/// Sets bit `index`.
 	pub fn set(&mut self, index: usize) {
 		debug_assert!(index < self.len);
 
-		let unit = &mut self.data[(index / bit_size_of::<u8>()) as _];
-		*unit |= 1 << (index % bit_size_of::<u8>());
+		let word = index / WORD_BITS;
+		let bit = 1 << (index % WORD_BITS);
+		if self.data[word] & bit == 0 {
+			self.data[word] |= bit;
+			self.set_count += 1;
 
-		self.set_count += 1;
+			if self.data[word] == !0 {
+				self.update_summary(word);
+			}
+		}
 	}
 
 	/// Clears bit `index`.
 	pub fn clear(&mut self, index: usize) {
 		debug_assert!(index < self.len);
 
-		let unit = &mut self.data[(index / bit_size_of::<u8>()) as _];
-		*unit &= !(1 << (index % bit_size_of::<u8>()));
+		let word = index / WORD_BITS;
+		let bit = 1 << (index % WORD_BITS);
+		if self.data[word] & bit != 0 {
+			self.data[word] &= !bit;
+			self.set_count -= 1;
 
-		self.set_count -= 1;
+			self.update_summary(word);
+		}
 	}
 
-	/// Finds a clear bit. The function returns the offset to the bit. If none is found, the
-	/// function returns None.
-	pub fn find_clear(&mut self) -> Option<usize> {
-		for i in 0..self.len {
-			if !self.is_set(i) {
-				return Some(i);
+	/// Finds the lowest clear bit whose index is greater or equal to `start`. The function
+	/// returns the offset to the bit. If none is found, the function returns None.
+	pub fn find_clear_from(&self, start: usize) -> Option<usize> {
+		if start >= self.len {
+			return None;
+		}
+
+		// Checking the remaining bits of the word containing `start`
+		let word = start / WORD_BITS;
+		if let Some(i) = first_clear(self.data[word] | low_mask(start % WORD_BITS)) {
+			return Some(word * WORD_BITS + i);
+		}
+
+		// Searching for the next word that is not full using the summary
+		let next = word + 1;
+		let mut summary_word = next / WORD_BITS;
+		let mut mask = low_mask(next % WORD_BITS);
+		while summary_word < self.full.len() {
+			if let Some(i) = first_clear(self.full[summary_word] | mask) {
+				let word = summary_word * WORD_BITS + i;
+				// Padding bits are set, so the bit is always in the bitfield
+				return Some(word * WORD_BITS + first_clear(self.data[word]).unwrap());
 			}
+
+			summary_word += 1;
+			mask = 0;
 		}
 
 		None
 	}
 
-	// TODO set_all
-	// TODO clear_all
-	// TODO fill
+	/// Finds the lowest clear bit. The function returns the offset to the bit. If none is found,
+	/// the function returns None.
+	pub fn find_clear(&self) -> Option<usize> {
+		self.find_clear_from(0)
+	}
+
+	/// Sets every bits in the given range `range` to `value`, a word at a time.
+	pub fn fill(&mut self, range: Range<usize>, value: bool) {
+		debug_assert!(range.end <= self.len);
+
+		let mut i = range.start;
+		while i < range.end {
+			let word = i / WORD_BITS;
+			let off = i % WORD_BITS;
+			let n = min(WORD_BITS - off, range.end - i);
+			let mask = low_mask(n) << off;
+
+			let before = self.data[word].count_ones() as usize;
+			if value {
+				self.data[word] |= mask;
+			} else {
+				self.data[word] &= !mask;
+			}
+			let after = self.data[word].count_ones() as usize;
+			self.set_count = self.set_count + after - before;
+
+			self.update_summary(word);
+			i += n;
+		}
+	}
+
+	/// Sets every bits.
+	pub fn set_all(&mut self) {
+		self.fill(0..self.len, true);
+	}
+
+	/// Clears every bits.
+	pub fn clear_all(&mut self) {
+		self.fill(0..self.len, false);
+	}
 }
 
 #[cfg(test)]
@@ -134,5 +258,48 @@ mod test {
 		}
 	}
 
-	// TODO Write more tests
+	#[test_case]
+	fn bitfield_find_clear0() {
+		let mut bitfield = Bitfield::new(5000).unwrap();
+		assert_eq!(bitfield.find_clear(), Some(0));
+
+		for i in 0..bitfield.len() {
+			assert_eq!(bitfield.find_clear(), Some(i));
+			bitfield.set(i);
+		}
+		assert_eq!(bitfield.find_clear(), None);
+		assert_eq!(bitfield.set_count(), 5000);
+
+		bitfield.clear(4321);
+		assert_eq!(bitfield.find_clear(), Some(4321));
+		assert_eq!(bitfield.find_clear_from(4322), None);
+		bitfield.clear(17);
+		assert_eq!(bitfield.find_clear(), Some(17));
+		assert_eq!(bitfield.find_clear_from(17), Some(17));
+		assert_eq!(bitfield.find_clear_from(18), Some(4321));
+	}
+
+	#[test_case]
+	fn bitfield_fill0() {
+		let mut bitfield = Bitfield::new(1000).unwrap();
+
+		bitfield.fill(3..997, true);
+		assert_eq!(bitfield.set_count(), 994);
+		for i in 0..bitfield.len() {
+			assert_eq!(bitfield.is_set(i), (3..997).contains(&i));
+		}
+		assert_eq!(bitfield.find_clear_from(3), Some(997));
+
+		bitfield.fill(100..200, false);
+		assert_eq!(bitfield.set_count(), 894);
+		assert_eq!(bitfield.find_clear_from(3), Some(100));
+
+		bitfield.set_all();
+		assert_eq!(bitfield.set_count(), 1000);
+		assert_eq!(bitfield.find_clear(), None);
+
+		bitfield.clear_all();
+		assert_eq!(bitfield.set_count(), 0);
+		assert_eq!(bitfield.find_clear_from(999), Some(999));
+	}
 }
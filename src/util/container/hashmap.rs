@@ -1,174 +1,278 @@
-//! A hashmap is a data structure that stores key/value pairs into buckets and uses the hash of the
-//! key to quickly get the bucket storing the value.
+//! A hashmap is a data structure that stores key/value pairs and uses the hash of the key to
+//! quickly find the place storing the value.
+//!
+//! This implementation uses open addressing with Robin Hood hashing: on insertion, an element
+//! takes the slot of any element that is closer to its ideal slot, which keeps probe sequences
+//! short. On removal, the following elements are shifted backward instead of leaving tombstones.
 
 use core::hash::Hash;
 use core::hash::Hasher;
-use core::mem::size_of_val;
+use core::mem;
 use core::ops::Index;
 use core::ops::IndexMut;
-use core::ptr;
 use crate::errno::Errno;
 use crate::errno;
 use super::vec::Vec;
 
-/// Bitwise XOR hasher.
-struct XORHasher {
-	/// The currently stored value.
-	value: u64,
-	/// The offset byte at which the next XOR operation shall be performed.
-	off: u8,
+/// The multiplier of the hash function, derived from the golden ratio.
+const HASH_SEED: u32 = 0x9e3779b9;
+
+/// The minimum number of slots of a non-empty table.
+const MIN_CAPACITY: usize = 8;
+/// The numerator of the maximum load factor of the table.
+const MAX_LOAD_NUM: usize = 7;
+/// The denominator of the maximum load factor of the table.
+const MAX_LOAD_DEN: usize = 8;
+
+/// A fast non-cryptographic hasher in the style of FxHash, which mixes whole words at once.
+/// The entropy is in the high bits of the hash, which are thus the ones used to select a slot.
+pub struct FxHasher {
+	/// The current hash.
+	hash: u32,
 }
 
-impl XORHasher {
+impl FxHasher {
 	/// Creates a new instance.
 	pub fn new() -> Self {
 		Self {
-			value: 0,
-			off: 0,
-		}
-	}
-}
-
-impl Hasher for XORHasher {
-	fn write(&mut self, bytes: &[u8]) {
-		for b in bytes {
-			self.value ^= (*b as u64) << (self.off * 8);
-			self.off = (self.off + 1) % size_of_val(&self.value) as u8;
+			hash: 0,
 		}
 	}
 
-	fn finish(&self) -> u64 {
-		self.value
+	/// Mixes the word `w` into the hash.
+	#[inline]
+	fn add(&mut self, w: u32) {
+		self.hash = (self.hash.rotate_left(5) ^ w).wrapping_mul(HASH_SEED);
 	}
 }
 
-/// A bucket is a list storing elements that match a given hash range.
-/// Since hashing function have collisions, several elements can have the same hash.
-struct Bucket<K: Eq + Hash, V> {
-	/// The vector storing the key/value pairs.
-	elements: Vec<(K, V)>,
-}
-
-impl<K: Eq + Hash, V> Bucket<K, V> {
-	/// Creates a new instance.
-	fn new() -> Self {
-		Self {
-			elements: Vec::new(),
+impl Hasher for FxHasher {
+	fn write(&mut self, bytes: &[u8]) {
+		let mut chunks = bytes.chunks_exact(4);
+		for c in &mut chunks {
+			self.add(u32::from_le_bytes([c[0], c[1], c[2], c[3]]));
 		}
-	}
 
-	/// Returns an immutable reference to the value with the given key `k`. If the key isn't
-	/// present, the function return None.
-	pub fn get(&self, k: K) -> Option<&V> {
-		for i in 0..self.elements.len() {
-			if self.elements[i].0 == k {
-				return Some(&self.elements[i].1);
+		let rem = chunks.remainder();
+		if !rem.is_empty() {
+			let mut w = 0;
+			for (i, b) in rem.iter().enumerate() {
+				w |= (*b as u32) << (i * 8);
 			}
+			self.add(w);
 		}
+	}
 
-		None
+	fn write_u8(&mut self, i: u8) {
+		self.add(i as _);
 	}
 
-	/// Returns a mutable reference to the value with the given key `k`. If the key isn't present,
-	/// the function return None.
-	pub fn get_mut(&mut self, k: K) -> Option<&mut V> {
-		for i in 0..self.elements.len() {
-			if self.elements[i].0 == k {
-				return Some(&mut self.elements[i].1);
-			}
-		}
+	fn write_u16(&mut self, i: u16) {
+		self.add(i as _);
+	}
 
-		None
+	fn write_u32(&mut self, i: u32) {
+		self.add(i);
 	}
 
-	/// Inserts a new element into the bucket. If the key was already present, the function
-	/// returns the previous value.
-	pub fn insert(&mut self, k: K, v: V) -> Result<Option<V>, Errno> {
-		let old = self.remove(&k);
-		self.elements.push((k, v))?;
-		Ok(old)
+	fn write_u64(&mut self, i: u64) {
+		self.add(i as _);
+		self.add((i >> 32) as _);
 	}
 
-	/// Removes an element from the bucket. If the key was present, the function returns the
-	/// value.
-	pub fn remove(&mut self, k: &K) -> Option<V> {
-		for i in 0..self.elements.len() {
-			if self.elements[i].0 == *k {
-				let val = unsafe {
-					ptr::read(&self.elements[i].1 as _)
-				};
-				self.elements.remove(i);
-
-				return Some(val);
-			}
-		}
+	fn write_usize(&mut self, i: usize) {
+		self.add(i as _);
+	}
 
-		None
+	fn finish(&self) -> u64 {
+		self.hash as _
 	}
 }
 
+/// Returns the hash of the key `k`.
+fn hash<K: Hash>(k: &K) -> u32 {
+	let mut hasher = FxHasher::new();
+	k.hash(&mut hasher);
+	hasher.finish() as _
+}
+
+/// A slot of the table storing an element.
+struct Slot<K, V> {
+	/// The hash of the key, kept to avoid hashing again when probing or growing.
+	hash: u32,
+	/// The key.
+	key: K,
+	/// The value.
+	value: V,
+}
+
 /// Structure representing a hashmap.
 pub struct HashMap<K: Eq + Hash, V> {
-	/// The vector containing buckets.
-	buckets: Vec<Bucket<K, V>>,
+	/// The table of slots. Its length is either zero or a power of two.
+	slots: Vec<Option<Slot<K, V>>>,
+	/// The number of elements in the hash map.
+	len: usize,
 }
 
 impl<K: Eq + Hash, V> HashMap::<K, V> {
-	/// Creates a new instance.
-	pub fn new(buckets_count: usize) -> Result<Self, Errno> {
-		if buckets_count == 0 {
-			return Err(errno::EINVAL);
+	/// Creates a new empty instance. No memory is allocated until the first insertion.
+	pub fn new() -> Self {
+		Self {
+			slots: Vec::new(),
+			len: 0,
 		}
+	}
 
-		let mut map = Self {
-			buckets: Vec::with_capacity(buckets_count)?,
-		};
-		for _ in 0..buckets_count {
-			map.buckets.push(Bucket::new())?;
-		}
+	/// Creates a new instance able to store at least `capacity` elements without reallocating.
+	pub fn with_capacity(capacity: usize) -> Result<Self, Errno> {
+		let mut map = Self::new();
+		map.try_reserve(capacity)?;
 		Ok(map)
 	}
 
 	/// Returns the number of elements in the hash map.
+	#[inline]
 	pub fn len(&self) -> usize {
-		let mut total = 0;
+		self.len
+	}
 
-		for b in self.buckets.iter() {
-			total += b.elements.len();
+	/// Tells whether the hash map is empty.
+	#[inline]
+	pub fn is_empty(&self) -> bool {
+		self.len == 0
+	}
+
+	/// Returns the number of elements the hash map can store without reallocating.
+	pub fn capacity(&self) -> usize {
+		self.slots.len() * MAX_LOAD_NUM / MAX_LOAD_DEN
+	}
+
+	/// Returns the mask to apply to an index to wrap it around the table.
+	#[inline]
+	fn mask(&self) -> usize {
+		self.slots.len() - 1
+	}
+
+	/// Returns the index of the ideal slot for the hash `hash`. The table must not be empty.
+	#[inline]
+	fn ideal_index(&self, hash: u32) -> usize {
+		let bits = self.slots.len().trailing_zeros();
+		(hash >> (32 - bits)) as usize
+	}
+
+	/// Returns the distance between the slot at index `i`, which stores an element with hash
+	/// `hash`, and the ideal slot of this element.
+	#[inline]
+	fn distance(&self, hash: u32, i: usize) -> usize {
+		i.wrapping_sub(self.ideal_index(hash)) & self.mask()
+	}
+
+	/// Returns the index of the slot storing the key `k` with hash `hash`. If the key isn't
+	/// present, the function returns None.
+	fn find(&self, hash: u32, k: &K) -> Option<usize> {
+		if self.slots.is_empty() {
+			return None;
 		}
 
-		total
+		let mut i = self.ideal_index(hash);
+		let mut dist = 0;
+		loop {
+			match &self.slots[i] {
+				Some(slot) => {
+					// Elements are ordered by distance, so the key cannot be further
+					if self.distance(slot.hash, i) < dist {
+						return None;
+					}
+					if slot.hash == hash && slot.key == *k {
+						return Some(i);
+					}
+				},
+
+				None => return None,
+			}
+
+			i = (i + 1) & self.mask();
+			dist += 1;
+		}
 	}
 
-	/// Tells whether the hash map is empty.
-	pub fn is_empty(&self) -> bool {
-		self.len() == 0
+	/// Places the slot `slot` into the table, whose key must not be present. The table must have
+	/// at least one free slot.
+	fn insert_slot(&mut self, mut slot: Slot<K, V>) {
+		let mut i = self.ideal_index(slot.hash);
+		let mut dist = 0;
+		loop {
+			let d = match &self.slots[i] {
+				Some(s) => self.distance(s.hash, i),
+				None => {
+					self.slots[i] = Some(slot);
+					self.len += 1;
+					return;
+				},
+			};
+
+			// Taking the place of an element that is closer to its ideal slot
+			if d < dist {
+				mem::swap(self.slots[i].as_mut().unwrap(), &mut slot);
+				dist = d;
+			}
+
+			i = (i + 1) & self.mask();
+			dist += 1;
+		}
 	}
 
-	/// Returns the number of buckets.
-	pub fn get_buckets_count(&self) -> usize {
-		self.buckets.len()
+	/// Moves the elements into a new table with `count` slots. `count` must be a power of two
+	/// large enough to store every elements.
+	/// If the allocation fails, the hash map is left untouched.
+	fn rehash(&mut self, count: usize) -> Result<(), Errno> {
+		let mut slots = Vec::with_capacity(count)?;
+		for _ in 0..count {
+			slots.push(None)?;
+		}
+
+		let mut old = mem::replace(&mut self.slots, slots);
+		self.len = 0;
+		for i in 0..old.len() {
+			if let Some(slot) = old[i].take() {
+				self.insert_slot(slot);
+			}
+		}
+
+		Ok(())
 	}
 
-	/// Returns the bucket index for the key `k`.
-	fn get_bucket_index(&self, k: &K) -> usize {
-		let mut hasher = XORHasher::new();
-		k.hash(&mut hasher);
-		(hasher.finish() / (self.buckets.len() as u64)) as usize
+	/// Reserves space for at least `additional` more elements, so that inserting them doesn't
+	/// require reallocating.
+	/// If the allocation fails, the hash map is left untouched and the function returns an error.
+	pub fn try_reserve(&mut self, additional: usize) -> Result<(), Errno> {
+		let needed = self.len.checked_add(additional).ok_or(errno::ENOMEM)?;
+		if needed <= self.capacity() {
+			return Ok(());
+		}
+
+		let min_count = needed.checked_mul(MAX_LOAD_DEN).ok_or(errno::ENOMEM)? / MAX_LOAD_NUM + 1;
+		let count = min_count.checked_next_power_of_two().ok_or(errno::ENOMEM)?;
+		self.rehash(core::cmp::max(count, MIN_CAPACITY))
 	}
 
 	/// Returns an immutable reference to the value with the given key `k`. If the key isn't
 	/// present, the function return None.
-	pub fn get(&self, k: K) -> Option<&V> {
-		let index = self.get_bucket_index(&k);
-		self.buckets[index].get(k)
+	pub fn get(&self, k: &K) -> Option<&V> {
+		let i = self.find(hash(k), k)?;
+		Some(&self.slots[i].as_ref().unwrap().value)
 	}
 
 	/// Returns a mutable reference to the value with the given key `k`. If the key isn't present,
 	/// the function return None.
-	pub fn get_mut(&mut self, k: K) -> Option<&mut V> {
-		let index = self.get_bucket_index(&k);
-		self.buckets[index].get_mut(k)
+	pub fn get_mut(&mut self, k: &K) -> Option<&mut V> {
+		let i = self.find(hash(k), k)?;
+		Some(&mut self.slots[i].as_mut().unwrap().value)
+	}
+
+	/// Tells whether the hash map contains the key `k`.
+	pub fn contains_key(&self, k: &K) -> bool {
+		self.find(hash(k), k).is_some()
 	}
 
 	/// Creates an iterator for the hash map.
@@ -179,50 +283,78 @@ impl<K: Eq + Hash, V> HashMap::<K, V> {
 	/// Inserts a new element into the hash map. If the key was already present, the function
 	/// returns the previous value.
 	pub fn insert(&mut self, k: K, v: V) -> Result<Option<V>, Errno> {
-		let index = self.get_bucket_index(&k);
-		self.buckets[index].insert(k, v)
+		let hash = hash(&k);
+		if let Some(i) = self.find(hash, &k) {
+			let slot = self.slots[i].as_mut().unwrap();
+			return Ok(Some(mem::replace(&mut slot.value, v)));
+		}
+
+		self.try_reserve(1)?;
+		self.insert_slot(Slot {
+			hash,
+			key: k,
+			value: v,
+		});
+		Ok(None)
 	}
 
 	/// Removes an element from the hash map. If the key was present, the function returns the
 	/// value.
-	pub fn remove(&mut self, k: K) -> Option<V> {
-		let index = self.get_bucket_index(&k);
-		self.buckets[index].remove(&k)
+	pub fn remove(&mut self, k: &K) -> Option<V> {
+		let mut i = self.find(hash(k), k)?;
+		let slot = self.slots[i].take().unwrap();
+		self.len -= 1;
+
+		// Shifting the following elements backward until one is in its ideal slot
+		loop {
+			let next = (i + 1) & self.mask();
+			let shift = match &self.slots[next] {
+				Some(s) => self.distance(s.hash, next) > 0,
+				None => false,
+			};
+			if !shift {
+				break;
+			}
+
+			self.slots[i] = self.slots[next].take();
+			i = next;
+		}
+
+		Some(slot.value)
 	}
 
-	/// Drops all elements in the hash map.
+	/// Drops all elements in the hash map. The memory is kept for later insertions.
 	pub fn clear(&mut self) {
-		for i in 0..self.buckets.len() {
-			self.buckets[i].elements.clear();
+		for i in 0..self.slots.len() {
+			self.slots[i] = None;
 		}
+		self.len = 0;
 	}
 }
 
-impl<K: Eq + Hash, V> Index<K> for HashMap<K, V> {
+impl<K: Eq + Hash, V> Index<&K> for HashMap<K, V> {
 	type Output = V;
 
 	#[inline]
-	fn index(&self, k: K) -> &Self::Output {
+	fn index(&self, k: &K) -> &Self::Output {
 		self.get(k).expect("no entry found for key")
 	}
 }
 
-impl<K: Eq + Hash, V> IndexMut<K> for HashMap<K, V> {
+impl<K: Eq + Hash, V> IndexMut<&K> for HashMap<K, V> {
 	#[inline]
-	fn index_mut(&mut self, k: K) -> &mut Self::Output {
+	fn index_mut(&mut self, k: &K) -> &mut Self::Output {
 		self.get_mut(k).expect("no entry found for key")
 	}
 }
 
-/// An iterator for the Vec structure.
+/// An iterator for the HashMap structure.
 pub struct HashMapIterator<'a, K: Hash + Eq, V> {
 	/// The hash map to iterate into.
 	hm: &'a HashMap<K, V>,
 
-	/// The current bucket index.
-	curr_bucket: usize,
-	/// The current element index.
-	curr_element: usize,
+	/// The index of the next slot to check.
+	curr: usize,
 }
 
 impl<'a, K: Hash + Eq, V> HashMapIterator<'a, K, V> {
@@ -231,38 +363,25 @@ impl<'a, K: Hash + Eq, V> HashMapIterator<'a, K, V> {
 		Self {
 			hm,
 
-			curr_bucket: 0,
-			curr_element: 0,
+			curr: 0,
 		}
 	}
 }
 
 impl<'a, K: Hash + Eq, V> Iterator for HashMapIterator<'a, K, V> {
-	type Item = &'a V;
+	type Item = (&'a K, &'a V);
 
 	fn next(&mut self) -> Option<Self::Item> {
-		if self.curr_bucket >= self.hm.buckets.len() {
-			return None;
-		}
-
-		let v = &self.hm.buckets[self.curr_bucket].elements[self.curr_element].1;
+		while self.curr < self.hm.slots.len() {
+			let slot = &self.hm.slots[self.curr];
+			self.curr += 1;
 
-		if self.curr_element >= self.hm.buckets[self.curr_bucket].elements.len() {
-			self.curr_element = 0;
-
-			for i in (self.curr_bucket + 1)..self.hm.buckets.len() {
-				if !self.hm.buckets[i].elements.is_empty() {
-					self.curr_bucket = i;
-					break;
-				}
-			}
-
-			if self.curr_bucket >= self.hm.buckets.len() {
-				return None
+			if let Some(s) = slot {
+				return Some((&s.key, &s.value));
 			}
 		}
 
-		Some(v)
+		None
 	}
 
 	fn count(self) -> usize {
@@ -273,36 +392,39 @@ impl<'a, K: Hash + Eq, V> Iterator for HashMapIterator<'a, K, V> {
 #[cfg(test)]
 mod test {
 	use super::*;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
+	use crate::selftest;
 
 	#[test_case]
 	fn hash_map0() {
-		if let Err(e) = HashMap::<u32, u32>::new(0) {
-			assert_eq!(e, errno::EINVAL);
-		} else {
-			assert!(false);
-		}
+		let hash_map = HashMap::<u32, u32>::new();
+
+		assert_eq!(hash_map.len(), 0);
+		assert_eq!(hash_map.capacity(), 0);
+		assert!(hash_map.get(&0).is_none());
 	}
 
 	#[test_case]
 	fn hash_map1() {
-		let mut hash_map = HashMap::<u32, u32>::new(16).unwrap();
+		let mut hash_map = HashMap::<u32, u32>::new();
 
 		assert_eq!(hash_map.len(), 0);
 
 		hash_map.insert(0, 0).unwrap();
 
 		assert_eq!(hash_map.len(), 1);
-		assert_eq!(*hash_map.get(0).unwrap(), 0);
-		assert_eq!(hash_map[0], 0);
+		assert_eq!(*hash_map.get(&0).unwrap(), 0);
+		assert_eq!(hash_map[&0], 0);
 
-		assert_eq!(hash_map.remove(0).unwrap(), 0);
+		assert_eq!(hash_map.remove(&0).unwrap(), 0);
 
 		assert_eq!(hash_map.len(), 0);
 	}
 
 	#[test_case]
 	fn hash_map2() {
-		let mut hash_map = HashMap::<u32, u32>::new(16).unwrap();
+		let mut hash_map = HashMap::<u32, u32>::new();
 
 		for i in 0..100 {
 			assert_eq!(hash_map.len(), i);
@@ -310,14 +432,90 @@ mod test {
 			hash_map.insert(i as _, 0).unwrap();
 
 			assert_eq!(hash_map.len(), i + 1);
-			assert_eq!(*hash_map.get(i as _).unwrap(), 0);
-			assert_eq!(hash_map[i as _], 0);
+			assert_eq!(*hash_map.get(&(i as _)).unwrap(), 0);
+			assert_eq!(hash_map[&(i as _)], 0);
 		}
 
 		for i in (0..100).rev() {
 			assert_eq!(hash_map.len(), i + 1);
-			assert_eq!(hash_map.remove(i as _).unwrap(), 0);
+			assert_eq!(hash_map.remove(&(i as _)).unwrap(), 0);
 			assert_eq!(hash_map.len(), i);
 		}
 	}
+
+	#[test_case]
+	fn hash_map3() {
+		let mut hash_map = HashMap::<u32, u32>::new();
+
+		// Keys sharing their low bits, such as aligned addresses
+		for i in 0..1000 {
+			assert!(hash_map.insert(i * 4096, i).unwrap().is_none());
+		}
+		assert_eq!(hash_map.insert(0, 42).unwrap(), Some(0));
+
+		// Removing every other key, then checking the others can still be found
+		for i in (0..1000).step_by(2) {
+			assert!(hash_map.remove(&(i * 4096)).is_some());
+		}
+		assert_eq!(hash_map.len(), 500);
+		for i in 0..1000 {
+			assert_eq!(hash_map.contains_key(&(i * 4096)), i % 2 == 1);
+		}
+		assert_eq!(hash_map.iter().filter(| (k, v) | **k == **v * 4096).count(), 500);
+	}
+
+	#[test_case]
+	fn hash_map_reserve() {
+		let mut hash_map = HashMap::<u32, u32>::with_capacity(100).unwrap();
+		let capacity = hash_map.capacity();
+		assert!(capacity >= 100);
+
+		for i in 0..100 {
+			hash_map.insert(i, i).unwrap();
+		}
+		assert_eq!(hash_map.capacity(), capacity);
+
+		hash_map.clear();
+		assert!(hash_map.is_empty());
+		assert_eq!(hash_map.capacity(), capacity);
+	}
+
+	#[test_case]
+	fn fx_hasher0() {
+		let h0 = {
+			let mut hasher = FxHasher::new();
+			hasher.write(b"ab");
+			hasher.finish()
+		};
+		let h1 = {
+			let mut hasher = FxHasher::new();
+			hasher.write(b"ba");
+			hasher.finish()
+		};
+
+		assert_ne!(h0, h1);
+	}
+
+	/// The number of elements in the map used for benchmarks.
+	const BENCH_SIZE: u32 = 1024;
+
+	fn hash_map_bench(b: &mut Bencher) {
+		let mut hash_map = HashMap::<u32, u32>::new();
+		for i in 0..BENCH_SIZE {
+			hash_map.insert(i, i).unwrap();
+		}
+
+		let mut i = 0;
+		b.iter_param(format_args!("get"), || {
+			selftest::black_box(hash_map.get(&(i % BENCH_SIZE)));
+			i += 1;
+		});
+		b.iter_param(format_args!("insert_remove"), || {
+			hash_map.insert(BENCH_SIZE, 0).unwrap();
+			selftest::black_box(hash_map.remove(&BENCH_SIZE));
+		});
+	}
+
+	#[test_case]
+	static HASH_MAP_BENCH: Bench = Bench::new("hash_map", hash_map_bench);
 }
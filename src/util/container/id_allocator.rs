@@ -9,42 +9,98 @@ use crate::util::container::bitfield::Bitfield;
 pub struct IDAllocator {
 	/// The bitfield keeping track of used identifiers.
 	used: Bitfield,
+
+	/// If true, identifiers are allocated in a rotating fashion instead of taking the lowest
+	/// available one, so that a freed identifier isn't reused right away.
+	cyclic: bool,
+	/// The identifier from which the next search starts, when allocating cyclically.
+	next: usize,
 }
 
 impl IDAllocator {
-	/// Creates a new instance.
+	/// Creates a new instance. Identifiers are allocated from the lowest available.
 	/// `max` is the maximum id.
 	pub fn new(max: u32) -> Result<Self, Errno> {
 		Ok(Self {
 			used: Bitfield::new((max + 1) as _)?,
+
+			cyclic: false,
+			next: 0,
 		})
 	}
 
+	/// Same as `new`, except identifiers are allocated cyclically: the search for an available
+	/// identifier starts after the last allocated one, wrapping around at the end of the range.
+	pub fn new_cyclic(max: u32) -> Result<Self, Errno> {
+		let mut s = Self::new(max)?;
+		s.cyclic = true;
+		Ok(s)
+	}
+
 	/// Allocates an identifier.
 	/// If `id` is not None, the function shall allocate the given id.
 	/// If the allocation fails, the function returns an Err.
 	pub fn alloc(&mut self, id: Option<u32>) -> Result<u32, Errno> {
 		if let Some(i) = id {
-			if !self.used.is_set(i as _) {
+			if (i as usize) < self.used.len() && !self.used.is_set(i as _) {
 				self.used.set(i as _);
 				Ok(i)
 			} else {
 				Err(errno::ENOMEM)
 			}
-		} else if let Some(i) = self.used.find_clear() {
+		} else {
+			let i = if self.cyclic {
+				self.used.find_clear_from(self.next).or_else(|| self.used.find_clear())
+			} else {
+				self.used.find_clear()
+			}.ok_or(errno::ENOMEM)?;
+
 			self.used.set(i);
+			self.next = (i + 1) % self.used.len();
 			Ok(i as _)
-		} else {
-			Err(errno::ENOMEM)
 		}
 	}
 
 	/// Frees the given identifier `id`.
 	pub fn free(&mut self, id: u32) {
-		if id > self.used.len() as _ || !self.used.is_set(id as _) {
+		if id as usize >= self.used.len() || !self.used.is_set(id as _) {
 			crate::kernel_panic!("Freeing identifier that isn't allocated!", 0);
 		}
 
 		self.used.clear(id as _);
 	}
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn id_allocator0() {
+		let mut allocator = IDAllocator::new(9).unwrap();
+		for i in 0..10 {
+			assert_eq!(allocator.alloc(None).unwrap(), i);
+		}
+		assert!(allocator.alloc(None).is_err());
+
+		allocator.free(3);
+		assert_eq!(allocator.alloc(None).unwrap(), 3);
+		assert!(allocator.alloc(Some(3)).is_err());
+	}
+
+	#[test_case]
+	fn id_allocator_cyclic0() {
+		let mut allocator = IDAllocator::new_cyclic(9).unwrap();
+		for i in 0..5 {
+			assert_eq!(allocator.alloc(None).unwrap(), i);
+		}
+
+		// A freed identifier is reused only after wrapping around
+		allocator.free(1);
+		for i in 5..10 {
+			assert_eq!(allocator.alloc(None).unwrap(), i);
+		}
+		assert_eq!(allocator.alloc(None).unwrap(), 1);
+		assert!(allocator.alloc(None).is_err());
+	}
+}
@@ -1,5 +1,9 @@
 //! This module implements the String structure which wraps the `str` type.
+//!
+//! Strings that fit in `INLINE_CAPACITY` bytes are stored inside of the structure itself, which
+//! avoids a heap allocation for short strings such as path components or device names.
 
+use core::cmp::max;
 use core::fmt::Debug;
 use core::fmt;
 use core::hash::Hash;
@@ -8,153 +12,261 @@ use core::str;
 use crate::errno::Errno;
 use crate::util::FailableClone;
 use crate::util::container::vec::Vec;
-use crate::util::math;
 
-/// Returns the number of characters required to represent the given number `n` as a String.
-fn get_number_len(mut n: i64, base: u8) -> usize {
-	if n == 0 {
-		1
+/// The maximum length in bytes of a string stored inline.
+const INLINE_CAPACITY: usize = 23;
+
+/// The maximum length of the string representation of a 64 bits integer.
+pub const NUMBER_MAX_LEN: usize = 20;
+
+/// The decimal representations of every numbers from `00` to `99`, used to convert integers two
+/// digits at a time.
+const DIGITS_LUT: &[u8; 200] = b"\
+	0001020304050607080910111213141516171819\
+	2021222324252627282930313233343536373839\
+	4041424344454647484950515253545556575859\
+	6061626364656667686970717273747576777879\
+	8081828384858687888990919293949596979899";
+
+/// Writes the decimal representation of `n` at the end of the buffer `buf`, two digits at a time.
+/// The function returns the offset of the first written byte.
+fn write_digits(mut n: u32, buf: &mut [u8], mut off: usize) -> usize {
+	while n >= 100 {
+		let i = ((n % 100) * 2) as usize;
+		n /= 100;
+		off -= 2;
+		buf[off..(off + 2)].copy_from_slice(&DIGITS_LUT[i..(i + 2)]);
+	}
+
+	if n >= 10 {
+		let i = (n * 2) as usize;
+		off -= 2;
+		buf[off..(off + 2)].copy_from_slice(&DIGITS_LUT[i..(i + 2)]);
 	} else {
-		let mut len = 0;
+		off -= 1;
+		buf[off] = b'0' + n as u8;
+	}
 
-		if n < 0 {
-			len += 1;
-		}
+	off
+}
 
-		while n != 0 {
-			len += 1;
-			n /= base as i64;
+// TODO Support other bases than only 10?
+/// Writes the decimal representation of the given number `n` into the buffer `buf` without
+/// allocating memory, then returns it as a string slice.
+pub fn number_to_str(n: i64, buf: &mut [u8; NUMBER_MAX_LEN]) -> &str {
+	// Taking the absolute value as unsigned to handle the minimum value
+	let mut abs = if n < 0 {
+		(!(n as u64)).wrapping_add(1)
+	} else {
+		n as u64
+	};
+
+	let mut off = NUMBER_MAX_LEN;
+	// 64 bits divisions are slow on 32 bits, so they are used only for the upper digits
+	while abs > u32::MAX as u64 {
+		let low = (abs % 100_000_000) as u32;
+		abs /= 100_000_000;
+
+		let end = off;
+		off = write_digits(low, buf, off);
+		// Padding with zeros since these are not the leading digits
+		while off > end - 8 {
+			off -= 1;
+			buf[off] = b'0';
 		}
+	}
+	off = write_digits(abs as u32, buf, off);
 
-		len
+	if n < 0 {
+		off -= 1;
+		buf[off] = b'-';
+	}
+
+	unsafe { // Safe because the buffer contains only ASCII characters
+		str::from_utf8_unchecked(&buf[off..])
 	}
 }
 
+/// The storage of a string's data.
+enum Data {
+	/// The string is stored inside of the structure.
+	Inline {
+		/// The length of the string in bytes.
+		len: u8,
+		/// The buffer storing the string.
+		buf: [u8; INLINE_CAPACITY],
+	},
+
+	/// The string is stored on the heap.
+	Heap(Vec<u8>),
+}
+
 /// The String structure, which wraps the `str` primitive type.
 pub struct String {
-	/// A Vec containing the string's data.
-	data: Vec::<u8>,
+	/// The string's data.
+	data: Data,
 }
 
 impl String {
 	/// Creates a new instance of empty string.
 	pub fn new() -> Self {
 		Self {
-			data: Vec::new(),
+			data: Data::Inline {
+				len: 0,
+				buf: [0; INLINE_CAPACITY],
+			},
 		}
 	}
 
-	/// Creates a new instance. If the string cannot be allocated, the function return Err.
-	pub fn from(s: &str) -> Result<Self, Errno> {
-		let bytes = s.as_bytes();
-		let mut v = Vec::with_capacity(bytes.len())?;
-		for b in bytes {
-			v.push(*b)?;
-		}
+	/// Creates a new instance from the given bytes. The bytes must be valid UTF-8.
+	fn from_bytes(bytes: &[u8]) -> Result<Self, Errno> {
+		let data = if bytes.len() <= INLINE_CAPACITY {
+			let mut buf = [0; INLINE_CAPACITY];
+			buf[..bytes.len()].copy_from_slice(bytes);
+
+			Data::Inline {
+				len: bytes.len() as _,
+				buf,
+			}
+		} else {
+			let mut v = Vec::with_capacity(bytes.len())?;
+			v.extend_from_slice(bytes)?;
+
+			Data::Heap(v)
+		};
 
 		Ok(Self {
-			data: v,
+			data,
 		})
 	}
 
-	// TODO Support other bases than only 10?
-	// TODO Use a generic type?
-	// TODO Optimize
+	/// Creates a new instance. If the string cannot be allocated, the function return Err.
+	pub fn from(s: &str) -> Result<Self, Errno> {
+		Self::from_bytes(s.as_bytes())
+	}
+
 	/// Creates a new instance filled with the string representation of a given number `n`.
+	/// Since the representation always fits inline, this function never allocates memory.
 	pub fn from_number(n: i64) -> Result<Self, Errno> {
-		let len = get_number_len(n, 10);
-		debug_assert!(len > 0);
-		let mut v = Vec::with_capacity(len)?;
-
-		let mut l = len;
-		if n < 0 {
-			v.push(b'-')?;
-			l -= 1;
-		}
-		for i in (0..l).rev() {
-			let b = {
-				if i == 0 {
-					(n % 10).abs() as u8
-				} else {
-					let shift = math::pow(10, i) as i64;
-					(n / shift % 10).abs() as u8
-				}
-			};
-
-			v.push(b'0' + b)?;
-		}
-		debug_assert_eq!(v.len(), len);
-
-		Ok(Self {
-			data: v,
-		})
+		let mut buf = [0; NUMBER_MAX_LEN];
+		Self::from(number_to_str(n, &mut buf))
 	}
 
 	/// Returns a reference to the wrapped string.
 	pub fn as_str(&self) -> &str {
 		unsafe {
-			str::from_utf8_unchecked(self.data.as_slice())
+			str::from_utf8_unchecked(self.as_bytes())
 		}
 	}
 
 	/// Returns a slice containing the bytes representation of the string.
 	pub fn as_bytes(&self) -> &[u8] {
-		self.as_str().as_bytes()
+		match &self.data {
+			Data::Inline {
+				len,
+				buf,
+			} => &buf[..(*len as usize)],
+
+			Data::Heap(v) => v.as_slice(),
+		}
 	}
 
 	/// Returns the length of the String in characters count.
 	pub fn len(&self) -> usize {
-		self.as_str().len()
+		self.as_bytes().len()
 	}
 
 	/// Tells whether the string is empty.
-	pub fn is_empty(&mut self) -> bool {
-		self.data.is_empty()
+	pub fn is_empty(&self) -> bool {
+		self.len() == 0
 	}
 
-	/// Appends the given char `ch` to the end of the string.
-	pub fn push(&mut self, ch: char) -> Result<(), Errno> {
-		match ch.len_utf8() {
-			1 => self.data.push(ch as u8)?,
-			_ => {
-				let val = ch as u32;
-				for i in 0..4 {
-					if let Err(e) = self.data.push(((val >> (8 * i)) & 0xff) as _) {
-						// TODO Clean
-						for _ in 0..i {
-							self.data.pop();
-						}
-
-						return Err(e);
-					}
+	/// Reserves space for at least `additional` more bytes. If the string doesn't fit inline
+	/// anymore, it is moved to the heap. Growth is geometric, so that appending bytes one after
+	/// the other takes amortized constant time.
+	fn reserve(&mut self, additional: usize) -> Result<(), Errno> {
+		match &mut self.data {
+			Data::Inline {
+				len,
+				buf,
+			} => {
+				let len = *len as usize;
+				if len + additional <= INLINE_CAPACITY {
+					return Ok(());
 				}
+
+				let capacity = max(len + additional, INLINE_CAPACITY * 2);
+				let mut v = Vec::with_capacity(capacity)?;
+				v.extend_from_slice(&buf[..len])?;
+				self.data = Data::Heap(v);
+
+				Ok(())
 			},
+
+			Data::Heap(v) => v.try_reserve(additional),
 		}
+	}
+
+	/// Appends the given bytes to the end of the string. The bytes must be valid UTF-8.
+	fn extend(&mut self, bytes: &[u8]) -> Result<(), Errno> {
+		self.reserve(bytes.len())?;
 
-		Ok(())
+		match &mut self.data {
+			Data::Inline {
+				len,
+				buf,
+			} => {
+				let l = *len as usize;
+				buf[l..(l + bytes.len())].copy_from_slice(bytes);
+				*len += bytes.len() as u8;
+
+				Ok(())
+			},
+
+			Data::Heap(v) => v.extend_from_slice(bytes),
+		}
+	}
+
+	/// Appends the given char `ch` to the end of the string.
+	pub fn push(&mut self, ch: char) -> Result<(), Errno> {
+		let mut buf = [0; 4];
+		self.extend(ch.encode_utf8(&mut buf).as_bytes())
 	}
 
-	// TODO Unit tests
 	/// Removes the last character from the string and returns it.
 	/// If the string is empty, the function returns None.
 	pub fn pop(&mut self) -> Option<char> {
-		if self.is_empty() {
-			return None;
+		let ch = self.as_str().chars().next_back()?;
+		let new_len = self.len() - ch.len_utf8();
+
+		match &mut self.data {
+			Data::Inline {
+				len,
+				..
+			} => *len = new_len as _,
+
+			Data::Heap(v) => v.truncate(new_len),
 		}
 
-		// TODO
-		todo!();
+		Some(ch)
 	}
 
 	/// Appends the string `other` to the current one.
 	pub fn push_str(&mut self, other: &String) -> Result<(), Errno> {
-		let mut v = other.data.failable_clone()?;
-		self.data.append(&mut v)
+		self.extend(other.as_bytes())
 	}
 
 	/// Turns the string into an empty string.
 	pub fn clear(&mut self) {
-		self.data.clear();
+		match &mut self.data {
+			Data::Inline {
+				len,
+				..
+			} => *len = 0,
+
+			// Keeping the allocation since the string is likely to be filled again
+			Data::Heap(v) => v.clear(),
+		}
 	}
 }
 
@@ -162,24 +274,13 @@ impl Eq for String {}
 
 impl PartialEq for String {
 	fn eq(&self, other: &String) -> bool {
-		self.data == other.data
+		self.as_bytes() == other.as_bytes()
 	}
 }
 
 impl PartialEq<str> for String {
 	fn eq(&self, other: &str) -> bool {
-		if self.len() != other.len() {
-			return false;
-		}
-
-		let bytes = other.as_bytes();
-		for i in 0..bytes.len() {
-			if self.data[i] != bytes[i] {
-				return false;
-			}
-		}
-
-		true
+		self.as_bytes() == other.as_bytes()
 	}
 }
 
@@ -197,9 +298,7 @@ impl Hash for String {
 
 impl FailableClone for String {
 	fn failable_clone(&self) -> Result<Self, Errno> {
-		Ok(Self {
-			data: self.data.failable_clone()?,
-		})
+		Self::from_bytes(self.as_bytes())
 	}
 }
 
@@ -331,7 +430,15 @@ mod test {
 		assert_eq!(String::from_number(-1009).unwrap(), "-1009");
 	}
 
-	// TODO Test min and max values
+	#[test_case]
+	fn string_from_number8() {
+		assert_eq!(String::from_number(4294967295).unwrap(), "4294967295");
+		assert_eq!(String::from_number(4294967296).unwrap(), "4294967296");
+		assert_eq!(String::from_number(100000000000).unwrap(), "100000000000");
+		assert_eq!(String::from_number(-100000000001).unwrap(), "-100000000001");
+		assert_eq!(String::from_number(i64::MAX).unwrap(), "9223372036854775807");
+		assert_eq!(String::from_number(i64::MIN).unwrap(), "-9223372036854775808");
+	}
 
 	#[test_case]
 	fn string_push0() {
@@ -354,4 +461,55 @@ mod test {
 		}
 		assert_eq!(s, "aaaaaaaaaa");
 	}
+
+	#[test_case]
+	fn string_push2() {
+		let mut s = String::new();
+		s.push('é').unwrap();
+		s.push('€').unwrap();
+		assert_eq!(s.len(), 5);
+		assert_eq!(s, "é€");
+	}
+
+	#[test_case]
+	fn string_pop0() {
+		let mut s = String::from("aé€").unwrap();
+		assert_eq!(s.pop(), Some('€'));
+		assert_eq!(s.pop(), Some('é'));
+		assert_eq!(s.pop(), Some('a'));
+		assert_eq!(s.pop(), None);
+		assert!(s.is_empty());
+	}
+
+	#[test_case]
+	fn string_inline0() {
+		let mut s = String::new();
+		for i in 0..INLINE_CAPACITY {
+			assert!(matches!(s.data, Data::Inline { .. }));
+			s.push((b'a' + (i % 26) as u8) as char).unwrap();
+		}
+		assert!(matches!(s.data, Data::Inline { .. }));
+
+		s.push('x').unwrap();
+		assert!(matches!(s.data, Data::Heap(_)));
+		assert_eq!(s, "abcdefghijklmnopqrstuvwx");
+
+		assert_eq!(s.pop(), Some('x'));
+		let clone = s.failable_clone().unwrap();
+		assert!(matches!(clone.data, Data::Inline { .. }));
+		assert_eq!(clone, s);
+	}
+
+	#[test_case]
+	fn string_push_str0() {
+		let mut s = String::from("/usr").unwrap();
+		let other = String::from("/share/a_rather_long_component").unwrap();
+		s.push_str(&other).unwrap();
+		s.push_str(&other).unwrap();
+		assert_eq!(s, "/usr/share/a_rather_long_component/share/a_rather_long_component");
+
+		s.clear();
+		assert!(s.is_empty());
+		assert_eq!(s, "");
+	}
 }
@@ -13,9 +13,13 @@ use core::ptr::drop_in_place;
 use core::ptr;
 use core::slice;
 use crate::errno::Errno;
+use crate::errno;
 use crate::memory::malloc;
 use crate::util::FailableClone;
 
+/// The minimum capacity of a vector holding allocated memory.
+const MIN_CAPACITY: usize = 4;
+
 /// A vector container is a dynamically-resizable array of elements.
 /// When resizing a vector, the elements can be moved, thus the callee should not rely on pointers
 /// to elements inside a vector.
@@ -40,48 +44,67 @@ impl<T> Vec<T> {
 		}
 	}
 
-	/// Reallocates the vector's data with the vector's capacity.
-	fn realloc(&mut self) -> Result<(), Errno> {
-		debug_assert!(self.capacity >= self.len);
-		if let Some(data) = &mut self.data {
+	/// Reallocates the vector's data to the given capacity, which must be at least the length of
+	/// the vector. If the allocation fails, the vector is left untouched.
+	fn realloc(&mut self, capacity: usize) -> Result<(), Errno> {
+		debug_assert!(capacity >= self.len);
+		if capacity == 0 {
+			self.data = None;
+		} else if let Some(data) = &mut self.data {
 			// Safe because the memory is rewritten when the object is placed into the vector
 			unsafe {
-				data.realloc_zero(self.capacity)?;
+				data.realloc_zero(capacity)?;
 			}
 		} else {
 			// Safe because the memory is rewritten when the object is placed into the vector
 			let data_ptr = unsafe {
-				malloc::Alloc::new_zero(self.capacity)?
+				malloc::Alloc::new_zero(capacity)?
 			};
 			self.data = Some(data_ptr);
-		};
-		debug_assert!(self.data.is_some());
+		}
+
+		self.capacity = capacity;
 		Ok(())
 	}
 
-	/// Increases the capacity of at least `min` elements.
-	fn increase_capacity(&mut self, min: usize) -> Result<(), Errno> {
-		if self.len + min < self.capacity {
+	/// Reserves capacity for at least `additional` more elements. To amortize the cost of
+	/// reallocations, the capacity is at least doubled when it has to grow.
+	/// If the allocation fails, the vector is left untouched.
+	pub fn try_reserve(&mut self, additional: usize) -> Result<(), Errno> {
+		let needed = self.len.checked_add(additional).ok_or(errno::ENOMEM)?;
+		if needed <= self.capacity {
+			return Ok(());
+		}
+
+		let capacity = max(max(self.capacity.saturating_mul(2), needed), MIN_CAPACITY);
+		self.realloc(capacity)
+	}
+
+	/// Reserves capacity for exactly `additional` more elements. This should be used when the
+	/// final size of the vector is known, since no additional space is allocated.
+	/// If the allocation fails, the vector is left untouched.
+	pub fn try_reserve_exact(&mut self, additional: usize) -> Result<(), Errno> {
+		let needed = self.len.checked_add(additional).ok_or(errno::ENOMEM)?;
+		if needed <= self.capacity {
 			return Ok(());
 		}
 
-		if self.capacity == 0 {
-			self.capacity = 1;
+		self.realloc(needed)
+	}
+
+	/// Reduces the capacity of the vector to its length, releasing the unused memory.
+	/// If the reallocation fails, the vector is left untouched.
+	pub fn shrink_to_fit(&mut self) {
+		if self.capacity > self.len {
+			self.realloc(self.len).ok();
 		}
-		self.capacity = max(self.capacity + self.capacity / 4, self.len + min);
-		self.realloc()
 	}
 
 	/// Creates a new emoty vector with the given capacity.
 	pub fn with_capacity(capacity: usize) -> Result<Self, Errno> {
-		if capacity > 0 {
-			let mut vec = Self::new();
-			vec.capacity = capacity;
-			vec.realloc()?;
-			Ok(vec)
-		} else {
-			Ok(Self::new())
-		}
+		let mut vec = Self::new();
+		vec.realloc(capacity)?;
+		Ok(vec)
 	}
 
 	/// Returns the number of elements inside of the vector.
@@ -131,38 +154,35 @@ impl<T> Vec<T> {
 		panic!("index out of bounds: the len is {} but the index is {}", self.len, index);
 	}
 
-	/// Returns the first element of the vector.
-	pub fn first(&self) -> T {
-		if self.is_empty() {
-			self.vector_panic(0);
-		}
-
-		unsafe {
-			ptr::read(&self.data.as_ref().unwrap()[0] as _)
-		}
+	/// Returns a reference to the first element of the vector. If the vector is empty, the
+	/// function returns None.
+	pub fn first(&self) -> Option<&T> {
+		self.as_slice().first()
 	}
 
-	/// Returns the first element of the vector.
-	pub fn last(&self) -> T {
-		if self.is_empty() {
-			self.vector_panic(0);
-		}
+	/// Returns a reference to the last element of the vector. If the vector is empty, the
+	/// function returns None.
+	pub fn last(&self) -> Option<&T> {
+		self.as_slice().last()
+	}
 
-		unsafe {
-			ptr::read(&self.data.as_ref().unwrap()[self.len - 1] as _)
-		}
+	/// Returns a pointer to the element at index `index`. The vector must have allocated memory.
+	unsafe fn ptr_at(&mut self, index: usize) -> *mut T {
+		self.data.as_mut().unwrap().as_ptr_mut().add(index)
 	}
 
 	/// Inserts an element at position index within the vector, shifting all elements after it to
 	/// the right.
 	pub fn insert(&mut self, index: usize, element: T) -> Result<(), Errno> {
-		self.increase_capacity(1)?;
-		debug_assert!(self.capacity > self.len);
+		if index > self.len {
+			self.vector_panic(index);
+		}
+		self.try_reserve(1)?;
 
 		unsafe {
-			let ptr = self.data.as_mut().unwrap().as_ptr_mut();
-			ptr::copy(ptr.offset(index as _), ptr.offset((index + 1) as _), self.len - index);
-			ptr::write_volatile(&mut self.data.as_mut().unwrap()[index] as _, element);
+			let ptr = self.ptr_at(index);
+			ptr::copy(ptr, ptr.add(1), self.len - index);
+			ptr::write(ptr, element);
 		}
 		self.len += 1;
 		Ok(())
@@ -171,19 +191,16 @@ impl<T> Vec<T> {
 	/// Removes and returns the element at position index within the vector, shifting all elements
 	/// after it to the left.
 	pub fn remove(&mut self, index: usize) -> T {
-		if self.is_empty() {
-			self.vector_panic(0);
+		if index >= self.len {
+			self.vector_panic(index);
 		}
 
-		let data = self.data.as_mut().unwrap();
 		let v = unsafe {
-			ptr::read(&data[index])
+			let ptr = self.ptr_at(index);
+			let v = ptr::read(ptr);
+			ptr::copy(ptr.add(1), ptr, self.len - index - 1);
+			v
 		};
-		unsafe {
-			let ptr = data.as_ptr_mut();
-			ptr::copy(ptr.offset((index + 1) as _), ptr.offset(index as _), self.len - index - 1);
-		}
-
 		self.len -= 1;
 
 		v
@@ -191,29 +208,27 @@ impl<T> Vec<T> {
 
 	/// Moves all the elements of `other` into `Self`, leaving `other` empty.
 	pub fn append(&mut self, other: &mut Vec::<T>) -> Result<(), Errno> {
-		if other.len() > 0 {
-			self.increase_capacity(other.len)?;
-
-			unsafe {
-				let self_ptr = self.data.as_mut().unwrap().as_ptr_mut();
-				let other_ptr = other.data.as_mut().unwrap().as_ptr();
-				ptr::copy(other_ptr, self_ptr.offset(self.len as _), other.len);
-			}
+		if other.is_empty() {
+			return Ok(());
+		}
+		self.try_reserve(other.len)?;
 
-			self.len += other.len;
-			other.clear();
+		unsafe {
+			ptr::copy_nonoverlapping(other.ptr_at(0), self.ptr_at(self.len), other.len);
 		}
+		self.len += other.len;
+		// The elements have been moved, they must not be dropped
+		other.len = 0;
 
 		Ok(())
 	}
 
 	/// Appends an element to the back of a collection.
 	pub fn push(&mut self, value: T) -> Result<(), Errno> {
-		self.increase_capacity(1)?;
-		debug_assert!(self.capacity > self.len);
+		self.try_reserve(1)?;
 
 		unsafe {
-			ptr::write(&mut self.data.as_mut().unwrap()[self.len] as _, value);
+			ptr::write(self.ptr_at(self.len), value);
 		}
 		self.len += 1;
 		Ok(())
@@ -239,29 +254,38 @@ impl<T> Vec<T> {
 	/// Truncates the vector to the given new len `len`. If `len` is greater than the current
 	/// length, the function has no effect.
 	pub fn truncate(&mut self, len: usize) {
-		if len < self.len() {
-			for i in len..self.len {
-				unsafe {
-					drop_in_place(&mut self[i]);
-				}
-			}
-
+		if len < self.len {
+			let tail = unsafe {
+				slice::from_raw_parts_mut(self.ptr_at(len), self.len - len)
+			};
 			self.len = len;
+
+			unsafe {
+				drop_in_place(tail);
+			}
 		}
 	}
 
-	/// Clears the vector, removing all values.
+	/// Clears the vector, removing all values. The allocated memory is kept for later use.
 	pub fn clear(&mut self) {
-		for e in self.into_iter() {
-			drop(e);
-		}
+		self.truncate(0);
+	}
+}
 
-		self.len = 0;
-		self.capacity = 0;
+impl<T: Copy> Vec<T> {
+	/// Appends the elements of the slice `slice` to the back of the vector, in a single copy.
+	pub fn extend_from_slice(&mut self, slice: &[T]) -> Result<(), Errno> {
+		if slice.is_empty() {
+			return Ok(());
+		}
+		self.try_reserve(slice.len())?;
 
-		if self.data.is_some() {
-			self.data = None;
+		unsafe {
+			ptr::copy_nonoverlapping(slice.as_ptr(), self.ptr_at(self.len), slice.len());
 		}
+		self.len += slice.len();
+
+		Ok(())
 	}
 }
 
@@ -272,8 +296,10 @@ impl<T: Default> Vec::<T> {
 		if new_len < self.len() {
 			self.truncate(new_len);
 		} else {
-			self.increase_capacity(new_len - self.len)?;
-			self.len = new_len;
+			self.try_reserve_exact(new_len - self.len)?;
+			while self.len < new_len {
+				self.push(T::default())?;
+			}
 		}
 
 		Ok(())
@@ -311,17 +337,17 @@ impl<T> FailableClone for Vec<T> where T: FailableClone {
 			}
 		};
 
+		// The length grows with each cloned element so that, if cloning fails, only the
+		// elements cloned so far are dropped
 		let mut v = Self {
-			len: self.len,
+			len: 0,
 			capacity: self.capacity,
 			data,
 		};
 
 		for i in 0..self.len() {
-			// Safe because the pointer is guaranteed to be correct thanks to the Alloc structure
-			unsafe {
-				ptr::write_volatile(&mut v[i] as _, self[i].failable_clone()?);
-			}
+			// Cannot reallocate since the capacity is the same
+			v.push(self[i].failable_clone()?)?;
 		}
 
 		Ok(v)
@@ -492,6 +518,7 @@ impl<'a, T> IntoIterator for &'a Vec<T> {
 
 impl<T> Drop for Vec<T> {
 	fn drop(&mut self) {
+		// The memory is freed when the allocation is dropped
 		self.clear();
 	}
 }
@@ -517,12 +544,129 @@ mod test {
 		}
 	}
 
-	// TODO More tests for insert/remove
+	#[test_case]
+	fn vec_insert_remove1() {
+		let mut v = Vec::<usize>::new();
+		for i in 0..10 {
+			v.push(i).unwrap();
+		}
 
-	// TODO append
+		v.insert(5, 42).unwrap();
+		v.insert(0, 43).unwrap();
+		v.insert(v.len(), 44).unwrap();
+		assert_eq!(v.len(), 13);
+		assert_eq!(v[0], 43);
+		assert_eq!(v[6], 42);
+		assert_eq!(v[12], 44);
 
-	// TODO reserve
-	// TODO resize
+		assert_eq!(v.remove(6), 42);
+		assert_eq!(v.remove(0), 43);
+		assert_eq!(v.remove(10), 44);
+		for i in 0..10 {
+			assert_eq!(v[i], i);
+		}
+	}
+
+	#[test_case]
+	fn vec_append() {
+		let mut v0 = Vec::<usize>::new();
+		let mut v1 = Vec::<usize>::new();
+		for i in 0..10 {
+			v0.push(i).unwrap();
+			v1.push(10 + i).unwrap();
+		}
+
+		v0.append(&mut v1).unwrap();
+		assert_eq!(v0.len(), 20);
+		assert!(v1.is_empty());
+		for i in 0..20 {
+			assert_eq!(v0[i], i);
+		}
+	}
+
+	#[test_case]
+	fn vec_extend_from_slice() {
+		let mut v = Vec::<u8>::new();
+		v.extend_from_slice(b"hello").unwrap();
+		v.extend_from_slice(b"").unwrap();
+		v.extend_from_slice(b" world").unwrap();
+		assert_eq!(v.as_slice(), b"hello world");
+	}
+
+	#[test_case]
+	fn vec_reserve() {
+		let mut v = Vec::<usize>::new();
+		v.try_reserve_exact(10).unwrap();
+		assert_eq!(v.capacity(), 10);
+
+		for i in 0..10 {
+			v.push(i).unwrap();
+		}
+		assert_eq!(v.capacity(), 10);
+
+		// Growing is geometric
+		v.push(10).unwrap();
+		assert!(v.capacity() >= 20);
+
+		v.shrink_to_fit();
+		assert_eq!(v.capacity(), 11);
+		for i in 0..11 {
+			assert_eq!(v[i], i);
+		}
+
+		v.clear();
+		assert_eq!(v.capacity(), 11);
+		v.shrink_to_fit();
+		assert_eq!(v.capacity(), 0);
+	}
+
+	#[test_case]
+	fn vec_resize() {
+		let mut v = Vec::<usize>::new();
+		v.push(1).unwrap();
+
+		v.resize(10).unwrap();
+		assert_eq!(v.len(), 10);
+		assert_eq!(v[0], 1);
+		for i in 1..10 {
+			assert_eq!(v[i], 0);
+		}
+
+		v.resize(2).unwrap();
+		assert_eq!(v.len(), 2);
+	}
+
+	/// The number of `DropCounter` instances dropped.
+	static mut DROPPED: usize = 0;
+
+	/// Structure counting the number of times it is dropped.
+	struct DropCounter {}
+
+	impl Drop for DropCounter {
+		fn drop(&mut self) {
+			unsafe {
+				DROPPED += 1;
+			}
+		}
+	}
+
+	#[test_case]
+	fn vec_drop() {
+		unsafe {
+			DROPPED = 0;
+		}
+
+		let mut v = Vec::<DropCounter>::new();
+		for _ in 0..10 {
+			v.push(DropCounter {}).unwrap();
+		}
+		drop(v.remove(3));
+		v.truncate(5);
+		assert_eq!(unsafe { DROPPED }, 5);
+
+		drop(v);
+		assert_eq!(unsafe { DROPPED }, 10);
+	}
 
 	#[test_case]
 	fn vec_push() {
@@ -559,7 +703,8 @@ mod test {
 		for i in 0..100 {
 			v.push(i).unwrap();
 			debug_assert_eq!(v.len(), 1);
-			debug_assert_eq!(v.first(), i);
+			debug_assert_eq!(v.first(), Some(&i));
+			debug_assert_eq!(v.last(), Some(&i));
 			v.pop();
 			debug_assert_eq!(v.len(), 0);
 		}
@@ -679,7 +824,52 @@ mod test {
 		assert_eq!(v.len(), 0);
 	}
 
-	// TODO Test resize
+	/// Element counting its live instances, whose clone fails for a given value.
+	struct Counted(usize);
+
+	/// The number of live instances of `Counted`.
+	static mut COUNTED_LIVE: usize = 0;
+
+	impl Counted {
+		fn new(val: usize) -> Self {
+			unsafe {
+				COUNTED_LIVE += 1;
+			}
+			Self(val)
+		}
+	}
+
+	impl FailableClone for Counted {
+		fn failable_clone(&self) -> Result<Self, Errno> {
+			if self.0 == 3 {
+				return Err(errno::ENOMEM);
+			}
+			Ok(Self::new(self.0))
+		}
+	}
+
+	impl Drop for Counted {
+		fn drop(&mut self) {
+			unsafe {
+				COUNTED_LIVE -= 1;
+			}
+		}
+	}
+
+	#[test_case]
+	fn vec_failable_clone0() {
+		let mut v = Vec::new();
+		for i in 0..8 {
+			v.push(Counted::new(i)).unwrap();
+		}
+
+		// The elements cloned before the failure must be dropped exactly once
+		assert!(v.failable_clone().is_err());
+		assert_eq!(unsafe { COUNTED_LIVE }, 8);
+
+		drop(v);
+		assert_eq!(unsafe { COUNTED_LIVE }, 0);
+	}
 
 	// TODO Test range functions
 }
@@ -0,0 +1,101 @@
+//! This module implements a hash table with a fixed number of slots, keyed by addresses.
+//!
+//! The table uses open addressing and never allocates memory, which allows to use it in code that
+//! cannot allocate, such as the memory allocator itself or locks. Entries are never removed, so
+//! an entry always stays in the same slot. Once every slot is used, new keys share a single
+//! overflow entry.
+
+use core::iter;
+
+/// A hash table with `N` slots, storing values of type `V` for keys of type `usize`.
+/// The number of slots `N` must be a power of two.
+pub struct FixedTable<V: Copy, const N: usize> {
+	/// The slots of the table. A slot is free if its key is None.
+	slots: [(Option<usize>, V); N],
+	/// The entry shared by the keys that couldn't be inserted because the table is full.
+	other: V,
+}
+
+impl<V: Copy, const N: usize> FixedTable<V, N> {
+	/// Creates a new table in which every entry has the value `init`.
+	pub const fn new(init: V) -> Self {
+		Self {
+			slots: [(None, init); N],
+			other: init,
+		}
+	}
+
+	/// Returns the entry for the key `key`, inserting it with the value `init` if not present.
+	/// If the table is full, the function returns the overflow entry.
+	pub fn get_mut(&mut self, key: usize, init: V) -> &mut V {
+		let mut i = (key >> 2).wrapping_mul(0x9e3779b1) % N;
+		for _ in 0..N {
+			match self.slots[i].0 {
+				None => self.slots[i] = (Some(key), init),
+				Some(k) if k == key => {},
+				_ => {
+					i = (i + 1) % N;
+					continue;
+				},
+			}
+
+			return &mut self.slots[i].1;
+		}
+
+		&mut self.other
+	}
+
+	/// Returns the overflow entry.
+	pub fn get_other_mut(&mut self) -> &mut V {
+		&mut self.other
+	}
+
+	/// Returns an iterator on the keys and values of the used entries, followed by the overflow
+	/// entry, which has no key.
+	pub fn iter(&self) -> impl Iterator<Item = (Option<usize>, &V)> {
+		self.slots.iter()
+			.filter(| (key, _) | key.is_some())
+			.map(| (key, val) | (*key, val))
+			.chain(iter::once((None, &self.other)))
+	}
+
+	/// Removes every entry and sets the overflow entry to `init`.
+	pub fn clear(&mut self, init: V) {
+		for slot in self.slots.iter_mut() {
+			*slot = (None, init);
+		}
+		self.other = init;
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test_case]
+	fn fixed_table0() {
+		let mut table = FixedTable::<usize, 16>::new(0);
+
+		*table.get_mut(0x1000, 0) += 1;
+		*table.get_mut(0x1000, 0) += 1;
+		*table.get_mut(0x2000, 0) += 5;
+		assert_eq!(*table.get_mut(0x1000, 0), 2);
+		assert_eq!(*table.get_mut(0x2000, 0), 5);
+		assert_eq!(table.iter().count(), 3);
+	}
+
+	#[test_case]
+	fn fixed_table_full() {
+		let mut table = FixedTable::<usize, 16>::new(0);
+
+		for i in 0..17 {
+			*table.get_mut(0x1000 + i * 4, 0) += 1;
+		}
+		assert_eq!(*table.get_other_mut(), 1);
+		assert_eq!(*table.get_mut(0x1000, 0), 1);
+
+		table.clear(0);
+		assert_eq!(table.iter().count(), 1);
+		assert_eq!(*table.get_other_mut(), 0);
+	}
+}
@@ -0,0 +1,39 @@
+#include <cpuid.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libc.h"
+
+// Bit of CPUID leaf 0x1 EDX telling whether SSE2 is supported.
+#define CPUID_SSE2	(1 << 26)
+// Bit of CPUID leaf 0x7 EBX telling whether ERMS is supported.
+#define CPUID_ERMS	(1 << 9)
+
+int libc_features = 0;
+
+/*
+ * Detects the features of the CPU in order to select the fastest
+ * implementation of each function. Before this function is called, only
+ * features available on every CPUs are used.
+ */
+void libc_init(void)
+{
+	unsigned eax, ebx, ecx, edx;
+	unsigned max;
+	int features = 0;
+
+	max = __get_cpuid_max(0, NULL);
+	if (max >= 0x1)
+	{
+		__cpuid(0x1, eax, ebx, ecx, edx);
+		if (edx & CPUID_SSE2)
+			features |= LIBC_FEATURE_SSE2;
+	}
+	if (max >= 0x7)
+	{
+		__cpuid_count(0x7, 0, eax, ebx, ecx, edx);
+		if (ebx & CPUID_ERMS)
+			features |= LIBC_FEATURE_ERMS;
+	}
+	libc_features = features;
+}
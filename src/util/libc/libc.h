@@ -15,12 +15,38 @@
 # define DOWN_ALIGN(ptr, n)\
 	(typeof(ptr)) ((intptr_t) (ptr) & ~((intptr_t) ((n) - 1)))
 
-// TODO Add support for SSE instructions if the CPU supports them
+// A word which may alias any other type, used to process memory word by word.
+typedef unsigned long __attribute__((may_alias)) word_t;
+
+// Evaluates to a non-zero value if one of the bytes of the word `w` is zero.
+# define HAS_ZERO(w)	(((w) - 0x01010101UL) & ~(w) & 0x80808080UL)
+
+// Feature flag: the CPU has Enhanced REP MOVSB/STOSB, making byte string
+// operations as fast as word ones.
+# define LIBC_FEATURE_ERMS	0b01
+// Feature flag: the CPU supports SSE2, which provides non-temporal stores.
+# define LIBC_FEATURE_SSE2	0b10
+
+// Copies and fills of at least this size bypass the cache using non-temporal
+// stores, if supported.
+# define NT_THRESHOLD	4096
+
+// The CPU features available to select the implementation of functions.
+extern int libc_features;
+
+void libc_init(void);
 
 void *memcpy(void *dest, const void *src, size_t n);
+void *memcpy_movsd(void *dest, const void *src, size_t n);
+void *memcpy_movsb(void *dest, const void *src, size_t n);
+void *memcpy_nt(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n);
 int memcmp(const void *s1, const void *s2, size_t n);
 
+void *memset(void *s, int c, size_t n);
+void *memset_stosd(void *s, int c, size_t n);
+void *memset_stosb(void *s, int c, size_t n);
+void *memset_nt(void *s, int c, size_t n);
 void bzero(void *s, size_t n);
 
 size_t strlen(const char *s);
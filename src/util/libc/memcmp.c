@@ -9,24 +9,26 @@
  */
 int memcmp(const void *s1, const void *s2, size_t n)
 {
-	// The index of the current byte
-	size_t i;
-	// The end of the aligned portion of memory
-	size_t align_end;
+	const unsigned char *a = s1;
+	const unsigned char *b = s2;
+	size_t i = 0;
 
-	i = 0;
-	align_end = (size_t) (DOWN_ALIGN(s1 + n, sizeof(long)) - s1);
-	while (i < n
-		&& !(IS_ALIGNED(s1, sizeof(long)) && IS_ALIGNED(s2, sizeof(long)))
-		&& ((volatile char *) s1)[i] == ((volatile char *) s2)[i])
+	while (i < n && !IS_ALIGNED(a + i, sizeof(word_t)))
+	{
+		if (a[i] != b[i])
+			return a[i] - b[i];
 		++i;
-	while (i < align_end
-		&& *((volatile long *) (s1 + i)) == *((volatile long *) (s2 + i)))
+	}
+	// Skipping identical words. `s2` may be unaligned, which is supported by
+	// the CPU
+	while (n - i >= sizeof(word_t)
+		&& *((const word_t *) (a + i)) == *((const word_t *) (b + i)))
+		i += sizeof(word_t);
+	while (i < n)
+	{
+		if (a[i] != b[i])
+			return a[i] - b[i];
 		++i;
-	while (i < n
-		&& ((volatile char *) s1)[i] == ((volatile char *) s2)[i])
-		++i;
-	if (i >= n)
-		return 0;
-	return (((unsigned char *) s1)[i] - ((unsigned char *) s2)[i]);
+	}
+	return 0;
 }
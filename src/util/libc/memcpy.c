@@ -4,39 +4,85 @@
 #include "libc.h"
 
 /*
- * Copies the given memory area `src` to `dest` with size `n`.
- * If the given memory areas are overlapping, the behaviour is undefined.
+ * Copies the given memory area `src` to `dest` with size `n`, using
+ * `rep movsd` for the words and `rep movsb` for the remaining bytes.
  */
-void *memcpy(void *dest, const void *src, size_t n)
+void *memcpy_movsd(void *dest, const void *src, size_t n)
+{
+	void *d = dest;
+	size_t words = n / sizeof(long);
+	size_t bytes = n % sizeof(long);
+
+	__asm__ volatile("rep movsl"
+		: "+D"(d), "+S"(src), "+c"(words) :: "memory");
+	__asm__ volatile("rep movsb"
+		: "+D"(d), "+S"(src), "+c"(bytes) :: "memory");
+	return dest;
+}
+
+/*
+ * Copies the given memory area `src` to `dest` with size `n`, using a single
+ * `rep movsb`. This is the fastest way on CPUs supporting ERMS.
+ */
+void *memcpy_movsb(void *dest, const void *src, size_t n)
+{
+	void *d = dest;
+
+	__asm__ volatile("rep movsb"
+		: "+D"(d), "+S"(src), "+c"(n) :: "memory");
+	return dest;
+}
+
+/*
+ * Copies the given memory area `src` to `dest` with size `n`, using
+ * non-temporal stores. The destination is not brought into the cache, which
+ * avoids evicting useful data when copying large areas.
+ * This function requires SSE2.
+ */
+void *memcpy_nt(void *dest, const void *src, size_t n)
 {
-	// The beginning of the destination memory
-	void *begin;
-	// The end of the destination memory
-	void *end;
-	// The end of the aligned portion of memory to be written
-	void *align_end;
-
-	begin = dest;
-	end = begin + n;
-	align_end = DOWN_ALIGN(end, sizeof(long));
-	while (dest < end
-		&& !(IS_ALIGNED(dest, sizeof(long)) && IS_ALIGNED(src, sizeof(long))))
+	void *d = dest;
+	void *end = dest + n;
+
+	while (d < end && !IS_ALIGNED(d, sizeof(long)))
 	{
-		*((volatile char *) dest) = *((volatile char *) src);
-		dest += sizeof(char);
+		*((volatile char *) d) = *((volatile char *) src);
+		d += sizeof(char);
 		src += sizeof(char);
 	}
-	while (dest < align_end)
+	while ((size_t) (end - d) >= 4 * sizeof(long))
 	{
-		*((volatile long *) dest) = *((volatile long *) src);
-		dest += sizeof(long);
-		src += sizeof(long);
+		__asm__ volatile("movnti %1, %0"
+			: "=m"(((long *) d)[0]) : "r"(((const long *) src)[0]));
+		__asm__ volatile("movnti %1, %0"
+			: "=m"(((long *) d)[1]) : "r"(((const long *) src)[1]));
+		__asm__ volatile("movnti %1, %0"
+			: "=m"(((long *) d)[2]) : "r"(((const long *) src)[2]));
+		__asm__ volatile("movnti %1, %0"
+			: "=m"(((long *) d)[3]) : "r"(((const long *) src)[3]));
+		d += 4 * sizeof(long);
+		src += 4 * sizeof(long);
 	}
-	while (dest < end)
+	// Non-temporal stores are weakly ordered
+	__asm__ volatile("sfence" ::: "memory");
+	while (d < end)
 	{
-		*((volatile char *) dest) = *((volatile char *) src);
-		dest += sizeof(char);
+		*((volatile char *) d) = *((volatile char *) src);
+		d += sizeof(char);
 		src += sizeof(char);
 	}
-	return begin;
+	return dest;
+}
+
+/*
+ * Copies the given memory area `src` to `dest` with size `n`.
+ * If the given memory areas are overlapping, the behaviour is undefined.
+ */
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	if (n >= NT_THRESHOLD && (libc_features & LIBC_FEATURE_SSE2))
+		return memcpy_nt(dest, src, n);
+	if (libc_features & LIBC_FEATURE_ERMS)
+		return memcpy_movsb(dest, src, n);
+	return memcpy_movsd(dest, src, n);
 }
@@ -3,22 +3,31 @@
 
 #include "libc.h"
 
-// TODO Optimize
 /*
  * Same as memcpy, except the function can handle overlapping memory areas.
  */
 void *memmove(void *dest, const void *src, size_t n)
 {
-	void *begin = dest;
-	size_t i = 0;
+	void *d;
+	size_t words;
+	size_t bytes;
 
-	if (dest < src)
+	if (dest <= src || dest >= src + n)
 		return memcpy(dest, src, n);
 
-	while (i < n)
-	{
-		((char *) dest)[n - i - 1] = ((char *) src)[n - i - 1];
-		++i;
-	}
-	return begin;
+	// The destination overlaps the end of the source, copying backward. The
+	// trailing bytes are copied first, then the words
+	d = dest + n - 1;
+	src += n - 1;
+	words = n / sizeof(long);
+	bytes = n % sizeof(long);
+	__asm__ volatile("std\n\t"
+		"rep movsb\n\t"
+		"sub $3, %%edi\n\t"
+		"sub $3, %%esi\n\t"
+		"mov %3, %%ecx\n\t"
+		"rep movsl\n\t"
+		"cld"
+		: "+D"(d), "+S"(src), "+c"(bytes) : "r"(words) : "memory", "cc");
+	return dest;
 }
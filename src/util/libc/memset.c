@@ -1,35 +1,89 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "libc.h"
+
 /*
- * TODO doc
+ * Returns a word with each byte set to the value `c`.
  */
 static long make_field(const int c)
 {
-	long field = 0;
-	size_t i = 0;
+	return (c & 0xff) * (long) 0x01010101;
+}
+
+/*
+ * Fills the memory area `s` of size `n` with the byte `c`, using `rep stosd`
+ * for the words and `rep stosb` for the remaining bytes.
+ */
+void *memset_stosd(void *s, int c, size_t n)
+{
+	void *d = s;
+	size_t words = n / sizeof(long);
+	size_t bytes = n % sizeof(long);
+	long field = make_field(c);
+
+	__asm__ volatile("rep stosl"
+		: "+D"(d), "+c"(words) : "a"(field) : "memory");
+	__asm__ volatile("rep stosb"
+		: "+D"(d), "+c"(bytes) : "a"(field) : "memory");
+	return s;
+}
+
+/*
+ * Fills the memory area `s` of size `n` with the byte `c`, using a single
+ * `rep stosb`. This is the fastest way on CPUs supporting ERMS.
+ */
+void *memset_stosb(void *s, int c, size_t n)
+{
+	void *d = s;
+
+	__asm__ volatile("rep stosb"
+		: "+D"(d), "+c"(n) : "a"(c) : "memory");
+	return s;
+}
+
+/*
+ * Fills the memory area `s` of size `n` with the byte `c`, using
+ * non-temporal stores. The memory is not brought into the cache.
+ * This function requires SSE2.
+ */
+void *memset_nt(void *s, int c, size_t n)
+{
+	void *d = s;
+	void *end = s + n;
+	long field = make_field(c);
 
-	for(; i < sizeof(long); ++i)
-		field = (field << 8) | (c & 0xff);
-	return field;
+	while (d < end && !IS_ALIGNED(d, sizeof(long)))
+	{
+		*((volatile char *) d) = c;
+		d += sizeof(char);
+	}
+	while ((size_t) (end - d) >= 4 * sizeof(long))
+	{
+		__asm__ volatile("movnti %1, %0" : "=m"(((long *) d)[0]) : "r"(field));
+		__asm__ volatile("movnti %1, %0" : "=m"(((long *) d)[1]) : "r"(field));
+		__asm__ volatile("movnti %1, %0" : "=m"(((long *) d)[2]) : "r"(field));
+		__asm__ volatile("movnti %1, %0" : "=m"(((long *) d)[3]) : "r"(field));
+		d += 4 * sizeof(long);
+	}
+	// Non-temporal stores are weakly ordered
+	__asm__ volatile("sfence" ::: "memory");
+	while (d < end)
+	{
+		*((volatile char *) d) = c;
+		d += sizeof(char);
+	}
+	return s;
 }
 
 /*
- * TODO doc
+ * Fills the memory area `s` of size `n` with the byte `c`.
  */
 void *memset(void *s, int c, size_t n)
 {
-	void *begin = s;
-	void *end = begin + n;
-	long field;
-
-	field = make_field(c);
-	while(s < end && (((intptr_t) s & (sizeof(long) - 1)) != 0))
-		*((char *) s++) = c;
-	while(s < (void *) ((intptr_t) end & ~((intptr_t) 7))
-		&& (((intptr_t) s & (sizeof(long) - 1)) == 0))
-		*((long *) s++) = field;
-	while(s < end)
-		*((char *) s++) = c;
-	return begin;
+	if (n >= NT_THRESHOLD && (libc_features & LIBC_FEATURE_SSE2))
+		return memset_nt(s, c, n);
+	if (libc_features & LIBC_FEATURE_ERMS)
+		return memset_stosb(s, c, n);
+	return memset_stosd(s, c, n);
 }
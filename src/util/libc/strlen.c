@@ -1,15 +1,29 @@
 #include <stddef.h>
+#include <stdint.h>
 
 #include "libc.h"
 
 /*
  * Returns the length of the string `s`.
+ * The string is read word by word. An aligned word never crosses a page
+ * boundary, so reading past the terminating null byte cannot fault.
  */
 size_t strlen(const char *s)
 {
-	size_t i = 0;
+	const char *p = s;
+	const word_t *w;
 
-	while(s[i])
-		++i;
-	return i;
+	while (!IS_ALIGNED(p, sizeof(word_t)))
+	{
+		if (!*((volatile const char *) p))
+			return p - s;
+		++p;
+	}
+	w = (const word_t *) p;
+	while (!HAS_ZERO(*w))
+		++w;
+	p = (const char *) w;
+	while (*((volatile const char *) p))
+		++p;
+	return p - s;
 }
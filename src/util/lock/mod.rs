@@ -2,4 +2,7 @@
 //! example.
 
 pub mod mutex;
+#[cfg(config_debug_lock_profiler)]
+pub mod profiler;
+pub mod seqlock;
 pub mod spinlock;
@@ -5,9 +5,14 @@
 //! time. Preventing race conditions.
 //!
 //! A Mutex usually works using spinlocks.
+//!
+//! If the lock profiler is enabled, the time spent waiting for and holding each mutex is accounted
+//! to the location of the code locking it (see module `profiler`).
 
 use core::marker::PhantomData;
 use crate::idt;
+#[cfg(config_debug_lock_profiler)]
+use crate::util::lock::profiler;
 use crate::util::lock::spinlock::Spinlock;
 
 /// Trait representing a Mutex.
@@ -20,6 +25,10 @@ pub trait TMutex<T: ?Sized> {
 	/// available.
 	/// The function returns a MutexGuard associated with the Mutex.
 	fn lock(&mut self) -> MutexGuard<T, Self>;
+	/// Locks the mutex if it isn't already locked, without waiting. If the mutex is already
+	/// locked, the function returns None.
+	/// This function is useful when waiting could lead to a deadlock, such as on kernel panic.
+	fn try_lock(&mut self) -> Option<MutexGuard<T, Self>>;
 
 	/// Returns an immutable reference to the payload. This function is unsafe because it can return
 	/// the payload while the Mutex isn't locked.
@@ -83,6 +92,9 @@ impl<'a, T: ?Sized, M: TMutex<T> + ?Sized> Drop for MutexGuard<'a, T, M> {
 pub struct Mutex<T: ?Sized> {
 	/// The spinlock for the underlying data.
 	spin: Spinlock,
+	/// The profiling data of the current acquisition.
+	#[cfg(config_debug_lock_profiler)]
+	acquisition: profiler::Acquisition,
 	/// The data associated to the mutex.
 	data: T,
 }
@@ -92,6 +104,8 @@ impl<T> Mutex<T> {
 	pub const fn new(data: T) -> Self {
 		Self {
 			spin: Spinlock::new(),
+			#[cfg(config_debug_lock_profiler)]
+			acquisition: profiler::Acquisition::new(),
 			data,
 		}
 	}
@@ -102,11 +116,24 @@ impl<T: ?Sized> TMutex<T> for Mutex<T> {
 		self.spin.is_locked()
 	}
 
+	#[cfg_attr(config_debug_lock_profiler, track_caller)]
 	fn lock(&mut self) -> MutexGuard<T, Self> {
+		#[cfg(not(config_debug_lock_profiler))]
 		self.spin.lock();
+		#[cfg(config_debug_lock_profiler)]
+		self.acquisition.acquire(&mut self.spin);
+
 		MutexGuard::new(self)
 	}
 
+	fn try_lock(&mut self) -> Option<MutexGuard<T, Self>> {
+		if self.spin.try_lock() {
+			Some(MutexGuard::new(self))
+		} else {
+			None
+		}
+	}
+
 	unsafe fn get_payload(&self) -> &T {
 		&self.data
 	}
@@ -116,7 +143,13 @@ impl<T: ?Sized> TMutex<T> for Mutex<T> {
 	}
 
 	unsafe fn unlock(&mut self) {
+		#[cfg(config_debug_lock_profiler)]
+		let sample = self.acquisition.release();
+
 		self.spin.unlock();
+
+		#[cfg(config_debug_lock_profiler)]
+		profiler::record(sample);
 	}
 }
 
@@ -128,6 +161,9 @@ pub struct InterruptMutex<T: ?Sized> {
 	spin: Spinlock,
 	/// Tells whether interruptions were enabled before locking.
 	interrupt_enabled: bool,
+	/// The profiling data of the current acquisition.
+	#[cfg(config_debug_lock_profiler)]
+	acquisition: profiler::Acquisition,
 
 	/// The data associated to the mutex.
 	data: T,
@@ -139,6 +175,8 @@ impl<T> InterruptMutex<T> {
 		Self {
 			spin: Spinlock::new(),
 			interrupt_enabled: false,
+			#[cfg(config_debug_lock_profiler)]
+			acquisition: profiler::Acquisition::new(),
 
 			data,
 		}
@@ -150,14 +188,33 @@ impl<T: ?Sized> TMutex<T> for InterruptMutex<T> {
 		self.spin.is_locked()
 	}
 
+	#[cfg_attr(config_debug_lock_profiler, track_caller)]
 	fn lock(&mut self) -> MutexGuard<T, Self> {
 		self.interrupt_enabled = idt::is_interrupt_enabled();
 		crate::cli!();
+		#[cfg(not(config_debug_lock_profiler))]
 		self.spin.lock();
+		#[cfg(config_debug_lock_profiler)]
+		self.acquisition.acquire(&mut self.spin);
 
 		MutexGuard::new(self)
 	}
 
+	fn try_lock(&mut self) -> Option<MutexGuard<T, Self>> {
+		let interrupt_enabled = idt::is_interrupt_enabled();
+		crate::cli!();
+
+		if self.spin.try_lock() {
+			self.interrupt_enabled = interrupt_enabled;
+			Some(MutexGuard::new(self))
+		} else {
+			if interrupt_enabled {
+				crate::sti!();
+			}
+			None
+		}
+	}
+
 	unsafe fn get_payload(&self) -> &T {
 		&self.data
 	}
@@ -168,7 +225,15 @@ impl<T: ?Sized> TMutex<T> for InterruptMutex<T> {
 
 	unsafe fn unlock(&mut self) {
 		if self.is_locked() {
+			#[cfg(config_debug_lock_profiler)]
+			let sample = self.acquisition.release();
+
 			self.spin.unlock();
+
+			// Recording before enabling interruptions to avoid being interrupted in between
+			#[cfg(config_debug_lock_profiler)]
+			profiler::record(sample);
+
 			if self.interrupt_enabled {
 				crate::sti!();
 			}
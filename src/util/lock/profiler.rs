@@ -0,0 +1,274 @@
+//! This module implements a profiler for the contention on mutexes.
+//!
+//! Each time a mutex is locked, the location of the code locking it is retrieved with
+//! `#[track_caller]`. When the mutex is unlocked, the time spent waiting for the lock and the time
+//! the lock was held are accounted to this location in a `FixedTable`, so that profiling never
+//! allocates memory nor locks a mutex.
+//!
+//! Durations are measured with the TSC and are given in cycles. The sites waiting the most are
+//! listed in the device `/dev/lockstat`. Writing to this device resets the statistics.
+
+use core::fmt;
+use core::panic::Location;
+use crate::idt;
+use crate::time::tsc;
+use crate::util::fixed_table::FixedTable;
+use crate::util::lock::spinlock::Spinlock;
+
+/// The number of slots in the table of sites. This value must be a power of two.
+const SITES_COUNT: usize = 256;
+/// The maximum number of sites listed by `write`.
+const TOP_COUNT: usize = 32;
+
+/// Structure storing the state of an acquisition of a mutex, from the moment it's locked to the
+/// moment it's unlocked.
+pub struct Acquisition {
+	/// The location of the code that locked the mutex. If None, the mutex isn't locked through
+	/// `acquire`.
+	site: Option<&'static Location<'static>>,
+	/// Tells whether the mutex was already locked when trying to lock it.
+	contended: bool,
+	/// The number of cycles spent waiting for the lock.
+	wait: u64,
+	/// The value of the TSC at the moment the lock was acquired.
+	acquired: u64,
+}
+
+impl Acquisition {
+	/// Creates a new instance.
+	pub const fn new() -> Self {
+		Self {
+			site: None,
+			contended: false,
+			wait: 0,
+			acquired: 0,
+		}
+	}
+
+	/// Locks the spinlock `spin` on behalf of the caller, recording the time spent waiting.
+	#[track_caller]
+	pub fn acquire(&mut self, spin: &mut Spinlock) {
+		let site = Location::caller();
+		let begin = tsc::read();
+		let contended = spin.is_locked();
+		spin.lock();
+		let now = tsc::read();
+
+		// The structure is protected by the spinlock from here
+		self.site = Some(site);
+		self.contended = contended;
+		self.wait = now - begin;
+		self.acquired = now;
+	}
+
+	/// Ends the acquisition. This function must be called while the spinlock is still locked.
+	/// The returned sample must be passed to `record` once the spinlock is unlocked, so that the
+	/// time spent recording doesn't count in the hold time.
+	/// If the spinlock wasn't locked through `acquire`, the function returns None.
+	pub fn release(&mut self) -> Option<Sample> {
+		let site = self.site.take()?;
+
+		Some(Sample {
+			site,
+			contended: self.contended,
+			wait: self.wait,
+			hold: tsc::read() - self.acquired,
+		})
+	}
+}
+
+/// A measure of an acquisition of a mutex.
+pub struct Sample {
+	/// The location of the code that locked the mutex.
+	site: &'static Location<'static>,
+	/// Tells whether the mutex was already locked when trying to lock it.
+	contended: bool,
+	/// The number of cycles spent waiting for the lock.
+	wait: u64,
+	/// The number of cycles the lock was held.
+	hold: u64,
+}
+
+/// Statistics on the acquisitions made by a site.
+#[derive(Clone, Copy)]
+struct Site {
+	/// The location of the site. If None, the site accounts the acquisitions that couldn't be
+	/// inserted because the table is full.
+	location: Option<&'static Location<'static>>,
+	/// The number of acquisitions.
+	count: u64,
+	/// The number of acquisitions for which the mutex was already locked.
+	contentions: u64,
+	/// The total number of cycles spent waiting for the lock.
+	wait_total: u64,
+	/// The longest wait, in cycles.
+	wait_max: u64,
+	/// The total number of cycles the lock was held.
+	hold_total: u64,
+	/// The longest hold, in cycles.
+	hold_max: u64,
+}
+
+/// An empty site, used for initialization.
+const EMPTY_SITE: Site = Site {
+	location: None,
+	count: 0,
+	contentions: 0,
+	wait_total: 0,
+	wait_max: 0,
+	hold_total: 0,
+	hold_max: 0,
+};
+
+impl Site {
+	/// Accounts the sample `sample`.
+	fn add(&mut self, sample: &Sample) {
+		self.count += 1;
+		if sample.contended {
+			self.contentions += 1;
+		}
+		self.wait_total += sample.wait;
+		self.wait_max = self.wait_max.max(sample.wait);
+		self.hold_total += sample.hold;
+		self.hold_max = self.hold_max.max(sample.hold);
+	}
+
+	/// Tells whether the site is a worse offender than `other`, comparing the time spent waiting,
+	/// then the number of contentions.
+	fn is_worse_than(&self, other: &Self) -> bool {
+		(self.wait_total, self.contentions) > (other.wait_total, other.contentions)
+	}
+}
+
+/// A table of sites, keyed by the address of their location.
+struct SiteTable(FixedTable<Site, SITES_COUNT>);
+
+impl SiteTable {
+	/// Creates a new empty table.
+	const fn new() -> Self {
+		Self(FixedTable::new(EMPTY_SITE))
+	}
+
+	/// Returns the entry for the site `location`, inserting it if not present.
+	fn get_mut(&mut self, location: &'static Location<'static>) -> &mut Site {
+		// Locations are unique per call site, so they can be identified by their address
+		let addr = location as *const _ as usize;
+		self.0.get_mut(addr, Site {
+			location: Some(location),
+			..EMPTY_SITE
+		})
+	}
+
+	/// Returns the sites with the most time spent waiting, sorted from worst to best. Free slots
+	/// are left at the end of the array.
+	fn get_top(&self) -> [Site; TOP_COUNT] {
+		let mut top = [EMPTY_SITE; TOP_COUNT];
+
+		for (_, site) in self.0.iter() {
+			if site.count == 0 || !site.is_worse_than(&top[TOP_COUNT - 1]) {
+				continue;
+			}
+
+			// Insertion sort, dropping the last site
+			let mut i = TOP_COUNT - 1;
+			while i > 0 && site.is_worse_than(&top[i - 1]) {
+				top[i] = top[i - 1];
+				i -= 1;
+			}
+			top[i] = *site;
+		}
+
+		top
+	}
+}
+
+/// The table of sites.
+static mut SITES: SiteTable = SiteTable::new();
+/// The spinlock protecting the table of sites. A mutex cannot be used since it would be profiled
+/// itself.
+static mut SITES_LOCK: Spinlock = Spinlock::new();
+
+/// Executes the closure `f` with the table of sites locked. Interrupts are disabled to prevent a
+/// deadlock if an interrupt handler unlocks a mutex while the table is locked.
+fn with_sites<T, F: FnOnce(&mut SiteTable) -> T>(f: F) -> T {
+	idt::wrap_disable_interrupts(|| {
+		unsafe { // Safe because using the spinlock
+			SITES_LOCK.lock();
+			let result = f(&mut SITES);
+			SITES_LOCK.unlock();
+
+			result
+		}
+	})
+}
+
+/// Accounts the sample `sample` to its site. If None, the function does nothing.
+pub fn record(sample: Option<Sample>) {
+	if let Some(sample) = sample {
+		with_sites(| table | table.get_mut(sample.site).add(&sample));
+	}
+}
+
+/// Resets the statistics of every site.
+pub fn reset() {
+	with_sites(| table | table.0.clear(EMPTY_SITE));
+}
+
+/// Writes the sites spending the most time waiting for locks with `w`, one per line, with the
+/// location of the site, the number of acquisitions and contentions, then the total and maximum
+/// wait and hold times.
+pub fn write(w: &mut dyn fmt::Write) -> fmt::Result {
+	// Copying the sites to avoid keeping the table locked while writing
+	let top = with_sites(| table | table.get_top());
+
+	writeln!(w, "site count contentions wait_total wait_max hold_total hold_max")?;
+	for site in top.iter().take_while(| site | site.count > 0) {
+		match site.location {
+			Some(l) => write!(w, "{}:{}", l.file(), l.line())?,
+			None => write!(w, "(other)")?,
+		}
+		writeln!(w, " {} {} {} {} {} {}", site.count, site.contentions, site.wait_total,
+			site.wait_max, site.hold_total, site.hold_max)?;
+	}
+
+	Ok(())
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	/// Returns a sample for the site `site`.
+	fn sample(site: &'static Location<'static>, contended: bool, wait: u64, hold: u64) -> Sample {
+		Sample {
+			site,
+			contended,
+			wait,
+			hold,
+		}
+	}
+
+	#[test_case]
+	fn lock_site_table0() {
+		let mut table = SiteTable::new();
+		let a = Location::caller();
+		let b = Location::caller();
+
+		table.get_mut(a).add(&sample(a, false, 10, 100));
+		table.get_mut(a).add(&sample(a, true, 50, 20));
+		table.get_mut(b).add(&sample(b, true, 500, 1));
+
+		let site = table.get_mut(a);
+		assert_eq!(site.count, 2);
+		assert_eq!(site.contentions, 1);
+		assert_eq!(site.wait_total, 60);
+		assert_eq!(site.wait_max, 50);
+		assert_eq!(site.hold_total, 120);
+		assert_eq!(site.hold_max, 100);
+
+		let top = table.get_top();
+		assert_eq!(top[0].wait_total, 500);
+		assert_eq!(top[1].wait_total, 60);
+		assert_eq!(top[2].count, 0);
+	}
+}
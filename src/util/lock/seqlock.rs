@@ -0,0 +1,76 @@
+//! This module implements the SeqLock structure, a lock optimized for data that is read very often
+//! and rarely written.
+//!
+//! Readers never write to shared memory: they read a sequence number, copy the data, then check
+//! that the sequence number didn't change in the meantime, retrying otherwise. Writers make the
+//! sequence number odd while modifying the data.
+
+use core::cell::UnsafeCell;
+use core::ptr;
+use core::sync::atomic::AtomicU32;
+use core::sync::atomic::Ordering;
+use core::sync::atomic;
+use crate::idt;
+
+/// A sequence lock protecting a value of type `T`. Since readers may observe a value that is
+/// being modified before retrying, `T` must be `Copy`.
+pub struct SeqLock<T: Copy> {
+	/// The sequence number. If odd, a writer is modifying the data.
+	seq: AtomicU32,
+	/// The protected data.
+	data: UnsafeCell<T>,
+}
+
+unsafe impl<T: Copy> Sync for SeqLock<T> {}
+
+impl<T: Copy> SeqLock<T> {
+	/// Creates a new instance with the given value.
+	pub const fn new(data: T) -> Self {
+		Self {
+			seq: AtomicU32::new(0),
+			data: UnsafeCell::new(data),
+		}
+	}
+
+	/// Returns a copy of the protected value. This function doesn't block writers.
+	pub fn read(&self) -> T {
+		loop {
+			let seq = self.seq.load(Ordering::Acquire);
+			if seq & 1 != 0 {
+				continue;
+			}
+
+			let data = unsafe {
+				ptr::read_volatile(self.data.get())
+			};
+			atomic::fence(Ordering::Acquire);
+
+			if self.seq.load(Ordering::Relaxed) == seq {
+				return data;
+			}
+		}
+	}
+
+	/// Modifies the protected value with the given closure `f`.
+	/// Interrupts are disabled during the modification so that a reader on the same core cannot
+	/// wait forever for the writer to finish.
+	pub fn write<F: FnOnce(&mut T)>(&self, f: F) {
+		idt::wrap_disable_interrupts(|| {
+			// Acquiring the lock against other writers
+			let seq = loop {
+				let seq = self.seq.load(Ordering::Relaxed);
+				if seq & 1 == 0 && self.seq.compare_exchange_weak(seq, seq + 1, Ordering::Acquire,
+					Ordering::Relaxed).is_ok() {
+					break seq;
+				}
+			};
+			atomic::fence(Ordering::Release);
+
+			f(unsafe {
+				&mut *self.data.get()
+			});
+
+			self.seq.store(seq.wrapping_add(2), Ordering::Release);
+		});
+	}
+}
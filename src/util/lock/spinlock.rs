@@ -3,6 +3,7 @@
 
 extern "C" {
 	pub fn spin_lock(lock: *mut i32);
+	pub fn spin_trylock(lock: *mut i32) -> i32;
 	pub fn spin_unlock(lock: *mut i32);
 }
 
@@ -43,6 +44,14 @@ impl Spinlock {
 		}
 	}
 
+	/// Wrapper for `spin_trylock`. Locks the spinlock if it isn't already locked, without
+	/// waiting. The function returns `true` if the spinlock has been locked.
+	pub fn try_lock(&mut self) -> bool {
+		unsafe {
+			spin_trylock(&mut self.locked) != 0
+		}
+	}
+
 	/// Wrapper for `spin_unlock`. Unlocks the spinlock.
 	pub unsafe fn unlock(&mut self) {
 		spin_unlock(&mut self.locked);
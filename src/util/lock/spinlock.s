@@ -1,4 +1,5 @@
 .global spin_lock
+.global spin_trylock
 .global spin_unlock
 
 /*
@@ -25,6 +26,26 @@ spin:
 	pop %ebp
 	ret
 
+/*
+ * Tries to lock the given spinlock without waiting. Returns 1 if the spinlock has been locked, 0 if it was already locked.
+ */
+spin_trylock:
+	push %ebp
+	mov %esp, %ebp
+
+	push %ebx
+	mov 8(%ebp), %ebx
+
+	mov $1, %eax
+	xchg %eax, (%ebx)
+	xor $1, %eax
+
+	pop %ebx
+
+	mov %ebp, %esp
+	pop %ebp
+	ret
+
 /*
  * Unlocks the given spinlock. Does nothing if the spinlock is already unlocked.
  */
@@ -6,10 +6,12 @@
 
 pub mod boxed;
 pub mod container;
+pub mod fixed_table;
 pub mod list;
 pub mod lock;
 pub mod math;
 pub mod ptr;
+pub mod rbtree;
 
 use core::str;
 use core::ffi::c_void;
@@ -89,6 +91,9 @@ macro_rules! register_get {
 }
 
 extern "C" {
+	/// Selects the implementation of the functions below according to the CPU's features.
+	pub fn libc_init();
+
 	pub fn memcpy(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
 	pub fn memmove(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
 	pub fn memcmp(s1: *const c_void, s2: *const c_void, n: usize) -> i32;
@@ -221,6 +226,10 @@ pub fn nbr_len(s: &[u8]) -> usize {
 #[cfg(test)]
 mod test {
 	use super::*;
+	use core::ptr;
+	use crate::memory::malloc;
+	use crate::selftest::Bench;
+	use crate::selftest::Bencher;
 
 	#[test_case]
 	fn memcpy0() {
@@ -291,7 +300,52 @@ mod test {
 		}
 	}
 
-	// TODO More tests on memmove
+	#[test_case]
+	fn memmove2() {
+		// Overlapping with the destination before the source, for every alignment and size
+		for off in 1..9 {
+			for len in 0..(64 - off) {
+				let mut buff: [u8; 64] = [0; 64];
+				for i in 0..64 {
+					buff[i] = i as u8;
+				}
+				unsafe {
+					memmove(buff.as_mut_ptr() as _, buff.as_ptr().add(off) as _, len);
+				}
+				for i in 0..len {
+					debug_assert_eq!(buff[i], (i + off) as u8);
+				}
+				for i in len..64 {
+					debug_assert_eq!(buff[i], i as u8);
+				}
+			}
+		}
+	}
+
+	#[test_case]
+	fn memmove3() {
+		// Overlapping with the destination after the source, which requires copying backward
+		for off in 1..9 {
+			for len in 0..(64 - off) {
+				let mut buff: [u8; 64] = [0; 64];
+				for i in 0..64 {
+					buff[i] = i as u8;
+				}
+				unsafe {
+					memmove(buff.as_mut_ptr().add(off) as _, buff.as_ptr() as _, len);
+				}
+				for i in 0..off {
+					debug_assert_eq!(buff[i], i as u8);
+				}
+				for i in 0..len {
+					debug_assert_eq!(buff[off + i], i as u8);
+				}
+				for i in (off + len)..64 {
+					debug_assert_eq!(buff[i], i as u8);
+				}
+			}
+		}
+	}
 
 	#[test_case]
 	fn memcmp0() {
@@ -323,12 +377,230 @@ mod test {
 		assert_eq!(val, 1);
 	}
 
-	// TODO More tests on memcmp
+	#[test_case]
+	fn memcmp2() {
+		let mut b0: [u8; 100] = [0; 100];
+		let mut b1: [u8; 100] = [0; 100];
 
-	// TODO Test `memset`
+		for i in 0..100 {
+			b0[i] = i as _;
+			b1[i] = i as _;
+		}
+		for off0 in 0..4 {
+			for off1 in 0..4 {
+				b1[off1 + 50] = 0xff;
+				let val = unsafe {
+					memcmp(b0.as_ptr().add(off0) as _, b1.as_ptr().add(off1) as _, 90)
+				};
+				b1[off1 + 50] = (off1 + 50) as _;
+
+				// Both areas are identical up to the modified byte only if the offsets match
+				if off0 == off1 {
+					assert_eq!(val, (off0 + 50) as i32 - 0xff);
+				} else {
+					assert_ne!(val, 0);
+				}
+			}
+		}
+	}
 
 	#[test_case]
-	fn memmove0() {
+	fn memset0() {
+		let mut buff: [u8; 100] = [0; 100];
+
+		unsafe {
+			memset(buff.as_mut_ptr().add(3) as _, 0xab, 90);
+		}
+		for i in 0..100 {
+			let expected = if (3..93).contains(&i) {
+				0xab
+			} else {
+				0
+			};
+			assert_eq!(buff[i], expected);
+		}
+	}
+
+	#[test_case]
+	fn memmove2() {
+		let mut buff: [u8; 100] = [0; 100];
+
+		for i in 0..100 {
+			buff[i] = i as _;
+		}
+		unsafe {
+			memmove(buff.as_mut_ptr().add(7) as _, buff.as_ptr().add(2) as _, 90);
+		}
+		for i in 0..90 {
+			assert_eq!(buff[7 + i], (2 + i) as u8);
+		}
+	}
+
+	extern "C" {
+		static libc_features: i32;
+
+		fn memcpy_movsd(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+		fn memcpy_movsb(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+		fn memcpy_nt(dest: *mut c_void, src: *const c_void, n: usize) -> *mut c_void;
+
+		fn memset_stosd(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+		fn memset_stosb(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+		fn memset_nt(s: *mut c_void, c: i32, n: usize) -> *mut c_void;
+	}
+
+	/// Feature flag telling whether the CPU supports SSE2. Must match the one in `libc.h`.
+	const LIBC_FEATURE_SSE2: i32 = 0b10;
+
+	/// A memory copy function.
+	type CopyFn = unsafe extern "C" fn(*mut c_void, *const c_void, usize) -> *mut c_void;
+	/// A memory fill function.
+	type FillFn = unsafe extern "C" fn(*mut c_void, i32, usize) -> *mut c_void;
+
+	/// Tells whether non-temporal variants can be used on the current CPU.
+	fn has_nt() -> bool {
+		unsafe {
+			libc_features & LIBC_FEATURE_SSE2 != 0
+		}
+	}
+
+	/// Returns the copy functions available on the current CPU, with their names.
+	fn copy_variants() -> [(&'static str, CopyFn, bool); 4] {
+		[
+			("memcpy", memcpy, true),
+			("movsd", memcpy_movsd, true),
+			("movsb", memcpy_movsb, true),
+			("nt", memcpy_nt, has_nt()),
+		]
+	}
+
+	/// Returns the fill functions available on the current CPU, with their names.
+	fn fill_variants() -> [(&'static str, FillFn, bool); 4] {
+		[
+			("memset", memset, true),
+			("stosd", memset_stosd, true),
+			("stosb", memset_stosb, true),
+			("nt", memset_nt, has_nt()),
+		]
+	}
+
+	/// The sizes used to test copy and fill functions.
+	const TEST_SIZES: [usize; 10] = [0, 1, 3, 4, 7, 63, 64, 4095, 4096, 4099];
+
+	#[test_case]
+	fn memcpy_variants() {
+		let mut src = malloc::Alloc::<u8>::new_default(4112).unwrap();
+		let mut dest = malloc::Alloc::<u8>::new_default(4112).unwrap();
+		for (i, b) in src.get_slice_mut().iter_mut().enumerate() {
+			*b = (i * 7) as _;
+		}
+
+		for (_, f, available) in copy_variants().iter() {
+			if !available {
+				continue;
+			}
+
+			for src_off in 0..4 {
+				for dest_off in 0..4 {
+					for n in TEST_SIZES.iter() {
+						for b in dest.get_slice_mut() {
+							*b = 0xff;
+						}
+						unsafe {
+							f(dest.as_ptr_mut().add(dest_off) as _,
+								src.as_ptr().add(src_off) as _, *n);
+						}
+
+						let d = dest.get_slice();
+						let s = src.get_slice();
+						for i in 0..4112 {
+							if i >= dest_off && i < dest_off + n {
+								assert_eq!(d[i], s[i - dest_off + src_off]);
+							} else {
+								assert_eq!(d[i], 0xff);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	#[test_case]
+	fn memset_variants() {
+		let mut buff = malloc::Alloc::<u8>::new_default(4112).unwrap();
+
+		for (_, f, available) in fill_variants().iter() {
+			if !available {
+				continue;
+			}
+
+			for off in 0..4 {
+				for n in TEST_SIZES.iter() {
+					for b in buff.get_slice_mut() {
+						*b = 0;
+					}
+					unsafe {
+						f(buff.as_ptr_mut().add(off) as _, 0x1ab, *n);
+					}
+
+					for (i, b) in buff.get_slice().iter().enumerate() {
+						if i >= off && i < off + n {
+							assert_eq!(*b, 0xab);
+						} else {
+							assert_eq!(*b, 0);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/// The sizes used for benchmarks.
+	const BENCH_SIZES: [usize; 3] = [64, 4096, 16384];
+
+	fn memcpy_bench(b: &mut Bencher) {
+		let max = BENCH_SIZES[BENCH_SIZES.len() - 1];
+		let src = malloc::Alloc::<u8>::new_default(max).unwrap();
+		let mut dest = malloc::Alloc::<u8>::new_default(max).unwrap();
+
+		for (name, f, available) in copy_variants().iter() {
+			if !available {
+				continue;
+			}
+
+			for n in BENCH_SIZES.iter() {
+				b.iter_param(format_args!("{}/{}", name, n), || unsafe {
+					f(dest.as_ptr_mut() as _, src.as_ptr() as _, *n);
+				});
+			}
+		}
+	}
+
+	#[test_case]
+	static MEMCPY_BENCH: Bench = Bench::new("memcpy", memcpy_bench);
+
+	fn memset_bench(b: &mut Bencher) {
+		let max = BENCH_SIZES[BENCH_SIZES.len() - 1];
+		let mut buff = malloc::Alloc::<u8>::new_default(max).unwrap();
+
+		for (name, f, available) in fill_variants().iter() {
+			if !available {
+				continue;
+			}
+
+			for n in BENCH_SIZES.iter() {
+				b.iter_param(format_args!("{}/{}", name, n), || unsafe {
+					f(buff.as_ptr_mut() as _, 0, *n);
+				});
+			}
+		}
+	}
+
+	#[test_case]
+	static MEMSET_BENCH: Bench = Bench::new("memset", memset_bench);
+
+	#[test_case]
+	fn bzero0() {
 		let mut buff: [usize; 100] = [0; 100];
 
 		for i in 0..100 {
@@ -342,7 +614,89 @@ mod test {
 		}
 	}
 
-	// TODO More tests on memmove
+	#[test_case]
+	fn strlen0() {
+		let mut buff: [u8; 100] = [b'a'; 100];
+
+		for off in 0..4 {
+			for len in 0..(96 - off) {
+				buff[off + len] = 0;
+				let val = unsafe {
+					strlen(buff.as_ptr().add(off) as _)
+				};
+				buff[off + len] = b'a';
+
+				assert_eq!(val, len);
+			}
+		}
+	}
+
+	/// Byte-wise implementation of `memcmp`, used as a reference for benchmarks.
+	fn memcmp_bytewise(s1: *const u8, s2: *const u8, n: usize) -> i32 {
+		for i in 0..n {
+			let (a, b) = unsafe {
+				(ptr::read_volatile(s1.add(i)), ptr::read_volatile(s2.add(i)))
+			};
+			if a != b {
+				return a as i32 - b as i32;
+			}
+		}
+
+		0
+	}
+
+	/// Byte-wise implementation of `strlen`, used as a reference for benchmarks.
+	fn strlen_bytewise(s: *const u8) -> usize {
+		let mut i = 0;
+		while unsafe {
+			ptr::read_volatile(s.add(i))
+		} != 0 {
+			i += 1;
+		}
+
+		i
+	}
+
+	fn memcmp_bench(b: &mut Bencher) {
+		let max = BENCH_SIZES[BENCH_SIZES.len() - 1];
+		let s1 = malloc::Alloc::<u8>::new_default(max).unwrap();
+		let s2 = malloc::Alloc::<u8>::new_default(max).unwrap();
+
+		for n in BENCH_SIZES.iter() {
+			b.iter_param(format_args!("word/{}", n), || unsafe {
+				memcmp(s1.as_ptr() as _, s2.as_ptr() as _, *n);
+			});
+			b.iter_param(format_args!("bytewise/{}", n), || {
+				memcmp_bytewise(s1.as_ptr(), s2.as_ptr(), *n);
+			});
+		}
+	}
+
+	#[test_case]
+	static MEMCMP_BENCH: Bench = Bench::new("memcmp", memcmp_bench);
+
+	fn strlen_bench(b: &mut Bencher) {
+		let max = BENCH_SIZES[BENCH_SIZES.len() - 1];
+		let mut s = malloc::Alloc::<u8>::new_default(max + 1).unwrap();
+
+		for n in BENCH_SIZES.iter() {
+			for (i, c) in s.get_slice_mut().iter_mut().enumerate() {
+				*c = if i < *n {
+					b'a'
+				} else {
+					0
+				};
+			}
 
-	// TODO Test `strlen`
+			b.iter_param(format_args!("word/{}", n), || unsafe {
+				strlen(s.as_ptr() as _);
+			});
+			b.iter_param(format_args!("bytewise/{}", n), || {
+				strlen_bytewise(s.as_ptr());
+			});
+		}
+	}
+
+	#[test_case]
+	static STRLEN_BENCH: Bench = Bench::new("strlen", strlen_bench);
 }
@@ -0,0 +1,1161 @@
+//! This module implements an intrusive red-black tree.
+//!
+//! Unlike `BinaryTree`, this tree doesn't allocate memory: each element embeds an `RBNode` which
+//! links it into the tree. Like `List`, the elements are NOT owned by the container, meaning that
+//! an element must be removed from the tree before being dropped or moved.
+//!
+//! Elements may maintain augmented data, which summarizes their subtree (for example, the size of
+//! the largest memory gap in it). The tree keeps it up to date through `RBElement::augment` each
+//! time the shape of a subtree changes, which allows to prune searches with `find_first`.
+
+use core::marker::PhantomData;
+use core::ops::Bound;
+use core::ops::RangeBounds;
+use core::ptr::NonNull;
+
+/// Type representing a link to a node.
+type Link = Option<NonNull<RBNode>>;
+
+/// The color of a tree node.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+enum NodeColor {
+	Red,
+	Black,
+}
+
+/// Trait for structures that can be stored into an RBTree.
+pub trait RBElement {
+	/// The type of the key by which elements are sorted.
+	type Key: Ord;
+
+	/// Tells whether the element has augmented data to be maintained by the tree. If false,
+	/// `augment` is never called.
+	const AUGMENTED: bool = false;
+
+	/// Returns the key of the element.
+	fn get_key(&self) -> Self::Key;
+
+	/// Recomputes the augmented data of the element from its children `left` and `right`. The
+	/// children's augmented data are always up to date when this function is called.
+	fn augment(&mut self, _left: Option<&Self>, _right: Option<&Self>) {}
+}
+
+/// A node of an RBTree. This structure is meant to be used inside of the structure to be stored
+/// in the tree.
+#[derive(Debug)]
+pub struct RBNode {
+	/// Pointer to the parent node
+	parent: Link,
+	/// Pointer to the left child
+	left: Link,
+	/// Pointer to the right child
+	right: Link,
+	/// The color of the node
+	color: NodeColor,
+}
+
+impl RBNode {
+	/// Creates a node which isn't linked to any tree.
+	pub const fn new() -> Self {
+		Self {
+			parent: None,
+			left: None,
+			right: None,
+			color: NodeColor::Red,
+		}
+	}
+}
+
+/// Returns a mutable reference to the given node.
+#[inline]
+unsafe fn node<'a>(n: NonNull<RBNode>) -> &'a mut RBNode {
+	&mut *n.as_ptr()
+}
+
+/// Tells whether the given link points to a red node. Empty links are black.
+#[inline]
+fn is_red(n: Link) -> bool {
+	n.map_or(false, | n | unsafe {
+		node(n)
+	}.color == NodeColor::Red)
+}
+
+/// Returns the leftmost node of the subtree with root `n`.
+unsafe fn leftmost(mut n: NonNull<RBNode>) -> NonNull<RBNode> {
+	while let Some(l) = node(n).left {
+		n = l;
+	}
+	n
+}
+
+/// Returns the rightmost node of the subtree with root `n`.
+unsafe fn rightmost(mut n: NonNull<RBNode>) -> NonNull<RBNode> {
+	while let Some(r) = node(n).right {
+		n = r;
+	}
+	n
+}
+
+/// Returns the node following `n` in order.
+unsafe fn next_node(n: NonNull<RBNode>) -> Link {
+	if let Some(r) = node(n).right {
+		return Some(leftmost(r));
+	}
+
+	let mut n = n;
+	while let Some(p) = node(n).parent {
+		if node(p).left == Some(n) {
+			return Some(p);
+		}
+		n = p;
+	}
+	None
+}
+
+/// Returns the node preceding `n` in order.
+unsafe fn prev_node(n: NonNull<RBNode>) -> Link {
+	if let Some(l) = node(n).left {
+		return Some(rightmost(l));
+	}
+
+	let mut n = n;
+	while let Some(p) = node(n).parent {
+		if node(p).right == Some(n) {
+			return Some(p);
+		}
+		n = p;
+	}
+	None
+}
+
+/// An intrusive red-black tree. Operations on the tree never allocate memory.
+pub struct RBTree<T: RBElement> {
+	/// The root node of the tree.
+	root: Link,
+	/// The number of elements in the tree.
+	len: usize,
+	/// The offset of the node in the elements stored by the tree.
+	inner_offset: usize,
+
+	/// Phantom data to be able to keep the type `T`
+	_phantom: PhantomData<T>,
+}
+
+impl<T: RBElement> RBTree<T> {
+	/// Creates a new tree with the given inner offset. This function should not be called
+	/// directly but only through the dedicated macro `rbtree_new`.
+	pub const fn new(inner_offset: usize) -> Self {
+		Self {
+			root: None,
+			len: 0,
+			inner_offset,
+
+			_phantom: PhantomData::<T>,
+		}
+	}
+
+	/// Tells whether the tree is empty.
+	#[inline]
+	pub fn is_empty(&self) -> bool {
+		self.root.is_none()
+	}
+
+	/// Returns the number of elements in the tree.
+	#[inline]
+	pub fn len(&self) -> usize {
+		self.len
+	}
+
+	/// Returns the element storing the node `n`.
+	#[inline]
+	unsafe fn elem<'a>(&self, n: NonNull<RBNode>) -> &'a mut T {
+		&mut *((n.as_ptr() as usize - self.inner_offset) as *mut T)
+	}
+
+	/// Returns the node stored in the element `elem`.
+	#[inline]
+	fn node_of(&self, elem: &T) -> NonNull<RBNode> {
+		NonNull::new((elem as *const T as usize + self.inner_offset) as *mut RBNode).unwrap()
+	}
+
+	/// Recomputes the augmented data of the node `n`.
+	unsafe fn augment_node(&self, n: NonNull<RBNode>) {
+		let left = node(n).left.map(| l | &*self.elem(l));
+		let right = node(n).right.map(| r | &*self.elem(r));
+		self.elem(n).augment(left, right);
+	}
+
+	/// Recomputes the augmented data of every node from `n` up to the root.
+	unsafe fn propagate(&self, mut n: Link) {
+		if !T::AUGMENTED {
+			return;
+		}
+
+		while let Some(curr) = n {
+			self.augment_node(curr);
+			n = node(curr).parent;
+		}
+	}
+
+	/// Replaces the child `old` of node `parent` with `new`. If `parent` is None, `new` becomes
+	/// the root.
+	unsafe fn replace_child(&mut self, parent: Link, old: NonNull<RBNode>, new: Link) {
+		match parent {
+			Some(p) if node(p).left == Some(old) => node(p).left = new,
+			Some(p) => node(p).right = new,
+			None => self.root = new,
+		}
+	}
+
+	/// Puts the subtree `new` at the place of the subtree with root `old`.
+	unsafe fn transplant(&mut self, old: NonNull<RBNode>, new: Link) {
+		let parent = node(old).parent;
+		self.replace_child(parent, old, new);
+		if let Some(new) = new {
+			node(new).parent = parent;
+		}
+	}
+
+	/// Applies a left rotation with `n` as root. `n` must have a right child.
+	unsafe fn rotate_left(&mut self, n: NonNull<RBNode>) {
+		let pivot = node(n).right.unwrap();
+
+		node(n).right = node(pivot).left;
+		if let Some(l) = node(pivot).left {
+			node(l).parent = Some(n);
+		}
+		self.transplant(n, Some(pivot));
+		node(pivot).left = Some(n);
+		node(n).parent = Some(pivot);
+
+		if T::AUGMENTED {
+			self.augment_node(n);
+			self.augment_node(pivot);
+		}
+	}
+
+	/// Applies a right rotation with `n` as root. `n` must have a left child.
+	unsafe fn rotate_right(&mut self, n: NonNull<RBNode>) {
+		let pivot = node(n).left.unwrap();
+
+		node(n).left = node(pivot).right;
+		if let Some(r) = node(pivot).right {
+			node(r).parent = Some(n);
+		}
+		self.transplant(n, Some(pivot));
+		node(pivot).right = Some(n);
+		node(n).parent = Some(pivot);
+
+		if T::AUGMENTED {
+			self.augment_node(n);
+			self.augment_node(pivot);
+		}
+	}
+
+	/// Inserts the given element into the tree. Elements with equal keys are kept in insertion
+	/// order. The element must not be linked to any tree.
+	pub fn insert(&mut self, elem: &mut T) {
+		let n = self.node_of(elem);
+		let key = elem.get_key();
+
+		unsafe {
+			let mut parent = None;
+			let mut left = false;
+			let mut curr = self.root;
+			while let Some(c) = curr {
+				parent = Some(c);
+				left = key < self.elem(c).get_key();
+				curr = if left {
+					node(c).left
+				} else {
+					node(c).right
+				};
+			}
+
+			*node(n) = RBNode {
+				parent,
+				left: None,
+				right: None,
+				color: NodeColor::Red,
+			};
+			match parent {
+				Some(p) if left => node(p).left = Some(n),
+				Some(p) => node(p).right = Some(n),
+				None => self.root = Some(n),
+			}
+			self.len += 1;
+
+			self.propagate(Some(n));
+			self.insert_fixup(n);
+		}
+
+		#[cfg(config_debug_debug)]
+		self.check();
+	}
+
+	/// Restores the red-black properties after the insertion of node `n`.
+	unsafe fn insert_fixup(&mut self, mut n: NonNull<RBNode>) {
+		while let Some(parent) = node(n).parent {
+			if node(parent).color == NodeColor::Black {
+				break;
+			}
+			// The parent is red, thus it cannot be the root
+			let grandparent = node(parent).parent.unwrap();
+			let parent_is_left = node(grandparent).left == Some(parent);
+			let uncle = if parent_is_left {
+				node(grandparent).right
+			} else {
+				node(grandparent).left
+			};
+
+			if is_red(uncle) {
+				node(parent).color = NodeColor::Black;
+				node(uncle.unwrap()).color = NodeColor::Black;
+				node(grandparent).color = NodeColor::Red;
+				n = grandparent;
+				continue;
+			}
+
+			if parent_is_left {
+				if node(parent).right == Some(n) {
+					n = parent;
+					self.rotate_left(n);
+				}
+			} else if node(parent).left == Some(n) {
+				n = parent;
+				self.rotate_right(n);
+			}
+
+			let parent = node(n).parent.unwrap();
+			node(parent).color = NodeColor::Black;
+			node(grandparent).color = NodeColor::Red;
+			if parent_is_left {
+				self.rotate_right(grandparent);
+			} else {
+				self.rotate_left(grandparent);
+			}
+		}
+
+		node(self.root.unwrap()).color = NodeColor::Black;
+	}
+
+	/// Removes the given element from the tree. The element must be linked to this tree.
+	pub fn remove(&mut self, elem: &mut T) {
+		let n = self.node_of(elem);
+
+		unsafe {
+			let (left, right) = (node(n).left, node(n).right);
+			// The node taking the place of the removed one and its parent
+			let (child, child_parent, removed_color) = match (left, right) {
+				(Some(left), Some(right)) => {
+					// Replacing the node with its successor
+					let succ = leftmost(right);
+					let succ_color = node(succ).color;
+					let child = node(succ).right;
+
+					let child_parent = if node(succ).parent == Some(n) {
+						succ
+					} else {
+						let p = node(succ).parent;
+						self.transplant(succ, child);
+						node(succ).right = Some(right);
+						node(right).parent = Some(succ);
+						p.unwrap()
+					};
+
+					self.transplant(n, Some(succ));
+					node(succ).left = Some(left);
+					node(left).parent = Some(succ);
+					node(succ).color = node(n).color;
+
+					(child, Some(child_parent), succ_color)
+				},
+
+				_ => {
+					let child = left.or(right);
+					let parent = node(n).parent;
+					self.transplant(n, child);
+
+					(child, parent, node(n).color)
+				},
+			};
+
+			*node(n) = RBNode::new();
+			self.len -= 1;
+
+			// Every node whose subtree changed is an ancestor of `child_parent`
+			self.propagate(child_parent);
+			if removed_color == NodeColor::Black {
+				self.remove_fixup(child, child_parent);
+			}
+		}
+
+		#[cfg(config_debug_debug)]
+		self.check();
+	}
+
+	/// Restores the red-black properties after a removal. `n` is the node which took the place
+	/// of the removed black node, and `parent` is its parent.
+	unsafe fn remove_fixup(&mut self, mut n: Link, mut parent: Link) {
+		while n != self.root && !is_red(n) {
+			let p = match parent {
+				Some(p) => p,
+				None => break,
+			};
+
+			// Since the removed node was black, the sibling cannot be empty
+			if node(p).left == n {
+				let mut sibling = node(p).right.unwrap();
+				if node(sibling).color == NodeColor::Red {
+					node(sibling).color = NodeColor::Black;
+					node(p).color = NodeColor::Red;
+					self.rotate_left(p);
+					sibling = node(p).right.unwrap();
+				}
+
+				if !is_red(node(sibling).left) && !is_red(node(sibling).right) {
+					node(sibling).color = NodeColor::Red;
+					n = Some(p);
+					parent = node(p).parent;
+				} else {
+					if !is_red(node(sibling).right) {
+						node(node(sibling).left.unwrap()).color = NodeColor::Black;
+						node(sibling).color = NodeColor::Red;
+						self.rotate_right(sibling);
+						sibling = node(p).right.unwrap();
+					}
+
+					node(sibling).color = node(p).color;
+					node(p).color = NodeColor::Black;
+					node(node(sibling).right.unwrap()).color = NodeColor::Black;
+					self.rotate_left(p);
+					n = self.root;
+				}
+			} else {
+				let mut sibling = node(p).left.unwrap();
+				if node(sibling).color == NodeColor::Red {
+					node(sibling).color = NodeColor::Black;
+					node(p).color = NodeColor::Red;
+					self.rotate_right(p);
+					sibling = node(p).left.unwrap();
+				}
+
+				if !is_red(node(sibling).left) && !is_red(node(sibling).right) {
+					node(sibling).color = NodeColor::Red;
+					n = Some(p);
+					parent = node(p).parent;
+				} else {
+					if !is_red(node(sibling).left) {
+						node(node(sibling).right.unwrap()).color = NodeColor::Black;
+						node(sibling).color = NodeColor::Red;
+						self.rotate_left(sibling);
+						sibling = node(p).left.unwrap();
+					}
+
+					node(sibling).color = node(p).color;
+					node(p).color = NodeColor::Black;
+					node(node(sibling).left.unwrap()).color = NodeColor::Black;
+					self.rotate_right(p);
+					n = self.root;
+				}
+			}
+		}
+
+		if let Some(n) = n {
+			node(n).color = NodeColor::Black;
+		}
+	}
+
+	/// Searches for an element with the given key.
+	fn get_node(&self, key: &T::Key) -> Link {
+		let mut curr = self.root;
+		while let Some(c) = curr {
+			let k = unsafe {
+				self.elem(c)
+			}.get_key();
+
+			curr = if *key < k {
+				unsafe {
+					node(c).left
+				}
+			} else if *key > k {
+				unsafe {
+					node(c).right
+				}
+			} else {
+				return Some(c);
+			};
+		}
+
+		None
+	}
+
+	/// Searches for an element with the given key and returns a reference.
+	pub fn get(&self, key: &T::Key) -> Option<&T> {
+		Some(unsafe {
+			self.elem(self.get_node(key)?)
+		})
+	}
+
+	/// Searches for an element with the given key and returns a mutable reference.
+	pub fn get_mut(&mut self, key: &T::Key) -> Option<&mut T> {
+		Some(unsafe {
+			self.elem(self.get_node(key)?)
+		})
+	}
+
+	/// Returns the first node whose key is greater than `key`, or greater or equal if `strict` is
+	/// false.
+	fn bound_node(&self, key: &T::Key, strict: bool) -> Link {
+		let mut result = None;
+		let mut curr = self.root;
+
+		while let Some(c) = curr {
+			let k = unsafe {
+				self.elem(c)
+			}.get_key();
+			let after = if strict {
+				k > *key
+			} else {
+				k >= *key
+			};
+
+			curr = if after {
+				result = Some(c);
+				unsafe {
+					node(c).left
+				}
+			} else {
+				unsafe {
+					node(c).right
+				}
+			};
+		}
+
+		result
+	}
+
+	/// Returns the first node in order.
+	fn first_node(&self) -> Link {
+		Some(unsafe {
+			leftmost(self.root?)
+		})
+	}
+
+	/// Returns the last node in order.
+	fn last_node(&self) -> Link {
+		Some(unsafe {
+			rightmost(self.root?)
+		})
+	}
+
+	/// Returns a reference to the element with the lowest key.
+	pub fn first(&self) -> Option<&T> {
+		Some(unsafe {
+			self.elem(self.first_node()?)
+		})
+	}
+
+	/// Returns a reference to the element with the greatest key.
+	pub fn last(&self) -> Option<&T> {
+		Some(unsafe {
+			self.elem(self.last_node()?)
+		})
+	}
+
+	/// Returns a cursor on the element with the lowest key.
+	pub fn cursor_front(&self) -> Cursor<'_, T> {
+		Cursor {
+			node: self.first_node(),
+			tree: self,
+		}
+	}
+
+	/// Same as `cursor_front`, except the cursor allows to modify the elements.
+	pub fn cursor_front_mut(&mut self) -> CursorMut<'_, T> {
+		CursorMut {
+			node: self.first_node(),
+			tree: self,
+		}
+	}
+
+	/// Returns a cursor on the first element whose key is greater or equal to `key`.
+	pub fn lower_bound(&self, key: &T::Key) -> Cursor<'_, T> {
+		Cursor {
+			node: self.bound_node(key, false),
+			tree: self,
+		}
+	}
+
+	/// Returns a cursor on the first element whose key is greater than `key`.
+	pub fn upper_bound(&self, key: &T::Key) -> Cursor<'_, T> {
+		Cursor {
+			node: self.bound_node(key, true),
+			tree: self,
+		}
+	}
+
+	/// Same as `lower_bound`, except the cursor allows to modify the elements.
+	pub fn lower_bound_mut(&mut self, key: &T::Key) -> CursorMut<'_, T> {
+		CursorMut {
+			node: self.bound_node(key, false),
+			tree: self,
+		}
+	}
+
+	/// Same as `upper_bound`, except the cursor allows to modify the elements.
+	pub fn upper_bound_mut(&mut self, key: &T::Key) -> CursorMut<'_, T> {
+		CursorMut {
+			node: self.bound_node(key, true),
+			tree: self,
+		}
+	}
+
+	/// Returns the first and past-the-end nodes of the given range.
+	fn range_nodes<R: RangeBounds<T::Key>>(&self, range: R) -> (Link, Link) {
+		let begin = match range.start_bound() {
+			Bound::Included(k) => self.bound_node(k, false),
+			Bound::Excluded(k) => self.bound_node(k, true),
+			Bound::Unbounded => self.first_node(),
+		};
+		let end = match range.end_bound() {
+			Bound::Included(k) => self.bound_node(k, true),
+			Bound::Excluded(k) => self.bound_node(k, false),
+			Bound::Unbounded => None,
+		};
+
+		// If the range is empty, `end` may be located before `begin`
+		let empty = match (begin, end) {
+			(None, _) => true,
+			(Some(b), Some(e)) => unsafe {
+				self.elem(b).get_key() >= self.elem(e).get_key()
+			},
+			_ => false,
+		};
+		if empty {
+			(None, None)
+		} else {
+			(begin, end)
+		}
+	}
+
+	/// Returns an iterator over the elements whose keys are in the given range, in order.
+	pub fn range<R: RangeBounds<T::Key>>(&self, range: R) -> RBTreeIterator<'_, T> {
+		let (node, end) = self.range_nodes(range);
+		RBTreeIterator {
+			tree: self,
+			node,
+			end,
+		}
+	}
+
+	/// Same as `range`, except the iterator allows to modify the elements.
+	pub fn range_mut<R: RangeBounds<T::Key>>(&mut self, range: R) -> RBTreeMutIterator<'_, T> {
+		let (node, end) = self.range_nodes(range);
+		RBTreeMutIterator {
+			tree: self,
+			node,
+			end,
+		}
+	}
+
+	/// Returns an iterator over every elements of the tree, in order.
+	pub fn iter(&self) -> RBTreeIterator<'_, T> {
+		self.range(..)
+	}
+
+	/// Same as `iter`, except the iterator allows to modify the elements.
+	pub fn iter_mut(&mut self) -> RBTreeMutIterator<'_, T> {
+		self.range_mut(..)
+	}
+
+	/// Searches for the first element in order for which `pred` returns true.
+	/// `subtree` tells, from the augmented data of an element, whether its subtree contains at
+	/// least one element matching `pred`. This allows to search in logarithmic time.
+	fn find_first_node<S, P>(&self, subtree: S, pred: P) -> Link
+		where S: Fn(&T) -> bool, P: Fn(&T) -> bool {
+		let mut n = self.root?;
+		if !subtree(unsafe {
+			self.elem(n)
+		}) {
+			return None;
+		}
+
+		loop {
+			unsafe {
+				match node(n).left {
+					Some(l) if subtree(self.elem(l)) => n = l,
+
+					_ if pred(self.elem(n)) => return Some(n),
+
+					_ => match node(n).right {
+						Some(r) if subtree(self.elem(r)) => n = r,
+						_ => return None,
+					},
+				}
+			}
+		}
+	}
+
+	/// Returns a cursor on the first element in order for which `pred` returns true. See
+	/// `find_first_node` for the meaning of `subtree`.
+	pub fn find_first<S, P>(&self, subtree: S, pred: P) -> Cursor<'_, T>
+		where S: Fn(&T) -> bool, P: Fn(&T) -> bool {
+		Cursor {
+			node: self.find_first_node(subtree, pred),
+			tree: self,
+		}
+	}
+
+	/// Same as `find_first`, except the cursor allows to modify the elements.
+	pub fn find_first_mut<S, P>(&mut self, subtree: S, pred: P) -> CursorMut<'_, T>
+		where S: Fn(&T) -> bool, P: Fn(&T) -> bool {
+		CursorMut {
+			node: self.find_first_node(subtree, pred),
+			tree: self,
+		}
+	}
+
+	/// Checks the integrity of the subtree with root `n` and returns its black height.
+	#[cfg(any(test, config_debug_debug))]
+	fn check_node(&self, n: NonNull<RBNode>) -> usize {
+		unsafe {
+			let black_height = | c: Link | {
+				if let Some(c) = c {
+					assert_eq!(node(c).parent, Some(n));
+					if node(n).color == NodeColor::Red {
+						assert_eq!(node(c).color, NodeColor::Black);
+					}
+
+					self.check_node(c)
+				} else {
+					1
+				}
+			};
+
+			if let Some(l) = node(n).left {
+				assert!(self.elem(l).get_key() <= self.elem(n).get_key());
+			}
+			if let Some(r) = node(n).right {
+				assert!(self.elem(r).get_key() >= self.elem(n).get_key());
+			}
+
+			let left = black_height(node(n).left);
+			let right = black_height(node(n).right);
+			assert_eq!(left, right);
+
+			if node(n).color == NodeColor::Black {
+				left + 1
+			} else {
+				left
+			}
+		}
+	}
+
+	/// Checks the integrity of the tree. If the tree is invalid, the function makes the kernel
+	/// panic. This function is available only in debug mode.
+	#[cfg(any(test, config_debug_debug))]
+	pub fn check(&self) {
+		if let Some(root) = self.root {
+			unsafe {
+				assert!(node(root).parent.is_none());
+				assert_eq!(node(root).color, NodeColor::Black);
+			}
+			self.check_node(root);
+		}
+	}
+}
+
+/// Creates a new RBTree object for the given type and field.
+/// If the parameter `field` is not the name of a field of type RBNode, the behaviour is
+/// undefined.
+#[macro_export]
+macro_rules! rbtree_new {
+	($type:ty, $field:ident) => {
+		crate::util::rbtree::RBTree::<$type>::new(crate::offset_of!($type, $field))
+	}
+}
+
+/// A cursor pointing to an element of an RBTree, or past the end of it. The past-the-end
+/// position sits between the last and the first elements.
+pub struct Cursor<'a, T: RBElement> {
+	/// The tree.
+	tree: &'a RBTree<T>,
+	/// The current node. If None, the cursor is past the end of the tree.
+	node: Link,
+}
+
+impl<'a, T: RBElement> Cursor<'a, T> {
+	/// Returns a reference to the element at the cursor's position.
+	pub fn get(&self) -> Option<&'a T> {
+		Some(unsafe {
+			self.tree.elem(self.node?)
+		})
+	}
+
+	/// Moves the cursor to the next element.
+	pub fn move_next(&mut self) {
+		self.node = match self.node {
+			Some(n) => unsafe {
+				next_node(n)
+			},
+			None => self.tree.first_node(),
+		};
+	}
+
+	/// Moves the cursor to the previous element.
+	pub fn move_prev(&mut self) {
+		self.node = match self.node {
+			Some(n) => unsafe {
+				prev_node(n)
+			},
+			None => self.tree.last_node(),
+		};
+	}
+}
+
+/// Same as `Cursor`, except the cursor allows to modify the elements.
+pub struct CursorMut<'a, T: RBElement> {
+	/// The tree.
+	tree: &'a mut RBTree<T>,
+	/// The current node. If None, the cursor is past the end of the tree.
+	node: Link,
+}
+
+impl<'a, T: RBElement> CursorMut<'a, T> {
+	/// Returns a reference to the element at the cursor's position.
+	pub fn get(&self) -> Option<&T> {
+		Some(unsafe {
+			self.tree.elem(self.node?)
+		})
+	}
+
+	/// Returns a mutable reference to the element at the cursor's position.
+	pub fn get_mut(&mut self) -> Option<&mut T> {
+		Some(unsafe {
+			self.tree.elem(self.node?)
+		})
+	}
+
+	/// Consumes the cursor and returns a mutable reference to the element at its position.
+	pub fn into_mut(self) -> Option<&'a mut T> {
+		Some(unsafe {
+			self.tree.elem(self.node?)
+		})
+	}
+
+	/// Updates the augmented data of the tree after the element at the cursor's position has
+	/// been modified.
+	/// The key of the element may be modified as long as its order relative to the other
+	/// elements stays the same.
+	pub fn update(&mut self) {
+		if let Some(n) = self.node {
+			unsafe {
+				let key = self.tree.elem(n).get_key();
+				debug_assert!(prev_node(n).map_or(true, | p | self.tree.elem(p).get_key() <= key));
+				debug_assert!(next_node(n).map_or(true, | n | self.tree.elem(n).get_key() >= key));
+
+				self.tree.propagate(Some(n));
+			}
+		}
+	}
+
+	/// Removes the element at the cursor's position from the tree, then moves the cursor to the
+	/// next element. The function returns the removed element.
+	pub fn remove(&mut self) -> Option<&'a mut T> {
+		let n = self.node?;
+
+		unsafe {
+			self.node = next_node(n);
+			let elem = self.tree.elem(n);
+			self.tree.remove(elem);
+			Some(elem)
+		}
+	}
+
+	/// Moves the cursor to the next element.
+	pub fn move_next(&mut self) {
+		self.node = match self.node {
+			Some(n) => unsafe {
+				next_node(n)
+			},
+			None => self.tree.first_node(),
+		};
+	}
+
+	/// Moves the cursor to the previous element.
+	pub fn move_prev(&mut self) {
+		self.node = match self.node {
+			Some(n) => unsafe {
+				prev_node(n)
+			},
+			None => self.tree.last_node(),
+		};
+	}
+}
+
+/// An iterator over a range of an RBTree, in order.
+pub struct RBTreeIterator<'a, T: RBElement> {
+	/// The tree to iterate into.
+	tree: &'a RBTree<T>,
+	/// The next node to be returned.
+	node: Link,
+	/// The node past the end of the range.
+	end: Link,
+}
+
+impl<'a, T: RBElement> Iterator for RBTreeIterator<'a, T> {
+	type Item = &'a T;
+
+	fn next(&mut self) -> Option<Self::Item> {
+		let n = self.node?;
+		if self.node == self.end {
+			return None;
+		}
+
+		unsafe {
+			self.node = next_node(n);
+			Some(self.tree.elem(n))
+		}
+	}
+}
+
+/// Same as `RBTreeIterator`, except the iterator allows to modify the elements.
+pub struct RBTreeMutIterator<'a, T: RBElement> {
+	/// The tree to iterate into.
+	tree: &'a mut RBTree<T>,
+	/// The next node to be returned.
+	node: Link,
+	/// The node past the end of the range.
+	end: Link,
+}
+
+impl<'a, T: RBElement> Iterator for RBTreeMutIterator<'a, T> {
+	type Item = &'a mut T;
+
+	fn next(&mut self) -> Option<Self::Item> {
+		let n = self.node?;
+		if self.node == self.end {
+			return None;
+		}
+
+		unsafe {
+			self.node = next_node(n);
+			Some(self.tree.elem(n))
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use crate::util::container::vec::Vec;
+	use crate::util::math;
+
+	/// An element for testing, with the maximum value of its subtree as augmented data.
+	struct Elem {
+		key: u32,
+		value: u32,
+		max_value: u32,
+
+		node: RBNode,
+	}
+
+	impl Elem {
+		fn new(key: u32, value: u32) -> Self {
+			Self {
+				key,
+				value,
+				max_value: value,
+
+				node: RBNode::new(),
+			}
+		}
+	}
+
+	impl RBElement for Elem {
+		type Key = u32;
+
+		const AUGMENTED: bool = true;
+
+		fn get_key(&self) -> u32 {
+			self.key
+		}
+
+		fn augment(&mut self, left: Option<&Self>, right: Option<&Self>) {
+			self.max_value = self.value;
+			for c in left.iter().chain(right.iter()) {
+				self.max_value = self.max_value.max(c.max_value);
+			}
+		}
+	}
+
+	/// Creates elements with pseudo-random keys and values. The vector must not be reallocated
+	/// once elements are inserted in a tree.
+	fn create_elems(count: usize) -> Vec<Elem> {
+		let mut elems = Vec::with_capacity(count).unwrap();
+		let mut val = 0;
+		for _ in 0..count {
+			val = math::pseudo_rand(val, 1664525, 1013904223, 0x1000);
+			elems.push(Elem::new(val, val % 97)).unwrap();
+		}
+		elems
+	}
+
+	/// Checks that the augmented data of every element in the subtree `n` is correct, and
+	/// returns the maximum value of the subtree.
+	fn check_augment_node(tree: &RBTree<Elem>, n: Link) -> u32 {
+		if let Some(n) = n {
+			unsafe {
+				let left = check_augment_node(tree, node(n).left);
+				let right = check_augment_node(tree, node(n).right);
+
+				let e = tree.elem(n);
+				let max = e.value.max(left).max(right);
+				assert_eq!(e.max_value, max);
+				max
+			}
+		} else {
+			0
+		}
+	}
+
+	/// Checks the integrity of the tree, including augmented data.
+	fn check_augment(tree: &RBTree<Elem>) {
+		tree.check();
+		check_augment_node(tree, tree.root);
+	}
+
+	#[test_case]
+	fn rbtree_insert0() {
+		let mut tree = crate::rbtree_new!(Elem, node);
+		assert!(tree.is_empty());
+		assert!(tree.first().is_none());
+
+		let mut elems = create_elems(100);
+		for e in elems.as_mut_slice() {
+			tree.insert(e);
+			tree.check();
+		}
+		assert_eq!(tree.len(), 100);
+
+		for e in elems.iter() {
+			assert_eq!(tree.get(&e.key).unwrap().key, e.key);
+		}
+
+		let mut prev = 0;
+		for e in tree.iter() {
+			assert!(e.key >= prev);
+			prev = e.key;
+		}
+		assert_eq!(tree.iter().count(), 100);
+		check_augment(&tree);
+	}
+
+	#[test_case]
+	fn rbtree_remove0() {
+		let mut tree = crate::rbtree_new!(Elem, node);
+		let mut elems = create_elems(100);
+		for e in elems.as_mut_slice() {
+			tree.insert(e);
+		}
+
+		for (i, e) in elems.as_mut_slice().iter_mut().enumerate() {
+			tree.remove(e);
+			tree.check();
+			check_augment(&tree);
+			assert_eq!(tree.len(), 99 - i);
+		}
+		assert!(tree.is_empty());
+	}
+
+	#[test_case]
+	fn rbtree_bounds0() {
+		let mut tree = crate::rbtree_new!(Elem, node);
+		let mut elems = Vec::with_capacity(10).unwrap();
+		for i in 0..10 {
+			elems.push(Elem::new(i * 10, i)).unwrap();
+		}
+		for e in elems.as_mut_slice() {
+			tree.insert(e);
+		}
+
+		assert_eq!(tree.lower_bound(&20).get().unwrap().key, 20);
+		assert_eq!(tree.lower_bound(&21).get().unwrap().key, 30);
+		assert_eq!(tree.upper_bound(&20).get().unwrap().key, 30);
+		assert!(tree.lower_bound(&91).get().is_none());
+
+		// Last element with a key lower or equal to 25
+		let mut cursor = tree.upper_bound(&25);
+		cursor.move_prev();
+		assert_eq!(cursor.get().unwrap().key, 20);
+
+		// Moving before the past-the-end position gives the last element
+		let mut cursor = tree.upper_bound(&1000);
+		cursor.move_prev();
+		assert_eq!(cursor.get().unwrap().key, 90);
+		assert_eq!(tree.first().unwrap().key, 0);
+		assert_eq!(tree.last().unwrap().key, 90);
+	}
+
+	#[test_case]
+	fn rbtree_range0() {
+		let mut tree = crate::rbtree_new!(Elem, node);
+		let mut elems = Vec::with_capacity(10).unwrap();
+		for i in 0..10 {
+			elems.push(Elem::new(i * 10, i)).unwrap();
+		}
+		for e in elems.as_mut_slice() {
+			tree.insert(e);
+		}
+
+		let mut i = 20;
+		for e in tree.range(15..=50) {
+			assert_eq!(e.key, i);
+			i += 10;
+		}
+		assert_eq!(i, 60);
+
+		assert_eq!(tree.range(20..50).count(), 3);
+		assert_eq!(tree.range(21..30).count(), 0);
+		assert_eq!(tree.range(50..20).count(), 0);
+		assert_eq!(tree.range(95..).count(), 0);
+		assert_eq!(tree.range(..).count(), 10);
+
+		for e in tree.range_mut(..30) {
+			e.value = 100;
+		}
+		assert_eq!(tree.iter().filter(| e | e.value == 100).count(), 3);
+	}
+
+	#[test_case]
+	fn rbtree_find_first0() {
+		let mut tree = crate::rbtree_new!(Elem, node);
+		let mut elems = create_elems(100);
+		for e in elems.as_mut_slice() {
+			tree.insert(e);
+		}
+
+		for threshold in 0..100 {
+			let expected = tree.iter().find(| e | e.value >= threshold).map(| e | e.key);
+			let found = tree.find_first(| e | e.max_value >= threshold,
+				| e | e.value >= threshold).get().map(| e | e.key);
+			assert_eq!(found, expected);
+		}
+
+		// Updating an element's augmented data
+		let key = elems[42].key;
+		let mut cursor = tree.lower_bound_mut(&key);
+		cursor.get_mut().unwrap().value = 1000;
+		cursor.update();
+		check_augment(&tree);
+		let found = tree.find_first(| e | e.max_value >= 1000, | e | e.value >= 1000);
+		assert_eq!(found.get().unwrap().key, key);
+
+		// Removing through the cursor
+		let mut cursor = tree.lower_bound_mut(&key);
+		assert_eq!(cursor.remove().unwrap().key, key);
+		check_augment(&tree);
+		assert!(tree.find_first(| e | e.max_value >= 1000, | e | e.value >= 1000).get().is_none());
+	}
+}
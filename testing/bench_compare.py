@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+
+# This script compares the results of the kernel's benchmarks against a baseline.
+#
+# Benchmarks run along with the selftests (see `make selftest`), which write their results in
+# `serial.log`. Each result is a line with the following format, where values are in CPU cycles:
+#   bench <name> ... min=<cycles> median=<cycles> p99=<cycles>
+#
+# Usage:
+#   bench_compare.py [--threshold <percent>] <log> <baseline>
+#       Compares the medians of the log against the baseline and exits with an error if one of
+#       them regressed by more than the threshold (10% by default).
+#   bench_compare.py --save <log> <baseline>
+#       Stores the results of the log as the new baseline.
+#
+# Since results depend on the machine, the baseline must be recorded on the machine running the
+# comparison.
+
+import argparse
+import re
+import sys
+
+LINE_REGEX = re.compile(r'^bench (\S+) \.\.\. min=(\d+) median=(\d+) p99=(\d+)$')
+
+
+def parse(path):
+    results = {}
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = LINE_REGEX.match(line.strip())
+            if m:
+                results[m.group(1)] = tuple(int(v) for v in m.group(2, 3, 4))
+    return results
+
+
+def save(results, path):
+    with open(path, 'w') as f:
+        for name, (min_, median, p99) in sorted(results.items()):
+            f.write('bench {} ... min={} median={} p99={}\n'.format(name, min_, median, p99))
+
+
+def compare(results, baseline, threshold):
+    regressions = 0
+    print('{:<40} {:>12} {:>12} {:>9}'.format('benchmark', 'baseline', 'median', 'change'))
+
+    for name, (_, median, _) in sorted(results.items()):
+        if name not in baseline:
+            print('{:<40} {:>12} {:>12} {:>9}'.format(name, '-', median, 'new'))
+            continue
+        base = baseline[name][1]
+        change = (median - base) * 100 / base if base != 0 else 0
+        status = ''
+        if change > threshold:
+            status = ' REGRESSION'
+            regressions += 1
+        print('{:<40} {:>12} {:>12} {:>+8.1f}%{}'.format(name, base, median, change, status))
+
+    for name in sorted(baseline.keys() - results.keys()):
+        print('{:<40} {:>12} {:>12} {:>9}'.format(name, baseline[name][1], '-', 'missing'))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--save', action='store_true', help='store the log as the new baseline')
+    parser.add_argument('--threshold', type=float, default=10,
+                        help='maximum accepted regression of the median, in percent')
+    parser.add_argument('log')
+    parser.add_argument('baseline')
+    args = parser.parse_args()
+
+    results = parse(args.log)
+    if not results:
+        sys.exit('No benchmark results in {}'.format(args.log))
+
+    if args.save:
+        save(results, args.baseline)
+        return
+
+    try:
+        baseline = parse(args.baseline)
+    except FileNotFoundError:
+        sys.exit('No baseline found, create one with --save')
+
+    regressions = compare(results, baseline, args.threshold)
+    if regressions > 0:
+        sys.exit('{} benchmark(s) regressed by more than {}%'.format(regressions, args.threshold))
+
+
+if __name__ == '__main__':
+    main()